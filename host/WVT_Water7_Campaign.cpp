@@ -0,0 +1,285 @@
+﻿#include "WVT_Water7_Campaign.hpp"
+#include "../lib/WVT_Water7_Firmware.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace water7
+{
+
+namespace
+{
+
+const uint32_t default_capacity = 16;
+
+/** Размер части, который примет устройство: с байтом режима пакет тоже помещается в буфер */
+uint8_t limit_chunk_size(uint8_t chunk_size, uint8_t flags)
+{
+    const uint8_t limit = static_cast<uint8_t>(WVT_W7_FIRMWARE_MAX_CHUNK_SIZE 
+        - (((flags & WVT_W7_FIRMWARE_FLAG_COMPRESSED) != 0) ? 1 : 0));
+
+    if (chunk_size == 0)
+    {
+        return 1;
+    }
+    return std::min(chunk_size, limit);
+}
+
+}
+
+Campaign::Campaign(const std::vector<uint8_t> & payload, uint32_t image, uint32_t crc, uint8_t chunk_size, uint8_t flags)
+    : payload(payload)
+    , chunk_size(limit_chunk_size(chunk_size, flags))
+    , chunks(static_cast<uint16_t>((payload.size() + this->chunk_size - 1) / this->chunk_size))
+    , policy(Policy::FEWEST_MISSING)
+    , device_frames(4)
+    , status_timeout(2)
+    , current_window(0)
+    , sequence(0)
+    , done(0)
+    , stored((flags & WVT_W7_FIRMWARE_FLAG_COMPRESSED) != 0)
+{
+    const uint32_t size = static_cast<uint32_t>(payload.size());
+
+    begin = { WVT_W7_PACKET_TYPE_FW_UPDATE, WVT_W7_FIRMWARE_BEGIN,
+        static_cast<uint8_t>(image >> 24), static_cast<uint8_t>(image >> 16), 
+        static_cast<uint8_t>(image >> 8), static_cast<uint8_t>(image),
+        static_cast<uint8_t>(size >> 24), static_cast<uint8_t>(size >> 16), 
+        static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size),
+        this->chunk_size,
+        static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16), 
+        static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) };
+    if (flags != 0)
+    {
+        begin.push_back(flags);
+    }
+}
+
+void Campaign::add_device(uint32_t device, uint32_t station)
+{
+    if (indices.count(device) != 0)
+    {
+        return;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(states.size());
+    Device state = { device, station, Stage::BEGIN, 0, 0, chunks, 0, {} };
+    states.push_back(std::move(state));
+    indices[device] = index;
+
+    if (stations.count(station) == 0)
+    {
+        stations[station].capacity = default_capacity;
+    }
+    enqueue(index);
+}
+
+void Campaign::set_capacity(uint32_t station, uint32_t frames)
+{
+    stations[station].capacity = frames;
+}
+
+uint32_t Campaign::remaining(const Device & device) const
+{
+    // Части, отправленные после последнего ответа, считаются принятыми
+    if (device.stage == Stage::BEGIN)
+    {
+        return chunks;
+    }
+    return static_cast<uint32_t>(device.reported - device.cursor);
+}
+
+void Campaign::enqueue(uint32_t index)
+{
+    Device & device = states[index];
+    Station & station = stations[device.station];
+
+    // Ключ: число недостающих частей в старших битах, порядок постановки - в младших
+    const uint64_t key = (policy == Policy::FEWEST_MISSING) 
+        ? ((static_cast<uint64_t>(remaining(device)) << 40) | (sequence & 0xFFFFFFFFFFULL)) : sequence;
+    sequence++;
+    device.ticket++;
+    station.queue.push({ key, index, device.ticket });
+}
+
+uint32_t Campaign::serve(uint32_t index, uint32_t budget, std::vector<Frame> & frames)
+{
+    Device & device = states[index];
+    uint32_t sent = 0;
+
+    if (device.stage == Stage::BEGIN)
+    {
+        frames.push_back({ device.id, begin });
+        sent++;
+
+        // Ответ на BEGIN не ждем: если команда потерялась, устройство ответит ошибкой на части
+        device.stage = Stage::SENDING;
+        device.missing.resize(chunks);
+        for (uint16_t chunk = 0; chunk < chunks; chunk++)
+        {
+            device.missing[chunk] = chunk;
+        }
+        device.cursor = 0;
+        device.reported = chunks;
+    }
+
+    while ((sent < budget) && (device.cursor < device.missing.size()))
+    {
+        const uint16_t chunk = device.missing[device.cursor++];
+        const size_t offset = static_cast<size_t>(chunk) * chunk_size;
+        const size_t length = std::min<size_t>(chunk_size, payload.size() - offset);
+        Frame frame = { device.id, { WVT_W7_PACKET_TYPE_FW_UPDATE, WVT_W7_FIRMWARE_CHUNK, 
+            static_cast<uint8_t>(chunk >> 8), static_cast<uint8_t>(chunk) } };
+
+        // Кампания не сжимает части: с флагом сжатия каждый пакет помечается несжатым
+        if (stored)
+        {
+            frame.data.push_back(WVT_W7_FIRMWARE_FRAME_STORED);
+        }
+        frame.data.insert(frame.data.end(), payload.begin() + static_cast<std::ptrdiff_t>(offset), 
+            payload.begin() + static_cast<std::ptrdiff_t>(offset + length));
+        frames.push_back(std::move(frame));
+        sent++;
+    }
+
+    if ((sent < budget) && (device.cursor == device.missing.size()))
+    {
+        frames.push_back({ device.id, { WVT_W7_PACKET_TYPE_FW_UPDATE, WVT_W7_FIRMWARE_COMMIT } });
+        sent++;
+
+        device.stage = Stage::AWAITING;
+        device.deadline = current_window + status_timeout;
+        deadlines[device.deadline].push_back(index);
+    }
+    return sent;
+}
+
+void Campaign::schedule(std::vector<Frame> & frames)
+{
+    std::vector<uint32_t> served;
+
+    frames.clear();
+    current_window++;
+
+    // Устройства, не ответившие на COMMIT, получают его повторно
+    const auto expired = deadlines.find(current_window);
+    if (expired != deadlines.end())
+    {
+        for (uint32_t index : expired->second)
+        {
+            Device & device = states[index];
+            if ((device.stage == Stage::AWAITING) && (device.deadline == current_window))
+            {
+                device.stage = Stage::SENDING;
+                enqueue(index);
+            }
+        }
+        deadlines.erase(expired);
+    }
+
+    for (auto & item : stations)
+    {
+        Station & station = item.second;
+        uint32_t budget = station.capacity;
+
+        while ((budget > 0) && (station.queue.empty() == false))
+        {
+            const Entry entry = station.queue.top();
+            station.queue.pop();
+
+            if (entry.ticket != states[entry.index].ticket)
+            {
+                continue;
+            }
+
+            budget -= serve(entry.index, std::min(budget, device_frames), frames);
+            served.push_back(entry.index);
+        }
+    }
+
+    // Устройство получает не больше device_frames пакетов за окно: 
+    // в очередь оно возвращается после планирования
+    for (uint32_t index : served)
+    {
+        if (states[index].stage == Stage::SENDING)
+        {
+            enqueue(index);
+        }
+    }
+}
+
+bool Campaign::on_uplink(uint32_t device_id, const uint8_t * data, uint16_t length)
+{
+    const auto found = indices.find(device_id);
+    if (    (found == indices.end())
+        ||  (length < 2)
+        ||  ((data[0] & ~WVT_W7_ERROR_FLAG) != WVT_W7_PACKET_TYPE_FW_UPDATE)  )
+    {
+        return false;
+    }
+
+    const uint32_t index = found->second;
+    Device & device = states[index];
+    if (device.stage == Stage::DONE)
+    {
+        return true;
+    }
+
+    // Ошибка: устройство не приняло BEGIN или прием завершился неудачей
+    if (data[0] & WVT_W7_ERROR_FLAG)
+    {
+        if (device.stage != Stage::BEGIN)
+        {
+            device.stage = Stage::BEGIN;
+            enqueue(index);
+        }
+        return true;
+    }
+
+    if (    (length < WVT_W7_FIRMWARE_STATUS_DATA_OFFSET)
+        ||  (data[1] != WVT_W7_FIRMWARE_STATUS)  )
+    {
+        return false;
+    }
+
+    switch (data[2])
+    {
+    case WVT_W7_FIRMWARE_VERIFIED:
+        device.stage = Stage::DONE;
+        device.missing.clear();
+        device.missing.shrink_to_fit();
+        device.ticket++;
+        done++;
+        return true;
+    case WVT_W7_FIRMWARE_IDLE:
+    case WVT_W7_FIRMWARE_FAILED:
+        device.stage = Stage::BEGIN;
+        enqueue(index);
+        return true;
+    default:
+        break;
+    }
+
+    // Ответ на BEGIN приходит, пока части еще отправляются: он не меняет план
+    if (device.stage != Stage::AWAITING)
+    {
+        return true;
+    }
+
+    // Список разбирается отдельно: неразобранный ответ не портит план устройства
+    std::vector<uint16_t> missing(chunks);
+    uint16_t count = chunks;
+    if (WVT_W7_Firmware_Missing(data, length, missing.data(), &count) != WVT_W7_OK)
+    {
+        return false;
+    }
+    missing.resize(count);
+    device.missing = std::move(missing);
+    device.cursor = 0;
+    device.reported = static_cast<uint16_t>((data[9] << 8) + data[10]);
+    device.stage = Stage::SENDING;
+    enqueue(index);
+    return true;
+}
+
+}
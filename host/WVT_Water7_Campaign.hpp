@@ -0,0 +1,148 @@
+﻿#pragma once
+#ifndef _WVT_WATER7_CAMPAIGN_HPP
+#define _WVT_WATER7_CAMPAIGN_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace water7
+{
+
+/**
+ * @brief	Кампания обновления прошивки парка устройств.
+ *			Для каждого окна передачи формирует пакеты WVT_W7_PACKET_TYPE_FW_UPDATE
+ *          с учетом пропускной способности базовых станций. Устройства каждой станции
+ *          обслуживаются из очереди с приоритетом: первыми - устройства с наименьшим 
+ *          числом недостающих частей, чтобы они быстрее закончили прием и освободили 
+ *          эфир. После отправки всех недостающих частей устройству отправляется COMMIT,
+ *          ответ на него (состояние со списком пропусков) обновляет приоритет.
+ */
+class Campaign
+{
+public:
+    enum class Policy
+    {
+        FEWEST_MISSING,     /*!< Первыми - устройства с наименьшим числом недостающих частей */
+        ROUND_ROBIN         /*!< По очереди, для сравнения */
+    };
+
+    struct Frame
+    {
+        uint32_t device;
+        std::vector<uint8_t> data;
+    };
+
+    /**
+     * @param 	payload	  	Образ (или патч, если в flags задан WVT_W7_FIRMWARE_FLAG_PATCH)
+     * @param 	image	  	Идентификатор образа
+     * @param 	crc		  	CRC-32 нового образа
+     * @param 	chunk_size	Размер части, не больше WVT_W7_FIRMWARE_MAX_CHUNK_SIZE 
+     *                      (с WVT_W7_FIRMWARE_FLAG_COMPRESSED - на байт меньше), больший уменьшается до него
+     * @param 	flags	  	Флаги команды BEGIN. С WVT_W7_FIRMWARE_FLAG_COMPRESSED части 
+     *                      передаются несжатыми, с байтом режима WVT_W7_FIRMWARE_FRAME_STORED
+     */
+    Campaign(const std::vector<uint8_t> & payload, uint32_t image, uint32_t crc, uint8_t chunk_size, uint8_t flags = 0);
+
+    void add_device(uint32_t device, uint32_t station);
+
+    /**
+     * @brief	Число пакетов, которое базовая станция передает за окно (по умолчанию 16)
+     */
+    void set_capacity(uint32_t station, uint32_t frames);
+
+    /**
+     * @brief	Наибольшее число пакетов одному устройству за окно (по умолчанию 4)
+     */
+    void set_device_frames(uint32_t frames) { device_frames = (frames == 0) ? 1 : frames; }
+
+    /**
+     * @brief	Число окон ожидания ответа на COMMIT, после которого запрос повторяется (по умолчанию 2)
+     */
+    void set_status_timeout(uint32_t windows) { status_timeout = (windows == 0) ? 1 : windows; }
+
+    void set_policy(Policy value) { policy = value; }
+
+    /**
+     * @brief	Планирует следующее окно передачи.
+     *
+     * @param [out]	frames	Пакеты для отправки, по порядку
+     */
+    void schedule(std::vector<Frame> & frames);
+
+    /**
+     * @brief	Обрабатывает ответ устройства на пакет обновления: состояние приема 
+     *          или ошибку (устройство не начинало прием - BEGIN повторяется).
+     *
+     * @returns	false - устройство не участвует в кампании или пакет не относится к обновлению.
+     */
+    bool on_uplink(uint32_t device, const uint8_t * data, uint16_t length);
+
+    size_t devices() const { return states.size(); }
+    size_t finished() const { return done; }
+    uint64_t window() const { return current_window; }
+
+private:
+    enum class Stage : uint8_t
+    {
+        BEGIN,
+        SENDING,
+        AWAITING,
+        DONE
+    };
+
+    struct Device
+    {
+        uint32_t id;
+        uint32_t station;
+        Stage stage;
+        uint32_t ticket;            /*!< Номер актуальной записи в очереди, остальные записи устарели */
+        uint16_t cursor;            /*!< Следующая часть из missing для отправки */
+        uint16_t reported;          /*!< Число пропусков по последнему ответу, включая не вошедшие в список */
+        uint64_t deadline;          /*!< Окно, после которого COMMIT повторяется */
+        std::vector<uint16_t> missing;
+    };
+
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t index;
+        uint32_t ticket;
+
+        bool operator<(const Entry & other) const { return key > other.key; }
+    };
+
+    struct Station
+    {
+        uint32_t capacity;
+        std::priority_queue<Entry> queue;
+    };
+
+    uint32_t remaining(const Device & device) const;
+    void enqueue(uint32_t index);
+    uint32_t serve(uint32_t index, uint32_t budget, std::vector<Frame> & frames);
+
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> begin;
+    uint8_t chunk_size;
+    uint16_t chunks;
+
+    std::vector<Device> states;
+    std::unordered_map<uint32_t, uint32_t> indices;
+    std::unordered_map<uint32_t, Station> stations;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> deadlines;
+
+    Policy policy;
+    uint32_t device_frames;
+    uint32_t status_timeout;
+    uint64_t current_window;
+    uint64_t sequence;
+    size_t done;
+    bool stored;                    /*!< Пакеты с частями начинаются с байта режима */
+};
+
+}
+
+#endif //_WVT_WATER7_CAMPAIGN_HPP
@@ -0,0 +1,185 @@
+﻿#include "WVT_Water7_Compressor.hpp"
+#include "../lib/WVT_Water7_Lz.h"
+#include "../lib/WVT_Water7_Firmware.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace water7
+{
+
+namespace
+{
+
+void put_length(std::vector<uint8_t> & out, size_t value)
+{
+    value -= WVT_W7_LZ_LENGTH_EXTENDED;
+    while (value >= UINT8_MAX)
+    {
+        out.push_back(UINT8_MAX);
+        value -= UINT8_MAX;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void put_sequence(std::vector<uint8_t> & out, const uint8_t * literals, size_t literal_count, size_t offset, size_t match)
+{
+    const size_t match_field = (match > 0) ? (match - WVT_W7_LZ_MIN_MATCH) : 0;
+    const uint8_t literal_nibble = static_cast<uint8_t>(std::min<size_t>(literal_count, WVT_W7_LZ_LENGTH_EXTENDED));
+    const uint8_t match_nibble = static_cast<uint8_t>(std::min<size_t>(match_field, WVT_W7_LZ_LENGTH_EXTENDED));
+
+    out.push_back(static_cast<uint8_t>((literal_nibble << 4) | match_nibble));
+    if (literal_nibble == WVT_W7_LZ_LENGTH_EXTENDED)
+    {
+        put_length(out, literal_count);
+    }
+    out.insert(out.end(), literals, literals + literal_count);
+
+    if (match > 0)
+    {
+        out.push_back(static_cast<uint8_t>(offset));
+        if (match_nibble == WVT_W7_LZ_LENGTH_EXTENDED)
+        {
+            put_length(out, match_field);
+        }
+    }
+}
+
+}
+
+std::vector<uint8_t> lz_compress(const uint8_t * data, size_t length, size_t dictionary)
+{
+    std::vector<uint8_t> out;
+    size_t literal = dictionary;
+    size_t position = dictionary;
+
+    while (position < length)
+    {
+        size_t best_length = 0;
+        size_t best_offset = 0;
+        const size_t window = std::min<size_t>(position, WVT_W7_LZ_WINDOW);
+
+        for (size_t offset = 1; offset <= window; offset++)
+        {
+            size_t match = 0;
+            while (((position + match) < length) && (data[position + match] == data[position + match - offset]))
+            {
+                match++;
+            }
+            if (match > best_length)
+            {
+                best_length = match;
+                best_offset = offset;
+            }
+        }
+
+        if (best_length < WVT_W7_LZ_MIN_MATCH)
+        {
+            position++;
+            continue;
+        }
+
+        put_sequence(out, data + literal, position - literal, best_offset, best_length);
+        position += best_length;
+        literal = position;
+    }
+
+    // Последняя последовательность - только литералы, даже пустая, если блок кончился повтором
+    if ((literal < length) || out.empty())
+    {
+        put_sequence(out, data + literal, length - literal, 0, 0);
+    }
+    return out;
+}
+
+uint8_t compressed_chunk_size(size_t size)
+{
+    // Байт режима занимает место в пакете, поэтому части делят оставшиеся байты без остатка
+    for (size_t count = 6; count >= 2; count--)
+    {
+        const size_t chunk_size = (WVT_W7_FIRMWARE_MAX_CHUNK_SIZE - 1) / count;
+        if (((size + chunk_size - 1) / chunk_size) <= WVT_W7_FIRMWARE_MAX_CHUNKS)
+        {
+            return static_cast<uint8_t>(chunk_size);
+        }
+    }
+    return 0;
+}
+
+std::vector<Compressed_Frame> compress_chunks(const std::vector<uint8_t> & image, uint8_t chunk_size, 
+    const std::vector<uint16_t> & chunks, size_t chain, size_t dictionary)
+{
+    std::vector<Compressed_Frame> frames;
+    std::vector<bool> sent((image.size() + chunk_size - 1) / chunk_size, false);
+    size_t next = 0;
+    size_t group_start = 0;
+    size_t group_frames = chain;
+
+    for (uint16_t chunk : chunks)
+    {
+        sent[chunk] = true;
+    }
+
+    const auto block = [&](uint16_t first, size_t count)
+    {
+        const size_t offset = static_cast<size_t>(first) * chunk_size;
+        const size_t length = std::min(count * chunk_size, image.size() - offset);
+        size_t used = 0;
+
+        // Словарь - части, которые устройство подтвердило, и части предыдущих пакетов группы
+        for (size_t chunk = first; (chunk > 0) && (used < offset) && (used < dictionary); chunk--)
+        {
+            if (sent[chunk - 1] && ((chunk - 1) < group_start))
+            {
+                break;
+            }
+            used = std::min(std::min(used + chunk_size, offset), dictionary);
+        }
+
+        std::vector<uint8_t> data = lz_compress(image.data() + offset - used, used + length, used);
+        if (data.size() < length)
+        {
+            data.insert(data.begin(), static_cast<uint8_t>(used));
+        }
+        else
+        {
+            // Несжимаемые части передаются как есть: пакет не длиннее несжатого
+            data.assign(1, WVT_W7_FIRMWARE_FRAME_STORED);
+            data.insert(data.end(), image.begin() + static_cast<std::ptrdiff_t>(offset), 
+                image.begin() + static_cast<std::ptrdiff_t>(offset + length));
+        }
+        return data;
+    };
+
+    while (next < chunks.size())
+    {
+        if (group_frames >= chain)
+        {
+            group_start = chunks[next];
+            group_frames = 0;
+        }
+
+        Compressed_Frame frame = { chunks[next], block(chunks[next], 1) };
+        size_t count = 1;
+
+        while (((next + count) < chunks.size())
+            && (chunks[next + count] == (frame.chunk + count))
+            && (((count + 1) * chunk_size) <= WVT_W7_FIRMWARE_MAX_BLOCK_SIZE))
+        {
+            std::vector<uint8_t> data = block(frame.chunk, count + 1);
+            if (data.size() > WVT_W7_FIRMWARE_MAX_CHUNK_SIZE)
+            {
+                break;
+            }
+            frame.data.swap(data);
+            count++;
+        }
+
+        frames.push_back(std::move(frame));
+        group_frames++;
+        next += count;
+    }
+    return frames;
+}
+
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+#ifndef _WVT_WATER7_COMPRESSOR_HPP
+#define _WVT_WATER7_COMPRESSOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "../lib/WVT_Water7_Firmware.h"
+
+namespace water7
+{
+
+/**
+ * @brief	Сжимает блок в формате WVT_W7_Lz_Decompress: повторы ищутся 
+ *          жадно по всему окну WVT_W7_LZ_WINDOW байт.
+ *
+ * @param 	data	  	Словарь, за которым следует блок
+ * @param 	length	  	Длина словаря и блока
+ * @param 	dictionary	Длина словаря: он не сжимается, но на него ссылаются повторы
+ */
+std::vector<uint8_t> lz_compress(const uint8_t * data, size_t length, size_t dictionary = 0);
+
+/**
+ * @brief	Размер части для передачи со сжатием: наименьший из размеров, на которые 
+ *          без остатка делится пакет без байта режима (20, 24, 30, 41 и 61 байт),
+ *          при котором число частей не превышает WVT_W7_FIRMWARE_MAX_CHUNKS.
+ *          Мелкие части плотнее заполняют пакет сжатыми данными, а несжимаемые 
+ *          части почти целиком заполняют пакет без сжатия.
+ *
+ * @returns	0 - образ слишком велик
+ */
+uint8_t compressed_chunk_size(size_t size);
+
+/**
+ * Пакет с частями образа, сжатыми вместе
+ */
+struct Compressed_Frame
+{
+    uint16_t chunk;                 /*!< Номер первой части */
+    std::vector<uint8_t> data;      /*!< Байт режима и сжатые или несжатые части */
+};
+
+/**
+ * @brief	Группирует части образа (или патча) в пакеты для передачи с 
+ *          WVT_W7_FIRMWARE_FLAG_COMPRESSED. В пакет добавляются части подряд, 
+ *          пока распакованные данные помещаются в WVT_W7_FIRMWARE_MAX_BLOCK_SIZE,
+ *          а сжатые - в WVT_W7_FIRMWARE_MAX_CHUNK_SIZE байт пакета.
+ *          Словарем служат байты образа перед первой частью пакета из частей, которые
+ *          устройство уже подтвердило (их нет в chunks), и из предыдущих пакетов группы
+ *          в chain пакетов. Если пакет группы потерян, устройство пропускает следующие 
+ *          пакеты группы до повтора, поэтому группы ограничивают потери при плохой связи.
+ *          Если сжатие не уменьшает части, они передаются без сжатия.
+ *          При повторной передаче пропуски из ответа о состоянии группируются заново.
+ *
+ * @param 	image	  	Образ
+ * @param 	chunk_size	Размер части из команды BEGIN (см. compressed_chunk_size)
+ * @param 	chunks	  	Номера частей по возрастанию: все части образа или пропуски из ответа о состоянии
+ * @param 	chain	  	Число пакетов в группе, 1 - словарь только из подтвержденных частей
+ * @param 	dictionary	Наибольшая длина словаря, не больше WVT_W7_FIRMWARE_DICTIONARY_SIZE устройства
+ */
+std::vector<Compressed_Frame> compress_chunks(const std::vector<uint8_t> & image, uint8_t chunk_size, 
+    const std::vector<uint16_t> & chunks, size_t chain = 4, size_t dictionary = WVT_W7_FIRMWARE_DICTIONARY_SIZE);
+
+}
+
+#endif //_WVT_WATER7_COMPRESSOR_HPP
@@ -0,0 +1,129 @@
+﻿#include "WVT_Water7_Coroutine.hpp"
+
+#include <stdint.h>
+
+namespace water7
+{
+
+namespace
+{
+
+/**
+ * Операция с памятью, на которой приостановлен разбор запроса. Функции памяти 
+ * разбора отвечают WVT_W7_ERROR_CODE_BUSY и запоминают операцию, сопрограмма 
+ * ждет ее через co_await, а повторный вызов после WVT_W7_Resume_With получает результат
+ */
+struct Pending_Operation
+{
+    enum class Kind { NONE, READ, WRITE };
+
+    Kind kind = Kind::NONE;
+    bool done = false;
+    uint16_t address = 0;
+    int32_t value = 0;
+    WVT_W7_Error_t error = WVT_W7_ERROR_CODE_OK;
+};
+
+/** Операция запроса, который разбирается на этом потоке */
+thread_local Pending_Operation * current = nullptr;
+
+WVT_W7_Error_t pending_read(uint16_t address, int32_t * value)
+{
+    Pending_Operation & operation = *current;
+
+    if (    operation.done
+        &&  (operation.kind == Pending_Operation::Kind::READ)
+        &&  (operation.address == address)  )
+    {
+        operation.kind = Pending_Operation::Kind::NONE;
+        operation.done = false;
+        *value = operation.value;
+        return operation.error;
+    }
+
+    operation.kind = Pending_Operation::Kind::READ;
+    operation.done = false;
+    operation.address = address;
+    return WVT_W7_ERROR_CODE_BUSY;
+}
+
+WVT_W7_Error_t pending_write(uint16_t address, int32_t value)
+{
+    Pending_Operation & operation = *current;
+
+    if (    operation.done
+        &&  (operation.kind == Pending_Operation::Kind::WRITE)
+        &&  (operation.address == address)
+        &&  (operation.value == value)  )
+    {
+        operation.kind = Pending_Operation::Kind::NONE;
+        operation.done = false;
+        return operation.error;
+    }
+
+    operation.kind = Pending_Operation::Kind::WRITE;
+    operation.done = false;
+    operation.address = address;
+    operation.value = value;
+    return WVT_W7_ERROR_CODE_BUSY;
+}
+
+const WVT_W7_Callbacks_t pending_callbacks = { pending_read, pending_write, nullptr, nullptr };
+
+/**
+ * @brief	Начинает или продолжает разбор на текущем потоке. Не сопрограмма: 
+ *          current не переживает приостановку, после которой поток может смениться
+ */
+uint8_t step(WVT_W7_Parse_State_t & state, Pending_Operation & operation, std::span<const uint8_t> frame, uint8_t * out)
+{
+    uint8_t length;
+
+    current = &operation;
+    if (state.suspended)
+    {
+        length = WVT_W7_Resume_With(&state);
+    }
+    else
+    {
+        // Разбор не меняет запрос
+        length = WVT_W7_Parse_With(&state, const_cast<uint8_t *>(frame.data()), static_cast<uint16_t>(frame.size()), out);
+    }
+    current = nullptr;
+    return length;
+}
+
+}
+
+task<size_t> parse(Async_Storage & storage, std::span<const uint8_t> frame, std::span<uint8_t> out)
+{
+    if (    (frame.size() > UINT16_MAX)
+        ||  (out.size() < WVT_W7_BUFFER_SIZE)  )
+    {
+        co_return 0;
+    }
+
+    WVT_W7_Parse_State_t state = {};
+    Pending_Operation operation;
+    state.callbacks = &pending_callbacks;
+
+    size_t length = step(state, operation, frame, out.data());
+    while (state.suspended)
+    {
+        if (operation.kind == Pending_Operation::Kind::READ)
+        {
+            const Storage_Result result = co_await storage.read(operation.address);
+            operation.value = result.value;
+            operation.error = result.error;
+        }
+        else
+        {
+            operation.error = co_await storage.write(operation.address, operation.value);
+        }
+        operation.done = true;
+
+        length = step(state, operation, frame, out.data());
+    }
+    co_return length;
+}
+
+}
@@ -0,0 +1,130 @@
+﻿#pragma once
+#ifndef _WVT_WATER7_COROUTINE_HPP
+#define _WVT_WATER7_COROUTINE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <coroutine>
+#include <exception>
+#include <span>
+#include <utility>
+#include "../lib/WVT_Water7.h"
+
+namespace water7
+{
+
+/**
+ * @brief	Ленивая задача-сопрограмма: начинает выполняться при co_await
+ *          (или start для задачи верхнего уровня) и по завершении передает 
+ *          управление ожидающей сопрограмме без роста стека.
+ */
+template <typename T>
+class task
+{
+public:
+    struct promise_type
+    {
+        T value{};
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept 
+            { 
+                return handle.promise().continuation; 
+            }
+            void await_resume() const noexcept {}
+        };
+
+        task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        final_awaiter final_suspend() const noexcept { return {}; }
+        void return_value(T result) { value = std::move(result); }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    task() = default;
+    task(task && other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+    task & operator=(task && other) noexcept
+    {
+        if (this != &other)
+        {
+            if (coroutine)
+            {
+                coroutine.destroy();
+            }
+            coroutine = std::exchange(other.coroutine, nullptr);
+        }
+        return *this;
+    }
+    task(const task &) = delete;
+    task & operator=(const task &) = delete;
+    ~task()
+    {
+        if (coroutine)
+        {
+            coroutine.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return (coroutine == nullptr) || coroutine.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        coroutine.promise().continuation = awaiting;
+        return coroutine;
+    }
+    T await_resume() { return std::move(coroutine.promise().value); }
+
+    /**
+     * @brief	Запускает задачу верхнего уровня. Завершение проверяется done
+     */
+    void start() { coroutine.resume(); }
+    bool done() const noexcept { return (coroutine == nullptr) || coroutine.done(); }
+    T & result() { return coroutine.promise().value; }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+    std::coroutine_handle<promise_type> coroutine = nullptr;
+};
+
+struct Storage_Result
+{
+    WVT_W7_Error_t error;
+    int32_t value;
+};
+
+/**
+ * @brief	Асинхронная память параметров одного устройства. 
+ *          Операции - сопрограммы, которые приостанавливаются на время ввода-вывода
+ *          и возвращают те же коды, что rom_read и rom_write.
+ */
+class Async_Storage
+{
+public:
+    virtual ~Async_Storage() = default;
+    virtual task<Storage_Result> read(uint16_t address) = 0;
+    virtual task<WVT_W7_Error_t> write(uint16_t address, int32_t value) = 0;
+};
+
+/**
+ * @brief	Обрабатывает запрос разборщиком WVT_W7_Parse_With, ожидая через co_await 
+ *          каждую операцию с памятью, на которой разбор приостановился. Состояние разбора 
+ *          хранится в кадре сопрограммы, поэтому одновременно обрабатываются запросы 
+ *          к любому числу устройств. Чтение, запись и изменение параметров, в том числе 
+ *          в обертках WVT_W7_PACKET_TYPE_TAGGED и WVT_W7_PACKET_TYPE_NO_ACK, идут в storage; 
+ *          на запросы модулей (подписки, дерево хешей, версии, архив, обновление прошивки, 
+ *          команды) отвечает WVT_W7_ERROR_CODE_INVALID_TYPE: их состояние - одно на процесс.
+ *
+ * @param 	   	storage	Память параметров устройства
+ * @param 	   	frame  	Запрос
+ * @param [out]	out	   	Буфер ответа, не меньше WVT_W7_BUFFER_SIZE байт
+ *
+ * @returns	Длина ответа, 0 - отвечать не нужно.
+ */
+task<size_t> parse(Async_Storage & storage, std::span<const uint8_t> frame, std::span<uint8_t> out);
+
+}
+
+#endif //_WVT_WATER7_COROUTINE_HPP
@@ -0,0 +1,114 @@
+﻿#include "WVT_Water7_Correlator.hpp"
+#include "../lib/WVT_Water7.h"
+
+#include <utility>
+
+namespace water7
+{
+
+Correlator::Correlator(uint32_t wheel_size)
+    : wheel((wheel_size == 0) ? 1 : wheel_size)
+    , current_slot(0)
+{
+}
+
+bool Correlator::submit(uint32_t device, const uint8_t * request, uint16_t length, 
+    uint32_t timeout, Handler handler, std::vector<uint8_t> & frame)
+{
+    uint8_t & tag = next_tag[device];
+    uint16_t attempts = 0;
+
+    // Теги выдаются по кругу, занятые ожидающими запросами пропускаются
+    while (requests.count(make_key(device, tag)) != 0)
+    {
+        if (++attempts > UINT8_MAX)
+        {
+            return false;
+        }
+        tag++;
+    }
+
+    const Key key = make_key(device, tag);
+    const uint32_t size = static_cast<uint32_t>(wheel.size());
+    const uint32_t delay = (timeout == 0) ? 1 : timeout;
+    const uint32_t slot = (current_slot + delay) % size;
+
+    Request & entry = requests[key];
+    entry.handler = std::move(handler);
+    entry.slot = slot;
+    entry.rounds = (delay - 1) / size;
+    entry.position = wheel[slot].insert(wheel[slot].end(), key);
+
+    frame.clear();
+    frame.reserve(static_cast<size_t>(length) + WVT_W7_TAGGED_DATA_OFFSET);
+    frame.push_back(WVT_W7_PACKET_TYPE_TAGGED);
+    frame.push_back(tag);
+    frame.insert(frame.end(), request, request + length);
+
+    tag++;
+    return true;
+}
+
+bool Correlator::on_uplink(uint32_t device, const uint8_t * data, uint16_t length)
+{
+    if (    (length < WVT_W7_TAGGED_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_TAGGED)  )
+    {
+        return false;
+    }
+
+    const auto found = requests.find(make_key(device, data[1]));
+    if (found == requests.end())
+    {
+        return false;
+    }
+
+    Handler handler = std::move(found->second.handler);
+    wheel[found->second.slot].erase(found->second.position);
+    requests.erase(found);
+
+    if (handler)
+    {
+        handler((data + WVT_W7_TAGGED_DATA_OFFSET), static_cast<uint16_t>(length - WVT_W7_TAGGED_DATA_OFFSET));
+    }
+    return true;
+}
+
+void Correlator::advance(uint32_t ticks)
+{
+    std::vector<Handler> expired;
+
+    while (ticks-- > 0)
+    {
+        current_slot = (current_slot + 1) % static_cast<uint32_t>(wheel.size());
+
+        std::list<Key> & slot = wheel[current_slot];
+        for (auto position = slot.begin(); position != slot.end(); )
+        {
+            const auto found = requests.find(*position);
+            if (found->second.rounds > 0)
+            {
+                found->second.rounds--;
+                ++position;
+                continue;
+            }
+
+            expired.push_back(std::move(found->second.handler));
+            position = slot.erase(position);
+            requests.erase(found);
+        }
+
+        // Обработчики вызываются после обхода ячейки: они могут отправить 
+        // повторный запрос, который попадет в эту же ячейку колеса
+        for (Handler & handler : expired)
+        {
+            if (handler)
+            {
+                handler(nullptr, 0);
+            }
+        }
+        expired.clear();
+    }
+}
+
+}
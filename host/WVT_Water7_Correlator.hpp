@@ -0,0 +1,94 @@
+﻿#pragma once
+#ifndef _WVT_WATER7_CORRELATOR_HPP
+#define _WVT_WATER7_CORRELATOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace water7
+{
+
+/**
+ * @brief	Сопоставление ответов устройств с запросами, отправленными в обертке 
+ *          с тегом последовательности (WVT_W7_PACKET_TYPE_TAGGED).
+ *			Ожидающие запросы хранятся в хеш-таблице по ключу (устройство, тег),
+ *          сроки ожидания отслеживаются колесом таймеров - поиск, ответ и 
+ *          истечение срока выполняются за O(1).
+ */
+class Correlator
+{
+public:
+    /**
+     * Обработчик ответа. Получает ответ на вложенный запрос без обертки, 
+     * при истечении срока ожидания вызывается с (nullptr, 0)
+     */
+    using Handler = std::function<void(const uint8_t * responce, uint16_t length)>;
+
+    /**
+     * @param 	wheel_size	Число ячеек колеса таймеров (тиков до полного оборота)
+     */
+    explicit Correlator(uint32_t wheel_size = 256);
+
+    /**
+     * @brief	Регистрирует запрос и формирует кадр для отправки.
+     *
+     * @param 	   	device 	Идентификатор устройства
+     * @param [in] 	request	Запрос без обертки
+     * @param 	   	length 	Длина запроса
+     * @param 	   	timeout	Срок ожидания ответа в тиках
+     * @param 	   	handler	Обработчик ответа
+     * @param [out]	frame  	Кадр с тегом последовательности
+     *
+     * @returns	false - все 256 тегов устройства заняты, запрос не зарегистрирован.
+     */
+    bool submit(uint32_t device, const uint8_t * request, uint16_t length, 
+        uint32_t timeout, Handler handler, std::vector<uint8_t> & frame);
+
+    /**
+     * @brief	Передает ответ устройства обработчику ожидающего запроса.
+     *
+     * @returns	false - ответ без тега или запрос с таким тегом не ожидается.
+     */
+    bool on_uplink(uint32_t device, const uint8_t * data, uint16_t length);
+
+    /**
+     * @brief	Продвигает колесо таймеров, вызывая обработчики просроченных запросов.
+     */
+    void advance(uint32_t ticks);
+
+    size_t pending() const { return requests.size(); }
+
+private:
+    using Key = uint64_t;
+
+    struct Request
+    {
+        Handler handler;
+        uint32_t slot;
+        uint32_t rounds;
+        std::list<Key>::iterator position;
+    };
+
+    static Key make_key(uint32_t device, uint8_t tag)
+    {
+        return (static_cast<Key>(device) << 8) | tag;
+    }
+
+    std::unordered_map<Key, Request> requests;
+    /**
+     * Следующий тег устройства. Хранится и после ответа на последний запрос: 
+     * иначе новый запрос получит тег просроченного, и опоздавший ответ 
+     * на просроченный запрос попадет к новому. Один байт на устройство
+     */
+    std::unordered_map<uint32_t, uint8_t> next_tag;
+    std::vector<std::list<Key>> wheel;
+    uint32_t current_slot;
+};
+
+}
+
+#endif //_WVT_WATER7_CORRELATOR_HPP
@@ -0,0 +1,181 @@
+﻿#include "WVT_Water7_Diff.hpp"
+#include "../lib/WVT_Water7_Patch.h"
+
+#include <string.h>
+#include <unordered_map>
+
+namespace water7
+{
+
+namespace
+{
+
+const size_t hash_length = 8;           // Длина подстроки для поиска совпадений
+const size_t aligned_match = 4;         // Наименьшая копия с тем же сдвигом, что и предыдущая
+const size_t max_candidates = 16;       // Число позиций старого образа на одну подстроку
+
+void put_u32(std::vector<uint8_t> & out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void put_varint(std::vector<uint8_t> & out, uint32_t value)
+{
+    uint8_t encoded[WVT_W7_VARINT_MAX_LENGTH];
+    const uint8_t length = WVT_W7_Put_Varint(value, encoded);
+    out.insert(out.end(), encoded, encoded + length);
+}
+
+uint64_t substring(const uint8_t * data)
+{
+    uint64_t key;
+    memcpy(&key, data, sizeof(key));
+    return key;
+}
+
+class Encoder
+{
+public:
+    Encoder(const std::vector<uint8_t> & old_image, const std::vector<uint8_t> & new_image, std::vector<uint8_t> & patch)
+        : old_image(old_image), new_image(new_image), patch(patch), source(0)
+    {
+    }
+
+    void copy(size_t from, size_t length)
+    {
+        move(WVT_W7_PATCH_COPY, from, length);
+    }
+
+    /**
+     * Участок нового образа без совпадений. Если на том же сдвиге в старом
+     * образе есть данные, передается разность с ними
+     */
+    void literal(size_t begin, size_t end, int64_t shift)
+    {
+        if (begin == end)
+        {
+            return;
+        }
+
+        const int64_t from = static_cast<int64_t>(begin) + shift;
+        const size_t length = end - begin;
+        if ((from >= 0) && ((static_cast<size_t>(from) + length) <= old_image.size()))
+        {
+            move(WVT_W7_PATCH_ADD, static_cast<size_t>(from), length);
+            for (size_t i = 0; i < length; i++)
+            {
+                patch.push_back(static_cast<uint8_t>(new_image[begin + i] - old_image[static_cast<size_t>(from) + i]));
+            }
+            return;
+        }
+
+        patch.push_back(WVT_W7_PATCH_INSERT);
+        put_varint(patch, static_cast<uint32_t>(length));
+        patch.insert(patch.end(), new_image.begin() + static_cast<std::ptrdiff_t>(begin), 
+            new_image.begin() + static_cast<std::ptrdiff_t>(end));
+    }
+
+private:
+    void move(WVT_W7_Patch_Op_t op, size_t from, size_t length)
+    {
+        patch.push_back(static_cast<uint8_t>(op));
+        put_varint(patch, WVT_W7_Zigzag(static_cast<uint32_t>(from) - static_cast<uint32_t>(source)));
+        put_varint(patch, static_cast<uint32_t>(length));
+        source = from + length;
+    }
+
+    const std::vector<uint8_t> & old_image;
+    const std::vector<uint8_t> & new_image;
+    std::vector<uint8_t> & patch;
+    size_t source;
+};
+
+}
+
+std::vector<uint8_t> make_patch(const std::vector<uint8_t> & old_image, const std::vector<uint8_t> & new_image)
+{
+    std::vector<uint8_t> patch;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> index;
+    Encoder encoder(old_image, new_image, patch);
+
+    put_u32(patch, static_cast<uint32_t>(old_image.size()));
+    put_u32(patch, WVT_W7_Crc32(0, old_image.data(), static_cast<uint32_t>(old_image.size())));
+    put_u32(patch, static_cast<uint32_t>(new_image.size()));
+
+    for (size_t i = 0; (i + hash_length) <= old_image.size(); i++)
+    {
+        std::vector<uint32_t> & positions = index[substring(old_image.data() + i)];
+        if (positions.size() < max_candidates)
+        {
+            positions.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    const auto match_length = [&](size_t from, size_t to)
+    {
+        size_t length = 0;
+        while (((from + length) < old_image.size()) && ((to + length) < new_image.size()) 
+            && (old_image[from + length] == new_image[to + length]))
+        {
+            length++;
+        }
+        return length;
+    };
+
+    int64_t shift = 0;          // Сдвиг последней копии: позиция в старом образе минус позиция в новом
+    size_t literal = 0;
+    size_t position = 0;
+
+    while (position < new_image.size())
+    {
+        size_t best_length = 0;
+        size_t best_from = 0;
+        bool aligned = false;
+
+        const int64_t expected = static_cast<int64_t>(position) + shift;
+        if ((expected >= 0) && (static_cast<size_t>(expected) < old_image.size()))
+        {
+            best_from = static_cast<size_t>(expected);
+            best_length = match_length(best_from, position);
+            aligned = true;
+        }
+
+        if ((position + hash_length) <= new_image.size())
+        {
+            const auto found = index.find(substring(new_image.data() + position));
+            if (found != index.end())
+            {
+                for (uint32_t from : found->second)
+                {
+                    const size_t length = match_length(from, position);
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_from = from;
+                        aligned = (static_cast<int64_t>(from) == expected);
+                    }
+                }
+            }
+        }
+
+        if (best_length < (aligned ? aligned_match : hash_length))
+        {
+            position++;
+            continue;
+        }
+
+        encoder.literal(literal, position, shift);
+        encoder.copy(best_from, best_length);
+        shift = static_cast<int64_t>(best_from) - static_cast<int64_t>(position);
+        position += best_length;
+        literal = position;
+    }
+
+    encoder.literal(literal, new_image.size(), shift);
+    return patch;
+}
+
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+#ifndef _WVT_WATER7_DIFF_HPP
+#define _WVT_WATER7_DIFF_HPP
+
+#include <stdint.h>
+#include <vector>
+
+namespace water7
+{
+
+/**
+ * @brief	Строит патч, по которому устройство собирает новый образ из текущего
+ *          (WVT_W7_FIRMWARE_FLAG_PATCH, формат команд - WVT_W7_Patch_Op_t).
+ *          Совпадающие участки ищутся по хешу 8-байтных подстрок старого образа
+ *          и копируются командой COPY. Участки между копиями с одинаковым сдвигом
+ *          (измененные адреса и константы) передаются разностью ADD, которая 
+ *          состоит в основном из нулей и хорошо сжимается; остальное - INSERT.
+ *
+ * @param 	old_image	Образ, установленный на устройстве
+ * @param 	new_image	Новый образ
+ *
+ * @returns	Патч с заголовком WVT_W7_PATCH_HEADER_SIZE байт
+ */
+std::vector<uint8_t> make_patch(const std::vector<uint8_t> & old_image, const std::vector<uint8_t> & new_image);
+
+}
+
+#endif //_WVT_WATER7_DIFF_HPP
@@ -1,11 +1,59 @@
 ﻿#include "WVT_Water7.h"
+#if WVT_W7_ENABLE_SUBSCRIPTIONS
+#include "WVT_Water7_Subscriptions.h"
+#endif
+#if WVT_W7_ENABLE_DIGEST
+#include "WVT_Water7_Digest.h"
+#endif
+#if WVT_W7_ENABLE_SYNC
+#include "WVT_Water7_Sync.h"
+#endif
+#if WVT_W7_ENABLE_DEFERRED
+#include "WVT_Water7_Deferred.h"
+#endif
+#if WVT_W7_ENABLE_ARCHIVE
+#include "WVT_Water7_Archive.h"
+#endif
+#if WVT_W7_ENABLE_FIRMWARE
+#include "WVT_Water7_Firmware.h"
+#endif
+#if WVT_W7_ENABLE_CONTROL
+#include "WVT_Water7_Control.h"
+#endif
 
 WVT_W7_Callbacks_t externals_functions;
+static uint32_t phase_seed = 0;
+static WVT_W7_Parse_State_t parse_state;
 
 WVT_W7_Error_t WVT_W7_Single_Parameter(
+    WVT_W7_Parse_State_t * state,
     uint16_t parameter_addres,
     WVT_W7_Parameter_Action_t action,
     uint8_t * responce_buffer);
+static uint8_t WVT_W7_Parse_Request(
+    WVT_W7_Parse_State_t * state,
+    uint8_t * data,
+    uint16_t length,
+    uint8_t * responce_buffer,
+    uint16_t responce_size);
+static uint8_t WVT_W7_Parse_Complete(WVT_W7_Parse_State_t * state);
+static uint8_t WVT_W7_Parameter_Request(WVT_W7_Packet_t packet_type);
+static WVT_W7_Error_t WVT_W7_Read_Packed(
+    WVT_W7_Parse_State_t * state,
+    uint16_t addres,
+    uint16_t number_of_parameters,
+    uint8_t * responce_buffer,
+    uint16_t * responce_length);
+static WVT_W7_Error_t WVT_W7_Modify_Parameter(
+    WVT_W7_Parse_State_t * state,
+    uint8_t * data,
+    uint16_t length,
+    uint8_t * responce_buffer);
+static WVT_W7_Error_t WVT_W7_Store_Parameter(
+    WVT_W7_Parse_State_t * state,
+    uint16_t parameter_addres,
+    int32_t previous_value,
+    int32_t value);
 
 /**
  * @brief	Формирует стартовый пакет, указывающий на начало работы устройства
@@ -54,10 +102,179 @@ WVT_W7_Status_t WVT_W7_Register_Callbacks(WVT_W7_Callbacks_t callbacks)
  * @param [out]	responce_buffer	Указатель на буфер с выходными данными
  *
  * @returns	Число зачисанных байт в буфер с выходными данными.
+ *          0 - отвечать не нужно (например, успешная запись без подтверждения).
  */
 uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
 {
+    return WVT_W7_Parse_With(&parse_state, data, length, responce_buffer);
+}
+
+/**
+ * @brief	Обрабатывает пакет так же, как WVT_W7_Parse, но с собственным состоянием разбора.
+ *			Запросы с разными состояниями приостанавливаются и продолжаются независимо, 
+ *			поэтому один разборщик обслуживает несколько запросов одновременно 
+ *			(например, запросы к разным устройствам на сервере). Перед первым вызовом 
+ *			состояние обнуляется, затем можно задать state->callbacks. С собственными 
+ *			функциями разбираются только запросы параметров, на остальные отвечает 
+ *			WVT_W7_ERROR_CODE_INVALID_TYPE, записи не меняют дерево хешей и версии параметров.
+ *
+ * @param [in/out] state	   	Состояние разбора
+ * @param [in] 	data		   	Указатель на буфер с входными данными
+ * @param 	   	length		   	Чило байт во входном буфере
+ * @param [out]	responce_buffer	Указатель на буфер с выходными данными, WVT_W7_BUFFER_SIZE байт
+ *
+ * @returns	Число зачисанных байт в буфер с выходными данными.
+ *          0 - отвечать не нужно или запрос приостановлен (state->suspended, см. WVT_W7_Resume_With).
+ */
+uint8_t WVT_W7_Parse_With(WVT_W7_Parse_State_t * state, uint8_t * data, uint16_t length, uint8_t * responce_buffer)
+{
+    if (state->suspended)
+    {
+        // Предыдущий запрос ждет завершения операции с памятью
+        if ((data && length && responce_buffer) == 0)
+        {
+            return 0;
+        }
+        responce_buffer[0] = (data[0] | WVT_W7_ERROR_FLAG);
+        responce_buffer[1] = WVT_W7_ERROR_CODE_BUSY;
+        return WVT_W7_ERROR_RESPONCE_LENGTH;
+    }
+
+    state->data = data;
+    state->length = length;
+    state->responce_buffer = responce_buffer;
+    state->parameter = 0;
+    state->position = WVT_W7_MULTI_DATA_OFFSET;
+    state->previous_value = 0;
+    state->has_value = 0;
+
+    return WVT_W7_Parse_Complete(state);
+}
+
+/**
+ * @brief	Продолжает запрос, приостановленный из-за того, что rom_read или rom_write
+ *			вернула WVT_W7_ERROR_CODE_BUSY. Вызывается, когда операция с памятью завершилась:
+ *			библиотека повторяет вызов с теми же аргументами, и функция возвращает результат.
+ *			Запрос и буфер ответа, переданные в WVT_W7_Parse, должны сохраниться до завершения.
+ *			Приостанавливаются запросы чтения, записи и изменения параметров.
+ *			Модули с памятью работают синхронно и на WVT_W7_ERROR_CODE_BUSY не строят 
+ *			ответ из неизвестных значений: подписка (WVT_W7_PACKET_TYPE_SUBSCRIBE) отвечает 
+ *			ошибкой WVT_W7_ERROR_CODE_BUSY, и сервер повторяет запрос; чтение изменений 
+ *			(WVT_W7_PACKET_TYPE_READ_CHANGED) переносит блок в следующий ответ или отвечает 
+ *			той же ошибкой; WVT_W7_Digest_Init возвращает ошибку; WVT_W7_Subscriptions_Poll 
+ *			проверяет параметр при следующем опросе. Запросы хешей и архива память не читают.
+ *
+ * @returns	Число зачисанных байт в буфер ответа, переданный в WVT_W7_Parse.
+ *          0 - отвечать не нужно или операция снова не завершилась (WVT_W7_Suspended).
+ */
+uint8_t WVT_W7_Resume(void)
+{
+    return WVT_W7_Resume_With(&parse_state);
+}
+
+/**
+ * @brief	Продолжает запрос, приостановленный в WVT_W7_Parse_With, так же, как WVT_W7_Resume
+ *
+ * @returns	Число зачисанных байт в буфер ответа, переданный в WVT_W7_Parse_With.
+ */
+uint8_t WVT_W7_Resume_With(WVT_W7_Parse_State_t * state)
+{
+    if (state->suspended == 0)
+    {
+        return 0;
+    }
+
+    state->suspended = 0;
+    return WVT_W7_Parse_Complete(state);
+}
+
+/**
+ * @returns	1 - запрос ждет завершения операции с памятью и вызова WVT_W7_Resume
+ */
+uint8_t WVT_W7_Suspended(void)
+{
+    return parse_state.suspended;
+}
+
+/**
+ * @brief	Функции, которые вызывает разбор запроса: собственные функции состояния разбора 
+ *			или зарегистрированные WVT_W7_Register_Callbacks
+ */
+static const WVT_W7_Callbacks_t * WVT_W7_State_Callbacks(const WVT_W7_Parse_State_t * state)
+{
+    return (state->callbacks != 0) ? state->callbacks : &externals_functions;
+}
+
+/**
+ * @returns	1 - запрос работает только с параметрами в памяти, 
+ *          которую дают функции состояния разбора (в том числе обертки над такими запросами)
+ */
+static uint8_t WVT_W7_Parameter_Request(WVT_W7_Packet_t packet_type)
+{
+    switch (packet_type)
+    {
+    case WVT_W7_PACKET_TYPE_READ_MULTIPLE:
+    case WVT_W7_PACKET_TYPE_READ_MULTIPLE_PACKED:
+    case WVT_W7_PACKET_TYPE_WRITE_MULTIPLE:
+    case WVT_W7_PACKET_TYPE_READ_SINGLE:
+    case WVT_W7_PACKET_TYPE_WRITE_SINGLE:
+    case WVT_W7_PACKET_TYPE_MODIFY:
+    case WVT_W7_PACKET_TYPE_NO_ACK:
+    case WVT_W7_PACKET_TYPE_TAGGED:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief	Разбирает запрос из состояния разбора, с начала или с места остановки
+ */
+static uint8_t WVT_W7_Parse_Complete(WVT_W7_Parse_State_t * state)
+{
+    const uint8_t responce_length = WVT_W7_Parse_Request(state, state->data, state->length, 
+        state->responce_buffer, WVT_W7_BUFFER_SIZE);
+
+    if (state->suspended)
+    {
+        return 0;
+    }
+
+#if WVT_W7_ENABLE_DEFERRED
+    // В режиме отложенных ответов ответ уйдет с ближайшим регулярным сообщением.
+    // Очередь одна на устройство: ответы за другую память в нее не попадают
+    if (    (state->callbacks == 0)
+        &&  (WVT_W7_Deferred_Queue(state->responce_buffer, responce_length))  )
+    {
+        return 0;
+    }
+#endif
+    return responce_length;
+}
+
+/**
+ * @brief	Обрабатывает запрос, ответ на который должен поместиться в responce_size байт.
+ *			Обертки над запросами (тег последовательности) занимают часть буфера 
+ *			и передают вложенному запросу оставшееся место.
+ *
+ * @param [in/out] state	   	Состояние разбора
+ * @param [in] 	data		   	Указатель на буфер с входными данными
+ * @param 	   	length		   	Чило байт во входном буфере
+ * @param [out]	responce_buffer	Указатель на буфер с выходными данными
+ * @param 	   	responce_size	Доступное место в выходном буфере
+ *
+ * @returns	Число зачисанных байт в буфер с выходными данными.
+ */
+static uint8_t WVT_W7_Parse_Request(
+    WVT_W7_Parse_State_t * state,
+    uint8_t * data,
+    uint16_t length,
+    uint8_t * responce_buffer,
+    uint16_t responce_size)
+{
+    const WVT_W7_Callbacks_t * callbacks = WVT_W7_State_Callbacks(state);
     WVT_W7_Error_t return_code = WVT_W7_ERROR_CODE_OK;
+    uint8_t resumable = 0;
     uint16_t responce_length;
     uint32_t addres;
     uint32_t number_of_parameters;
@@ -69,6 +286,15 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
     }
     
     WVT_W7_Packet_t packet_type = (WVT_W7_Packet_t) data[0];
+
+    // Модули хранят состояние этого устройства, а не памяти собственных функций
+    if (    (state->callbacks != 0)
+        &&  (WVT_W7_Parameter_Request(packet_type) == 0)  )
+    {
+        responce_buffer[0] = (packet_type | WVT_W7_ERROR_FLAG);
+        responce_buffer[1] = WVT_W7_ERROR_CODE_INVALID_TYPE;
+        return WVT_W7_ERROR_RESPONCE_LENGTH;
+    }
     
     switch (packet_type)
     {
@@ -77,7 +303,7 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
         number_of_parameters = (data[3] << 8) + data[4];
         
         if (     (length == WVT_W7_READ_MULTIPLE_LENGTH)
-            &&  ((WVT_W7_MULTI_DATA_OFFSET + (number_of_parameters * WVT_W7_PARAMETER_WIDTH)) <= WVT_W7_BUFFER_SIZE) )
+            &&  ((WVT_W7_MULTI_DATA_OFFSET + (number_of_parameters * WVT_W7_PARAMETER_WIDTH)) <= responce_size) )
         {
             // Тип сообщения, адрес начала последовательности и длинна последовательности
             // заполняются из входящего пакета
@@ -86,14 +312,14 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
                 responce_buffer[i] = data[i];
             }
             
-            uint16_t current_parameter = 0;
             while (	(return_code == WVT_W7_ERROR_CODE_OK)
-                &&	(current_parameter < number_of_parameters)	)
+                &&	(state->parameter < number_of_parameters)	)
             {
-                return_code = WVT_W7_Single_Parameter((addres + current_parameter), WVT_W7_PARAMETER_READ, 
-                    (responce_buffer + WVT_W7_MULTI_DATA_OFFSET + (current_parameter * WVT_W7_PARAMETER_WIDTH)));
-                current_parameter++;
+                return_code = WVT_W7_Single_Parameter(state, (addres + state->parameter), WVT_W7_PARAMETER_READ, 
+                    (responce_buffer + WVT_W7_MULTI_DATA_OFFSET + (state->parameter * WVT_W7_PARAMETER_WIDTH)));
+                state->parameter += (return_code == WVT_W7_ERROR_CODE_OK);
             }
+            resumable = 1;
             responce_length = WVT_W7_READ_MULTIPLE_LENGTH + (number_of_parameters * WVT_W7_PARAMETER_WIDTH);
         }
         else
@@ -101,6 +327,28 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
             return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
         }
         break;
+    case WVT_W7_PACKET_TYPE_READ_MULTIPLE_PACKED:
+        if (length == WVT_W7_READ_MULTIPLE_LENGTH)
+        {
+            addres = (data[1] << 8) + data[2];
+            number_of_parameters = (data[3] << 8) + data[4];
+
+            // Тип сообщения и адрес начала последовательности заполняются из входящего пакета,
+            // длинна последовательности - по числу уместившихся параметров
+            for (uint8_t i = 0 ; i < WVT_W7_MULTI_DATA_OFFSET ; i++)
+            {
+                responce_buffer[i] = data[i];
+            }
+
+            responce_length = responce_size;
+            return_code = WVT_W7_Read_Packed(state, addres, number_of_parameters, responce_buffer, &responce_length);
+            resumable = 1;
+        }
+        else
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        break;
     case WVT_W7_PACKET_TYPE_WRITE_MULTIPLE:
         addres = (data[1] << 8) + data[2];
         number_of_parameters = (data[3] << 8) + data[4];
@@ -114,15 +362,15 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
                 responce_buffer[i] = data[i];
             }
             
-            uint16_t current_parameter = 0;
             while (     (return_code == WVT_W7_ERROR_CODE_OK)
-                    &&	(current_parameter < number_of_parameters) )
+                    &&	(state->parameter < number_of_parameters) )
             {
-                return_code = WVT_W7_Single_Parameter((addres + current_parameter),
+                return_code = WVT_W7_Single_Parameter(state, (addres + state->parameter),
                     WVT_W7_PARAMETER_WRITE, 
-                    (data + WVT_W7_MULTI_DATA_OFFSET + (current_parameter * WVT_W7_PARAMETER_WIDTH)));
-                current_parameter++;
+                    (data + WVT_W7_MULTI_DATA_OFFSET + (state->parameter * WVT_W7_PARAMETER_WIDTH)));
+                state->parameter += (return_code == WVT_W7_ERROR_CODE_OK);
             }
+            resumable = 1;
             // Не опечатка
             responce_length = WVT_W7_READ_MULTIPLE_LENGTH;
         }
@@ -142,9 +390,10 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
                 responce_buffer[i] = data[i];
             }
             
-            return_code = WVT_W7_Single_Parameter(addres, 
+            return_code = WVT_W7_Single_Parameter(state, addres, 
                 WVT_W7_PARAMETER_READ,
                 (responce_buffer + WVT_W7_SINGLE_DATA_OFFSET));
+            resumable = 1;
             responce_length = WVT_W7_READ_SINGLE_LENGTH + WVT_W7_PARAMETER_WIDTH;
         }
         else
@@ -163,9 +412,10 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
                 responce_buffer[i] = data[i];
             }
             
-            return_code = WVT_W7_Single_Parameter(addres, 
+            return_code = WVT_W7_Single_Parameter(state, addres, 
                 WVT_W7_PARAMETER_WRITE,
                 (data + WVT_W7_SINGLE_DATA_OFFSET));
+            resumable = 1;
             responce_length = WVT_W7_WRITE_SINGLE_LENGTH;
         }
         else
@@ -173,9 +423,141 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
             return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
         }
         break;
+    case WVT_W7_PACKET_TYPE_MODIFY:
+        if (    (length == WVT_W7_MODIFY_LENGTH)
+            ||  (length == WVT_W7_COMPARE_AND_SWAP_LENGTH)  )
+        {
+            return_code = WVT_W7_Modify_Parameter(state, data, length, responce_buffer);
+            resumable = 1;
+            responce_length = WVT_W7_MODIFY_LENGTH;
+        }
+        else
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        break;
+    case WVT_W7_PACKET_TYPE_NO_ACK:
+        // Обертка над запросом записи: успешная запись не подтверждается,
+        // в ответ отправляется только ошибка вложенного запроса
+        if (length < 2)
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+            break;
+        }
+
+        if (    (data[1] != WVT_W7_PACKET_TYPE_WRITE_SINGLE)
+            &&  (data[1] != WVT_W7_PACKET_TYPE_WRITE_MULTIPLE)
+            &&  (data[1] != WVT_W7_PACKET_TYPE_MODIFY)  )
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_TYPE;
+            break;
+        }
+
+        responce_length = WVT_W7_Parse_Request(state, (data + 1), (length - 1), responce_buffer, responce_size);
+        if (    (state->suspended)
+            ||  ((responce_buffer[0] & WVT_W7_ERROR_FLAG) == 0)  )
+        {
+            responce_length = 0;
+        }
+
+        return responce_length;
+    case WVT_W7_PACKET_TYPE_TAGGED:
+        // Обертка с тегом последовательности: ответ на вложенный запрос 
+        // получает тот же тег, что позволяет серверу отправить несколько запросов подряд
+        if (    (length < WVT_W7_TAGGED_DATA_OFFSET + 1)
+            ||  (responce_size <= WVT_W7_TAGGED_DATA_OFFSET)  )
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+            break;
+        }
+
+        responce_length = WVT_W7_Parse_Request(state, (data + WVT_W7_TAGGED_DATA_OFFSET), 
+            (length - WVT_W7_TAGGED_DATA_OFFSET),
+            (responce_buffer + WVT_W7_TAGGED_DATA_OFFSET),
+            (responce_size - WVT_W7_TAGGED_DATA_OFFSET));
+        if (responce_length == 0)
+        {
+            return 0;
+        }
+
+        responce_buffer[0] = packet_type;
+        responce_buffer[1] = data[1];
+        return (responce_length + WVT_W7_TAGGED_DATA_OFFSET);
+#if WVT_W7_ENABLE_SUBSCRIPTIONS
+    case WVT_W7_PACKET_TYPE_SUBSCRIBE:
+        if (length == WVT_W7_SUBSCRIBE_LENGTH) 
+        {
+            // Ответ повторяет запрос
+            for(uint8_t i = 0 ; i < WVT_W7_SUBSCRIBE_LENGTH ; i++)
+            {
+                responce_buffer[i] = data[i];
+            }
+            
+            return_code = WVT_W7_Subscribe(data);
+            responce_length = WVT_W7_SUBSCRIBE_LENGTH;
+        }
+        else
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        break;
+#endif
+#if WVT_W7_ENABLE_DIGEST
+    case WVT_W7_PACKET_TYPE_DIGEST:
+        if (length == WVT_W7_DIGEST_LENGTH) 
+        {
+            responce_length = responce_size;
+            return_code = WVT_W7_Digest_Read(data, responce_buffer, &responce_length);
+        }
+        else
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        break;
+#endif
+#if WVT_W7_ENABLE_SYNC
+    case WVT_W7_PACKET_TYPE_READ_CHANGED:
+        if (length == WVT_W7_READ_CHANGED_LENGTH) 
+        {
+            responce_length = responce_size;
+            return_code = WVT_W7_Sync_Read(data, responce_buffer, &responce_length);
+        }
+        else
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        break;
+#endif
+#if WVT_W7_ENABLE_ARCHIVE
+    case WVT_W7_PACKET_TYPE_READ_ARCHIVE:
+        if (length == WVT_W7_READ_ARCHIVE_LENGTH) 
+        {
+            responce_length = responce_size;
+            return_code = WVT_W7_Archive_Read(data, responce_buffer, &responce_length);
+        }
+        else
+        {
+            return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        break;
+#endif
     case WVT_W7_PACKET_TYPE_FW_UPDATE:
-        if (    (externals_functions.rfl_handler == 0)
-            ||  (externals_functions.rfl_command == 0)   )
+#if WVT_W7_ENABLE_FIRMWARE
+        if (WVT_W7_Firmware_Ready())
+        {
+            responce_length = responce_size;
+            return_code = WVT_W7_Firmware_Parse(data, length, responce_buffer, &responce_length);
+            if (    (return_code == WVT_W7_ERROR_CODE_OK)
+                &&  (responce_length == 0)  )
+            {
+                return 0;
+            }
+            break;
+        }
+#endif
+
+        if (    (callbacks->rfl_handler == 0)
+            ||  (callbacks->rfl_command == 0)   )
         {
             return_code = WVT_W7_ERROR_CODE_INVALID_TYPE;
             break;
@@ -187,25 +569,35 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
             break;
         }
         
-        return_code = externals_functions.rfl_handler(data, length, responce_buffer, &responce_length);
+        responce_length = responce_size;
+        return_code = callbacks->rfl_handler(data, length, responce_buffer, &responce_length);
        
         break;
     case WVT_W7_PACKET_TYPE_CONTROL:
-        if (    (externals_functions.rfl_handler == 0)
-            ||  (externals_functions.rfl_command == 0)   )
+        if (    (callbacks->rfl_handler == 0)
+            ||  (callbacks->rfl_command == 0)   )
         {
             return_code = WVT_W7_ERROR_CODE_INVALID_TYPE;
             break;
         }
 
-        if (length != 7)
+        if (length != WVT_W7_CONTROL_LENGTH)
         {
             return_code = WVT_W7_ERROR_CODE_INVALID_LENGTH;
             break;
         }
         
-        return_code = externals_functions.rfl_command(data, length, responce_buffer, &responce_length);
-        
+        responce_length = responce_size;
+        return_code = callbacks->rfl_command(data, length, responce_buffer, &responce_length);
+
+#if WVT_W7_ENABLE_CONTROL
+        // Долгая команда не задерживает обработку: сразу отвечаем, что она принята,
+        // результат приложение передаст через WVT_W7_Control_Complete
+        if (return_code == WVT_W7_ERROR_CODE_BUSY)
+        {
+            return WVT_W7_Control_Accept(data, responce_buffer, responce_size);
+        }
+#endif
         break;
     default:
         return_code = WVT_W7_ERROR_CODE_INVALID_TYPE;
@@ -217,6 +609,13 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
         responce_buffer[0] = packet_type;
         return responce_length;
     }
+    else if (   (return_code == WVT_W7_ERROR_CODE_BUSY)
+            &&  (resumable)  )
+    {
+        // Ответ будет сформирован в WVT_W7_Resume
+        state->suspended = 1;
+        return 0;
+    }
     else
     {
         responce_buffer[0] = (packet_type | WVT_W7_ERROR_FLAG);
@@ -231,6 +630,7 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
  *			Данные размещаются начиная с нулевого смещения и занимают четыре байта
  *			Порядок байт: от старшего к младшему
  *
+ * @param [in/out]	state	   				Состояние разбора
  * @param 	   		parameter_addres	   	Адрес параметра
  * @param 	   		action	   				Действие: чтение или запись
  * @param [in/out]	responce_buffer			Из этого буфера будут прочитанны или записаны данные
@@ -240,6 +640,7 @@ uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer)
  * 			- WVT_W7_ERROR_CODE_LL_ERROR	    Произошла ошибка при записи
  */
 WVT_W7_Error_t WVT_W7_Single_Parameter(
+    WVT_W7_Parse_State_t * state,
     uint16_t parameter_addres,
     WVT_W7_Parameter_Action_t action,
     uint8_t * responce_buffer)
@@ -254,7 +655,7 @@ WVT_W7_Error_t WVT_W7_Single_Parameter(
     
     if (action == WVT_W7_PARAMETER_READ)
     {
-        rom_operation_result = externals_functions.rom_read(parameter_addres, &value) ;
+        rom_operation_result = WVT_W7_State_Callbacks(state)->rom_read(parameter_addres, &value) ;
         if (rom_operation_result == WVT_W7_ERROR_CODE_OK)
         {
             responce_buffer[0] = (value >> 24);
@@ -265,16 +666,396 @@ WVT_W7_Error_t WVT_W7_Single_Parameter(
     }
     else
     {
+        int32_t previous_value = 0;
+
         value =   (responce_buffer[0] << 24) 
                 + (responce_buffer[1] << 16)
                 + (responce_buffer[2] << 8) 
                 +  responce_buffer[3];
-        rom_operation_result = externals_functions.rom_write(parameter_addres, value);
+
+#if WVT_W7_ENABLE_DIGEST
+        // Для обновления дерева хешей нужно прежнее значение параметра. 
+        // Оно сохраняется, чтобы после приостановленной записи не читать его заново
+        if (    (state->callbacks == 0)
+            &&  (WVT_W7_Digest_Covers(parameter_addres))  )
+        {
+            if (state->has_value == 0)
+            {
+                rom_operation_result = WVT_W7_State_Callbacks(state)->rom_read(parameter_addres, &previous_value);
+                if (rom_operation_result == WVT_W7_ERROR_CODE_BUSY)
+                {
+                    return rom_operation_result;
+                }
+
+                state->value = (rom_operation_result == WVT_W7_ERROR_CODE_OK) ? previous_value : 0;
+                state->has_value = 1;
+            }
+            previous_value = state->value;
+        }
+#endif
+
+        rom_operation_result = WVT_W7_Store_Parameter(state, parameter_addres, previous_value, value);
+        if (rom_operation_result != WVT_W7_ERROR_CODE_BUSY)
+        {
+            state->has_value = 0;
+        }
     }
     
     return rom_operation_result;
 }
 
+/**
+ * @brief	Записывает параметр в EEPROM и отмечает изменение в дереве хешей 
+ *			и счетчиках версий. Через эту функцию проходят все записи параметров.
+ *
+ * @param 	   		parameter_addres	   	Адрес параметра
+ * @param 	   		previous_value	   		Значение параметра до записи
+ * @param 	   		value	   				Новое значение
+ *
+ * @returns	Результат rom_write
+ */
+static WVT_W7_Error_t WVT_W7_Store_Parameter(
+    WVT_W7_Parse_State_t * state,
+    uint16_t parameter_addres,
+    int32_t previous_value,
+    int32_t value)
+{
+    const WVT_W7_Error_t rom_operation_result = WVT_W7_State_Callbacks(state)->rom_write(parameter_addres, value);
+
+    // Дерево хешей и версии ведутся только для памяти этого устройства
+    if (    (rom_operation_result == WVT_W7_ERROR_CODE_OK)
+        &&  (state->callbacks == 0)  )
+    {
+#if WVT_W7_ENABLE_DIGEST
+        WVT_W7_Digest_Update(parameter_addres, previous_value, value);
+#else
+        (void)previous_value;
+#endif
+#if WVT_W7_ENABLE_SYNC
+        WVT_W7_Sync_Touch(parameter_addres);
+#endif
+    }
+
+    return rom_operation_result;
+}
+
+/**
+ * @brief	Атомарно изменяет параметр одной парой rom_read и rom_write.
+ *			Формат запроса: тип, адрес (2 байта), операция, операнд (4 байта).
+ *			Для сравнения с обменом операнд - ожидаемое значение, за ним следует новое (4 байта).
+ *			Ответ: тип, адрес, операция и значение параметра после операции.
+ *			Если сравнение с обменом не удалось, возвращается текущее значение параметра.
+ *			Неизменившееся значение не перезаписывается.
+ *
+ * @param [in] 	data		   	Запрос
+ * @param 	   	length		   	Длина запроса
+ * @param [out]	responce_buffer	Буфер с ответом длинной WVT_W7_MODIFY_LENGTH
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Операция выполнена
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Неизвестная операция или длина не соответствует операции
+ * 			- Код ошибки rom_read или rom_write
+ */
+static WVT_W7_Error_t WVT_W7_Modify_Parameter(
+    WVT_W7_Parse_State_t * state,
+    uint8_t * data,
+    uint16_t length,
+    uint8_t * responce_buffer)
+{
+    const uint16_t parameter_addres = (uint16_t) ((data[1] << 8) + data[2]);
+    const WVT_W7_Modify_Operation_t operation = (WVT_W7_Modify_Operation_t) data[3];
+    const int32_t operand =   (data[4] << 24) 
+                            + (data[5] << 16)
+                            + (data[6] << 8) 
+                            +  data[7];
+    int32_t value;
+    int32_t result;
+    int64_t sum;
+
+    if (    (operation > WVT_W7_MODIFY_COMPARE_AND_SWAP)
+        ||  ((operation == WVT_W7_MODIFY_COMPARE_AND_SWAP) != (length == WVT_W7_COMPARE_AND_SWAP_LENGTH))  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    WVT_W7_Error_t rom_operation_result;
+
+    // После приостановленной записи значение не читается заново: 
+    // операция применяется к тому же значению
+    if (state->has_value == 0)
+    {
+        rom_operation_result = WVT_W7_State_Callbacks(state)->rom_read(parameter_addres, &value);
+        if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+        {
+            return rom_operation_result;
+        }
+        state->value = value;
+        state->has_value = 1;
+    }
+    value = state->value;
+
+    switch (operation)
+    {
+    case WVT_W7_MODIFY_SET_BITS:
+        result = (int32_t) ((uint32_t) value | (uint32_t) operand);
+        break;
+    case WVT_W7_MODIFY_CLEAR_BITS:
+        result = (int32_t) ((uint32_t) value & ~(uint32_t) operand);
+        break;
+    case WVT_W7_MODIFY_ADD_SATURATED:
+        sum = (int64_t) value + operand;
+        sum = (sum > INT32_MAX) ? INT32_MAX : sum;
+        sum = (sum < INT32_MIN) ? INT32_MIN : sum;
+        result = (int32_t) sum;
+        break;
+    case WVT_W7_MODIFY_COMPARE_AND_SWAP:
+    default:
+        result = value;
+        if (value == operand)
+        {
+            result =  (data[8] << 24) 
+                    + (data[9] << 16)
+                    + (data[10] << 8) 
+                    +  data[11];
+        }
+        break;
+    }
+
+    if (result != value)
+    {
+        rom_operation_result = WVT_W7_Store_Parameter(state, parameter_addres, value, result);
+        if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+        {
+            state->has_value = (rom_operation_result == WVT_W7_ERROR_CODE_BUSY);
+            return rom_operation_result;
+        }
+    }
+    state->has_value = 0;
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        responce_buffer[i] = data[i];
+    }
+    responce_buffer[4] = (result >> 24);
+    responce_buffer[5] = (result >> 16);
+    responce_buffer[6] = (result >> 8);
+    responce_buffer[7] =  result;
+
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Читает последовательность параметров в сжатом виде.
+ *			Каждый параметр кодируется разностью с предыдущим (для первого - с нулем),
+ *			разность переводится в zigzag и записывается как varint.
+ *			Параметры кодируются прямо в выходной буфер, пока помещаются в него,
+ *			число уместившихся параметров записывается в заголовок ответа.
+ *
+ * @param 	   	addres	   				Адрес первого параметра
+ * @param 	   	number_of_parameters	Запрошенное число параметров
+ * @param [out]	responce_buffer			Буфер с ответом, заголовок уже заполнен
+ * @param [in/out] responce_length		На входе - размер буфера, на выходе - длина ответа
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		Параметры прочитаны. Если чтение параметра не удалось 
+ *										после первого, ответ содержит параметры перед ним
+ * 			- Код ошибки rom_read		Ошибка чтения первого параметра
+ */
+static WVT_W7_Error_t WVT_W7_Read_Packed(
+    WVT_W7_Parse_State_t * state,
+    uint16_t addres,
+    uint16_t number_of_parameters,
+    uint8_t * responce_buffer,
+    uint16_t * responce_length)
+{
+    const uint16_t responce_size = *responce_length;
+    uint16_t position = state->position;
+    uint16_t current_parameter = state->parameter;
+    uint32_t previous_value = state->previous_value;
+
+    // Параметр занимает хотя бы байт: в заполненный буфер следующий не читается
+    while (     (current_parameter < number_of_parameters)
+            &&  (position < responce_size)  )
+    {
+        int32_t value;
+        const WVT_W7_Error_t rom_operation_result = WVT_W7_State_Callbacks(state)->rom_read(
+            (uint16_t) (addres + current_parameter), &value);
+
+        // Закодированная часть ответа уже в буфере, продолжение - с этого места
+        if (rom_operation_result == WVT_W7_ERROR_CODE_BUSY)
+        {
+            state->position = position;
+            state->parameter = current_parameter;
+            state->previous_value = previous_value;
+            return rom_operation_result;
+        }
+
+        // Прочитанные параметры отправляются, остальные сервер запросит по их числу в ответе
+        if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+        {
+            if (current_parameter > 0)
+            {
+                break;
+            }
+            return rom_operation_result;
+        }
+
+        const uint32_t delta = WVT_W7_Zigzag((uint32_t) value - previous_value);
+        uint8_t encoded[WVT_W7_VARINT_MAX_LENGTH];
+        const uint8_t encoded_length = WVT_W7_Put_Varint(delta, encoded);
+
+        if ((position + encoded_length) > responce_size)
+        {
+            break;
+        }
+
+        for (uint8_t i = 0; i < encoded_length; i++)
+        {
+            responce_buffer[position++] = encoded[i];
+        }
+        previous_value = (uint32_t) value;
+        current_parameter++;
+    }
+
+    responce_buffer[3] = (current_parameter >> 8);
+    responce_buffer[4] =  current_parameter;
+    *responce_length = position;
+
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Разбирает сжатый ответ на чтение последовательности параметров (на стороне сервера)
+ *
+ * @param 	   	data		   	Принятый пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	address		   	Адрес первого параметра
+ * @param [out]	values		   	Значения параметров
+ * @param [in/out] count		На входе - размер массива values, на выходе - число параметров
+ *
+ * @returns	- WVT_W7_OK     Пакет разобран
+ *          - WVT_W7_ERROR  Неверный тип или формат пакета, либо параметры не помещаются в values
+ */
+WVT_W7_Status_t WVT_W7_Unpack_Multiple(const uint8_t * data, uint16_t length,
+    uint16_t * address, int32_t * values, uint16_t * count)
+{
+    if (    (data == 0)
+        ||  (length < WVT_W7_MULTI_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_READ_MULTIPLE_PACKED)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    const uint16_t number_of_parameters = (uint16_t) ((data[3] << 8) + data[4]);
+    uint16_t position = WVT_W7_MULTI_DATA_OFFSET;
+    uint32_t previous_value = 0;
+
+    if (number_of_parameters > *count)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    for (uint16_t i = 0; i < number_of_parameters; i++)
+    {
+        uint32_t delta;
+        const uint8_t encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &delta);
+
+        if (encoded_length == 0)
+        {
+            return WVT_W7_ERROR;
+        }
+
+        position += encoded_length;
+        previous_value += WVT_W7_Unzigzag(delta);
+        values[i] = (int32_t) previous_value;
+    }
+
+    if (position != length)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    *address = (uint16_t) ((data[1] << 8) + data[2]);
+    *count = number_of_parameters;
+
+    return WVT_W7_OK;
+}
+
+/**
+ * @brief	Переводит разность в zigzag: числа, близкие к нулю, 
+ *          независимо от знака получают малые значения
+ *
+ * @param 	delta	Разность двух 32-битных значений в дополнительном коде
+ *
+ * @returns	0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3 ...
+ */
+uint32_t WVT_W7_Zigzag(uint32_t delta)
+{
+    return (delta << 1) ^ (0UL - (delta >> 31));
+}
+
+/**
+ * @brief	Обратное преобразование к WVT_W7_Zigzag
+ */
+uint32_t WVT_W7_Unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0UL - (value & 1));
+}
+
+/**
+ * @brief	Записывает число в формате varint: по 7 бит в байте, начиная с младших,
+ *          старший бит байта указывает на продолжение
+ *
+ * @param 	   	value	Число
+ * @param [out]	data	Буфер, не менее WVT_W7_VARINT_MAX_LENGTH байт
+ *
+ * @returns	Число записанных байт
+ */
+uint8_t WVT_W7_Put_Varint(uint32_t value, uint8_t * data)
+{
+    uint8_t length = 0;
+
+    while (value >= 0x80)
+    {
+        data[length++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    data[length++] = (uint8_t) value;
+
+    return length;
+}
+
+/**
+ * @brief	Читает число в формате varint
+ *
+ * @param 	   	data	Буфер с данными
+ * @param 	   	length	Число доступных байт
+ * @param [out]	value	Прочитанное число
+ *
+ * @returns	Число прочитанных байт, 0 - данные обрываются или число длиннее 32 бит
+ */
+uint8_t WVT_W7_Get_Varint(const uint8_t * data, uint16_t length, uint32_t * value)
+{
+    uint32_t result = 0;
+
+    for (uint8_t i = 0; (i < length) && (i < WVT_W7_VARINT_MAX_LENGTH); i++)
+    {
+        // В пятом байте помещаются только 4 старших бита 32-битного числа
+        if (    (i == (WVT_W7_VARINT_MAX_LENGTH - 1))
+            &&  (data[i] & 0xF0)  )
+        {
+            return 0;
+        }
+
+        result |= (uint32_t) (data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0)
+        {
+            *value = result;
+            return (uint8_t) (i + 1);
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief	    Формирует пакет о событии
  *
@@ -318,6 +1099,94 @@ uint8_t WVT_W7_PairEvent(uint8_t par, uint32_t value, uint16_t diff,  uint8_t *
     return 8;
 }
 
+/**
+ * @brief	    Формирует пакет с пачкой часовых парных событий: текущее значение
+ *              параметра и разности за несколько прошедших часов.
+ *              Заменяет до WVT_W7_PAIR_BATCH_MAX отдельных пакетов WVT_W7_PairEvent.
+ *
+ * @param 	   	par		   	    Передаваемый параметр
+ * @param 	   	value		   	Текущее значение параметра
+ * @param 	   	diffs		   	Часовые разности, начиная с последнего часа:
+ *                              diffs[0] - разница value со значением час назад,
+ *                              diffs[1] - разница за предыдущий час и т.д.
+ * @param 	   	count		   	Число часовых разностей
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если разности не помещаются в буфер).
+ */
+uint8_t WVT_W7_PairEvent_Batch(uint8_t par, uint32_t value, const uint16_t * diffs, uint8_t count,
+    uint8_t * responce_buffer)
+{
+    if (    (count > WVT_W7_PAIR_BATCH_MAX)
+        ||  ((diffs == 0) && (count != 0))  )
+    {
+        return 0;
+    }
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_PAIR_EVENT_BATCH;
+    responce_buffer[1] = par;
+    responce_buffer[2] = (value >> 24);
+    responce_buffer[3] = (value >> 16);
+    responce_buffer[4] = (value >> 8);
+    responce_buffer[5] = (value >> 0);
+    responce_buffer[6] = count;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        responce_buffer[WVT_W7_PAIR_BATCH_DATA_OFFSET + (i * WVT_W7_PAIR_BATCH_DIFF_WIDTH)]     = (diffs[i] >> 8);
+        responce_buffer[WVT_W7_PAIR_BATCH_DATA_OFFSET + (i * WVT_W7_PAIR_BATCH_DIFF_WIDTH) + 1] =  diffs[i] & 0xFF;
+    }
+
+    return WVT_W7_PAIR_BATCH_DATA_OFFSET + (count * WVT_W7_PAIR_BATCH_DIFF_WIDTH);
+}
+
+/**
+ * @brief	    Разбирает пакет с пачкой часовых парных событий (на стороне сервера)
+ *
+ * @param 	   	data		   	Принятый пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	par		   	    Передаваемый параметр
+ * @param [out]	value		   	Текущее значение параметра
+ * @param [out]	diffs		   	Часовые разности, начиная с последнего часа
+ * @param [in/out] count		На входе - размер массива diffs, на выходе - число разностей
+ *
+ * @returns	- WVT_W7_OK     Пакет разобран
+ *          - WVT_W7_ERROR  Неверный тип или длина пакета, либо разности не помещаются в diffs
+ */
+WVT_W7_Status_t WVT_W7_PairEvent_Batch_Decode(const uint8_t * data, uint16_t length, 
+    uint8_t * par, uint32_t * value, uint16_t * diffs, uint8_t * count)
+{
+    if (    (data == 0)
+        ||  (length < WVT_W7_PAIR_BATCH_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_PAIR_EVENT_BATCH)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    const uint8_t diffs_number = data[6];
+
+    if (    (length != (WVT_W7_PAIR_BATCH_DATA_OFFSET + (diffs_number * WVT_W7_PAIR_BATCH_DIFF_WIDTH)))
+        ||  (diffs_number > *count)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    *par = data[1];
+    *value =  ((uint32_t) data[2] << 24)
+            + ((uint32_t) data[3] << 16)
+            + ((uint32_t) data[4] << 8)
+            +   data[5];
+
+    for (uint8_t i = 0; i < diffs_number; i++)
+    {
+        const uint8_t * diff = data + WVT_W7_PAIR_BATCH_DATA_OFFSET + (i * WVT_W7_PAIR_BATCH_DIFF_WIDTH);
+        diffs[i] = (uint16_t) ((diff[0] << 8) + diff[1]);
+    }
+    *count = diffs_number;
+
+    return WVT_W7_OK;
+}
+
 /**
  * @brief	    Распаковывает значение настройки дополнительных параметров
  *              Возвращает число параметров, настроенных для отправки и записывает
@@ -371,6 +1240,8 @@ static void WVT_W7_Additional_Parameter(uint16_t address, uint8_t * data)
  * @param 	   	payload		            Адрес параметра
  * @param       additional_parameters   Упакованное значение настройки (из EEPROM)
  *                                      Значение 0 отключит отправку дополнительных параметров
+ *              В хвост сообщения добавляются отложенные ответы (WVT_W7_Deferred_Enable),
+ *              поэтому буфер должен вмещать WVT_W7_BUFFER_SIZE байт.
  * 
  * @returns	    Число записанных байт
  */
@@ -406,15 +1277,254 @@ uint8_t WVT_W7_Short_Regular(
 		    ((responce_buffer + 7) + (i * WVT_W7_ADDITIONAL_DATA_WIDTH)));
     }
     
+#if WVT_W7_ENABLE_DEFERRED
+	return WVT_W7_Deferred_Append(responce_buffer, 
+        (WVT_W7_ADDITIONAL_DATA_OFFSET + (WVT_W7_ADDITIONAL_DATA_WIDTH * number_of_additional_params)));
+#else
 	return (WVT_W7_ADDITIONAL_DATA_OFFSET + (WVT_W7_ADDITIONAL_DATA_WIDTH * number_of_additional_params));
+#endif
 }	
 
+/**
+ * @brief		Формирует длинное регулярное сообщение с произвольным списком параметров.
+ *              Для каждого параметра записывается разность адреса с предыдущим 
+ *              (для первого - с нулем) и значение; оба числа переводятся в zigzag
+ *              и записываются как varint, поэтому малые значения и соседние адреса 
+ *              занимают по байту. С флагом WVT_W7_LONG_REGULAR_DELTA вместо значения 
+ *              записывается разность с предыдущим значением.
+ *              Параметры добавляются, пока помещаются в WVT_W7_BUFFER_SIZE. Параметры, 
+ *              которые не удалось прочитать, пропускаются.
+ *              Как и в WVT_W7_Short_Regular, в хвост добавляются отложенные ответы.
+ *              Место под самый старый из них резервируется заранее, поэтому длинный 
+ *              список параметров не задерживает ответы: остаток списка уходит
+ *              в следующем сообщении.
+ *
+ * @param [out]	responce_buffer		    Указатель на буфер с выходными данными
+ * @param 	   	payload		            Основное значение
+ * @param 	   	schedule		        Периодичность отправки регулярного сообщения (упакованный формат)
+ * @param [in] 	addresses	            Список адресов параметров
+ * @param 	   	count		            Число адресов в списке
+ * @param 	   	flags		            WVT_W7_LONG_REGULAR_DELTA или 0
+ * @param [out]	packed		            Число обработанных адресов списка. Если список не поместился, 
+ *                                      следующее сообщение можно начать с addresses + packed
+ * 
+ * @returns	    Число записанных байт
+ */
+uint8_t WVT_W7_Long_Regular(
+    uint8_t * responce_buffer,
+    int32_t payload,
+    uint16_t schedule,
+    const uint16_t * addresses,
+    uint16_t count,
+    uint8_t flags,
+    uint16_t * packed)
+{
+    uint16_t position = WVT_W7_LONG_REGULAR_DATA_OFFSET;
+#if WVT_W7_ENABLE_DEFERRED
+    const uint16_t limit = (uint16_t) (WVT_W7_BUFFER_SIZE - WVT_W7_Deferred_Next());
+#else
+    const uint16_t limit = WVT_W7_BUFFER_SIZE;
+#endif
+    uint16_t current = 0;
+    uint16_t number_of_parameters = 0;
+    uint32_t previous_address = 0;
+    uint32_t previous_value = 0;
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_LONG_REGULAR;
+    responce_buffer[1] = (schedule >> 8);
+    responce_buffer[2] = schedule;
+    
+    responce_buffer[3] = (payload >> 24);
+    responce_buffer[4] = (payload >> 16);
+    responce_buffer[5] = (payload >> 8);
+    responce_buffer[6] = (payload);
+    responce_buffer[7] = flags;
+
+    for (; current < count; current++)
+    {
+        int32_t value;
+        uint8_t encoded[2 * WVT_W7_VARINT_MAX_LENGTH];
+
+        if (externals_functions.rom_read(addresses[current], &value) != WVT_W7_ERROR_CODE_OK)
+        {
+            continue;
+        }
+
+        uint8_t encoded_length = WVT_W7_Put_Varint(
+            WVT_W7_Zigzag(addresses[current] - previous_address), encoded);
+        encoded_length += WVT_W7_Put_Varint(
+            WVT_W7_Zigzag((uint32_t) value - previous_value), (encoded + encoded_length));
+
+        if ((position + encoded_length) > limit)
+        {
+            break;
+        }
+
+        for (uint8_t i = 0; i < encoded_length; i++)
+        {
+            responce_buffer[position++] = encoded[i];
+        }
+        previous_address = addresses[current];
+        if (flags & WVT_W7_LONG_REGULAR_DELTA)
+        {
+            previous_value = (uint32_t) value;
+        }
+        number_of_parameters++;
+    }
+
+    responce_buffer[8] = (number_of_parameters >> 8);
+    responce_buffer[9] =  number_of_parameters;
+    if (packed)
+    {
+        *packed = current;
+    }
+
+#if WVT_W7_ENABLE_DEFERRED
+    return WVT_W7_Deferred_Append(responce_buffer, (uint8_t) position);
+#else
+    return (uint8_t) position;
+#endif
+}
+
+/**
+ * @brief	Разбирает длинное регулярное сообщение (на стороне сервера)
+ *
+ * @param 	   	data		   	Принятый пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	payload		   	Основное значение
+ * @param [out]	schedule	   	Периодичность отправки
+ * @param [out]	addresses	   	Адреса параметров
+ * @param [out]	values		   	Значения параметров
+ * @param [in/out] count		На входе - размер массивов, на выходе - число параметров
+ *
+ * @returns	- WVT_W7_OK     Пакет разобран
+ *          - WVT_W7_ERROR  Неверный тип или формат пакета, либо параметры не помещаются в массивы
+ */
+WVT_W7_Status_t WVT_W7_Long_Regular_Decode(const uint8_t * data, uint16_t length,
+    int32_t * payload, uint16_t * schedule, uint16_t * addresses, int32_t * values, uint16_t * count)
+{
+    if (    (data == 0)
+        ||  (length < WVT_W7_LONG_REGULAR_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_LONG_REGULAR)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    const uint8_t delta_coding = (data[7] & WVT_W7_LONG_REGULAR_DELTA);
+    const uint16_t number_of_parameters = (uint16_t) ((data[8] << 8) + data[9]);
+    uint16_t position = WVT_W7_LONG_REGULAR_DATA_OFFSET;
+    uint32_t previous_address = 0;
+    uint32_t previous_value = 0;
+
+    if (number_of_parameters > *count)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    for (uint16_t i = 0; i < number_of_parameters; i++)
+    {
+        uint32_t address_delta;
+        uint32_t value;
+        uint8_t encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &address_delta);
+
+        if (encoded_length == 0)
+        {
+            return WVT_W7_ERROR;
+        }
+        position += encoded_length;
+
+        encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &value);
+        if (encoded_length == 0)
+        {
+            return WVT_W7_ERROR;
+        }
+        position += encoded_length;
+
+        previous_address += WVT_W7_Unzigzag(address_delta);
+        value = previous_value + WVT_W7_Unzigzag(value);
+        if (delta_coding)
+        {
+            previous_value = value;
+        }
+
+        addresses[i] = (uint16_t) previous_address;
+        values[i] = (int32_t) value;
+    }
+
+    // Хвост с отложенными ответами разбирает WVT_W7_Deferred_Trailer
+#if WVT_W7_ENABLE_DEFERRED
+    if ((position != length) && (data[position] != WVT_W7_DEFERRED_MARKER))
+#else
+    if (position != length)
+#endif
+    {
+        return WVT_W7_ERROR;
+    }
+
+    *payload = (int32_t) (((uint32_t) data[3] << 24) + ((uint32_t) data[4] << 16) + ((uint32_t) data[5] << 8) + data[6]);
+    *schedule = (uint16_t) ((data[1] << 8) + data[2]);
+    *count = number_of_parameters;
+
+    return WVT_W7_OK;
+}
+
+/**
+ * @brief       Задает зерно, из которого выводится смещение фазы планировщиков.
+ *              Устройства с одинаковым расписанием, но разными зернами (например,
+ *              серийными номерами) отправляют сообщения в разные моменты периода,
+ *              а не все одновременно на его границе. Число отправок в сутки не меняется.
+ *              Зерно 0 дает нулевое смещение, но сетка слотов общая для любого зерна: 
+ *              WVT_W7_PrecisionScheduler отсчитывает слоты от начала суток, а не 
+ *              от времени последней отправки, как раньше, поэтому и с зерном 0 
+ *              опоздавший опрос не сдвигает следующие отправки.
+ * 
+ * @param seed            Уникальное для устройства значение
+ */
+void WVT_W7_Set_Phase_Seed(uint32_t seed)
+{
+    phase_seed = seed;
+}
+
+/**
+ * @brief       Финализатор MurmurHash3: 0 переходит в 0, остальные значения перемешиваются.
+ *              Общий для смещения фазы и дерева хешей (WVT_Water7_Digest.c).
+ */
+uint32_t WVT_W7_Mix(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BUL;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35UL;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/**
+ * @brief       Рассчитывает смещение фазы устройства внутри периода расписания.
+ *              Зерно перемешивается, чтобы последовательные серийные номера 
+ *              равномерно распределялись по периоду.
+ * 
+ * @param period          Период расписания (в минутах или секундах)
+ * @return                Смещение в тех же единицах, от 0 до period - 1
+ */
+static uint32_t WVT_W7_Phase_Offset(uint32_t period)
+{
+    if (period == 0)
+    {
+        return 0;
+    }
+
+    return WVT_W7_Mix(phase_seed) % period;
+}
+
 /**
  * @brief       Рассчитывает, нужно ли сейчас отправлять периодическое сообщение, исходя
  *              из желаемоего количества отправок в день. Распределяет события равномерно
  *              в течении дня.
  *              Если для текущей пары час-минута срабатывает событие, то следующий вызов функции
  *              с этой же парой не приведет к срабатыванию события. 
+ *              Слоты сдвигаются на фазу устройства (см. WVT_W7_Set_Phase_Seed).
  * 
  * @param current_hour    Текущий час
  * @param current_minute  Текущая минута
@@ -431,8 +1541,11 @@ uint8_t WVT_W7_Scheduler(uint8_t current_hour, uint8_t current_minute, int32_t s
 	schedule = (24 * 60) / schedule;
 	
 	const uint32_t minutes_since_beginning = (current_hour * 60) + current_minute;
+	// Минута того же смещения, что и у WVT_W7_Next_Fire
+	const uint32_t offset = WVT_W7_Phase_Offset((uint32_t) schedule * 60) / 60;
+	const uint32_t shifted_minutes = ((minutes_since_beginning + (24 * 60)) - offset) % (24 * 60);
 	
-	const uint8_t time_has_come = (minutes_since_beginning % schedule) == 0;
+	const uint8_t time_has_come = (shifted_minutes % schedule) == 0;
 	
 	if (time_has_come)
 	{
@@ -457,6 +1570,8 @@ uint8_t WVT_W7_Scheduler(uint8_t current_hour, uint8_t current_minute, int32_t s
  *              в течении дня.
  *              Если для текущей комбинации час-минута-секунда срабатывает событие, то следующий вызов функции
  *              с этой же комбинацией не приведет к срабатыванию события. 
+ *              Слоты расположены на секундах, кратных (24 * 3600) / schedule, от начала суток
+ *              планировщика, которые начинаются со смещения фазы устройства (см. WVT_W7_Set_Phase_Seed).
  * 
  * @param current_hour    Текущий час
  * @param current_minute  Текущая минута
@@ -470,21 +1585,109 @@ uint8_t WVT_W7_PrecisionScheduler(uint8_t current_hour, uint8_t current_minute,
     uint8_t ret = 0;
     static uint32_t next_execution_time = 0;
     static uint8_t wait_new_day = 0;
-    static uint8_t last_hour = 0;
+    static uint32_t last_seconds = 0;
     // Частота отправки равна числу секунд в день, деленных на необходимое число сообщений
     uint32_t newschedule = (24 * 3600) / schedule;
     uint32_t seconds_since_beginning = (uint32_t)((current_hour * 3600) + current_minute * 60 + current_second);
-    if (current_hour < last_hour) wait_new_day = 0;
+    // Сутки планировщика начинаются со смещения фазы устройства
+    seconds_since_beginning = ((seconds_since_beginning + (24 * 3600)) - WVT_W7_Phase_Offset(newschedule)) % (24 * 3600);
+    if (seconds_since_beginning < last_seconds) wait_new_day = 0;
     if (seconds_since_beginning >= next_execution_time && wait_new_day == 0)
     {
         ret = 1;
-        next_execution_time = (uint32_t)(seconds_since_beginning + newschedule);
+        // Следующий слот берется из сетки суток, чтобы поздний опрос не сдвигал расписание
+        next_execution_time = ((seconds_since_beginning / newschedule) + 1) * newschedule;
         if (next_execution_time >= 24 * 60 * 60)
         {
             wait_new_day = 1;
-            next_execution_time -= 24 * 60 * 60;
+            next_execution_time = 0;
         }
     }
-    last_hour = current_hour;
+    last_seconds = seconds_since_beginning;
     return ret;
 }
+
+
+/**
+ * @brief       Рассчитывает время до следующего срабатывания WVT_W7_Scheduler.
+ *              Позволяет запрограммировать будильник RTC один раз на сообщение
+ *              вместо ежеминутного опроса планировщика.
+ *              Слоты расположены на границах минут, кратных (24 * 60) / schedule,
+ *              и сдвинуты на фазу устройства с точностью до секунды (см. WVT_W7_Set_Phase_Seed):
+ *              будильник срабатывает внутри минуты слота WVT_W7_Scheduler на своей 
+ *              для устройства секунде, поэтому устройства одной минуты не выходят в эфир разом.
+ *              Последний слот суток может быть короче остальных.
+ *              Слот, начинающийся ровно в момент now, считается уже наступившим.
+ * 
+ * @param schedule        Желаемое число отправок в день
+ * @param now             Число секунд, прошедших с начала суток
+ * @return                - Число секунд до следующего слота (не меньше 1)
+ *                        - 0 неверное расписание
+ */
+uint32_t WVT_W7_Next_Fire(int32_t schedule, uint32_t now)
+{
+    const uint32_t minutes_per_day = 24 * 60;
+
+    if (schedule <= 0)
+    {
+        return 0;
+    }
+
+    uint32_t period = minutes_per_day / (uint32_t) schedule;
+    if (period == 0)
+    {
+        period = 1;
+    }
+
+    // Время отсчитывается от первого слота суток, сдвинутого на фазу устройства
+    const uint32_t offset = WVT_W7_Phase_Offset(period * 60);
+    now = ((now % (minutes_per_day * 60)) + (minutes_per_day * 60) - offset) % (minutes_per_day * 60);
+
+    uint32_t next_slot = ((now / 60) / period + 1) * period;
+    if (next_slot >= minutes_per_day)
+    {
+        // Первый слот следующих суток
+        next_slot = minutes_per_day;
+    }
+
+    return (next_slot * 60) - now;
+}
+
+/**
+ * @brief       Рассчитывает время до следующего срабатывания посекундного планировщика.
+ *              Слоты расположены на секундах, кратных (24 * 3600) / schedule, 
+ *              и сдвинуты на фазу устройства (см. WVT_W7_Set_Phase_Seed),
+ *              отсчет начинается заново в начале каждых суток.
+ *              Слот, совпадающий с now, считается уже наступившим.
+ * 
+ * @param schedule        Желаемое число отправок в день
+ * @param now             Число секунд, прошедших с начала суток
+ * @return                - Число секунд до следующего слота (не меньше 1)
+ *                        - 0 неверное расписание
+ */
+uint32_t WVT_W7_Precision_Next_Fire(int32_t schedule, uint32_t now)
+{
+    const uint32_t seconds_per_day = 24 * 3600;
+
+    if (schedule <= 0)
+    {
+        return 0;
+    }
+
+    uint32_t period = seconds_per_day / (uint32_t) schedule;
+    if (period == 0)
+    {
+        period = 1;
+    }
+
+    const uint32_t offset = WVT_W7_Phase_Offset(period);
+    now = ((now % seconds_per_day) + seconds_per_day - offset) % seconds_per_day;
+
+    uint32_t next_slot = (now / period + 1) * period;
+    if (next_slot >= seconds_per_day)
+    {
+        next_slot = seconds_per_day;
+    }
+
+    return next_slot - now;
+}
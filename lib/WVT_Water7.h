@@ -4,6 +4,40 @@
 
 #include <stdint.h>
 
+/*
+ * Модули, которые обрабатывают свои запросы внутри WVT_W7_Parse. Включенный модуль 
+ * нужно собрать вместе с WVT_Water7.c, выключенный не занимает места в прошивке, 
+ * а его запросы получают ответ WVT_W7_ERROR_CODE_INVALID_TYPE
+ */
+#ifndef WVT_W7_ENABLE_SUBSCRIPTIONS
+#define WVT_W7_ENABLE_SUBSCRIPTIONS         0   /*!< Подписки на изменения параметров, WVT_Water7_Subscriptions.c */
+#endif
+
+#ifndef WVT_W7_ENABLE_DIGEST
+#define WVT_W7_ENABLE_DIGEST                0   /*!< Дерево хешей параметров, WVT_Water7_Digest.c */
+#endif
+
+#ifndef WVT_W7_ENABLE_SYNC
+#define WVT_W7_ENABLE_SYNC                  0   /*!< Чтение изменившихся параметров, WVT_Water7_Sync.c */
+#endif
+
+#ifndef WVT_W7_ENABLE_DEFERRED
+#define WVT_W7_ENABLE_DEFERRED              0   /*!< Отложенные ответы в регулярных сообщениях, WVT_Water7_Deferred.c */
+#endif
+
+#ifndef WVT_W7_ENABLE_ARCHIVE
+#define WVT_W7_ENABLE_ARCHIVE               0   /*!< Чтение архива, WVT_Water7_Archive.c */
+#endif
+
+#ifndef WVT_W7_ENABLE_FIRMWARE
+#define WVT_W7_ENABLE_FIRMWARE              0   /*!< Встроенное обновление прошивки, WVT_Water7_Firmware.c, WVT_Water7_Patch.c,
+                                                     WVT_Water7_Lz.c и WVT_Water7_Crc32.c. Выключенное - пакеты передаются в rfl_handler */
+#endif
+
+#ifndef WVT_W7_ENABLE_CONTROL
+#define WVT_W7_ENABLE_CONTROL               0   /*!< Очередь результатов долгих команд CONTROL, WVT_Water7_Control.c */
+#endif
+
 #define WVT_W7_ERROR_FLAG					0x40
 #define WVT_W7_REGULAR_MESSAGE_FLAG			0x80
 
@@ -16,12 +50,22 @@
 #define WVT_W7_READ_SINGLE_LENGTH   	   	3UL
 #define WVT_W7_WRITE_SINGLE_LENGTH   	   	7UL
 #define WVT_W7_EVENT_LENGTH   	        	7UL
+#define WVT_W7_MODIFY_LENGTH   	        	8UL
+#define WVT_W7_COMPARE_AND_SWAP_LENGTH      12UL
+#define WVT_W7_CONTROL_LENGTH               7UL
 
 #define WVT_W7_PARAMETER_WIDTH              4   /*!< Число байт, выделенное под храниние параметра */
 #define WVT_W7_MULTI_DATA_OFFSET            5   /*!< Начало данных в пакетах с несколькими параметрами */
 #define WVT_W7_SINGLE_DATA_OFFSET           3   /*!< Начало данных в пакетах с одним параметром */
 #define WVT_W7_ADDITIONAL_DATA_OFFSET       7   /*!< Начало дополнительных данных в регулярном сообщении */
 #define WVT_W7_ADDITIONAL_DATA_WIDTH        5   /*!< Число байт, выделенно под каждый дополнительный параметр */
+#define WVT_W7_LONG_REGULAR_DATA_OFFSET     10  /*!< Начало параметров в длинном регулярном сообщении: тип, расписание, значение, флаги, число параметров */
+#define WVT_W7_LONG_REGULAR_DELTA           0x01    /*!< Флаг длинного регулярного сообщения: значения кодируются разностью с предыдущим */
+#define WVT_W7_TAGGED_DATA_OFFSET           2   /*!< Начало вложенного запроса или ответа после тега последовательности */
+#define WVT_W7_VARINT_MAX_LENGTH            5   /*!< Наибольшая длина 32-битного числа в формате varint */
+#define WVT_W7_PAIR_BATCH_DATA_OFFSET       7   /*!< Начало часовых разностей в пакете с пачкой парных событий */
+#define WVT_W7_PAIR_BATCH_DIFF_WIDTH        2   /*!< Число байт, выделенное под одну часовую разность */
+#define WVT_W7_PAIR_BATCH_MAX               ((WVT_W7_BUFFER_SIZE - WVT_W7_PAIR_BATCH_DATA_OFFSET) / WVT_W7_PAIR_BATCH_DIFF_WIDTH)
 
 typedef enum
 {
@@ -31,20 +75,36 @@ typedef enum
     WVT_W7_ERROR_CODE_INVALID_VALUE		= 0x03,
     WVT_W7_ERROR_CODE_LL_ERROR			= 0x04,
     WVT_W7_ERROR_CODE_READ_ONLY		    = 0x05,
-    WVT_W7_ERROR_CODE_INVALID_LENGTH    = 0x06
+    WVT_W7_ERROR_CODE_INVALID_LENGTH    = 0x06,
+    WVT_W7_ERROR_CODE_BUSY              = 0x07  /*!< Операция с памятью не завершена (см. WVT_W7_Resume), 
+                                                     в ответе - устройство занято, запрос нужно повторить */
 } WVT_W7_Error_t;
 
 typedef enum
 {
     WVT_W7_PACKET_TYPE_READ_MULTIPLE	= 0x03,
+    WVT_W7_PACKET_TYPE_READ_MULTIPLE_PACKED	= 0x04,
     WVT_W7_PACKET_TYPE_WRITE_SINGLE		= 0x06,
     WVT_W7_PACKET_TYPE_READ_SINGLE		= 0x07,
     WVT_W7_PACKET_TYPE_WRITE_MULTIPLE	= 0x10,
+    WVT_W7_PACKET_TYPE_MODIFY       	= 0x16,
     WVT_W7_PACKET_TYPE_ECHO				= 0x19,
     WVT_W7_PACKET_TYPE_EVENT			= 0x20,
     WVT_W7_PACKET_TYPE_PAIR_EVENT       = 0x21,
+    WVT_W7_PACKET_TYPE_MULTI_EVENT      = 0x22,
+    WVT_W7_PACKET_TYPE_PAIR_EVENT_BATCH = 0x23,
+    WVT_W7_PACKET_TYPE_LONG_REGULAR     = 0x24,
+    WVT_W7_PACKET_TYPE_SERIES           = 0x25,
     WVT_W7_PACKET_TYPE_CONTROL			= 0x27,
-    WVT_W7_PACKET_TYPE_FW_UPDATE		= 0x29
+    WVT_W7_PACKET_TYPE_CONTROL_RESULT   = 0x28,
+    WVT_W7_PACKET_TYPE_FW_UPDATE		= 0x29,
+    WVT_W7_PACKET_TYPE_SUBSCRIBE        = 0x2A,
+    WVT_W7_PACKET_TYPE_NOTIFY           = 0x2B,
+    WVT_W7_PACKET_TYPE_DIGEST           = 0x2C,
+    WVT_W7_PACKET_TYPE_READ_CHANGED     = 0x2D,
+    WVT_W7_PACKET_TYPE_READ_ARCHIVE     = 0x2E,
+    WVT_W7_PACKET_TYPE_NO_ACK           = 0x30,
+    WVT_W7_PACKET_TYPE_TAGGED           = 0x31
 } WVT_W7_Packet_t;
    
 typedef enum
@@ -55,6 +115,14 @@ typedef enum
     WVT_W7_TIMEOUT = 0x03U
 } WVT_W7_Status_t;
 
+typedef enum
+{
+    WVT_W7_MODIFY_SET_BITS          = 0x00, /*!< Установить биты маски */
+    WVT_W7_MODIFY_CLEAR_BITS        = 0x01, /*!< Сбросить биты маски */
+    WVT_W7_MODIFY_ADD_SATURATED     = 0x02, /*!< Прибавить число с насыщением */
+    WVT_W7_MODIFY_COMPARE_AND_SWAP  = 0x03  /*!< Записать новое значение, если текущее равно ожидаемому */
+} WVT_W7_Modify_Operation_t;
+
 typedef enum
 {
     WVT_W7_PARAMETER_READ,
@@ -70,13 +138,38 @@ typedef struct
 typedef struct
 {
     WVT_W7_Error_t(*rom_read)(uint16_t address, int32_t * value);   /*!< Внешняя функция чтения данных из постоянной памяти */
-    WVT_W7_Error_t(*rom_write)(uint16_t address, int32_t value);    /*!< Внешняя функция записи данных в постоянную память */
+    WVT_W7_Error_t(*rom_write)(uint16_t address, int32_t value);    /*!< Внешняя функция записи данных в постоянную память. 
+                                                                         Обе функции могут вернуть WVT_W7_ERROR_CODE_BUSY, см. WVT_W7_Resume */
     WVT_W7_Error_t(*rfl_handler)(uint8_t * data, uint16_t length, 
         uint8_t * responce_buffer, uint16_t * bytes_written);       /*!< Внешняя функция удаленного обновления прошивки */
     WVT_W7_Error_t(*rfl_command)(uint8_t * data, uint16_t length, 
-        uint8_t * responce_buffer, uint16_t * bytes_written);
+        uint8_t * responce_buffer, uint16_t * bytes_written);       /*!< Внешняя функция команд обновления прошивки. 
+                                                                         В обе функции *bytes_written передается равным свободному 
+                                                                         месту в responce_buffer, возвращается длина ответа - не больше его */
 } WVT_W7_Callbacks_t;
 
+/**
+ * Состояние разбора запроса, приостановленного из-за WVT_W7_ERROR_CODE_BUSY (см. WVT_W7_Parse_With).
+ * Счетчики циклов по параметрам хранятся здесь, поэтому при возобновлении 
+ * запрос разбирается заново, а выполненные операции с памятью пропускаются
+ */
+typedef struct
+{
+    const WVT_W7_Callbacks_t * callbacks;   /*!< Функции для запросов с этим состоянием, 0 - зарегистрированные WVT_W7_Register_Callbacks.
+                                                 Собственные функции - память другого устройства: разбираются только запросы 
+                                                 параметров, модули (подписки, дерево хешей, версии, архив, обновление прошивки, 
+                                                 команды, отложенные ответы) хранят состояние этого устройства и не вызываются */
+    uint8_t * data;
+    uint8_t * responce_buffer;
+    uint16_t length;
+    uint16_t parameter;         /*!< Число обработанных параметров запроса */
+    uint16_t position;          /*!< Длина сжатого ответа WVT_W7_Read_Packed */
+    uint32_t previous_value;    /*!< Последнее значение, записанное в сжатый ответ */
+    int32_t value;              /*!< Значение текущего параметра, прочитанное перед записью */
+    uint8_t has_value;
+    uint8_t suspended;          /*!< Запрос ждет завершения операции с памятью и вызова WVT_W7_Resume_With */
+} WVT_W7_Parse_State_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,17 +178,45 @@ extern "C" {
     void WVT_Radio_Callback(uint8_t * data, uint16_t length);
     WVT_W7_Status_t WVT_W7_Register_Callbacks(WVT_W7_Callbacks_t callbacks);
     uint8_t WVT_W7_Parse(uint8_t * data, uint16_t length, uint8_t * responce_buffer);
+    uint8_t WVT_W7_Resume(void);
+    uint8_t WVT_W7_Suspended(void);
+    uint8_t WVT_W7_Parse_With(WVT_W7_Parse_State_t * state, uint8_t * data, uint16_t length, uint8_t * responce_buffer);
+    uint8_t WVT_W7_Resume_With(WVT_W7_Parse_State_t * state);
+    WVT_W7_Status_t WVT_W7_Unpack_Multiple(const uint8_t * data, uint16_t length,
+        uint16_t * address, int32_t * values, uint16_t * count);
+    uint8_t WVT_W7_Put_Varint(uint32_t value, uint8_t * data);
+    uint8_t WVT_W7_Get_Varint(const uint8_t * data, uint16_t length, uint32_t * value);
+    uint32_t WVT_W7_Zigzag(uint32_t delta);
+    uint32_t WVT_W7_Unzigzag(uint32_t value);
     uint8_t WVT_W7_Short_Regular(
         uint8_t * responce_buffer,
         int32_t payload,
         uint8_t parameter_number,
         uint16_t schedule, 
         int32_t additional_parameters);
+    uint8_t WVT_W7_Long_Regular(
+        uint8_t * responce_buffer,
+        int32_t payload,
+        uint16_t schedule,
+        const uint16_t * addresses,
+        uint16_t count,
+        uint8_t flags,
+        uint16_t * packed);
+    WVT_W7_Status_t WVT_W7_Long_Regular_Decode(const uint8_t * data, uint16_t length,
+        int32_t * payload, uint16_t * schedule, uint16_t * addresses, int32_t * values, uint16_t * count);
     uint8_t WVT_W7_Event(uint16_t event, uint16_t payload, uint8_t * responce_buffer);
     uint8_t WVT_W7_PairEvent(uint8_t par, uint32_t value, uint16_t diff,  uint8_t * responce_buffer);
+    uint8_t WVT_W7_PairEvent_Batch(uint8_t par, uint32_t value, const uint16_t * diffs, uint8_t count,
+        uint8_t * responce_buffer);
+    WVT_W7_Status_t WVT_W7_PairEvent_Batch_Decode(const uint8_t * data, uint16_t length, 
+        uint8_t * par, uint32_t * value, uint16_t * diffs, uint8_t * count);
     uint8_t WVT_W7_Parse_Additional_Parameters(uint8_t * parameters, int32_t setting);
+    uint32_t WVT_W7_Mix(uint32_t hash);
+    void WVT_W7_Set_Phase_Seed(uint32_t seed);
     uint8_t WVT_W7_Scheduler(uint8_t current_hour, uint8_t current_minute, int32_t schedule);
     uint8_t WVT_W7_PrecisionScheduler(uint8_t current_hour, uint8_t current_minute, uint8_t current_second, int32_t schedule); 
+    uint32_t WVT_W7_Next_Fire(int32_t schedule, uint32_t now);
+    uint32_t WVT_W7_Precision_Next_Fire(int32_t schedule, uint32_t now);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,166 @@
+﻿#include "WVT_Water7_Aggregator.h"
+
+typedef struct
+{
+    uint16_t event;
+    uint8_t count;
+    uint16_t payload;
+} WVT_W7_Aggregated_Event_t;
+
+static WVT_W7_Aggregated_Event_t aggregated_events[WVT_W7_AGGREGATOR_CAPACITY];
+static uint8_t aggregated_number = 0;
+static uint32_t window_start = 0;
+static uint32_t window_length = 0;
+static const uint16_t * priority_list = 0;
+static uint8_t priority_list_length = 0;
+
+/**
+ * @brief	Настраивает накопление событий
+ *
+ * @param   window		   	    Длительность окна накопления в секундах.
+ *                              Значение 0 отключает накопление
+ * @param   priority_events		Массив событий, которые отправляются немедленно, минуя окно.
+ *                              Массив должен существовать все время работы библиотеки
+ * @param   priority_count		Число элементов в priority_events
+ */
+void WVT_W7_Aggregator_Init(uint32_t window, const uint16_t * priority_events, uint8_t priority_count)
+{
+    window_length = window;
+    priority_list = priority_events;
+    priority_list_length = (priority_events != 0) ? priority_count : 0;
+    aggregated_number = 0;
+}
+
+/**
+ * @brief	Проверяет, входит ли событие в список приоритетных
+ */
+static uint8_t WVT_W7_Is_Priority_Event(uint16_t event)
+{
+    for (uint8_t i = 0; i < priority_list_length; i++)
+    {
+        if (priority_list[i] == event)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief	    Добавляет событие в текущее окно накопления.
+ *              Повторы события с тем же идентификатором увеличивают счетчик,
+ *              значение берется из последнего повтора.
+ *              Приоритетное событие сразу формирует обычный пакет о событии.
+ *              Если в окне не осталось места, накопленные события выгружаются 
+ *              в выходной буфер, а новое событие открывает следующее окно.
+ *
+ * @param 	   	event		   	Тип события
+ * @param 	   	payload		   	Полезная нагрузка события
+ * @param 	   	now		   	    Текущее время в секундах
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если отправлять нечего).
+ */
+uint8_t WVT_W7_Aggregator_Add(uint16_t event, uint16_t payload, uint32_t now, uint8_t * responce_buffer)
+{
+    uint8_t responce_length = 0;
+
+    if (    (window_length == 0)
+        ||  WVT_W7_Is_Priority_Event(event)  )
+    {
+        return WVT_W7_Event(event, payload, responce_buffer);
+    }
+
+    for (uint8_t i = 0; i < aggregated_number; i++)
+    {
+        if (aggregated_events[i].event == event)
+        {
+            if (aggregated_events[i].count < UINT8_MAX)
+            {
+                aggregated_events[i].count++;
+            }
+            aggregated_events[i].payload = payload;
+            return 0;
+        }
+    }
+
+    if (aggregated_number == WVT_W7_AGGREGATOR_CAPACITY)
+    {
+        responce_length = WVT_W7_Aggregator_Flush(responce_buffer);
+    }
+
+    if (aggregated_number == 0)
+    {
+        window_start = now;
+    }
+
+    aggregated_events[aggregated_number].event = event;
+    aggregated_events[aggregated_number].count = 1;
+    aggregated_events[aggregated_number].payload = payload;
+    aggregated_number++;
+
+    return responce_length;
+}
+
+/**
+ * @brief	    Проверяет, закрылось ли окно накопления, и если да - 
+ *              формирует пакет с накопленными событиями
+ *
+ * @param 	   	now		   	    Текущее время в секундах
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если окно еще открыто).
+ */
+uint8_t WVT_W7_Aggregator_Poll(uint32_t now, uint8_t * responce_buffer)
+{
+    if (    (aggregated_number == 0)
+        ||  ((now - window_start) < window_length)  )
+    {
+        return 0;
+    }
+
+    return WVT_W7_Aggregator_Flush(responce_buffer);
+}
+
+/**
+ * @brief	    Формирует пакет с накопленными событиями, не дожидаясь закрытия окна.
+ *              Единственное событие без повторов отправляется обычным пакетом о событии.
+ *
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если событий нет).
+ */
+uint8_t WVT_W7_Aggregator_Flush(uint8_t * responce_buffer)
+{
+    if (aggregated_number == 0)
+    {
+        return 0;
+    }
+
+    if (    (aggregated_number == 1)
+        &&  (aggregated_events[0].count == 1)  )
+    {
+        aggregated_number = 0;
+        return WVT_W7_Event(aggregated_events[0].event, aggregated_events[0].payload, responce_buffer);
+    }
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_MULTI_EVENT;
+    responce_buffer[1] = aggregated_number;
+
+    for (uint8_t i = 0; i < aggregated_number; i++)
+    {
+        uint8_t * entry = responce_buffer + WVT_W7_MULTI_EVENT_DATA_OFFSET + (i * WVT_W7_MULTI_EVENT_WIDTH);
+
+        entry[0] = (aggregated_events[i].event >> 8);
+        entry[1] =  aggregated_events[i].event;
+        entry[2] =  aggregated_events[i].count;
+        entry[3] = (aggregated_events[i].payload >> 8);
+        entry[4] =  aggregated_events[i].payload;
+    }
+
+    const uint8_t responce_length = WVT_W7_MULTI_EVENT_DATA_OFFSET + (aggregated_number * WVT_W7_MULTI_EVENT_WIDTH);
+    aggregated_number = 0;
+
+    return responce_length;
+}
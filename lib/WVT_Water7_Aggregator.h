@@ -0,0 +1,29 @@
+﻿#pragma once
+#ifndef WVT_WATER7_AGGREGATOR_H_
+#define WVT_WATER7_AGGREGATOR_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_AGGREGATOR_CAPACITY
+#define WVT_W7_AGGREGATOR_CAPACITY          8   /*!< Число разных событий, накапливаемых за одно окно */
+#endif
+
+#define WVT_W7_MULTI_EVENT_DATA_OFFSET      2   /*!< Начало записей в пакете с несколькими событиями */
+#define WVT_W7_MULTI_EVENT_WIDTH            5   /*!< Число байт на запись: идентификатор, счетчик, значение */
+
+#if (WVT_W7_MULTI_EVENT_DATA_OFFSET + (WVT_W7_AGGREGATOR_CAPACITY * WVT_W7_MULTI_EVENT_WIDTH)) > WVT_W7_BUFFER_SIZE
+#error "WVT_W7_AGGREGATOR_CAPACITY does not fit into WVT_W7_BUFFER_SIZE"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void WVT_W7_Aggregator_Init(uint32_t window, const uint16_t * priority_events, uint8_t priority_count);
+    uint8_t WVT_W7_Aggregator_Add(uint16_t event, uint16_t payload, uint32_t now, uint8_t * responce_buffer);
+    uint8_t WVT_W7_Aggregator_Poll(uint32_t now, uint8_t * responce_buffer);
+    uint8_t WVT_W7_Aggregator_Flush(uint8_t * responce_buffer);
+#ifdef __cplusplus
+}
+#endif
+#endif 
@@ -0,0 +1,461 @@
+﻿#include "WVT_Water7_Archive.h"
+
+/** Отсчет архива и состояние разностного кодирования */
+typedef struct
+{
+    uint32_t timestamp;
+    uint32_t delta;
+    uint32_t value;
+} WVT_W7_Archive_Sample_t;
+
+/** Положение при чтении страницы */
+typedef struct
+{
+    uint16_t page;
+    uint16_t offset;
+    WVT_W7_Archive_Sample_t sample;
+} WVT_W7_Archive_Cursor_t;
+
+static const WVT_W7_Archive_Storage_t * archive_storage = 0;
+static WVT_W7_Archive_Cursor_t archive_head;
+static uint32_t archive_sequence = 0;
+static uint8_t archive_empty = 1;
+
+/**
+ * @brief	Читает заголовок страницы
+ *
+ * @returns	1 - страница записана
+ */
+static uint8_t WVT_W7_Archive_Header(uint16_t page, uint32_t * sequence, WVT_W7_Archive_Sample_t * sample)
+{
+    uint8_t header[WVT_W7_ARCHIVE_HEADER_SIZE];
+
+    if (    (archive_storage->read((uint32_t) page * WVT_W7_ARCHIVE_PAGE_SIZE, header, sizeof(header)) != WVT_W7_ERROR_CODE_OK)
+        ||  (((header[0] << 8) + header[1]) != WVT_W7_ARCHIVE_MAGIC)  )
+    {
+        return 0;
+    }
+
+    *sequence = ((uint32_t) header[2] << 24) + ((uint32_t) header[3] << 16) + ((uint32_t) header[4] << 8) + header[5];
+    sample->timestamp = ((uint32_t) header[6] << 24) + ((uint32_t) header[7] << 16) + ((uint32_t) header[8] << 8) + header[9];
+    sample->value = ((uint32_t) header[10] << 24) + ((uint32_t) header[11] << 16) + ((uint32_t) header[12] << 8) + header[13];
+    sample->delta = 0;
+    return 1;
+}
+
+/**
+ * @brief	Переходит к следующему отсчету страницы.
+ *          Запись состоит из длины и двух varint: разности соседних интервалов
+ *          времени и разности значений, обе в zigzag.
+ *
+ * @returns	1 - отсчет прочитан, 0 - страница закончилась
+ */
+static uint8_t WVT_W7_Archive_Next(WVT_W7_Archive_Cursor_t * cursor)
+{
+    const uint32_t address = ((uint32_t) cursor->page * WVT_W7_ARCHIVE_PAGE_SIZE) + cursor->offset;
+    uint8_t record[WVT_W7_ARCHIVE_RECORD_MAX];
+    uint32_t delta_of_delta;
+    uint32_t value_delta;
+
+    if (    ((cursor->offset + 1) > WVT_W7_ARCHIVE_PAGE_SIZE)
+        ||  (archive_storage->read(address, record, 1) != WVT_W7_ERROR_CODE_OK)
+        ||  (record[0] >= WVT_W7_ARCHIVE_RECORD_MAX)
+        ||  ((cursor->offset + 1 + record[0]) > WVT_W7_ARCHIVE_PAGE_SIZE)
+        ||  (archive_storage->read(address + 1, record + 1, record[0]) != WVT_W7_ERROR_CODE_OK)  )
+    {
+        return 0;
+    }
+
+    const uint8_t time_length = WVT_W7_Get_Varint(record + 1, record[0], &delta_of_delta);
+    if (    (time_length == 0)
+        ||  (WVT_W7_Get_Varint(record + 1 + time_length, (uint16_t) (record[0] - time_length), &value_delta) == 0)  )
+    {
+        return 0;
+    }
+
+    cursor->sample.delta += WVT_W7_Unzigzag(delta_of_delta);
+    cursor->sample.timestamp += cursor->sample.delta;
+    cursor->sample.value += WVT_W7_Unzigzag(value_delta);
+    cursor->offset += (uint16_t) (1 + record[0]);
+    return 1;
+}
+
+/**
+ * @brief	Подключает архив к флеш-памяти и находит место записи.
+ *          Последней записанной считается страница с наибольшим номером,
+ *          последний отсчет - перед первой стертой записью на ней.
+ *
+ * @param 	storage		Функции доступа к флеш-памяти. Структура должна существовать 
+ *                      все время работы библиотеки
+ *
+ * @returns	- WVT_W7_OK     Архив готов
+ *          - WVT_W7_ERROR  Не переданы функции доступа к памяти
+ */
+WVT_W7_Status_t WVT_W7_Archive_Init(const WVT_W7_Archive_Storage_t * storage)
+{
+    if (    (storage == 0)
+        ||  (storage->read == 0)
+        ||  (storage->write == 0)
+        ||  (storage->erase == 0)   )
+    {
+        archive_storage = 0;
+        return WVT_W7_ERROR;
+    }
+
+    archive_storage = storage;
+    archive_empty = 1;
+    archive_sequence = 0;
+    archive_head.page = WVT_W7_ARCHIVE_PAGES - 1;
+
+    for (uint16_t page = 0; page < WVT_W7_ARCHIVE_PAGES; page++)
+    {
+        uint32_t sequence;
+        WVT_W7_Archive_Sample_t sample;
+
+        if (    WVT_W7_Archive_Header(page, &sequence, &sample)
+            &&  (archive_empty || ((int32_t) (sequence - archive_sequence) > 0))  )
+        {
+            archive_empty = 0;
+            archive_sequence = sequence;
+            archive_head.page = page;
+            archive_head.sample = sample;
+        }
+    }
+
+    if (archive_empty == 0)
+    {
+        archive_head.offset = WVT_W7_ARCHIVE_HEADER_SIZE;
+        while (WVT_W7_Archive_Next(&archive_head))
+        {
+        }
+    }
+
+    return WVT_W7_OK;
+}
+
+/**
+ * @brief	Стирает архив
+ */
+WVT_W7_Status_t WVT_W7_Archive_Format(void)
+{
+    if (archive_storage == 0)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    for (uint16_t page = 0; page < WVT_W7_ARCHIVE_PAGES; page++)
+    {
+        if (archive_storage->erase((uint32_t) page * WVT_W7_ARCHIVE_PAGE_SIZE) != WVT_W7_ERROR_CODE_OK)
+        {
+            return WVT_W7_ERROR;
+        }
+    }
+
+    archive_empty = 1;
+    archive_sequence = 0;
+    archive_head.page = WVT_W7_ARCHIVE_PAGES - 1;
+    return WVT_W7_OK;
+}
+
+/**
+ * @brief	Стирает следующую страницу кольца и записывает в ее заголовок первый отсчет.
+ *          Самая старая страница архива при этом теряется.
+ */
+static WVT_W7_Error_t WVT_W7_Archive_Start_Page(uint32_t timestamp, uint32_t value)
+{
+    const uint16_t page = (uint16_t) ((archive_head.page + 1) % WVT_W7_ARCHIVE_PAGES);
+    const uint32_t sequence = archive_empty ? 0 : (archive_sequence + 1);
+    const uint8_t header[WVT_W7_ARCHIVE_HEADER_SIZE] = {
+        (uint8_t) (WVT_W7_ARCHIVE_MAGIC >> 8), (uint8_t) WVT_W7_ARCHIVE_MAGIC,
+        (uint8_t) (sequence >> 24), (uint8_t) (sequence >> 16), (uint8_t) (sequence >> 8), (uint8_t) sequence,
+        (uint8_t) (timestamp >> 24), (uint8_t) (timestamp >> 16), (uint8_t) (timestamp >> 8), (uint8_t) timestamp,
+        (uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value };
+    WVT_W7_Error_t result = archive_storage->erase((uint32_t) page * WVT_W7_ARCHIVE_PAGE_SIZE);
+
+    if (result == WVT_W7_ERROR_CODE_OK)
+    {
+        result = archive_storage->write((uint32_t) page * WVT_W7_ARCHIVE_PAGE_SIZE, header, sizeof(header));
+    }
+    if (result != WVT_W7_ERROR_CODE_OK)
+    {
+        return result;
+    }
+
+    archive_empty = 0;
+    archive_sequence = sequence;
+    archive_head.page = page;
+    archive_head.offset = WVT_W7_ARCHIVE_HEADER_SIZE;
+    archive_head.sample.timestamp = timestamp;
+    archive_head.sample.delta = 0;
+    archive_head.sample.value = value;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Добавляет отсчет в архив. Время отсчетов должно возрастать.
+ *
+ * @param 	timestamp	Время отсчета в секундах
+ * @param 	value		Значение
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Отсчет записан
+ *          - WVT_W7_ERROR_CODE_INVALID_TYPE    Архив не подключен
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Время не больше времени последнего отсчета
+ *          - Код ошибки функций доступа к памяти
+ */
+WVT_W7_Error_t WVT_W7_Archive_Append(uint32_t timestamp, int32_t value)
+{
+    uint8_t record[WVT_W7_ARCHIVE_RECORD_MAX];
+
+    if (archive_storage == 0)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_TYPE;
+    }
+
+    if (archive_empty)
+    {
+        return WVT_W7_Archive_Start_Page(timestamp, (uint32_t) value);
+    }
+
+    if ((int32_t) (timestamp - archive_head.sample.timestamp) <= 0)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    const uint32_t delta = timestamp - archive_head.sample.timestamp;
+    record[0] = WVT_W7_Put_Varint(WVT_W7_Zigzag(delta - archive_head.sample.delta), record + 1);
+    record[0] += WVT_W7_Put_Varint(WVT_W7_Zigzag((uint32_t) value - archive_head.sample.value), record + 1 + record[0]);
+
+    if ((archive_head.offset + 1 + record[0]) > WVT_W7_ARCHIVE_PAGE_SIZE)
+    {
+        return WVT_W7_Archive_Start_Page(timestamp, (uint32_t) value);
+    }
+
+    const WVT_W7_Error_t result = archive_storage->write(
+        ((uint32_t) archive_head.page * WVT_W7_ARCHIVE_PAGE_SIZE) + archive_head.offset, record, (uint16_t) (1 + record[0]));
+    if (result != WVT_W7_ERROR_CODE_OK)
+    {
+        return result;
+    }
+
+    archive_head.offset += (uint16_t) (1 + record[0]);
+    archive_head.sample.timestamp = timestamp;
+    archive_head.sample.delta = delta;
+    archive_head.sample.value = (uint32_t) value;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Читает из архива отсчеты с временем от T1 до T2 включительно.
+ *          Первый отсчет записывается без сжатия, остальные - как в архиве: 
+ *          varint разностей интервалов и значений. Если отсчеты не поместились,
+ *          в ответе выставляется признак продолжения и время первого неотправленного 
+ *          отсчета: сервер продолжает чтение, повторив запрос с этим временем вместо T1.
+ *          Страницы, все отсчеты которых раньше T1, пропускаются по заголовку следующей страницы.
+ *
+ * @param [in] 	data		   	Запрос: тип, T1 (4 байта), T2 (4 байта)
+ * @param [out]	responce_buffer	Буфер с ответом
+ * @param [in/out] responce_length	На входе - размер буфера, на выходе - длина ответа
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Ответ сформирован
+ *          - WVT_W7_ERROR_CODE_INVALID_TYPE    Архив не подключен
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   T1 больше T2
+ *          - WVT_W7_ERROR_CODE_INVALID_LENGTH  Отсчет не помещается в буфер
+ */
+WVT_W7_Error_t WVT_W7_Archive_Read(const uint8_t * data, uint8_t * responce_buffer, uint16_t * responce_length)
+{
+    const uint32_t first = ((uint32_t) data[1] << 24) + ((uint32_t) data[2] << 16) + ((uint32_t) data[3] << 8) + data[4];
+    const uint32_t last = ((uint32_t) data[5] << 24) + ((uint32_t) data[6] << 16) + ((uint32_t) data[7] << 8) + data[8];
+    const uint16_t responce_size = *responce_length;
+    uint16_t position = WVT_W7_READ_ARCHIVE_DATA_OFFSET;
+    uint16_t count = 0;
+    uint8_t more = 0;
+    uint8_t done = archive_empty;
+    uint32_t resume = 0;
+    WVT_W7_Archive_Sample_t previous = { 0, 0, 0 };
+
+    if (archive_storage == 0)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_TYPE;
+    }
+    if (first > last)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+    if ((WVT_W7_READ_ARCHIVE_DATA_OFFSET + WVT_W7_ARCHIVE_SAMPLE_WIDTH) > responce_size)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+    }
+
+    // Страницы просматриваются от самой старой к текущей
+    for (uint16_t step = 1; (done == 0) && (step <= WVT_W7_ARCHIVE_PAGES); step++)
+    {
+        WVT_W7_Archive_Cursor_t cursor;
+        WVT_W7_Archive_Sample_t next_page;
+        uint32_t sequence;
+        uint8_t has_sample;
+
+        cursor.page = (uint16_t) ((archive_head.page + step) % WVT_W7_ARCHIVE_PAGES);
+        cursor.offset = WVT_W7_ARCHIVE_HEADER_SIZE;
+        if (    (WVT_W7_Archive_Header(cursor.page, &sequence, &cursor.sample) == 0)
+            ||  ((archive_sequence - sequence) >= WVT_W7_ARCHIVE_PAGES)  )
+        {
+            continue;
+        }
+
+        if (    (cursor.page != archive_head.page)
+            &&  WVT_W7_Archive_Header((uint16_t) ((cursor.page + 1) % WVT_W7_ARCHIVE_PAGES), &sequence, &next_page)
+            &&  (next_page.timestamp <= first)  )
+        {
+            continue;
+        }
+
+        for (has_sample = 1; has_sample; has_sample = WVT_W7_Archive_Next(&cursor))
+        {
+            const WVT_W7_Archive_Sample_t sample = cursor.sample;
+            uint8_t encoded[2 * WVT_W7_VARINT_MAX_LENGTH];
+            uint8_t encoded_length;
+
+            if (sample.timestamp < first)
+            {
+                continue;
+            }
+            if (sample.timestamp > last)
+            {
+                done = 1;
+                break;
+            }
+
+            if (count == 0)
+            {
+                for (uint8_t i = 0; i < 4; i++)
+                {
+                    encoded[i] = (uint8_t) (sample.timestamp >> (24 - (8 * i)));
+                    encoded[4 + i] = (uint8_t) (sample.value >> (24 - (8 * i)));
+                }
+                encoded_length = WVT_W7_ARCHIVE_SAMPLE_WIDTH;
+                previous.delta = 0;
+            }
+            else
+            {
+                const uint32_t delta = sample.timestamp - previous.timestamp;
+                encoded_length = WVT_W7_Put_Varint(WVT_W7_Zigzag(delta - previous.delta), encoded);
+                encoded_length += WVT_W7_Put_Varint(WVT_W7_Zigzag(sample.value - previous.value), encoded + encoded_length);
+                previous.delta = delta;
+            }
+
+            if ((position + encoded_length) > responce_size)
+            {
+                more = 1;
+                done = 1;
+                resume = sample.timestamp;
+                break;
+            }
+
+            for (uint8_t i = 0; i < encoded_length; i++)
+            {
+                responce_buffer[position++] = encoded[i];
+            }
+            previous.timestamp = sample.timestamp;
+            previous.value = sample.value;
+            count++;
+        }
+    }
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_READ_ARCHIVE;
+    responce_buffer[1] = more;
+    responce_buffer[2] = (resume >> 24);
+    responce_buffer[3] = (resume >> 16);
+    responce_buffer[4] = (resume >> 8);
+    responce_buffer[5] =  resume;
+    responce_buffer[6] = (count >> 8);
+    responce_buffer[7] =  count;
+    *responce_length = position;
+
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Разбирает ответ на чтение архива (на стороне сервера)
+ *
+ * @param 	   	data		   	Принятый пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	timestamps	   	Время отсчетов
+ * @param [out]	values		   	Значения отсчетов
+ * @param [in/out] count		На входе - размер массивов, на выходе - число отсчетов
+ * @param [out]	more		   	1 - отсчеты не поместились, чтение нужно продолжить
+ * @param [out]	resume		   	Время, с которого нужно продолжить чтение
+ *
+ * @returns	- WVT_W7_OK     Пакет разобран
+ *          - WVT_W7_ERROR  Неверный тип или формат пакета, либо отсчеты не помещаются в массивы
+ */
+WVT_W7_Status_t WVT_W7_Archive_Decode(const uint8_t * data, uint16_t length,
+    uint32_t * timestamps, int32_t * values, uint16_t * count, uint8_t * more, uint32_t * resume)
+{
+    if (    (data == 0)
+        ||  (length < WVT_W7_READ_ARCHIVE_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_READ_ARCHIVE)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    const uint16_t number_of_samples = (uint16_t) ((data[6] << 8) + data[7]);
+    uint16_t position = WVT_W7_READ_ARCHIVE_DATA_OFFSET;
+    uint32_t timestamp = 0;
+    uint32_t delta = 0;
+    uint32_t value = 0;
+
+    if (number_of_samples > *count)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    for (uint16_t i = 0; i < number_of_samples; i++)
+    {
+        if (i == 0)
+        {
+            if ((position + WVT_W7_ARCHIVE_SAMPLE_WIDTH) > length)
+            {
+                return WVT_W7_ERROR;
+            }
+            timestamp = ((uint32_t) data[8] << 24) + ((uint32_t) data[9] << 16) + ((uint32_t) data[10] << 8) + data[11];
+            value = ((uint32_t) data[12] << 24) + ((uint32_t) data[13] << 16) + ((uint32_t) data[14] << 8) + data[15];
+            position += WVT_W7_ARCHIVE_SAMPLE_WIDTH;
+        }
+        else
+        {
+            uint32_t delta_of_delta;
+            uint32_t value_delta;
+            uint8_t encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &delta_of_delta);
+
+            if (encoded_length == 0)
+            {
+                return WVT_W7_ERROR;
+            }
+            position += encoded_length;
+
+            encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &value_delta);
+            if (encoded_length == 0)
+            {
+                return WVT_W7_ERROR;
+            }
+            position += encoded_length;
+
+            delta += WVT_W7_Unzigzag(delta_of_delta);
+            timestamp += delta;
+            value += WVT_W7_Unzigzag(value_delta);
+        }
+
+        timestamps[i] = timestamp;
+        values[i] = (int32_t) value;
+    }
+
+    if (position != length)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    *count = number_of_samples;
+    *more = data[1];
+    *resume = ((uint32_t) data[2] << 24) + ((uint32_t) data[3] << 16) + ((uint32_t) data[4] << 8) + data[5];
+    return WVT_W7_OK;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+#ifndef WVT_WATER7_ARCHIVE_H_
+#define WVT_WATER7_ARCHIVE_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_ARCHIVE_PAGE_SIZE
+#define WVT_W7_ARCHIVE_PAGE_SIZE            256 /*!< Размер стираемой страницы флеш-памяти архива */
+#endif
+
+#ifndef WVT_W7_ARCHIVE_PAGES
+#define WVT_W7_ARCHIVE_PAGES                16  /*!< Число страниц в кольце архива */
+#endif
+
+#define WVT_W7_ARCHIVE_MAGIC                0xA7C5  /*!< Признак записанного заголовка страницы */
+#define WVT_W7_ARCHIVE_HEADER_SIZE          14  /*!< Заголовок страницы: признак, номер страницы, время и значение первого отсчета */
+#define WVT_W7_ARCHIVE_RECORD_MAX           (1 + (2 * WVT_W7_VARINT_MAX_LENGTH))
+#define WVT_W7_READ_ARCHIVE_LENGTH          9UL
+#define WVT_W7_READ_ARCHIVE_DATA_OFFSET     8   /*!< Начало отсчетов в ответе: тип, признак продолжения, время продолжения, число отсчетов */
+#define WVT_W7_ARCHIVE_SAMPLE_WIDTH         8   /*!< Первый отсчет ответа: время и значение без сжатия */
+
+#if (WVT_W7_ARCHIVE_PAGES < 2)
+#error "WVT_W7_ARCHIVE_PAGES must be at least 2"
+#endif
+
+#if (WVT_W7_ARCHIVE_PAGE_SIZE < (WVT_W7_ARCHIVE_HEADER_SIZE + WVT_W7_ARCHIVE_RECORD_MAX)) || (WVT_W7_ARCHIVE_PAGE_SIZE > 0xFFFF)
+#error "WVT_W7_ARCHIVE_PAGE_SIZE does not fit a page header and a record"
+#endif
+
+/**
+ * Функции доступа к флеш-памяти архива. Смещения отсчитываются от начала области архива
+ * размером WVT_W7_ARCHIVE_PAGES * WVT_W7_ARCHIVE_PAGE_SIZE байт. 
+ * Стертая память читается как 0xFF.
+ */
+typedef struct
+{
+    WVT_W7_Error_t(*read)(uint32_t offset, uint8_t * data, uint16_t length);
+    WVT_W7_Error_t(*write)(uint32_t offset, const uint8_t * data, uint16_t length);
+    WVT_W7_Error_t(*erase)(uint32_t offset);                                        /*!< Стирает страницу, начинающуюся с offset */
+} WVT_W7_Archive_Storage_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    WVT_W7_Status_t WVT_W7_Archive_Init(const WVT_W7_Archive_Storage_t * storage);
+    WVT_W7_Status_t WVT_W7_Archive_Format(void);
+    WVT_W7_Error_t WVT_W7_Archive_Append(uint32_t timestamp, int32_t value);
+    WVT_W7_Error_t WVT_W7_Archive_Read(const uint8_t * data, uint8_t * responce_buffer, uint16_t * responce_length);
+    WVT_W7_Status_t WVT_W7_Archive_Decode(const uint8_t * data, uint16_t length,
+        uint32_t * timestamps, int32_t * values, uint16_t * count, uint8_t * more, uint32_t * resume);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,133 @@
+﻿#include "WVT_Water7_Control.h"
+
+static uint8_t control_queue[WVT_W7_CONTROL_QUEUE_SIZE];
+static uint8_t control_used = 0;
+static uint8_t control_ticket = 0;
+
+/**
+ * @brief	Возвращает номер, который получит команда, если rfl_command вернет 
+ *          WVT_W7_ERROR_CODE_BUSY. Вызывается из rfl_command: по этому номеру 
+ *          приложение сообщает о завершении команды в WVT_W7_Control_Complete.
+ */
+uint8_t WVT_W7_Control_Ticket(void)
+{
+    return control_ticket;
+}
+
+/**
+ * @brief	Формирует ответ на долгую команду: команда принята и выполняется.
+ *          Ответ: тип WVT_W7_PACKET_TYPE_CONTROL_RESULT, номер команды, 
+ *          WVT_W7_CONTROL_ACCEPTED и команда без типа, чтобы сервер сопоставил номер с запросом.
+ *
+ * @param [in] 	data		   	Команда WVT_W7_PACKET_TYPE_CONTROL длиной WVT_W7_CONTROL_LENGTH
+ * @param [out]	responce_buffer	Буфер ответа
+ * @param 	   	responce_size  	Доступное место в буфере
+ *
+ * @returns	Длина ответа
+ */
+uint8_t WVT_W7_Control_Accept(const uint8_t * data, uint8_t * responce_buffer, uint16_t responce_size)
+{
+    if (responce_size < WVT_W7_CONTROL_ACCEPTED_LENGTH)
+    {
+        responce_buffer[0] = (data[0] | WVT_W7_ERROR_FLAG);
+        responce_buffer[1] = WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        return WVT_W7_ERROR_RESPONCE_LENGTH;
+    }
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_CONTROL_RESULT;
+    responce_buffer[1] = control_ticket++;
+    responce_buffer[2] = WVT_W7_CONTROL_ACCEPTED;
+    for (uint8_t i = 1; i < WVT_W7_CONTROL_LENGTH; i++)
+    {
+        responce_buffer[2 + i] = data[i];
+    }
+    return WVT_W7_CONTROL_ACCEPTED_LENGTH;
+}
+
+/**
+ * @brief	Ставит в очередь кадр завершения долгой команды: тип WVT_W7_PACKET_TYPE_CONTROL_RESULT,
+ *          номер команды, WVT_W7_CONTROL_COMPLETED, код результата и данные результата.
+ *			Кадры забирает приложение через WVT_W7_Control_Next, в том же контексте: 
+ *			обе функции меняют control_used без блокировок.
+ *
+ * @param 	   	ticket	Номер команды из WVT_W7_Control_Ticket
+ * @param 	   	result	Результат выполнения
+ * @param [in] 	data  	Данные результата, может быть 0 при length == 0
+ * @param 	   	length	Длина данных, не больше WVT_W7_CONTROL_MAX_RESULT
+ *
+ * @returns	1 - кадр поставлен в очередь, 0 - очередь заполнена или данные слишком длинные.
+ */
+uint8_t WVT_W7_Control_Complete(uint8_t ticket, WVT_W7_Error_t result, const uint8_t * data, uint8_t length)
+{
+    const uint8_t frame_length = (uint8_t) (WVT_W7_CONTROL_RESULT_DATA_OFFSET + length);
+
+    if (    (length > WVT_W7_CONTROL_MAX_RESULT)
+        ||  ((length > 0) && (data == 0))
+        ||  ((control_used + frame_length + 1) > WVT_W7_CONTROL_QUEUE_SIZE)  )
+    {
+        return 0;
+    }
+
+    control_queue[control_used++] = frame_length;
+    control_queue[control_used++] = WVT_W7_PACKET_TYPE_CONTROL_RESULT;
+    control_queue[control_used++] = ticket;
+    control_queue[control_used++] = WVT_W7_CONTROL_COMPLETED;
+    control_queue[control_used++] = result;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        control_queue[control_used++] = data[i];
+    }
+    return 1;
+}
+
+/**
+ * @brief	Возвращает число кадров завершения, ожидающих отправки
+ */
+uint8_t WVT_W7_Control_Pending(void)
+{
+    uint8_t count = 0;
+
+    for (uint8_t position = 0; position < control_used; position += (control_queue[position] + 1))
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief	Забирает из очереди самый старый кадр завершения. Вызывается в том же контексте,
+ *          что WVT_W7_Control_Complete
+ *
+ * @param [out]	responce_buffer	Буфер для кадра, WVT_W7_BUFFER_SIZE байт
+ *
+ * @returns	Длина кадра, 0 - очередь пуста
+ */
+uint8_t WVT_W7_Control_Next(uint8_t * responce_buffer)
+{
+    if (control_used == 0)
+    {
+        return 0;
+    }
+
+    const uint8_t length = control_queue[0];
+    for (uint8_t i = 0; i < length; i++)
+    {
+        responce_buffer[i] = control_queue[1 + i];
+    }
+
+    for (uint8_t i = (uint8_t) (length + 1); i < control_used; i++)
+    {
+        control_queue[i - length - 1] = control_queue[i];
+    }
+    control_used -= (uint8_t) (length + 1);
+
+    return length;
+}
+
+/**
+ * @brief	Удаляет все ожидающие кадры завершения
+ */
+void WVT_W7_Control_Clear(void)
+{
+    control_used = 0;
+}
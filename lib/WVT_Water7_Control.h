@@ -0,0 +1,50 @@
+﻿#pragma once
+#ifndef WVT_WATER7_CONTROL_H_
+#define WVT_WATER7_CONTROL_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_CONTROL_QUEUE_SIZE
+#define WVT_W7_CONTROL_QUEUE_SIZE           64  /*!< Размер очереди кадров завершения в байтах, с длинами кадров */
+#endif
+
+#define WVT_W7_CONTROL_ACCEPTED_LENGTH      9UL /*!< Тип, номер команды, состояние и команда без типа */
+#define WVT_W7_CONTROL_RESULT_DATA_OFFSET   4   /*!< Начало данных результата: тип, номер команды, состояние, код ошибки */
+
+#if (WVT_W7_CONTROL_QUEUE_SIZE > 255) || (WVT_W7_CONTROL_QUEUE_SIZE < (WVT_W7_CONTROL_RESULT_DATA_OFFSET + 1))
+#error "WVT_W7_CONTROL_QUEUE_SIZE must be in range 5..255"
+#endif
+
+/* Кадр завершения занимает место в очереди вместе с байтом длины и должен поместиться в буфер ответа */
+#if ((WVT_W7_CONTROL_QUEUE_SIZE - 1) > WVT_W7_BUFFER_SIZE)
+#define WVT_W7_CONTROL_MAX_RESULT           (WVT_W7_BUFFER_SIZE - WVT_W7_CONTROL_RESULT_DATA_OFFSET)
+#else
+#define WVT_W7_CONTROL_MAX_RESULT           (WVT_W7_CONTROL_QUEUE_SIZE - 1 - WVT_W7_CONTROL_RESULT_DATA_OFFSET)
+#endif
+
+typedef enum
+{
+    WVT_W7_CONTROL_ACCEPTED             = 0x01,     /*!< Команда принята, результат придет отдельным кадром */
+    WVT_W7_CONTROL_COMPLETED            = 0x02
+} WVT_W7_Control_State_t;
+
+/*
+ * Очередь кадров завершения не защищена от одновременного доступа: WVT_W7_Control_Complete, 
+ * WVT_W7_Control_Next, WVT_W7_Control_Pending и WVT_W7_Control_Clear меняют одну длину очереди 
+ * и вызываются из одного контекста. Команду, завершившуюся в прерывании, 
+ * приложение передает в WVT_W7_Control_Complete из основного цикла
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    uint8_t WVT_W7_Control_Ticket(void);
+    uint8_t WVT_W7_Control_Accept(const uint8_t * data, uint8_t * responce_buffer, uint16_t responce_size);
+    uint8_t WVT_W7_Control_Complete(uint8_t ticket, WVT_W7_Error_t result, const uint8_t * data, uint8_t length);
+    uint8_t WVT_W7_Control_Pending(void);
+    uint8_t WVT_W7_Control_Next(uint8_t * responce_buffer);
+    void WVT_W7_Control_Clear(void);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,29 @@
+﻿#pragma once
+#ifndef WVT_WATER7_CRC32_H_
+#define WVT_WATER7_CRC32_H_
+
+#include <stdint.h>
+
+#ifndef WVT_W7_CRC32_TABLES
+#define WVT_W7_CRC32_TABLES                 1   /*!< 1 - расчет по таблицам slice-by-8 (8 КБ констант), 0 - побитный расчет */
+#endif
+
+/**
+ * Функция расчета CRC-32 с теми же параметрами, что у WVT_W7_Crc32
+ */
+typedef uint32_t(*WVT_W7_Crc32_Function_t)(uint32_t crc, const uint8_t * data, uint32_t length);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    uint32_t WVT_W7_Crc32(uint32_t crc, const uint8_t * data, uint32_t length);
+    uint32_t WVT_W7_Crc32_Bitwise(uint32_t crc, const uint8_t * data, uint32_t length);
+#if WVT_W7_CRC32_TABLES
+    uint32_t WVT_W7_Crc32_Slice8(uint32_t crc, const uint8_t * data, uint32_t length);
+#endif
+    void WVT_W7_Crc32_Register(WVT_W7_Crc32_Function_t hardware);
+#ifdef __cplusplus
+}
+#endif
+#endif
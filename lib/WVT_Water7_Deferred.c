@@ -0,0 +1,166 @@
+﻿#include "WVT_Water7_Deferred.h"
+
+static uint8_t deferred_queue[WVT_W7_DEFERRED_QUEUE_SIZE];
+static uint8_t deferred_used = 0;
+static uint8_t deferred_enabled = 0;
+
+/**
+ * @brief	Включает или отключает режим отложенных ответов.
+ *          В этом режиме WVT_W7_Parse не возвращает ответ сразу, а ставит его в очередь:
+ *          ответы уходят в хвосте следующего регулярного сообщения, 
+ *          и устройству не нужно отдельно включать передатчик.
+ *			При отключении режима очередь сохраняется до ближайшего регулярного сообщения.
+ *
+ * @param 	enable		0 - ответы отправляются сразу
+ */
+void WVT_W7_Deferred_Enable(uint8_t enable)
+{
+    deferred_enabled = enable;
+}
+
+/**
+ * @brief	Возвращает число ответов, ожидающих отправки
+ */
+uint8_t WVT_W7_Deferred_Pending(void)
+{
+    uint8_t count = 0;
+
+    for (uint8_t position = 0; position < deferred_used; position += (deferred_queue[position] + 1))
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief	Возвращает место, которое займет в хвосте сообщения самый старый ожидающий ответ
+ *
+ * @returns	Длина ответа с маркером и длиной; 0 - очередь пуста
+ */
+uint8_t WVT_W7_Deferred_Next(void)
+{
+    return (deferred_used != 0) ? (uint8_t) (WVT_W7_DEFERRED_HEADER_WIDTH + deferred_queue[0]) : 0;
+}
+
+/**
+ * @brief	Удаляет все ожидающие ответы
+ */
+void WVT_W7_Deferred_Clear(void)
+{
+    deferred_used = 0;
+}
+
+/**
+ * @brief	Ставит ответ в очередь отложенных ответов.
+ *
+ * @param [in] 	responce	Ответ, сформированный WVT_W7_Parse
+ * @param 	   	length		Длина ответа
+ *
+ * @returns	1 - ответ поставлен в очередь, 
+ *          0 - режим отключен, ответ слишком велик для хвоста регулярного сообщения
+ *              или очередь заполнена; ответ нужно отправить сразу.
+ */
+uint8_t WVT_W7_Deferred_Queue(const uint8_t * responce, uint8_t length)
+{
+    if (    (deferred_enabled == 0)
+        ||  (length == 0)
+        ||  (length > WVT_W7_DEFERRED_MAX_RESPONCE)
+        ||  ((deferred_used + length + 1) > WVT_W7_DEFERRED_QUEUE_SIZE)  )
+    {
+        return 0;
+    }
+
+    deferred_queue[deferred_used++] = length;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        deferred_queue[deferred_used++] = responce[i];
+    }
+    return 1;
+}
+
+/**
+ * @brief	Добавляет ожидающие ответы в хвост сообщения, пока они помещаются в WVT_W7_BUFFER_SIZE.
+ *          Каждый ответ записывается как маркер WVT_W7_DEFERRED_MARKER, длина и байты ответа.
+ *			Ответы отправляются в порядке поступления.
+ *
+ * @param [out]	responce_buffer	Буфер с регулярным сообщением
+ * @param 	   	length		   	Длина регулярного сообщения
+ *
+ * @returns	Длина сообщения с добавленными ответами
+ */
+uint8_t WVT_W7_Deferred_Append(uint8_t * responce_buffer, uint8_t length)
+{
+    uint8_t position = 0;
+
+    while (position < deferred_used)
+    {
+        const uint8_t responce_length = deferred_queue[position];
+
+        if ((length + WVT_W7_DEFERRED_HEADER_WIDTH + responce_length) > WVT_W7_BUFFER_SIZE)
+        {
+            break;
+        }
+
+        responce_buffer[length++] = WVT_W7_DEFERRED_MARKER;
+        responce_buffer[length++] = responce_length;
+        for (uint8_t i = 0; i < responce_length; i++)
+        {
+            responce_buffer[length++] = deferred_queue[position + 1 + i];
+        }
+        position += (responce_length + 1);
+    }
+
+    // Неотправленные ответы сдвигаются в начало очереди
+    for (uint8_t i = position; i < deferred_used; i++)
+    {
+        deferred_queue[i - position] = deferred_queue[i];
+    }
+    deferred_used -= position;
+
+    return length;
+}
+
+/**
+ * @brief	Находит начало отложенных ответов в принятом регулярном сообщении (для сервера).
+ *          Дополнительные параметры занимают по WVT_W7_ADDITIONAL_DATA_WIDTH байт 
+ *          и начинаются с адреса меньше 64, поэтому маркер с ними не совпадает.
+ *          В длинном регулярном сообщении (WVT_W7_Long_Regular) пропускаются 
+ *          пары varint всех упакованных параметров.
+ *
+ * @param [in] 	data  	Регулярное сообщение
+ * @param 	   	length	Длина сообщения
+ *
+ * @returns	Смещение первого маркера; length - ответов в сообщении нет.
+ */
+uint8_t WVT_W7_Deferred_Trailer(const uint8_t * data, uint8_t length)
+{
+    uint8_t position = WVT_W7_ADDITIONAL_DATA_OFFSET;
+
+    if (    (length >= WVT_W7_LONG_REGULAR_DATA_OFFSET)
+        &&  (data[0] == WVT_W7_PACKET_TYPE_LONG_REGULAR)  )
+    {
+        const uint32_t number_of_varints = 2 * (uint32_t) ((data[8] << 8) + data[9]);
+
+        position = WVT_W7_LONG_REGULAR_DATA_OFFSET;
+        for (uint32_t i = 0; i < number_of_varints; i++)
+        {
+            uint32_t value;
+            const uint8_t encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &value);
+
+            if (encoded_length == 0)
+            {
+                return length;
+            }
+            position += encoded_length;
+        }
+        return ((position < length) && (data[position] == WVT_W7_DEFERRED_MARKER)) ? position : length;
+    }
+
+    while (     (position < length)
+            &&  (data[position] != WVT_W7_DEFERRED_MARKER)  )
+    {
+        position += WVT_W7_ADDITIONAL_DATA_WIDTH;
+    }
+
+    return (position < length) ? position : length;
+}
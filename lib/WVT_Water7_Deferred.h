@@ -0,0 +1,34 @@
+﻿#pragma once
+#ifndef WVT_WATER7_DEFERRED_H_
+#define WVT_WATER7_DEFERRED_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_DEFERRED_QUEUE_SIZE
+#define WVT_W7_DEFERRED_QUEUE_SIZE          64  /*!< Размер очереди отложенных ответов в байтах, с длинами ответов */
+#endif
+
+#define WVT_W7_DEFERRED_MARKER              0xFE    /*!< Начало записи в хвосте регулярного сообщения. Адреса доппараметров меньше 64 */
+#define WVT_W7_DEFERRED_HEADER_WIDTH        2       /*!< Маркер и длина ответа */
+#define WVT_W7_SHORT_REGULAR_MAX_LENGTH     (WVT_W7_ADDITIONAL_DATA_OFFSET + (5 * WVT_W7_ADDITIONAL_DATA_WIDTH))
+#define WVT_W7_DEFERRED_MAX_RESPONCE        (WVT_W7_BUFFER_SIZE - WVT_W7_SHORT_REGULAR_MAX_LENGTH - WVT_W7_DEFERRED_HEADER_WIDTH)
+
+#if (WVT_W7_DEFERRED_QUEUE_SIZE > 255) || (WVT_W7_DEFERRED_QUEUE_SIZE < 2)
+#error "WVT_W7_DEFERRED_QUEUE_SIZE must be in range 2..255"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void WVT_W7_Deferred_Enable(uint8_t enable);
+    uint8_t WVT_W7_Deferred_Pending(void);
+    uint8_t WVT_W7_Deferred_Next(void);
+    void WVT_W7_Deferred_Clear(void);
+    uint8_t WVT_W7_Deferred_Queue(const uint8_t * responce, uint8_t length);
+    uint8_t WVT_W7_Deferred_Append(uint8_t * responce_buffer, uint8_t length);
+    uint8_t WVT_W7_Deferred_Trailer(const uint8_t * data, uint8_t length);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,210 @@
+﻿#include "WVT_Water7_Digest.h"
+
+extern WVT_W7_Callbacks_t externals_functions;
+
+static uint32_t digest_nodes[WVT_W7_DIGEST_NODES];
+static uint8_t digest_ready = 0;
+
+/**
+ * @brief	Хеш одного параметра. Хеш листа - сумма хешей его параметров,
+ *          поэтому запись одного параметра обновляет лист без чтения соседей.
+ *          Нечитаемые параметры считаются равными нулю.
+ *
+ * @param 	address		Адрес параметра
+ * @param 	value		Значение параметра
+ *
+ * @returns	Хеш пары адрес-значение
+ */
+uint32_t WVT_W7_Digest_Parameter_Hash(uint16_t address, int32_t value)
+{
+    return WVT_W7_Mix((uint32_t) value ^ WVT_W7_Mix(address + 0x9E3779B9UL));
+}
+
+/**
+ * @brief	Хеш внутреннего узла дерева по хешам его потомков
+ */
+uint32_t WVT_W7_Digest_Combine(uint32_t left, uint32_t right)
+{
+    return WVT_W7_Mix(left ^ WVT_W7_Mix(right + 0x9E3779B9UL));
+}
+
+/**
+ * @brief	Пересчитывает внутренние узлы дерева по листьям
+ */
+static void WVT_W7_Digest_Build_Interior(uint32_t * nodes)
+{
+    for (uint16_t node = WVT_W7_DIGEST_LEAVES - 1; node > 0; node--)
+    {
+        nodes[node] = WVT_W7_Digest_Combine(nodes[2 * node], nodes[(2 * node) + 1]);
+    }
+}
+
+/**
+ * @brief	Строит дерево хешей по известным значениям параметров (на стороне сервера).
+ *          Узел 1 - корень, потомки узла n - узлы 2n и 2n + 1,
+ *          листья - узлы с WVT_W7_DIGEST_LEAVES по WVT_W7_DIGEST_NODES - 1.
+ *
+ * @param 	   	values		Значения WVT_W7_DIGEST_PARAMETERS параметров, 
+ *                          начиная с WVT_W7_DIGEST_FIRST_ADDRESS
+ * @param [out]	nodes		Массив узлов размером WVT_W7_DIGEST_NODES
+ */
+void WVT_W7_Digest_Build(const int32_t * values, uint32_t * nodes)
+{
+    for (uint16_t leaf = 0; leaf < WVT_W7_DIGEST_LEAVES; leaf++)
+    {
+        uint32_t hash = 0;
+
+        for (uint16_t i = 0; i < WVT_W7_DIGEST_BLOCK; i++)
+        {
+            const uint16_t offset = (uint16_t) ((leaf * WVT_W7_DIGEST_BLOCK) + i);
+            hash += WVT_W7_Digest_Parameter_Hash((uint16_t) (WVT_W7_DIGEST_FIRST_ADDRESS + offset), values[offset]);
+        }
+        nodes[WVT_W7_DIGEST_LEAVES + leaf] = hash;
+    }
+
+    WVT_W7_Digest_Build_Interior(nodes);
+}
+
+/**
+ * @brief	Строит дерево хешей таблицы параметров, читая их через rom_read.
+ *          Вызывается один раз после регистрации внешних функций. 
+ *          Дальше дерево обновляется при каждой записи параметра.
+ *          Функция синхронная: если rom_read вернула WVT_W7_ERROR_CODE_BUSY, 
+ *          дерево не строится, и вызов нужно повторить, когда память освободится.
+ *
+ * @return  - WVT_W7_OK Дерево построено
+ *          - WVT_W7_ERROR Внешние функции не зарегистрированы или память занята
+ */
+WVT_W7_Status_t WVT_W7_Digest_Init(void)
+{
+    if (externals_functions.rom_read == 0)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    // Пока дерево перестраивается, записи его не обновляют
+    digest_ready = 0;
+
+    for (uint16_t leaf = 0; leaf < WVT_W7_DIGEST_LEAVES; leaf++)
+    {
+        uint32_t hash = 0;
+
+        for (uint16_t i = 0; i < WVT_W7_DIGEST_BLOCK; i++)
+        {
+            const uint16_t address = (uint16_t) (WVT_W7_DIGEST_FIRST_ADDRESS + (leaf * WVT_W7_DIGEST_BLOCK) + i);
+            int32_t value;
+
+            const WVT_W7_Error_t rom_operation_result = externals_functions.rom_read(address, &value);
+            if (rom_operation_result == WVT_W7_ERROR_CODE_BUSY)
+            {
+                // Значение неизвестно: дерево с нулем вместо него расходилось бы с сервером
+                return WVT_W7_ERROR;
+            }
+            if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+            {
+                value = 0;
+            }
+            hash += WVT_W7_Digest_Parameter_Hash(address, value);
+        }
+        digest_nodes[WVT_W7_DIGEST_LEAVES + leaf] = hash;
+    }
+
+    WVT_W7_Digest_Build_Interior(digest_nodes);
+    digest_ready = 1;
+
+    return WVT_W7_OK;
+}
+
+/**
+ * @brief	Проверяет, покрывается ли параметр деревом хешей
+ *
+ * @returns	1, если дерево построено и параметр входит в покрываемый диапазон
+ */
+uint8_t WVT_W7_Digest_Covers(uint16_t address)
+{
+    // Адреса ниже первого при вычитании становятся большими и тоже отсекаются
+    return (digest_ready != 0)
+        && (((uint32_t) address - (uint32_t) WVT_W7_DIGEST_FIRST_ADDRESS) < WVT_W7_DIGEST_PARAMETERS);
+}
+
+/**
+ * @brief	Обновляет лист и путь до корня после записи параметра.
+ *          Библиотека вызывает функцию сама при записи через WVT_W7_Parse,
+ *          приложение - при изменении параметров в обход протокола.
+ *
+ * @param 	address		Адрес параметра
+ * @param 	old_value	Значение до записи
+ * @param 	new_value	Записанное значение
+ */
+void WVT_W7_Digest_Update(uint16_t address, int32_t old_value, int32_t new_value)
+{
+    if (WVT_W7_Digest_Covers(address) == 0)
+    {
+        return;
+    }
+
+    uint16_t node = (uint16_t) (WVT_W7_DIGEST_LEAVES + ((address - WVT_W7_DIGEST_FIRST_ADDRESS) / WVT_W7_DIGEST_BLOCK));
+
+    digest_nodes[node] += WVT_W7_Digest_Parameter_Hash(address, new_value) 
+                        - WVT_W7_Digest_Parameter_Hash(address, old_value);
+
+    for (node /= 2; node > 0; node /= 2)
+    {
+        digest_nodes[node] = WVT_W7_Digest_Combine(digest_nodes[2 * node], digest_nodes[(2 * node) + 1]);
+    }
+}
+
+/**
+ * @brief	Обрабатывает запрос хешей дерева.
+ *          Формат запроса: тип, уровень (0 - корень), номер первого узла на уровне, число узлов.
+ *          Ответ повторяет запрос и содержит хеши узлов по 4 байта.
+ *          Сервер сравнивает хеши со своим деревом и запрашивает потомков только 
+ *          несовпавших узлов, а параметры - только несовпавших листьев.
+ *
+ * @param [in] 	data		   	Запрос длинной WVT_W7_DIGEST_LENGTH
+ * @param [out]	responce_buffer	Буфер с ответом
+ * @param [in/out] responce_length	На входе - размер буфера, на выходе - длина ответа
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Хеши записаны
+ *          - WVT_W7_ERROR_CODE_INVALID_TYPE    Дерево не построено
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Узлы вне дерева или не помещаются в ответ
+ */
+WVT_W7_Error_t WVT_W7_Digest_Read(const uint8_t * data, uint8_t * responce_buffer, uint16_t * responce_length)
+{
+    const uint8_t level = data[1];
+    const uint8_t first = data[2];
+    const uint8_t count = data[3];
+
+    if (digest_ready == 0)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_TYPE;
+    }
+
+    if (    (level > 8)
+        ||  ((1UL << level) > WVT_W7_DIGEST_LEAVES)
+        ||  (count == 0)
+        ||  ((WVT_W7_DIGEST_DATA_OFFSET + (count * WVT_W7_DIGEST_HASH_WIDTH)) > *responce_length)
+        ||  (((uint32_t) first + count) > (1UL << level))  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    for (uint8_t i = 0; i < WVT_W7_DIGEST_DATA_OFFSET; i++)
+    {
+        responce_buffer[i] = data[i];
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const uint32_t hash = digest_nodes[(1UL << level) + first + i];
+        uint8_t * record = responce_buffer + WVT_W7_DIGEST_DATA_OFFSET + (i * WVT_W7_DIGEST_HASH_WIDTH);
+
+        record[0] = (hash >> 24);
+        record[1] = (hash >> 16);
+        record[2] = (hash >> 8);
+        record[3] =  hash;
+    }
+    *responce_length = WVT_W7_DIGEST_DATA_OFFSET + (count * WVT_W7_DIGEST_HASH_WIDTH);
+
+    return WVT_W7_ERROR_CODE_OK;
+}
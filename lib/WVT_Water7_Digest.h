@@ -0,0 +1,44 @@
+﻿#pragma once
+#ifndef WVT_WATER7_DIGEST_H_
+#define WVT_WATER7_DIGEST_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_DIGEST_LEAVES
+#define WVT_W7_DIGEST_LEAVES                64  /*!< Число листьев дерева хешей, степень двойки */
+#endif
+
+#ifndef WVT_W7_DIGEST_BLOCK
+#define WVT_W7_DIGEST_BLOCK                 4   /*!< Число параметров, покрываемых одним листом */
+#endif
+
+#ifndef WVT_W7_DIGEST_FIRST_ADDRESS
+#define WVT_W7_DIGEST_FIRST_ADDRESS         0   /*!< Адрес первого параметра, покрываемого деревом */
+#endif
+
+#define WVT_W7_DIGEST_PARAMETERS            (WVT_W7_DIGEST_LEAVES * WVT_W7_DIGEST_BLOCK)
+#define WVT_W7_DIGEST_NODES                 (2 * WVT_W7_DIGEST_LEAVES)  /*!< Размер массива узлов, узел 0 не используется */
+#define WVT_W7_DIGEST_LENGTH                4UL
+#define WVT_W7_DIGEST_DATA_OFFSET           4   /*!< Начало хешей в ответе */
+#define WVT_W7_DIGEST_HASH_WIDTH            4
+#define WVT_W7_DIGEST_MAX_NODES             ((WVT_W7_BUFFER_SIZE - WVT_W7_DIGEST_DATA_OFFSET) / WVT_W7_DIGEST_HASH_WIDTH)
+
+#if ((WVT_W7_DIGEST_LEAVES & (WVT_W7_DIGEST_LEAVES - 1)) != 0) || (WVT_W7_DIGEST_LEAVES > 256)
+#error "WVT_W7_DIGEST_LEAVES must be a power of two not greater than 256"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    WVT_W7_Status_t WVT_W7_Digest_Init(void);
+    uint8_t WVT_W7_Digest_Covers(uint16_t address);
+    void WVT_W7_Digest_Update(uint16_t address, int32_t old_value, int32_t new_value);
+    WVT_W7_Error_t WVT_W7_Digest_Read(const uint8_t * data, uint8_t * responce_buffer, uint16_t * responce_length);
+    void WVT_W7_Digest_Build(const int32_t * values, uint32_t * nodes);
+    uint32_t WVT_W7_Digest_Parameter_Hash(uint16_t address, int32_t value);
+    uint32_t WVT_W7_Digest_Combine(uint32_t left, uint32_t right);
+#ifdef __cplusplus
+}
+#endif
+#endif 
@@ -0,0 +1,819 @@
+﻿#include "WVT_Water7_Firmware.h"
+#include "WVT_Water7_Patch.h"
+#include "WVT_Water7_Lz.h"
+
+#define WVT_W7_FIRMWARE_CHECKPOINT_PATCH    27  /*!< Положение применения патча в заголовке записи о состоянии */
+#define WVT_W7_FIRMWARE_CHECKPOINT_SEQUENCE (WVT_W7_FIRMWARE_CHECKPOINT_PATCH + WVT_W7_PATCH_STATE_SIZE)
+
+#if (WVT_W7_FIRMWARE_CHECKPOINT_HEADER != (WVT_W7_FIRMWARE_CHECKPOINT_SEQUENCE + 1))
+#error "WVT_W7_FIRMWARE_CHECKPOINT_HEADER does not match the checkpoint layout"
+#endif
+
+static const WVT_W7_Firmware_Storage_t * firmware_storage = 0;
+static uint8_t firmware_bitmap[WVT_W7_FIRMWARE_MAX_CHUNKS / 8];
+static uint8_t firmware_block[WVT_W7_FIRMWARE_DICTIONARY_SIZE + WVT_W7_FIRMWARE_MAX_BLOCK_SIZE];    /*!< Словарь и распакованные части */
+static uint32_t firmware_image = 0;
+static uint32_t firmware_size = 0;
+static uint32_t firmware_crc = 0;
+static uint16_t firmware_chunks = 0;
+static uint16_t firmware_received = 0;
+static uint8_t firmware_chunk_size = 0;
+static uint16_t firmware_unsaved = 0;
+static uint16_t firmware_prefix = 0;
+static uint8_t firmware_flags = 0;
+static uint32_t firmware_verified = 0;
+static uint32_t firmware_running_crc = 0;
+static uint8_t firmware_sequence = 0;
+static WVT_W7_Firmware_Region_t firmware_slot = WVT_W7_FIRMWARE_REGION_STATE_B;
+static WVT_W7_Firmware_State_t firmware_state = WVT_W7_FIRMWARE_IDLE;
+
+static void WVT_W7_Firmware_Restore(void);
+static WVT_W7_Error_t WVT_W7_Firmware_Advance(void);
+static void WVT_W7_Firmware_Status(uint8_t * responce_buffer, uint16_t * responce_length);
+
+/**
+ * @brief	Включает встроенный механизм обновления прошивки.
+ *          Пакеты WVT_W7_PACKET_TYPE_FW_UPDATE обрабатываются библиотекой,
+ *          а не функцией rfl_handler. Состояние приема, сохраненное до 
+ *          перезагрузки, восстанавливается из областей WVT_W7_FIRMWARE_REGION_STATE 
+ *          и WVT_W7_FIRMWARE_REGION_STATE_B.
+ *
+ * @param 	storage		Функции доступа к памяти образов. Структура должна существовать 
+ *                      все время работы библиотеки. 0 - вернуть обработку в rfl_handler
+ *
+ * @returns	- WVT_W7_OK     Настройка выполнена
+ *          - WVT_W7_ERROR  Не переданы функции чтения, записи или стирания
+ */
+WVT_W7_Status_t WVT_W7_Firmware_Init(const WVT_W7_Firmware_Storage_t * storage)
+{
+    firmware_storage = 0;
+    firmware_state = WVT_W7_FIRMWARE_IDLE;
+
+    if (storage == 0)
+    {
+        return WVT_W7_OK;
+    }
+
+    if (    (storage->read == 0)
+        ||  (storage->write == 0)
+        ||  (storage->erase == 0)   )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    firmware_storage = storage;
+    WVT_W7_Firmware_Restore();
+    return WVT_W7_OK;
+}
+
+/**
+ * @brief	Формирует сообщение о состоянии приема образа для отправки после WVT_W7_Start,
+ *          чтобы сервер продолжил передачу с пропущенных частей, а не с начала.
+ *
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число записанных байт, 0 - прием образа не начинался
+ */
+uint8_t WVT_W7_Firmware_Resume(uint8_t * responce_buffer)
+{
+    uint16_t responce_length = WVT_W7_BUFFER_SIZE;
+
+    if (    (firmware_storage == 0)
+        ||  (firmware_state == WVT_W7_FIRMWARE_IDLE)  )
+    {
+        return 0;
+    }
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_FW_UPDATE;
+    WVT_W7_Firmware_Status(responce_buffer, &responce_length);
+    return (uint8_t) responce_length;
+}
+
+/**
+ * @brief	Проверяет, включен ли встроенный механизм обновления
+ */
+uint8_t WVT_W7_Firmware_Ready(void)
+{
+    return (firmware_storage != 0);
+}
+
+static uint8_t WVT_W7_Firmware_Has_Chunk(uint16_t chunk)
+{
+    return (firmware_bitmap[chunk >> 3] >> (chunk & 7)) & 1;
+}
+
+/**
+ * @brief	Заполняет заголовок записи о состоянии приема
+ */
+static void WVT_W7_Firmware_Checkpoint_Header(uint8_t * header, uint8_t sequence)
+{
+    header[0] = (uint8_t) (WVT_W7_FIRMWARE_CHECKPOINT_MAGIC >> 8);
+    header[1] = (uint8_t) WVT_W7_FIRMWARE_CHECKPOINT_MAGIC;
+    header[2] = (firmware_image >> 24);
+    header[3] = (firmware_image >> 16);
+    header[4] = (firmware_image >> 8);
+    header[5] =  firmware_image;
+    header[6] = (firmware_size >> 24);
+    header[7] = (firmware_size >> 16);
+    header[8] = (firmware_size >> 8);
+    header[9] =  firmware_size;
+    header[10] = firmware_chunk_size;
+    header[11] = (firmware_crc >> 24);
+    header[12] = (firmware_crc >> 16);
+    header[13] = (firmware_crc >> 8);
+    header[14] =  firmware_crc;
+    header[15] = firmware_state;
+    header[16] = (firmware_received >> 8);
+    header[17] =  firmware_received;
+    header[18] = firmware_flags;
+    header[19] = (firmware_verified >> 24);
+    header[20] = (firmware_verified >> 16);
+    header[21] = (firmware_verified >> 8);
+    header[22] =  firmware_verified;
+    header[23] = (firmware_running_crc >> 24);
+    header[24] = (firmware_running_crc >> 16);
+    header[25] = (firmware_running_crc >> 8);
+    header[26] =  firmware_running_crc;
+    WVT_W7_Patch_Save(header + WVT_W7_FIRMWARE_CHECKPOINT_PATCH);
+    header[WVT_W7_FIRMWARE_CHECKPOINT_SEQUENCE] = sequence;
+}
+
+/**
+ * @brief	Сохраняет состояние приема: параметры образа и битовую карту принятых частей.
+ *          Запись защищена собственной CRC-32 и делается в область, не содержащую последнюю 
+ *          запись, поэтому при прерванной записи восстанавливается предыдущая.
+ *          При ошибке записи прием продолжается, состояние сохранится в следующий раз.
+ */
+static void WVT_W7_Firmware_Save(void)
+{
+    const WVT_W7_Firmware_Region_t slot = (firmware_slot == WVT_W7_FIRMWARE_REGION_STATE) 
+        ? WVT_W7_FIRMWARE_REGION_STATE_B : WVT_W7_FIRMWARE_REGION_STATE;
+    uint8_t header[WVT_W7_FIRMWARE_CHECKPOINT_HEADER];
+    uint8_t checksum[4];
+
+    WVT_W7_Firmware_Checkpoint_Header(header, (uint8_t) (firmware_sequence + 1));
+    uint32_t crc = WVT_W7_Crc32(0, header, sizeof(header));
+    crc = WVT_W7_Crc32(crc, firmware_bitmap, sizeof(firmware_bitmap));
+    checksum[0] = (crc >> 24);
+    checksum[1] = (crc >> 16);
+    checksum[2] = (crc >> 8);
+    checksum[3] =  crc;
+
+    if (    (firmware_storage->erase(slot, WVT_W7_FIRMWARE_CHECKPOINT_SIZE) == WVT_W7_ERROR_CODE_OK)
+        &&  (firmware_storage->write(slot, 0, header, sizeof(header)) == WVT_W7_ERROR_CODE_OK)
+        &&  (firmware_storage->write(slot, sizeof(header), 
+                firmware_bitmap, sizeof(firmware_bitmap)) == WVT_W7_ERROR_CODE_OK)
+        &&  (firmware_storage->write(slot, sizeof(header) + sizeof(firmware_bitmap), 
+                checksum, sizeof(checksum)) == WVT_W7_ERROR_CODE_OK)  )
+    {
+        firmware_slot = slot;
+        firmware_sequence++;
+        firmware_unsaved = 0;
+    }
+}
+
+/**
+ * @brief	Читает запись о состоянии приема из области slot: заголовок и битовую карту
+ *
+ * @returns	1 - запись цела
+ */
+static uint8_t WVT_W7_Firmware_Load(WVT_W7_Firmware_Region_t slot, uint8_t * header)
+{
+    uint8_t checksum[4];
+
+    if (    (firmware_storage->read(slot, 0, header, WVT_W7_FIRMWARE_CHECKPOINT_HEADER) != WVT_W7_ERROR_CODE_OK)
+        ||  (((header[0] << 8) + header[1]) != WVT_W7_FIRMWARE_CHECKPOINT_MAGIC)
+        ||  (firmware_storage->read(slot, WVT_W7_FIRMWARE_CHECKPOINT_HEADER, 
+                firmware_bitmap, sizeof(firmware_bitmap)) != WVT_W7_ERROR_CODE_OK)
+        ||  (firmware_storage->read(slot, WVT_W7_FIRMWARE_CHECKPOINT_HEADER + sizeof(firmware_bitmap), 
+                checksum, sizeof(checksum)) != WVT_W7_ERROR_CODE_OK)  )
+    {
+        return 0;
+    }
+
+    uint32_t crc = WVT_W7_Crc32(0, header, WVT_W7_FIRMWARE_CHECKPOINT_HEADER);
+    crc = WVT_W7_Crc32(crc, firmware_bitmap, sizeof(firmware_bitmap));
+    return (crc == (((uint32_t) checksum[0] << 24) + ((uint32_t) checksum[1] << 16) + ((uint32_t) checksum[2] << 8) + checksum[3]));
+}
+
+/**
+ * @brief	Восстанавливает сохраненное состояние приема из более новой целой записи.
+ *          Если целых записей нет, прием начнется с команды BEGIN.
+ */
+static void WVT_W7_Firmware_Restore(void)
+{
+    uint8_t header[WVT_W7_FIRMWARE_CHECKPOINT_HEADER];
+
+    firmware_unsaved = 0;
+    firmware_sequence = 0;
+    firmware_slot = WVT_W7_FIRMWARE_REGION_STATE_B;
+
+    const uint8_t valid = WVT_W7_Firmware_Load(WVT_W7_FIRMWARE_REGION_STATE, header);
+    const uint8_t sequence = valid ? header[WVT_W7_FIRMWARE_CHECKPOINT_SEQUENCE] : 0;
+    if (    WVT_W7_Firmware_Load(WVT_W7_FIRMWARE_REGION_STATE_B, header)
+        &&  ((valid == 0) || ((int8_t) (header[WVT_W7_FIRMWARE_CHECKPOINT_SEQUENCE] - sequence) > 0))  )
+    {
+        firmware_slot = WVT_W7_FIRMWARE_REGION_STATE_B;
+    }
+    else if ((valid == 0) || (WVT_W7_Firmware_Load(WVT_W7_FIRMWARE_REGION_STATE, header) == 0))
+    {
+        return;
+    }
+    else
+    {
+        firmware_slot = WVT_W7_FIRMWARE_REGION_STATE;
+    }
+    firmware_sequence = header[WVT_W7_FIRMWARE_CHECKPOINT_SEQUENCE];
+
+    firmware_image = ((uint32_t) header[2] << 24) + ((uint32_t) header[3] << 16) + ((uint32_t) header[4] << 8) + header[5];
+    firmware_size = ((uint32_t) header[6] << 24) + ((uint32_t) header[7] << 16) + ((uint32_t) header[8] << 8) + header[9];
+    firmware_chunk_size = header[10];
+    firmware_crc = ((uint32_t) header[11] << 24) + ((uint32_t) header[12] << 16) + ((uint32_t) header[13] << 8) + header[14];
+    firmware_received = (uint16_t) ((header[16] << 8) + header[17]);
+    firmware_flags = header[18];
+    firmware_verified = ((uint32_t) header[19] << 24) + ((uint32_t) header[20] << 16) + ((uint32_t) header[21] << 8) + header[22];
+    firmware_running_crc = ((uint32_t) header[23] << 24) + ((uint32_t) header[24] << 16) + ((uint32_t) header[25] << 8) + header[26];
+    firmware_prefix = 0;
+
+    if (    (firmware_chunk_size == 0)
+        ||  (header[15] > WVT_W7_FIRMWARE_FAILED)  )
+    {
+        return;
+    }
+    firmware_chunks = (uint16_t) ((firmware_size + firmware_chunk_size - 1) / firmware_chunk_size);
+    firmware_state = (WVT_W7_Firmware_State_t) header[15];
+
+    // Патч применяется дальше с сохраненного положения: проверенное начало нового образа 
+    // и его CRC-32 сохранены вместе с ним
+    if (firmware_flags & WVT_W7_FIRMWARE_FLAG_PATCH)
+    {
+        WVT_W7_Patch_Load(header + WVT_W7_FIRMWARE_CHECKPOINT_PATCH);
+    }
+}
+
+/**
+ * @brief	Область, в которую записываются принятые части: образ или патч
+ */
+static WVT_W7_Firmware_Region_t WVT_W7_Firmware_Data_Region(void)
+{
+    return (firmware_flags & WVT_W7_FIRMWARE_FLAG_PATCH) ? WVT_W7_FIRMWARE_REGION_SCRATCH : WVT_W7_FIRMWARE_REGION_TARGET;
+}
+
+/**
+ * @brief	Продвигает проверенное начало образа по мере приема частей подряд: применяет патч 
+ *          и считает CRC-32 нового начала образа, читая его из WVT_W7_FIRMWARE_REGION_TARGET.
+ *          Проверка распределяется по приему частей, и к его концу CRC-32 образа уже посчитана.
+ *          Если патч поврежден или построен не для текущего образа, прием завершается ошибкой.
+ */
+static WVT_W7_Error_t WVT_W7_Firmware_Advance(void)
+{
+    uint8_t block[WVT_W7_FIRMWARE_VERIFY_BLOCK];
+
+    while ((firmware_prefix < firmware_chunks) && WVT_W7_Firmware_Has_Chunk(firmware_prefix))
+    {
+        firmware_prefix++;
+    }
+
+    uint32_t available = (firmware_prefix == firmware_chunks) 
+        ? firmware_size : ((uint32_t) firmware_prefix * firmware_chunk_size);
+
+    if (firmware_flags & WVT_W7_FIRMWARE_FLAG_PATCH)
+    {
+        const WVT_W7_Error_t result = WVT_W7_Patch_Apply(firmware_storage, available, firmware_size);
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            firmware_state = WVT_W7_FIRMWARE_FAILED;
+            WVT_W7_Firmware_Save();
+            return result;
+        }
+        available = WVT_W7_Patch_Written();
+    }
+
+    while (firmware_verified < available)
+    {
+        const uint16_t block_length = (uint16_t) (((available - firmware_verified) < WVT_W7_FIRMWARE_VERIFY_BLOCK) 
+            ? (available - firmware_verified) : WVT_W7_FIRMWARE_VERIFY_BLOCK);
+        const WVT_W7_Error_t result = firmware_storage->read(WVT_W7_FIRMWARE_REGION_TARGET, firmware_verified, block, block_length);
+
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            return result;
+        }
+        firmware_running_crc = WVT_W7_Crc32(firmware_running_crc, block, block_length);
+        firmware_verified += block_length;
+    }
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Проверяет, что записано во флеш-память на месте части. Части, принятые после 
+ *          последнего сохранения состояния, после перезагрузки приходят повторно, а записанную 
+ *          флеш-память нельзя записать второй раз без стирания. Запись, прерванная перезагрузкой, 
+ *          оставляет записанным начало части, остальные байты стерты.
+ *
+ * @param [out]	written		Число первых байт части, уже записанных во флеш-память
+ *
+ * @returns	- 1 - память содержит начало части, остальное стерто
+ *          - 0 - память повреждена прерванной записью и не может быть дописана
+ */
+static uint8_t WVT_W7_Firmware_Written(uint32_t offset, const uint8_t * data, uint16_t length, uint16_t * written)
+{
+    uint8_t block[WVT_W7_FIRMWARE_VERIFY_BLOCK];
+
+    *written = 0;
+    for (uint16_t position = 0; position < length; position += WVT_W7_FIRMWARE_VERIFY_BLOCK)
+    {
+        const uint16_t block_length = ((length - position) < WVT_W7_FIRMWARE_VERIFY_BLOCK) 
+            ? (uint16_t) (length - position) : WVT_W7_FIRMWARE_VERIFY_BLOCK;
+
+        if (firmware_storage->read(WVT_W7_Firmware_Data_Region(), offset + position, block, block_length) != WVT_W7_ERROR_CODE_OK)
+        {
+            return 1;
+        }
+        for (uint16_t i = 0; i < block_length; i++)
+        {
+            if (    (*written == (position + i))
+                &&  (block[i] == data[position + i])  )
+            {
+                (*written)++;
+            }
+            else if (block[i] != 0xFF)
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief	Начинает прием образа. Повторная команда для того же образа 
+ *          с тем же размером продолжает прием с уже принятыми частями.
+ *          Запрос: образ (4 байта), размер (4 байта), размер части (1 байт), CRC-32 образа (4 байта),
+ *          необязательные флаги (1 байт). Для патча размер - это размер патча, 
+ *          а CRC-32 считается по новому образу.
+ */
+static WVT_W7_Error_t WVT_W7_Firmware_Begin(const uint8_t * data, uint16_t length)
+{
+    const uint32_t image = ((uint32_t) data[2] << 24) + ((uint32_t) data[3] << 16) + ((uint32_t) data[4] << 8) + data[5];
+    const uint32_t size = ((uint32_t) data[6] << 24) + ((uint32_t) data[7] << 16) + ((uint32_t) data[8] << 8) + data[9];
+    const uint8_t chunk_size = data[10];
+    const uint32_t crc = ((uint32_t) data[11] << 24) + ((uint32_t) data[12] << 16) + ((uint32_t) data[13] << 8) + data[14];
+    const uint8_t flags = (length == WVT_W7_FIRMWARE_BEGIN_FLAGS_LENGTH) ? data[15] : 0;
+
+    if (    (size == 0)
+        ||  (chunk_size == 0)
+        ||  (chunk_size > WVT_W7_FIRMWARE_MAX_CHUNK_SIZE)
+        ||  (((size + chunk_size - 1) / chunk_size) > WVT_W7_FIRMWARE_MAX_CHUNKS)
+        ||  (flags & ~(WVT_W7_FIRMWARE_FLAG_PATCH | WVT_W7_FIRMWARE_FLAG_COMPRESSED))  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    if (    (firmware_state != WVT_W7_FIRMWARE_IDLE)
+        &&  (firmware_state != WVT_W7_FIRMWARE_FAILED)
+        &&  (image == firmware_image)
+        &&  (size == firmware_size)
+        &&  (chunk_size == firmware_chunk_size)
+        &&  (crc == firmware_crc)
+        &&  (flags == firmware_flags)  )
+    {
+        return WVT_W7_ERROR_CODE_OK;
+    }
+
+    const WVT_W7_Error_t result = firmware_storage->erase((flags & WVT_W7_FIRMWARE_FLAG_PATCH) 
+        ? WVT_W7_FIRMWARE_REGION_SCRATCH : WVT_W7_FIRMWARE_REGION_TARGET, size);
+    if (result != WVT_W7_ERROR_CODE_OK)
+    {
+        firmware_state = WVT_W7_FIRMWARE_IDLE;
+        return result;
+    }
+
+    for (uint16_t i = 0; i < sizeof(firmware_bitmap); i++)
+    {
+        firmware_bitmap[i] = 0;
+    }
+    firmware_image = image;
+    firmware_size = size;
+    firmware_crc = crc;
+    firmware_chunk_size = chunk_size;
+    firmware_chunks = (uint16_t) ((size + chunk_size - 1) / chunk_size);
+    firmware_received = 0;
+    firmware_prefix = 0;
+    firmware_verified = 0;
+    firmware_running_crc = 0;
+    firmware_flags = flags;
+    firmware_state = WVT_W7_FIRMWARE_RECEIVING;
+    WVT_W7_Patch_Reset();
+    WVT_W7_Firmware_Save();
+
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Распаковывает сжатый пакет в firmware_block. Словарь блока - байты, 
+ *          уже записанные перед первой частью пакета: они читаются из памяти.
+ *          Если части словаря еще не приняты, пакет пропускается, 
+ *          и сервер повторит его по ответу о состоянии.
+ *
+ * @param [in/out] chunk_data	На входе - пакет после номера части, на выходе - распакованные части,
+ *                              0 - пакет пропущен
+ * @param [in/out] chunk_length	Длина пакета, затем распакованных частей
+ */
+static WVT_W7_Error_t WVT_W7_Firmware_Unpack(uint16_t chunk, const uint8_t ** chunk_data, uint16_t * chunk_length)
+{
+    const uint32_t offset = (uint32_t) chunk * firmware_chunk_size;
+    const uint8_t dictionary = (*chunk_data)[0];
+
+    (*chunk_data)++;
+    (*chunk_length)--;
+    if (dictionary == WVT_W7_FIRMWARE_FRAME_STORED)
+    {
+        return WVT_W7_ERROR_CODE_OK;
+    }
+
+    if (    (dictionary > WVT_W7_FIRMWARE_DICTIONARY_SIZE)
+        ||  (dictionary > offset)  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    for (uint16_t i = (uint16_t) ((offset - dictionary) / firmware_chunk_size); i < chunk; i++)
+    {
+        if (WVT_W7_Firmware_Has_Chunk(i) == 0)
+        {
+            *chunk_data = 0;
+            return WVT_W7_ERROR_CODE_OK;
+        }
+    }
+
+    if (dictionary > 0)
+    {
+        const WVT_W7_Error_t result = firmware_storage->read(WVT_W7_Firmware_Data_Region(), offset - dictionary, 
+            firmware_block, dictionary);
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            return result;
+        }
+    }
+
+    if (WVT_W7_Lz_Decompress(*chunk_data, *chunk_length, firmware_block, dictionary, 
+            sizeof(firmware_block), chunk_length) != WVT_W7_ERROR_CODE_OK)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+    *chunk_data = firmware_block + dictionary;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Записывает части образа. Части принимаются в любом порядке, 
+ *          повторно принятые части не записываются. Части патча применяются
+ *          по мере того, как начало патча принимается без пропусков.
+ *          Пакет содержит одну или несколько частей подряд, начиная с указанной; 
+ *          сжатый пакет распаковывается не более чем в WVT_W7_FIRMWARE_MAX_BLOCK_SIZE байт.
+ */
+static WVT_W7_Error_t WVT_W7_Firmware_Chunk(const uint8_t * data, uint16_t length)
+{
+    uint16_t chunk = (uint16_t) ((data[2] << 8) + data[3]);
+    const uint32_t offset = (uint32_t) chunk * firmware_chunk_size;
+    const uint8_t * chunk_data = data + WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET;
+    uint16_t chunk_length = (uint16_t) (length - WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET);
+
+    if (    (firmware_state != WVT_W7_FIRMWARE_RECEIVING)
+        ||  (chunk >= firmware_chunks)  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    if (firmware_flags & WVT_W7_FIRMWARE_FLAG_COMPRESSED)
+    {
+        const WVT_W7_Error_t result = WVT_W7_Firmware_Unpack(chunk, &chunk_data, &chunk_length);
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            return result;
+        }
+        if (chunk_data == 0)
+        {
+            return WVT_W7_ERROR_CODE_OK;
+        }
+    }
+
+    // Все части, кроме последней, имеют полный размер
+    if (    (chunk_length == 0)
+        ||  (chunk_length > (firmware_size - offset))
+        ||  (   ((offset + chunk_length) != firmware_size)
+            &&  ((chunk_length % firmware_chunk_size) != 0) )  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+    }
+
+    for (; chunk_length > 0; chunk++)
+    {
+        const uint32_t chunk_offset = (uint32_t) chunk * firmware_chunk_size;
+        const uint16_t part = (chunk_length < firmware_chunk_size) ? chunk_length : firmware_chunk_size;
+
+        if (WVT_W7_Firmware_Has_Chunk(chunk) == 0)
+        {
+            uint16_t written;
+
+            // Отдельную часть стереть нельзя: образ передается заново с команды BEGIN
+            if (WVT_W7_Firmware_Written(chunk_offset, chunk_data, part, &written) == 0)
+            {
+                firmware_state = WVT_W7_FIRMWARE_FAILED;
+                WVT_W7_Firmware_Save();
+                return WVT_W7_ERROR_CODE_OK;
+            }
+            if (written < part)
+            {
+                const WVT_W7_Error_t result = firmware_storage->write(WVT_W7_Firmware_Data_Region(), chunk_offset + written, 
+                    chunk_data + written, (uint16_t) (part - written));
+                if (result != WVT_W7_ERROR_CODE_OK)
+                {
+                    return result;
+                }
+            }
+
+            firmware_bitmap[chunk >> 3] |= (uint8_t) (1 << (chunk & 7));
+            firmware_received++;
+            firmware_unsaved++;
+        }
+        chunk_data += part;
+        chunk_length = (uint16_t) (chunk_length - part);
+    }
+
+    if (    (firmware_prefix < firmware_chunks)
+        &&  WVT_W7_Firmware_Has_Chunk(firmware_prefix)  )
+    {
+        const WVT_W7_Error_t result = WVT_W7_Firmware_Advance();
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            return result;
+        }
+    }
+
+    if (firmware_received == firmware_chunks)
+    {
+        firmware_state = WVT_W7_FIRMWARE_COMPLETE;
+        WVT_W7_Firmware_Save();
+    }
+    else if (firmware_unsaved >= WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL)
+    {
+        WVT_W7_Firmware_Save();
+    }
+
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Формирует ответ о состоянии приема со списком пропущенных частей.
+ *          Пропуски записываются диапазонами: varint расстояния от конца предыдущего 
+ *          диапазона (для первого - от нуля) и varint длины диапазона без единицы.
+ *          Если все диапазоны не помещаются в буфер, отправляются первые из них;
+ *          сервер видит это по общему числу пропусков.
+ */
+static void WVT_W7_Firmware_Status(uint8_t * responce_buffer, uint16_t * responce_length)
+{
+    const uint16_t responce_size = *responce_length;
+    const uint16_t missing = (uint16_t) (firmware_chunks - firmware_received);
+    uint16_t position = WVT_W7_FIRMWARE_STATUS_DATA_OFFSET;
+    uint16_t previous_end = 0;
+    uint16_t chunk = 0;
+
+    responce_buffer[1] = WVT_W7_FIRMWARE_STATUS;
+    responce_buffer[2] = firmware_state;
+    responce_buffer[3] = (firmware_image >> 24);
+    responce_buffer[4] = (firmware_image >> 16);
+    responce_buffer[5] = (firmware_image >> 8);
+    responce_buffer[6] =  firmware_image;
+    responce_buffer[7] = (firmware_chunks >> 8);
+    responce_buffer[8] =  firmware_chunks;
+    responce_buffer[9] = (missing >> 8);
+    responce_buffer[10] = missing;
+
+    while ((firmware_state == WVT_W7_FIRMWARE_RECEIVING) && (chunk < firmware_chunks))
+    {
+        uint8_t encoded[2 * WVT_W7_VARINT_MAX_LENGTH];
+        uint8_t encoded_length;
+        uint16_t end;
+
+        if (WVT_W7_Firmware_Has_Chunk(chunk))
+        {
+            chunk++;
+            continue;
+        }
+
+        for (end = chunk; (end < firmware_chunks) && (WVT_W7_Firmware_Has_Chunk(end) == 0); end++)
+        {
+        }
+
+        encoded_length = WVT_W7_Put_Varint((uint32_t) (chunk - previous_end), encoded);
+        encoded_length += WVT_W7_Put_Varint((uint32_t) (end - chunk - 1), encoded + encoded_length);
+        if ((position + encoded_length) > responce_size)
+        {
+            break;
+        }
+
+        for (uint8_t i = 0; i < encoded_length; i++)
+        {
+            responce_buffer[position++] = encoded[i];
+        }
+        previous_end = end;
+        chunk = end;
+    }
+
+    *responce_length = position;
+}
+
+/**
+ * @brief	Сравнивает CRC-32, посчитанную во время приема, с CRC-32 из команды BEGIN
+ *          и сообщает приложению о готовности образа
+ */
+static WVT_W7_Error_t WVT_W7_Firmware_Verify(void)
+{
+    const uint32_t size = (firmware_flags & WVT_W7_FIRMWARE_FLAG_PATCH) ? WVT_W7_Patch_Output_Size() : firmware_size;
+    const WVT_W7_Error_t result = WVT_W7_Firmware_Advance();
+
+    if (result != WVT_W7_ERROR_CODE_OK)
+    {
+        return result;
+    }
+
+    if (    (firmware_verified != size)
+        ||  (firmware_running_crc != firmware_crc)  )
+    {
+        firmware_state = WVT_W7_FIRMWARE_FAILED;
+        WVT_W7_Firmware_Save();
+        return WVT_W7_ERROR_CODE_OK;
+    }
+
+    firmware_state = WVT_W7_FIRMWARE_VERIFIED;
+    WVT_W7_Firmware_Save();
+    if (firmware_storage->commit)
+    {
+        return firmware_storage->commit(firmware_image, size);
+    }
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Обрабатывает пакет обновления прошивки.
+ *          - BEGIN  - начинает или продолжает прием образа, отвечает состоянием
+ *          - CHUNK  - части образа: номер первой части (2 байта) и данные. С флагом 
+ *                     WVT_W7_FIRMWARE_FLAG_COMPRESSED данные начинаются с байта режима и могут быть сжаты.
+ *                     Ответ не отправляется, если часть не повреждена прерванной записью: 
+ *                     тогда прием завершается ошибкой
+ *          - STATUS - отвечает состоянием и списком пропущенных частей
+ *          - COMMIT - проверяет полностью принятый образ. Если приняты не все части, 
+ *                     отвечает как на STATUS
+ *
+ * @param [in] 	data		   	Пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	responce_buffer	Буфер с ответом
+ * @param [in/out] responce_length	На входе - размер буфера, на выходе - длина ответа (0 - не отвечать)
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Пакет обработан
+ *          - WVT_W7_ERROR_CODE_INVALID_TYPE    Неизвестная подкоманда
+ *          - WVT_W7_ERROR_CODE_INVALID_LENGTH  Неверная длина пакета
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Неверные параметры образа или часть вне образа
+ *          - Код ошибки функций доступа к памяти
+ */
+WVT_W7_Error_t WVT_W7_Firmware_Parse(const uint8_t * data, uint16_t length, 
+    uint8_t * responce_buffer, uint16_t * responce_length)
+{
+    WVT_W7_Error_t result;
+
+    if (length < 2)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+    }
+    if (*responce_length < WVT_W7_FIRMWARE_STATUS_DATA_OFFSET)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+    }
+
+    switch (data[1])
+    {
+    case WVT_W7_FIRMWARE_BEGIN:
+        if (    (length != WVT_W7_FIRMWARE_BEGIN_LENGTH)
+            &&  (length != WVT_W7_FIRMWARE_BEGIN_FLAGS_LENGTH)  )
+        {
+            return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        result = WVT_W7_Firmware_Begin(data, length);
+        break;
+    case WVT_W7_FIRMWARE_CHUNK:
+        if (length <= WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET)
+        {
+            return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        result = WVT_W7_Firmware_Chunk(data, length);
+        // Отвечает, только если прием прерван частью, поврежденной прерванной записью
+        if (    (result != WVT_W7_ERROR_CODE_OK)
+            ||  (firmware_state != WVT_W7_FIRMWARE_FAILED)  )
+        {
+            if (result == WVT_W7_ERROR_CODE_OK)
+            {
+                *responce_length = 0;
+            }
+            return result;
+        }
+        break;
+    case WVT_W7_FIRMWARE_STATUS:
+        if (length != 2)
+        {
+            return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        result = WVT_W7_ERROR_CODE_OK;
+        break;
+    case WVT_W7_FIRMWARE_COMMIT:
+        if (length != 2)
+        {
+            return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+        }
+        result = (firmware_state == WVT_W7_FIRMWARE_COMPLETE) ? WVT_W7_Firmware_Verify() : WVT_W7_ERROR_CODE_OK;
+        break;
+    default:
+        return WVT_W7_ERROR_CODE_INVALID_TYPE;
+    }
+
+    if (result == WVT_W7_ERROR_CODE_OK)
+    {
+        // Сервер будет повторять пропуски по этому ответу: состояние сохраняется,
+        // чтобы после перезагрузки пропуски не изменились
+        if (firmware_unsaved > 0)
+        {
+            WVT_W7_Firmware_Save();
+        }
+        WVT_W7_Firmware_Status(responce_buffer, responce_length);
+    }
+    return result;
+}
+
+/**
+ * @brief	Разворачивает список пропущенных частей из ответа о состоянии (на стороне сервера)
+ *
+ * @param 	   	data		   	Принятый пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	chunks		   	Номера пропущенных частей
+ * @param [in/out] count		На входе - размер массива chunks, на выходе - число номеров
+ *
+ * @returns	- WVT_W7_OK     Пакет разобран
+ *          - WVT_W7_ERROR  Неверный тип или формат пакета, либо номера не помещаются в массив
+ */
+WVT_W7_Status_t WVT_W7_Firmware_Missing(const uint8_t * data, uint16_t length, 
+    uint16_t * chunks, uint16_t * count)
+{
+    uint16_t position = WVT_W7_FIRMWARE_STATUS_DATA_OFFSET;
+    uint32_t chunk = 0;
+    uint16_t number = 0;
+
+    if (    (data == 0)
+        ||  (length < WVT_W7_FIRMWARE_STATUS_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_FW_UPDATE)
+        ||  (data[1] != WVT_W7_FIRMWARE_STATUS)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    const uint16_t total = (uint16_t) ((data[7] << 8) + data[8]);
+
+    while (position < length)
+    {
+        uint32_t gap;
+        uint32_t range;
+        uint8_t encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &gap);
+
+        if (encoded_length == 0)
+        {
+            return WVT_W7_ERROR;
+        }
+        position += encoded_length;
+
+        encoded_length = WVT_W7_Get_Varint(data + position, (uint16_t) (length - position), &range);
+        if (encoded_length == 0)
+        {
+            return WVT_W7_ERROR;
+        }
+        position += encoded_length;
+
+        chunk += gap;
+        if ((chunk + range) >= total)
+        {
+            return WVT_W7_ERROR;
+        }
+
+        for (uint32_t i = 0; i <= range; i++)
+        {
+            if (number >= *count)
+            {
+                return WVT_W7_ERROR;
+            }
+            chunks[number++] = (uint16_t) (chunk++);
+        }
+    }
+
+    *count = number;
+    return WVT_W7_OK;
+}
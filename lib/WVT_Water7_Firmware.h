@@ -0,0 +1,103 @@
+﻿#pragma once
+#ifndef WVT_WATER7_FIRMWARE_H_
+#define WVT_WATER7_FIRMWARE_H_
+
+#include "WVT_Water7.h"
+#include "WVT_Water7_Crc32.h"
+
+#ifndef WVT_W7_FIRMWARE_MAX_CHUNKS
+#define WVT_W7_FIRMWARE_MAX_CHUNKS          2048    /*!< Наибольшее число частей образа, размер битовой карты в битах */
+#endif
+
+#ifndef WVT_W7_FIRMWARE_VERIFY_BLOCK
+#define WVT_W7_FIRMWARE_VERIFY_BLOCK        64      /*!< Размер блока при чтении образа для проверки контрольной суммы */
+#endif
+
+#ifndef WVT_W7_FIRMWARE_MAX_BLOCK_SIZE
+#define WVT_W7_FIRMWARE_MAX_BLOCK_SIZE      256     /*!< Наибольший размер частей одного сжатого пакета после распаковки */
+#endif
+
+#ifndef WVT_W7_FIRMWARE_DICTIONARY_SIZE
+#define WVT_W7_FIRMWARE_DICTIONARY_SIZE     254     /*!< Наибольшая длина словаря сжатого пакета: уже записанных байт перед его частями */
+#endif
+
+#ifndef WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL
+#define WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL 16      /*!< Число новых частей, после которого состояние приема сохраняется в память */
+#endif
+
+#define WVT_W7_FIRMWARE_BEGIN_LENGTH        15UL
+#define WVT_W7_FIRMWARE_BEGIN_FLAGS_LENGTH  16UL    /*!< Команда BEGIN с байтом флагов */
+#define WVT_W7_FIRMWARE_FLAG_PATCH          0x01    /*!< Передается патч к текущему образу, а не образ целиком */
+#define WVT_W7_FIRMWARE_FLAG_COMPRESSED     0x02    /*!< Пакеты с частями начинаются с байта режима: длина словаря перед блоком 
+                                                         WVT_W7_Lz_Decompress или WVT_W7_FIRMWARE_FRAME_STORED */
+#define WVT_W7_FIRMWARE_FRAME_STORED        0xFF    /*!< Байт режима пакета, части в котором не сжаты */
+#define WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET   4   /*!< Начало данных в части образа: тип, подкоманда, номер части */
+#define WVT_W7_FIRMWARE_STATUS_DATA_OFFSET  11  /*!< Начало списка пропусков: тип, подкоманда, состояние, образ, число частей, число пропусков */
+#define WVT_W7_FIRMWARE_MAX_CHUNK_SIZE      (WVT_W7_BUFFER_SIZE - WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET)
+#define WVT_W7_FIRMWARE_CHECKPOINT_MAGIC    0xF7CB  /*!< Меняется при каждом изменении записи о состоянии приема */
+#define WVT_W7_FIRMWARE_CHECKPOINT_HEADER   53  /*!< Признак, образ, размер, размер части, CRC-32 образа, состояние, число принятых частей, флаги,
+                                                     длина проверенного начала образа и его CRC-32, положение применения патча, номер записи */
+#define WVT_W7_FIRMWARE_CHECKPOINT_SIZE     (WVT_W7_FIRMWARE_CHECKPOINT_HEADER + (WVT_W7_FIRMWARE_MAX_CHUNKS / 8) + 4)
+
+#if (WVT_W7_FIRMWARE_MAX_CHUNKS % 8) || (WVT_W7_FIRMWARE_MAX_CHUNKS > 0xFFFF)
+#error "WVT_W7_FIRMWARE_MAX_CHUNKS must be a multiple of 8 not greater than 65535"
+#endif
+
+#if (WVT_W7_FIRMWARE_DICTIONARY_SIZE >= WVT_W7_FIRMWARE_FRAME_STORED)
+#error "WVT_W7_FIRMWARE_DICTIONARY_SIZE must be less than 255"
+#endif
+
+typedef enum
+{
+    WVT_W7_FIRMWARE_REGION_TARGET       = 0x00,     /*!< Область, в которую записывается новый образ */
+    WVT_W7_FIRMWARE_REGION_STATE        = 0x01,     /*!< Область для сохранения состояния приема, WVT_W7_FIRMWARE_CHECKPOINT_SIZE байт */
+    WVT_W7_FIRMWARE_REGION_ACTIVE       = 0x02,     /*!< Текущий образ, к которому применяется патч. Только чтение */
+    WVT_W7_FIRMWARE_REGION_SCRATCH      = 0x03,     /*!< Область для приема патча */
+    WVT_W7_FIRMWARE_REGION_STATE_B      = 0x04      /*!< Вторая область для сохранения состояния, на другой странице флеш-памяти:
+                                                         записи чередуются, и прерванная запись не портит предыдущую */
+} WVT_W7_Firmware_Region_t;
+
+typedef enum
+{
+    WVT_W7_FIRMWARE_BEGIN               = 0x01,
+    WVT_W7_FIRMWARE_CHUNK               = 0x02,
+    WVT_W7_FIRMWARE_STATUS              = 0x03,
+    WVT_W7_FIRMWARE_COMMIT              = 0x04
+} WVT_W7_Firmware_Command_t;
+
+typedef enum
+{
+    WVT_W7_FIRMWARE_IDLE                = 0x00,
+    WVT_W7_FIRMWARE_RECEIVING           = 0x01,
+    WVT_W7_FIRMWARE_COMPLETE            = 0x02,     /*!< Все части приняты, образ не проверен */
+    WVT_W7_FIRMWARE_VERIFIED            = 0x03,
+    WVT_W7_FIRMWARE_FAILED              = 0x04      /*!< Контрольная сумма не совпала или часть повреждена во флеш-памяти, 
+                                                         образ нужно передать заново */
+} WVT_W7_Firmware_State_t;
+
+/**
+ * Функции доступа к памяти образов. Смещения отсчитываются от начала области
+ */
+typedef struct
+{
+    WVT_W7_Error_t(*read)(WVT_W7_Firmware_Region_t region, uint32_t offset, uint8_t * data, uint16_t length);
+    WVT_W7_Error_t(*write)(WVT_W7_Firmware_Region_t region, uint32_t offset, const uint8_t * data, uint16_t length);
+    WVT_W7_Error_t(*erase)(WVT_W7_Firmware_Region_t region, uint32_t size);     /*!< Стирает первые size байт области */
+    WVT_W7_Error_t(*commit)(uint32_t image, uint32_t size);                     /*!< Образ проверен, приложение может переключиться на него. Необязательна */
+} WVT_W7_Firmware_Storage_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    WVT_W7_Status_t WVT_W7_Firmware_Init(const WVT_W7_Firmware_Storage_t * storage);
+    uint8_t WVT_W7_Firmware_Ready(void);
+    uint8_t WVT_W7_Firmware_Resume(uint8_t * responce_buffer);
+    WVT_W7_Error_t WVT_W7_Firmware_Parse(const uint8_t * data, uint16_t length, 
+        uint8_t * responce_buffer, uint16_t * responce_length);
+    WVT_W7_Status_t WVT_W7_Firmware_Missing(const uint8_t * data, uint16_t length, 
+        uint16_t * chunks, uint16_t * count);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,108 @@
+﻿#include "WVT_Water7_Lz.h"
+
+/**
+ * @brief	Дочитывает длину, записанную в поле токена и байтах продолжения:
+ *          если поле равно WVT_W7_LZ_LENGTH_EXTENDED, к нему прибавляются 
+ *          следующие байты, пока байт равен 255.
+ *
+ * @returns	0 - пакет закончился внутри длины
+ */
+static uint8_t WVT_W7_Lz_Length(const uint8_t * data, uint16_t length, uint16_t * position, uint32_t * value)
+{
+    uint8_t extension;
+
+    if (*value != WVT_W7_LZ_LENGTH_EXTENDED)
+    {
+        return 1;
+    }
+
+    do
+    {
+        if (*position >= length)
+        {
+            return 0;
+        }
+        extension = data[(*position)++];
+        *value += extension;
+    } while (extension == UINT8_MAX);
+
+    return 1;
+}
+
+/**
+ * @brief	Распаковывает блок, сжатый методом LZ77 с окном WVT_W7_LZ_WINDOW байт.
+ *          Блок состоит из последовательностей: токен (старшие 4 бита - число литералов,
+ *          младшие - длина повтора без WVT_W7_LZ_MIN_MATCH), байты продолжения числа литералов,
+ *          литералы, смещение повтора (1 байт), байты продолжения длины повтора. 
+ *          Последняя последовательность заканчивается литералами.
+ *          Повторы ссылаются на распакованные данные этого же блока и на словарь - 
+ *          данные, предшествующие блоку, которые лежат в начале буфера output.
+ *
+ * @param [in] 	data		 	Сжатый блок
+ * @param 	   	length		 	Длина сжатого блока
+ * @param [in/out] output	 	На входе - словарь, за ним - распакованные данные
+ * @param 	   	dictionary	 	Длина словаря в начале output, 0 - блок независим
+ * @param 	   	capacity	 	Размер буфера output вместе со словарем
+ * @param [out]	output_length	Длина распакованных данных без словаря
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Блок распакован
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Блок поврежден или не помещается в буфер
+ */
+WVT_W7_Error_t WVT_W7_Lz_Decompress(const uint8_t * data, uint16_t length, 
+    uint8_t * output, uint16_t dictionary, uint16_t capacity, uint16_t * output_length)
+{
+    uint16_t position = 0;
+    uint16_t written = dictionary;
+
+    if (dictionary > capacity)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    while (position < length)
+    {
+        const uint8_t token = data[position++];
+        uint32_t literals = token >> 4;
+        uint32_t match = token & 0x0F;
+
+        if (    (WVT_W7_Lz_Length(data, length, &position, &literals) == 0)
+            ||  (literals > (uint32_t) (length - position))
+            ||  (literals > (uint32_t) (capacity - written))  )
+        {
+            return WVT_W7_ERROR_CODE_INVALID_VALUE;
+        }
+
+        for (uint32_t i = 0; i < literals; i++)
+        {
+            output[written++] = data[position++];
+        }
+
+        if (position == length)
+        {
+            break;
+        }
+
+        const uint8_t offset = data[position++];
+        if (    (offset == 0)
+            ||  (offset > written)
+            ||  (WVT_W7_Lz_Length(data, length, &position, &match) == 0)  )
+        {
+            return WVT_W7_ERROR_CODE_INVALID_VALUE;
+        }
+
+        match += WVT_W7_LZ_MIN_MATCH;
+        if (match > (uint32_t) (capacity - written))
+        {
+            return WVT_W7_ERROR_CODE_INVALID_VALUE;
+        }
+
+        // Повтор может перекрываться с собой: копируется побайтно
+        for (uint32_t i = 0; i < match; i++, written++)
+        {
+            output[written] = output[written - offset];
+        }
+    }
+
+    *output_length = (uint16_t) (written - dictionary);
+    return WVT_W7_ERROR_CODE_OK;
+}
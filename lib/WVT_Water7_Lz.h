@@ -0,0 +1,20 @@
+﻿#pragma once
+#ifndef WVT_WATER7_LZ_H_
+#define WVT_WATER7_LZ_H_
+
+#include "WVT_Water7.h"
+
+#define WVT_W7_LZ_MIN_MATCH                 3       /*!< Наименьшая длина повтора */
+#define WVT_W7_LZ_WINDOW                    255     /*!< Наибольшее расстояние до повтора: смещение занимает один байт */
+#define WVT_W7_LZ_LENGTH_EXTENDED           15      /*!< Значение поля длины, после которого следуют байты продолжения */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    WVT_W7_Error_t WVT_W7_Lz_Decompress(const uint8_t * data, uint16_t length, 
+        uint8_t * output, uint16_t dictionary, uint16_t capacity, uint16_t * output_length);
+#ifdef __cplusplus
+}
+#endif
+#endif
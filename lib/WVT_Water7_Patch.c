@@ -0,0 +1,353 @@
+﻿#include "WVT_Water7_Patch.h"
+
+#define WVT_W7_PATCH_NO_OP                  0xFF
+
+static uint32_t patch_input = 0;
+static uint32_t patch_output = 0;
+static uint32_t patch_source = 0;
+static uint32_t patch_remaining = 0;
+static uint32_t patch_old_size = 0;
+static uint32_t patch_new_size = 0;
+static uint8_t patch_op = WVT_W7_PATCH_NO_OP;
+static uint8_t patch_resumed = 0;
+
+/**
+ * @brief	Начинает применение патча с начала
+ */
+void WVT_W7_Patch_Reset(void)
+{
+    patch_input = 0;
+    patch_output = 0;
+    patch_source = 0;
+    patch_remaining = 0;
+    patch_old_size = 0;
+    patch_new_size = 0;
+    patch_op = WVT_W7_PATCH_NO_OP;
+    patch_resumed = 0;
+}
+
+/**
+ * @brief	Проверяет, что патч применен полностью
+ */
+uint8_t WVT_W7_Patch_Done(void)
+{
+    return (patch_input >= WVT_W7_PATCH_HEADER_SIZE)
+        && (patch_op == WVT_W7_PATCH_NO_OP)
+        && (patch_output == patch_new_size);
+}
+
+/**
+ * @brief	Размер нового образа из заголовка патча
+ */
+uint32_t WVT_W7_Patch_Output_Size(void)
+{
+    return patch_new_size;
+}
+
+/**
+ * @brief	Число байт нового образа, уже записанных в WVT_W7_FIRMWARE_REGION_TARGET
+ */
+uint32_t WVT_W7_Patch_Written(void)
+{
+    return patch_output;
+}
+
+/**
+ * @brief	Записывает положение применения патча для сохранения состояния приема
+ *
+ * @param [out]	state	WVT_W7_PATCH_STATE_SIZE байт
+ */
+void WVT_W7_Patch_Save(uint8_t * state)
+{
+    const uint32_t values[6] = { patch_input, patch_output, patch_source, patch_remaining, patch_old_size, patch_new_size };
+
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        state[(4 * i) + 0] = (uint8_t) (values[i] >> 24);
+        state[(4 * i) + 1] = (uint8_t) (values[i] >> 16);
+        state[(4 * i) + 2] = (uint8_t) (values[i] >> 8);
+        state[(4 * i) + 3] = (uint8_t)  values[i];
+    }
+    state[24] = patch_op;
+}
+
+/**
+ * @brief	Продолжает применение патча с сохраненного положения. Новый образ за ним мог быть 
+ *          записан до перезагрузки, поэтому следующие блоки сначала сравниваются с записанными
+ *
+ * @param [in]	state	WVT_W7_PATCH_STATE_SIZE байт из WVT_W7_Patch_Save
+ */
+void WVT_W7_Patch_Load(const uint8_t * state)
+{
+    uint32_t values[6];
+
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        values[i] = ((uint32_t) state[4 * i] << 24) + ((uint32_t) state[(4 * i) + 1] << 16) 
+            + ((uint32_t) state[(4 * i) + 2] << 8) + state[(4 * i) + 3];
+    }
+    patch_input = values[0];
+    patch_output = values[1];
+    patch_source = values[2];
+    patch_remaining = values[3];
+    patch_old_size = values[4];
+    patch_new_size = values[5];
+    patch_op = state[24];
+    patch_resumed = 1;
+}
+
+/**
+ * @brief	Записывает блок нового образа. После восстановления положения блок мог быть записан 
+ *          до перезагрузки целиком или частично: записанная флеш-память не записывается второй раз, 
+ *          дописывается только стертый остаток. Первый не записанный целиком блок - последний такой
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Блок записан
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Память повреждена прерванной записью
+ *          - Код ошибки функций доступа к памяти
+ */
+static WVT_W7_Error_t WVT_W7_Patch_Write(const WVT_W7_Firmware_Storage_t * storage, const uint8_t * block, uint16_t length)
+{
+    uint8_t written[WVT_W7_FIRMWARE_VERIFY_BLOCK];
+    uint16_t count = 0;
+
+    if (patch_resumed)
+    {
+        const WVT_W7_Error_t result = storage->read(WVT_W7_FIRMWARE_REGION_TARGET, patch_output, written, length);
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            return result;
+        }
+
+        while ((count < length) && (written[count] == block[count]))
+        {
+            count++;
+        }
+        for (uint16_t i = count; i < length; i++)
+        {
+            if (written[i] != 0xFF)
+            {
+                return WVT_W7_ERROR_CODE_INVALID_VALUE;
+            }
+        }
+        if (count < length)
+        {
+            patch_resumed = 0;
+        }
+    }
+
+    if (count == length)
+    {
+        return WVT_W7_ERROR_CODE_OK;
+    }
+    return storage->write(WVT_W7_FIRMWARE_REGION_TARGET, patch_output + count, block + count, (uint16_t) (length - count));
+}
+
+/**
+ * @brief	Читает заголовок патча, проверяет исходный образ и стирает область нового образа
+ */
+static WVT_W7_Error_t WVT_W7_Patch_Header(const WVT_W7_Firmware_Storage_t * storage)
+{
+    uint8_t block[WVT_W7_FIRMWARE_VERIFY_BLOCK];
+    uint32_t crc = 0;
+    WVT_W7_Error_t result = storage->read(WVT_W7_FIRMWARE_REGION_SCRATCH, 0, block, WVT_W7_PATCH_HEADER_SIZE);
+
+    if (result != WVT_W7_ERROR_CODE_OK)
+    {
+        return result;
+    }
+
+    patch_old_size = ((uint32_t) block[0] << 24) + ((uint32_t) block[1] << 16) + ((uint32_t) block[2] << 8) + block[3];
+    const uint32_t old_crc = ((uint32_t) block[4] << 24) + ((uint32_t) block[5] << 16) + ((uint32_t) block[6] << 8) + block[7];
+    patch_new_size = ((uint32_t) block[8] << 24) + ((uint32_t) block[9] << 16) + ((uint32_t) block[10] << 8) + block[11];
+
+    // Патч применим только к тому образу, от которого он построен
+    for (uint32_t offset = 0; offset < patch_old_size; offset += WVT_W7_FIRMWARE_VERIFY_BLOCK)
+    {
+        const uint16_t block_length = (uint16_t) (((patch_old_size - offset) < WVT_W7_FIRMWARE_VERIFY_BLOCK) 
+            ? (patch_old_size - offset) : WVT_W7_FIRMWARE_VERIFY_BLOCK);
+
+        result = storage->read(WVT_W7_FIRMWARE_REGION_ACTIVE, offset, block, block_length);
+        if (result != WVT_W7_ERROR_CODE_OK)
+        {
+            return result;
+        }
+        crc = WVT_W7_Crc32(crc, block, block_length);
+    }
+
+    if (    (crc != old_crc)
+        ||  (patch_new_size == 0)  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    result = storage->erase(WVT_W7_FIRMWARE_REGION_TARGET, patch_new_size);
+    if (result == WVT_W7_ERROR_CODE_OK)
+    {
+        patch_input = WVT_W7_PATCH_HEADER_SIZE;
+    }
+    return result;
+}
+
+/**
+ * @brief	Читает команду патча
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Команда прочитана или еще не принята целиком (patch_op не изменился)
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Неизвестная команда или выход за границы образов
+ */
+static WVT_W7_Error_t WVT_W7_Patch_Op(const WVT_W7_Firmware_Storage_t * storage, uint32_t available, uint32_t size)
+{
+    uint8_t op[WVT_W7_PATCH_OP_MAX];
+    const uint16_t op_length = ((available - patch_input) < WVT_W7_PATCH_OP_MAX) 
+        ? (uint16_t) (available - patch_input) : WVT_W7_PATCH_OP_MAX;
+    uint32_t offset = 0;
+    uint32_t length;
+    uint8_t position = 1;
+    uint8_t encoded_length;
+
+    WVT_W7_Error_t result = storage->read(WVT_W7_FIRMWARE_REGION_SCRATCH, patch_input, op, op_length);
+    if (result != WVT_W7_ERROR_CODE_OK)
+    {
+        return result;
+    }
+
+    if (op[0] > WVT_W7_PATCH_INSERT)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    if (op[0] != WVT_W7_PATCH_INSERT)
+    {
+        encoded_length = WVT_W7_Get_Varint(op + position, (uint16_t) (op_length - position), &offset);
+        if (encoded_length == 0)
+        {
+            // Команда обрывается на непринятой части
+            return (available < size) ? WVT_W7_ERROR_CODE_OK : WVT_W7_ERROR_CODE_INVALID_VALUE;
+        }
+        position += encoded_length;
+    }
+
+    encoded_length = WVT_W7_Get_Varint(op + position, (uint16_t) (op_length - position), &length);
+    if (encoded_length == 0)
+    {
+        return (available < size) ? WVT_W7_ERROR_CODE_OK : WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+    position += encoded_length;
+
+    const uint32_t source = patch_source + WVT_W7_Unzigzag(offset);
+    if (    (length == 0)
+        ||  (length > (patch_new_size - patch_output))
+        ||  (   (op[0] != WVT_W7_PATCH_INSERT)
+            &&  ((source > patch_old_size) || (length > (patch_old_size - source))) )  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    if (op[0] != WVT_W7_PATCH_INSERT)
+    {
+        patch_source = source;
+    }
+    patch_op = op[0];
+    patch_remaining = length;
+    patch_input += position;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Применяет принятое начало патча, продолжая с места предыдущего вызова.
+ *          Патч хранится в области WVT_W7_FIRMWARE_REGION_SCRATCH, исходный образ - 
+ *          в WVT_W7_FIRMWARE_REGION_ACTIVE, новый образ записывается последовательно 
+ *          в WVT_W7_FIRMWARE_REGION_TARGET. Используется буфер на WVT_W7_FIRMWARE_VERIFY_BLOCK байт.
+ *
+ * @param 	storage		Функции доступа к памяти образов
+ * @param 	available	Число принятых подряд байт патча с начала
+ * @param 	size		Размер патча
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Принятая часть применена
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Патч поврежден или построен для другого образа
+ *          - Код ошибки функций доступа к памяти
+ */
+WVT_W7_Error_t WVT_W7_Patch_Apply(const WVT_W7_Firmware_Storage_t * storage, uint32_t available, uint32_t size)
+{
+    uint8_t block[WVT_W7_FIRMWARE_VERIFY_BLOCK];
+    uint8_t old_block[WVT_W7_FIRMWARE_VERIFY_BLOCK];
+    WVT_W7_Error_t result = WVT_W7_ERROR_CODE_OK;
+
+    if (patch_input == 0)
+    {
+        if (available < WVT_W7_PATCH_HEADER_SIZE)
+        {
+            return (available < size) ? WVT_W7_ERROR_CODE_OK : WVT_W7_ERROR_CODE_INVALID_VALUE;
+        }
+        result = WVT_W7_Patch_Header(storage);
+    }
+
+    while (result == WVT_W7_ERROR_CODE_OK)
+    {
+        if (patch_op == WVT_W7_PATCH_NO_OP)
+        {
+            if (patch_input >= available)
+            {
+                break;
+            }
+
+            const uint32_t input = patch_input;
+            result = WVT_W7_Patch_Op(storage, available, size);
+            if (patch_input == input)
+            {
+                break;
+            }
+            continue;
+        }
+
+        uint16_t length = (patch_remaining < WVT_W7_FIRMWARE_VERIFY_BLOCK) 
+            ? (uint16_t) patch_remaining : WVT_W7_FIRMWARE_VERIFY_BLOCK;
+
+        if (patch_op != WVT_W7_PATCH_COPY)
+        {
+            if (patch_input >= available)
+            {
+                break;
+            }
+            if ((available - patch_input) < length)
+            {
+                length = (uint16_t) (available - patch_input);
+            }
+            result = storage->read(WVT_W7_FIRMWARE_REGION_SCRATCH, patch_input, block, length);
+        }
+
+        if (    (result == WVT_W7_ERROR_CODE_OK)
+            &&  (patch_op != WVT_W7_PATCH_INSERT)  )
+        {
+            result = storage->read(WVT_W7_FIRMWARE_REGION_ACTIVE, patch_source, old_block, length);
+            for (uint16_t i = 0; i < length; i++)
+            {
+                block[i] = (patch_op == WVT_W7_PATCH_ADD) ? (uint8_t) (block[i] + old_block[i]) : old_block[i];
+            }
+            patch_source += length;
+        }
+
+        if (result == WVT_W7_ERROR_CODE_OK)
+        {
+            result = WVT_W7_Patch_Write(storage, block, length);
+        }
+
+        if (patch_op != WVT_W7_PATCH_COPY)
+        {
+            patch_input += length;
+        }
+        patch_output += length;
+        patch_remaining -= length;
+        if (patch_remaining == 0)
+        {
+            patch_op = WVT_W7_PATCH_NO_OP;
+        }
+    }
+
+    if (    (result == WVT_W7_ERROR_CODE_OK)
+        &&  (available >= size)
+        &&  (WVT_W7_Patch_Done() == 0)  )
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+    return result;
+}
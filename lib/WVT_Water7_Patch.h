@@ -0,0 +1,36 @@
+﻿#pragma once
+#ifndef WVT_WATER7_PATCH_H_
+#define WVT_WATER7_PATCH_H_
+
+#include "WVT_Water7_Firmware.h"
+
+#define WVT_W7_PATCH_HEADER_SIZE            12  /*!< Заголовок патча: размер и CRC-32 исходного образа, размер нового образа */
+#define WVT_W7_PATCH_OP_MAX                 (1 + (2 * WVT_W7_VARINT_MAX_LENGTH))
+#define WVT_W7_PATCH_STATE_SIZE             25  /*!< Положение применения патча: позиции в патче, новом и исходном образах, 
+                                                     остаток команды, размеры образов, команда */
+
+/**
+ * Команды патча. Указатель в исходном образе сдвигается командами COPY и ADD
+ */
+typedef enum
+{
+    WVT_W7_PATCH_COPY                   = 0x00,     /*!< Смещение указателя (zigzag varint), длина (varint): копирует байты исходного образа */
+    WVT_W7_PATCH_ADD                    = 0x01,     /*!< Смещение указателя, длина, байты: прибавляет байты к исходному образу */
+    WVT_W7_PATCH_INSERT                 = 0x02      /*!< Длина, байты: новые данные */
+} WVT_W7_Patch_Op_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void WVT_W7_Patch_Reset(void);
+    WVT_W7_Error_t WVT_W7_Patch_Apply(const WVT_W7_Firmware_Storage_t * storage, uint32_t available, uint32_t size);
+    uint8_t WVT_W7_Patch_Done(void);
+    uint32_t WVT_W7_Patch_Output_Size(void);
+    uint32_t WVT_W7_Patch_Written(void);
+    void WVT_W7_Patch_Save(uint8_t * state);
+    void WVT_W7_Patch_Load(const uint8_t * state);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,362 @@
+﻿#include "WVT_Water7_Series.h"
+
+#define WVT_W7_SERIES_CAPACITY_BITS         ((WVT_W7_BUFFER_SIZE - WVT_W7_SERIES_DATA_OFFSET) * 8)
+
+static uint8_t series_frame[WVT_W7_BUFFER_SIZE];
+static uint16_t series_bits = 0;
+static uint16_t series_count = 0;
+static uint16_t series_max_samples = 0;
+static uint32_t series_deadline = 0;
+static uint32_t series_first_timestamp = 0;
+static uint32_t series_timestamp = 0;
+static uint32_t series_delta = 0;
+static uint32_t series_value = 0;
+
+/** Ширина полей с префиксами '10', '110', '1110' и '1111' */
+static const uint8_t time_widths[4] = { 7, 9, 12, 32 };
+static const uint8_t value_widths[4] = { 6, 12, 20, 32 };
+
+/**
+ * @brief	Настраивает накопление отсчетов
+ *
+ * @param   max_samples		   	Наибольшее число отсчетов в сообщении. 
+ *                              0 - сообщение отправляется, когда заполнен кадр
+ * @param   deadline		   	Наибольший возраст первого отсчета в секундах, 
+ *                              после которого сообщение отправляется при вызове WVT_W7_Series_Poll.
+ *                              0 - без ограничения
+ */
+void WVT_W7_Series_Init(uint16_t max_samples, uint32_t deadline)
+{
+    series_max_samples = max_samples;
+    series_deadline = deadline;
+    series_count = 0;
+}
+
+/**
+ * @brief	Записывает биты в поток, начиная со старшего
+ */
+static void WVT_W7_Series_Put_Bits(uint32_t value, uint8_t width)
+{
+    for (uint8_t i = width; i > 0; i--)
+    {
+        const uint16_t byte = WVT_W7_SERIES_DATA_OFFSET + (series_bits >> 3);
+
+        if ((series_bits & 7) == 0)
+        {
+            series_frame[byte] = 0;
+        }
+        if ((value >> (i - 1)) & 1)
+        {
+            series_frame[byte] |= (uint8_t) (0x80 >> (series_bits & 7));
+        }
+        series_bits++;
+    }
+}
+
+/**
+ * @brief	Кодирует число в zigzag кодом переменной длины: '0' - ноль,
+ *          иначе префикс из единиц, завершаемый нулем (кроме последнего '1111'),
+ *          и поле ширины widths[число единиц - 1]
+ *
+ * @param 	value		Число в zigzag
+ * @param 	widths		Ширина полей
+ * @param 	write		0 - только рассчитать размер, иначе - записать в поток
+ *
+ * @returns	Число бит
+ */
+static uint8_t WVT_W7_Series_Field(uint32_t value, const uint8_t * widths, uint8_t write)
+{
+    uint8_t prefix = 0;
+
+    if (value == 0)
+    {
+        if (write)
+        {
+            WVT_W7_Series_Put_Bits(0x0, 1);
+        }
+        return 1;
+    }
+
+    while ((prefix < 3) && (value >= (1UL << widths[prefix])))
+    {
+        prefix++;
+    }
+
+    const uint8_t prefix_width = (prefix < 3) ? (uint8_t) (prefix + 2) : 4;
+    if (write)
+    {
+        WVT_W7_Series_Put_Bits((prefix < 3) ? ((1UL << prefix_width) - 2) : 0xF, prefix_width);
+        WVT_W7_Series_Put_Bits(value, widths[prefix]);
+    }
+    return (uint8_t) (prefix_width + widths[prefix]);
+}
+
+/**
+ * @brief	Кодирует отсчет после первого.
+ *          Время записывается как разность соседних интервалов (delta-of-delta),
+ *          при постоянном периоде отсчет занимает 1 бит. Значение записывается
+ *          разностью с предыдущим: показания счетчиков - целые числа, и разность 
+ *          занимает меньше бит, чем XOR, в котором переносы меняют старшие разряды.
+ *
+ * @param 	timestamp	Время отсчета
+ * @param 	value		Значение отсчета
+ * @param 	write		0 - только рассчитать размер, иначе - записать отсчет в поток
+ *
+ * @returns	Число бит, занимаемых отсчетом
+ */
+static uint16_t WVT_W7_Series_Sample(uint32_t timestamp, uint32_t value, uint8_t write)
+{
+    const uint32_t delta = timestamp - series_timestamp;
+    const uint16_t bits = (uint16_t) (WVT_W7_Series_Field(WVT_W7_Zigzag(delta - series_delta), time_widths, write)
+        + WVT_W7_Series_Field(WVT_W7_Zigzag(value - series_value), value_widths, write));
+
+    if (write)
+    {
+        series_delta = delta;
+        series_timestamp = timestamp;
+        series_value = value;
+        series_count++;
+    }
+
+    return bits;
+}
+
+/**
+ * @brief	Начинает новое сообщение с отсчета, записанного без сжатия
+ */
+static void WVT_W7_Series_Start(uint32_t timestamp, uint32_t value)
+{
+    series_frame[3] = (timestamp >> 24);
+    series_frame[4] = (timestamp >> 16);
+    series_frame[5] = (timestamp >> 8);
+    series_frame[6] =  timestamp;
+    series_frame[7] = (value >> 24);
+    series_frame[8] = (value >> 16);
+    series_frame[9] = (value >> 8);
+    series_frame[10] = value;
+
+    series_first_timestamp = timestamp;
+    series_timestamp = timestamp;
+    series_delta = 0;
+    series_value = value;
+    series_bits = 0;
+    series_count = 1;
+}
+
+/**
+ * @brief	    Добавляет отсчет в накапливаемое сообщение.
+ *              Если отсчет не помещается в кадр или в сообщении уже max_samples отсчетов,
+ *              накопленное сообщение выгружается в выходной буфер, а отсчет начинает следующее.
+ *
+ * @param 	   	timestamp	   	Время отсчета в секундах
+ * @param 	   	value		   	Значение
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если отправлять нечего).
+ */
+uint8_t WVT_W7_Series_Add(uint32_t timestamp, int32_t value, uint8_t * responce_buffer)
+{
+    uint8_t responce_length = 0;
+
+    if (series_count > 0)
+    {
+        if (    ((series_max_samples == 0) || (series_count < series_max_samples))
+            &&  ((series_bits + WVT_W7_Series_Sample(timestamp, (uint32_t) value, 0)) <= WVT_W7_SERIES_CAPACITY_BITS)  )
+        {
+            WVT_W7_Series_Sample(timestamp, (uint32_t) value, 1);
+            if (series_count == series_max_samples)
+            {
+                return WVT_W7_Series_Flush(responce_buffer);
+            }
+            return 0;
+        }
+
+        responce_length = WVT_W7_Series_Flush(responce_buffer);
+    }
+
+    WVT_W7_Series_Start(timestamp, (uint32_t) value);
+    return responce_length;
+}
+
+/**
+ * @brief	    Проверяет возраст накопленного сообщения
+ *
+ * @param 	   	now		   	    Текущее время в секундах
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если отправлять нечего).
+ */
+uint8_t WVT_W7_Series_Poll(uint32_t now, uint8_t * responce_buffer)
+{
+    if (    (series_count > 0)
+        &&  (series_deadline > 0)
+        &&  ((now - series_first_timestamp) >= series_deadline)  )
+    {
+        return WVT_W7_Series_Flush(responce_buffer);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief	    Выгружает накопленные отсчеты, не дожидаясь заполнения кадра
+ *
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если отсчетов нет).
+ */
+uint8_t WVT_W7_Series_Flush(uint8_t * responce_buffer)
+{
+    const uint16_t responce_length = WVT_W7_SERIES_DATA_OFFSET + ((series_bits + 7) >> 3);
+
+    if (series_count == 0)
+    {
+        return 0;
+    }
+
+    series_frame[0] = WVT_W7_PACKET_TYPE_SERIES;
+    series_frame[1] = (series_count >> 8);
+    series_frame[2] =  series_count;
+
+    for (uint16_t i = 0; i < responce_length; i++)
+    {
+        responce_buffer[i] = series_frame[i];
+    }
+    series_count = 0;
+
+    return (uint8_t) responce_length;
+}
+
+typedef struct
+{
+    const uint8_t * data;
+    uint16_t position;
+    uint16_t limit;
+} WVT_W7_Bit_Reader_t;
+
+/**
+ * @brief	Читает биты из потока, начиная со старшего
+ *
+ * @returns	0 - поток закончился
+ */
+static uint8_t WVT_W7_Series_Get_Bits(WVT_W7_Bit_Reader_t * reader, uint8_t width, uint32_t * value)
+{
+    uint32_t result = 0;
+
+    if ((uint32_t) reader->position + width > reader->limit)
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < width; i++)
+    {
+        const uint8_t bit = (reader->data[reader->position >> 3] >> (7 - (reader->position & 7))) & 1;
+        result = (result << 1) | bit;
+        reader->position++;
+    }
+
+    *value = result;
+    return 1;
+}
+
+/**
+ * @brief	Читает число, записанное WVT_W7_Series_Field, и переводит его из zigzag
+ *
+ * @returns	0 - поток закончился
+ */
+static uint8_t WVT_W7_Series_Get_Field(WVT_W7_Bit_Reader_t * reader, const uint8_t * widths, uint32_t * value)
+{
+    uint32_t bit;
+    uint32_t field = 0;
+    uint8_t prefix = 0;
+
+    // Число единиц перед нулем определяет ширину поля
+    while (prefix < 4)
+    {
+        if (WVT_W7_Series_Get_Bits(reader, 1, &bit) == 0)
+        {
+            return 0;
+        }
+        if (bit == 0)
+        {
+            break;
+        }
+        prefix++;
+    }
+
+    if (    (prefix > 0)
+        &&  (WVT_W7_Series_Get_Bits(reader, widths[prefix - 1], &field) == 0)  )
+    {
+        return 0;
+    }
+
+    *value = WVT_W7_Unzigzag(field);
+    return 1;
+}
+
+/**
+ * @brief	Разбирает сообщение с накопленными отсчетами (на стороне сервера)
+ *
+ * @param 	   	data		   	Принятый пакет
+ * @param 	   	length		   	Длина пакета
+ * @param [out]	timestamps	   	Время отсчетов
+ * @param [out]	values		   	Значения отсчетов
+ * @param [in/out] count		На входе - размер массивов, на выходе - число отсчетов
+ *
+ * @returns	- WVT_W7_OK     Пакет разобран
+ *          - WVT_W7_ERROR  Неверный тип или формат пакета, либо отсчеты не помещаются в массивы
+ */
+WVT_W7_Status_t WVT_W7_Series_Decode(const uint8_t * data, uint16_t length,
+    uint32_t * timestamps, int32_t * values, uint16_t * count)
+{
+    if (    (data == 0)
+        ||  (length < WVT_W7_SERIES_DATA_OFFSET)
+        ||  (data[0] != WVT_W7_PACKET_TYPE_SERIES)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    const uint16_t number_of_samples = (uint16_t) ((data[1] << 8) + data[2]);
+    WVT_W7_Bit_Reader_t reader = { data + WVT_W7_SERIES_DATA_OFFSET, 0, 
+        (uint16_t) ((length - WVT_W7_SERIES_DATA_OFFSET) * 8) };
+    uint32_t timestamp = ((uint32_t) data[3] << 24) + ((uint32_t) data[4] << 16) + ((uint32_t) data[5] << 8) + data[6];
+    uint32_t value = ((uint32_t) data[7] << 24) + ((uint32_t) data[8] << 16) + ((uint32_t) data[9] << 8) + data[10];
+    uint32_t delta = 0;
+
+    if (    (number_of_samples == 0)
+        ||  (number_of_samples > *count)  )
+    {
+        return WVT_W7_ERROR;
+    }
+
+    timestamps[0] = timestamp;
+    values[0] = (int32_t) value;
+
+    for (uint16_t i = 1; i < number_of_samples; i++)
+    {
+        uint32_t delta_of_delta;
+        uint32_t value_delta;
+
+        if (    (WVT_W7_Series_Get_Field(&reader, time_widths, &delta_of_delta) == 0)
+            ||  (WVT_W7_Series_Get_Field(&reader, value_widths, &value_delta) == 0)  )
+        {
+            return WVT_W7_ERROR;
+        }
+
+        delta += delta_of_delta;
+        timestamp += delta;
+        value += value_delta;
+
+        timestamps[i] = timestamp;
+        values[i] = (int32_t) value;
+    }
+
+    // Допускается только дополнение последнего байта
+    if ((reader.limit - reader.position) >= 8)
+    {
+        return WVT_W7_ERROR;
+    }
+
+    *count = number_of_samples;
+    return WVT_W7_OK;
+}
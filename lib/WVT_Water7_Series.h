@@ -0,0 +1,22 @@
+﻿#pragma once
+#ifndef WVT_WATER7_SERIES_H_
+#define WVT_WATER7_SERIES_H_
+
+#include "WVT_Water7.h"
+
+#define WVT_W7_SERIES_DATA_OFFSET           11  /*!< Начало битового потока: тип, число отсчетов, время и значение первого отсчета */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void WVT_W7_Series_Init(uint16_t max_samples, uint32_t deadline);
+    uint8_t WVT_W7_Series_Add(uint32_t timestamp, int32_t value, uint8_t * responce_buffer);
+    uint8_t WVT_W7_Series_Poll(uint32_t now, uint8_t * responce_buffer);
+    uint8_t WVT_W7_Series_Flush(uint8_t * responce_buffer);
+    WVT_W7_Status_t WVT_W7_Series_Decode(const uint8_t * data, uint16_t length,
+        uint32_t * timestamps, int32_t * values, uint16_t * count);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,201 @@
+﻿#include "WVT_Water7_Subscriptions.h"
+
+extern WVT_W7_Callbacks_t externals_functions;
+
+typedef struct
+{
+    uint16_t address;
+    uint8_t mode;
+    uint8_t pending;
+    uint32_t threshold;
+    uint16_t min_interval;
+    uint16_t max_interval;
+    int32_t last_value;
+    uint32_t last_report;
+} WVT_W7_Subscription_t;
+
+static WVT_W7_Subscription_t subscriptions[WVT_W7_SUBSCRIPTIONS_MAX];
+
+/**
+ * @brief	Удаляет все подписки. Таблица подписок хранится в ОЗУ, 
+ *          после перезагрузки сервер должен повторить подписку
+ */
+void WVT_W7_Subscriptions_Clear(void)
+{
+    for (uint8_t i = 0; i < WVT_W7_SUBSCRIPTIONS_MAX; i++)
+    {
+        subscriptions[i].mode = WVT_W7_SUBSCRIPTION_NONE;
+    }
+}
+
+/**
+ * @brief	Обрабатывает запрос подписки на изменения параметра.
+ *          Формат запроса: тип, адрес (2 байта), режим, порог (4 байта),
+ *          минимальный и максимальный интервалы между уведомлениями в секундах (по 2 байта).
+ *          Максимальный интервал 0 отключает периодические уведомления без изменений.
+ *          Повторная подписка на тот же адрес заменяет прежние настройки.
+ *
+ * @param [in] 	data		   	Запрос длинной WVT_W7_SUBSCRIBE_LENGTH
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Подписка изменена
+ *          - WVT_W7_ERROR_CODE_INVALID_VALUE   Неверный режим или таблица подписок заполнена
+ * 			- Код ошибки rom_read		        Параметр не может быть прочитан. Запрос не приостанавливается: 
+ *			                                    на WVT_W7_ERROR_CODE_BUSY сервер получает ошибку и повторяет подписку
+ */
+WVT_W7_Error_t WVT_W7_Subscribe(const uint8_t * data)
+{
+    const uint16_t address = (uint16_t) ((data[1] << 8) + data[2]);
+    const uint8_t mode = data[3];
+    WVT_W7_Subscription_t * free_entry = 0;
+    WVT_W7_Subscription_t * entry = 0;
+    int32_t value;
+
+    for (uint8_t i = 0; i < WVT_W7_SUBSCRIPTIONS_MAX; i++)
+    {
+        if (subscriptions[i].mode == WVT_W7_SUBSCRIPTION_NONE)
+        {
+            free_entry = (free_entry == 0) ? &subscriptions[i] : free_entry;
+        }
+        else if (subscriptions[i].address == address)
+        {
+            entry = &subscriptions[i];
+        }
+    }
+
+    if (mode == WVT_W7_SUBSCRIPTION_NONE)
+    {
+        if (entry != 0)
+        {
+            entry->mode = WVT_W7_SUBSCRIPTION_NONE;
+        }
+        return WVT_W7_ERROR_CODE_OK;
+    }
+
+    if (mode > WVT_W7_SUBSCRIPTION_RELATIVE)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    entry = (entry == 0) ? free_entry : entry;
+    if (entry == 0)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+
+    const WVT_W7_Error_t rom_operation_result = externals_functions.rom_read(address, &value);
+    if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+    {
+        return rom_operation_result;
+    }
+
+    entry->address = address;
+    entry->mode = mode;
+    entry->threshold =    ((uint32_t) data[4] << 24)
+                        + ((uint32_t) data[5] << 16)
+                        + ((uint32_t) data[6] << 8)
+                        +   data[7];
+    entry->min_interval = (uint16_t) ((data[8] << 8) + data[9]);
+    entry->max_interval = (uint16_t) ((data[10] << 8) + data[11]);
+    entry->last_value = value;
+    // Первое уведомление после подписки сообщает текущее значение
+    entry->pending = 1;
+
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/**
+ * @brief	Проверяет, пересекло ли значение порог подписки относительно 
+ *          последнего отправленного значения
+ */
+static uint8_t WVT_W7_Threshold_Crossed(const WVT_W7_Subscription_t * entry, int32_t value)
+{
+    int64_t change = (int64_t) value - entry->last_value;
+    int64_t base = entry->last_value;
+
+    change = (change < 0) ? -change : change;
+    base = (base < 0) ? -base : base;
+
+    if (change == 0)
+    {
+        return 0;
+    }
+
+    if (entry->mode == WVT_W7_SUBSCRIPTION_ABSOLUTE)
+    {
+        return change >= (int64_t) entry->threshold;
+    }
+
+    return (change * 1000) >= ((int64_t) entry->threshold * base);
+}
+
+/**
+ * @brief	    Опрашивает параметры с подпиской и формирует уведомление о тех,
+ *              значение которых пересекло порог (не чаще минимального интервала)
+ *              или не отправлялось дольше максимального интервала.
+ *              Формат уведомления: тип, число записей, записи по WVT_W7_NOTIFY_WIDTH байт:
+ *              адрес (2 байта) и значение (4 байта).
+ *              Параметр, который не удалось прочитать (в том числе WVT_W7_ERROR_CODE_BUSY), 
+ *              проверяется при следующем опросе.
+ *
+ * @param 	   	now		   	    Текущее время в секундах
+ * @param [out]	responce_buffer	Выходной буфер с сообщением NB-Fi.
+ *
+ * @returns	Число байт, записанных в выходной буфер (0, если уведомлять не о чем).
+ */
+uint8_t WVT_W7_Subscriptions_Poll(uint32_t now, uint8_t * responce_buffer)
+{
+    uint8_t notifications = 0;
+
+    for (uint8_t i = 0; i < WVT_W7_SUBSCRIPTIONS_MAX; i++)
+    {
+        WVT_W7_Subscription_t * entry = &subscriptions[i];
+        int32_t value;
+
+        if (entry->mode == WVT_W7_SUBSCRIPTION_NONE)
+        {
+            continue;
+        }
+
+        const uint32_t elapsed = now - entry->last_report;
+        if (    (entry->pending == 0)
+            &&  (elapsed < entry->min_interval)  )
+        {
+            continue;
+        }
+
+        if (externals_functions.rom_read(entry->address, &value) != WVT_W7_ERROR_CODE_OK)
+        {
+            continue;
+        }
+
+        if (    (entry->pending == 0)
+            &&  (WVT_W7_Threshold_Crossed(entry, value) == 0)
+            &&  ((entry->max_interval == 0) || (elapsed < entry->max_interval))  )
+        {
+            continue;
+        }
+
+        uint8_t * record = responce_buffer + WVT_W7_NOTIFY_DATA_OFFSET + (notifications * WVT_W7_NOTIFY_WIDTH);
+        record[0] = (entry->address >> 8);
+        record[1] =  entry->address;
+        record[2] = (value >> 24);
+        record[3] = (value >> 16);
+        record[4] = (value >> 8);
+        record[5] =  value;
+        notifications++;
+
+        entry->last_value = value;
+        entry->last_report = now;
+        entry->pending = 0;
+    }
+
+    if (notifications == 0)
+    {
+        return 0;
+    }
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_NOTIFY;
+    responce_buffer[1] = notifications;
+
+    return WVT_W7_NOTIFY_DATA_OFFSET + (notifications * WVT_W7_NOTIFY_WIDTH);
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+#ifndef WVT_WATER7_SUBSCRIPTIONS_H_
+#define WVT_WATER7_SUBSCRIPTIONS_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_SUBSCRIPTIONS_MAX
+#define WVT_W7_SUBSCRIPTIONS_MAX            8   /*!< Число параметров, на изменения которых можно подписаться */
+#endif
+
+#define WVT_W7_SUBSCRIBE_LENGTH             12UL
+#define WVT_W7_NOTIFY_DATA_OFFSET           2   /*!< Начало записей в уведомлении об изменениях */
+#define WVT_W7_NOTIFY_WIDTH                 6   /*!< Число байт на запись: адрес и значение параметра */
+
+#if (WVT_W7_NOTIFY_DATA_OFFSET + (WVT_W7_SUBSCRIPTIONS_MAX * WVT_W7_NOTIFY_WIDTH)) > WVT_W7_BUFFER_SIZE
+#error "WVT_W7_SUBSCRIPTIONS_MAX does not fit into WVT_W7_BUFFER_SIZE"
+#endif
+
+typedef enum
+{
+    WVT_W7_SUBSCRIPTION_NONE        = 0x00, /*!< Отменить подписку */
+    WVT_W7_SUBSCRIPTION_ABSOLUTE    = 0x01, /*!< Порог - абсолютное изменение значения */
+    WVT_W7_SUBSCRIPTION_RELATIVE    = 0x02  /*!< Порог - изменение в десятых долях процента */
+} WVT_W7_Subscription_Mode_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    WVT_W7_Error_t WVT_W7_Subscribe(const uint8_t * data);
+    uint8_t WVT_W7_Subscriptions_Poll(uint32_t now, uint8_t * responce_buffer);
+    void WVT_W7_Subscriptions_Clear(void);
+#ifdef __cplusplus
+}
+#endif
+#endif 
@@ -0,0 +1,174 @@
+﻿#include "WVT_Water7_Sync.h"
+
+extern WVT_W7_Callbacks_t externals_functions;
+
+static uint32_t sync_version = 0;
+static uint32_t block_versions[WVT_W7_SYNC_BLOCKS];
+static uint8_t sync_ready = 0;
+
+/**
+ * @brief	Включает отслеживание изменений параметров.
+ *          Счетчики хранятся в ОЗУ, поэтому после перезагрузки все блоки считаются
+ *          измененными в версии version. Чтобы сервер с более старой версией получил
+ *          все параметры, а с более новой - только изменения, приложение передает
+ *          версию, сохраненную до перезагрузки (WVT_W7_Sync_Version), увеличенную на единицу.
+ *
+ * @param 	version		Начальная версия
+ */
+void WVT_W7_Sync_Init(uint32_t version)
+{
+    sync_version = version;
+    for (uint16_t i = 0; i < WVT_W7_SYNC_BLOCKS; i++)
+    {
+        block_versions[i] = version;
+    }
+    sync_ready = 1;
+}
+
+/**
+ * @brief	Возвращает текущую версию таблицы параметров
+ */
+uint32_t WVT_W7_Sync_Version(void)
+{
+    return sync_version;
+}
+
+/**
+ * @brief	Отмечает изменение параметра: увеличивает версию таблицы и 
+ *          присваивает ее блоку параметра.
+ *          Библиотека вызывает функцию сама при записи через WVT_W7_Parse,
+ *          приложение - при изменении параметров в обход протокола.
+ *
+ * @param 	address		Адрес измененного параметра
+ */
+void WVT_W7_Sync_Touch(uint16_t address)
+{
+    const uint32_t offset = (uint32_t) address - (uint32_t) WVT_W7_SYNC_FIRST_ADDRESS;
+
+    if (    (sync_ready == 0)
+        ||  (offset >= WVT_W7_SYNC_PARAMETERS)  )
+    {
+        return;
+    }
+
+    sync_version++;
+    block_versions[offset / WVT_W7_SYNC_BLOCK] = sync_version;
+}
+
+/**
+ * @brief	Обрабатывает запрос параметров, измененных после версии V.
+ *          Формат запроса: тип, версия V (4 байта), адрес, с которого продолжить просмотр (2 байта),
+ *          в первом запросе - WVT_W7_SYNC_FIRST_ADDRESS.
+ *          Формат ответа: тип, текущая версия (4 байта), признак продолжения,
+ *          адрес продолжения (2 байта), записи по WVT_W7_READ_CHANGED_WIDTH байт: адрес и значение.
+ *          Записи блока не разделяются между ответами. Если признак продолжения не 0,
+ *          сервер повторяет запрос с адресом продолжения. После полного просмотра
+ *          сервер запоминает версию из первого ответа и передает ее в следующий раз.
+ *
+ * @param [in] 	data		   	Запрос длинной WVT_W7_READ_CHANGED_LENGTH
+ * @param [out]	responce_buffer	Буфер с ответом
+ * @param [in/out] responce_length	На входе - размер буфера, на выходе - длина ответа
+ *
+ * @returns	- WVT_W7_ERROR_CODE_OK		        Ответ сформирован
+ *          - WVT_W7_ERROR_CODE_INVALID_TYPE    Отслеживание изменений не включено
+ *          - WVT_W7_ERROR_CODE_INVALID_LENGTH  Блок параметров не помещается в буфер
+ *          - Код ошибки rom_read               Параметр первого блока ответа не прочитан 
+ *                                              (параметры без адреса, WVT_W7_ERROR_CODE_INVALID_ADDRESS, 
+ *                                              пропускаются). Непрочитанный блок после первого 
+ *                                              переносится в следующий ответ
+ */
+WVT_W7_Error_t WVT_W7_Sync_Read(const uint8_t * data, uint8_t * responce_buffer, uint16_t * responce_length)
+{
+    const uint32_t since =    ((uint32_t) data[1] << 24)
+                            + ((uint32_t) data[2] << 16)
+                            + ((uint32_t) data[3] << 8)
+                            +   data[4];
+    const uint32_t start = (uint32_t) ((data[5] << 8) + data[6]) - (uint32_t) WVT_W7_SYNC_FIRST_ADDRESS;
+    const uint16_t responce_size = *responce_length;
+    uint16_t position = WVT_W7_READ_CHANGED_DATA_OFFSET;
+    uint32_t block = start / WVT_W7_SYNC_BLOCK;
+
+    if (sync_ready == 0)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_TYPE;
+    }
+
+    if ((WVT_W7_READ_CHANGED_DATA_OFFSET + (WVT_W7_SYNC_BLOCK * WVT_W7_READ_CHANGED_WIDTH)) > responce_size)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_LENGTH;
+    }
+
+    // Адрес вне отслеживаемого диапазона означает, что просмотр завершен
+    if (block > WVT_W7_SYNC_BLOCKS)
+    {
+        block = WVT_W7_SYNC_BLOCKS;
+    }
+
+    for (; block < WVT_W7_SYNC_BLOCKS; block++)
+    {
+        if (block_versions[block] <= since)
+        {
+            continue;
+        }
+
+        if ((position + (WVT_W7_SYNC_BLOCK * WVT_W7_READ_CHANGED_WIDTH)) > responce_size)
+        {
+            break;
+        }
+
+        const uint16_t block_position = position;
+        WVT_W7_Error_t rom_operation_result = WVT_W7_ERROR_CODE_OK;
+
+        for (uint16_t i = 0; i < WVT_W7_SYNC_BLOCK; i++)
+        {
+            const uint16_t address = (uint16_t) (WVT_W7_SYNC_FIRST_ADDRESS + (block * WVT_W7_SYNC_BLOCK) + i);
+            int32_t value;
+
+            rom_operation_result = externals_functions.rom_read(address, &value);
+            if (rom_operation_result == WVT_W7_ERROR_CODE_INVALID_ADDRESS)
+            {
+                // Параметра с таким адресом нет, передавать нечего
+                rom_operation_result = WVT_W7_ERROR_CODE_OK;
+                continue;
+            }
+            if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+            {
+                break;
+            }
+
+            responce_buffer[position++] = (address >> 8);
+            responce_buffer[position++] =  address;
+            responce_buffer[position++] = (value >> 24);
+            responce_buffer[position++] = (value >> 16);
+            responce_buffer[position++] = (value >> 8);
+            responce_buffer[position++] =  value;
+        }
+
+        // Ответ сообщает текущую версию: без непрочитанного параметра сервер 
+        // принял бы ее и больше не увидел его изменения. Блок переносится в следующий ответ, 
+        // а если он первый - запрос завершается ошибкой чтения
+        if (rom_operation_result != WVT_W7_ERROR_CODE_OK)
+        {
+            if (block_position == WVT_W7_READ_CHANGED_DATA_OFFSET)
+            {
+                return rom_operation_result;
+            }
+            position = block_position;
+            break;
+        }
+    }
+
+    const uint16_t next = (uint16_t) (WVT_W7_SYNC_FIRST_ADDRESS + (block * WVT_W7_SYNC_BLOCK));
+
+    responce_buffer[0] = WVT_W7_PACKET_TYPE_READ_CHANGED;
+    responce_buffer[1] = (sync_version >> 24);
+    responce_buffer[2] = (sync_version >> 16);
+    responce_buffer[3] = (sync_version >> 8);
+    responce_buffer[4] =  sync_version;
+    responce_buffer[5] = (block < WVT_W7_SYNC_BLOCKS);
+    responce_buffer[6] = (next >> 8);
+    responce_buffer[7] =  next;
+    *responce_length = position;
+
+    return WVT_W7_ERROR_CODE_OK;
+}
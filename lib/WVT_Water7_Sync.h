@@ -0,0 +1,39 @@
+﻿#pragma once
+#ifndef WVT_WATER7_SYNC_H_
+#define WVT_WATER7_SYNC_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_SYNC_BLOCKS
+#define WVT_W7_SYNC_BLOCKS                  64  /*!< Число блоков параметров со своим счетчиком изменений */
+#endif
+
+#ifndef WVT_W7_SYNC_BLOCK
+#define WVT_W7_SYNC_BLOCK                   4   /*!< Число параметров в блоке. 1 - счетчик на каждый параметр */
+#endif
+
+#ifndef WVT_W7_SYNC_FIRST_ADDRESS
+#define WVT_W7_SYNC_FIRST_ADDRESS           0   /*!< Адрес первого отслеживаемого параметра */
+#endif
+
+#define WVT_W7_SYNC_PARAMETERS              (WVT_W7_SYNC_BLOCKS * WVT_W7_SYNC_BLOCK)
+#define WVT_W7_READ_CHANGED_LENGTH          7UL
+#define WVT_W7_READ_CHANGED_DATA_OFFSET     8   /*!< Начало записей в ответе: тип, версия, признак продолжения, адрес продолжения */
+#define WVT_W7_READ_CHANGED_WIDTH           6   /*!< Число байт на запись: адрес и значение параметра */
+
+#if (WVT_W7_READ_CHANGED_DATA_OFFSET + (WVT_W7_SYNC_BLOCK * WVT_W7_READ_CHANGED_WIDTH)) > WVT_W7_BUFFER_SIZE
+#error "WVT_W7_SYNC_BLOCK does not fit into WVT_W7_BUFFER_SIZE"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void WVT_W7_Sync_Init(uint32_t version);
+    uint32_t WVT_W7_Sync_Version(void);
+    void WVT_W7_Sync_Touch(uint16_t address);
+    WVT_W7_Error_t WVT_W7_Sync_Read(const uint8_t * data, uint8_t * responce_buffer, uint16_t * responce_length);
+#ifdef __cplusplus
+}
+#endif
+#endif 
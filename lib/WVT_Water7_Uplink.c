@@ -0,0 +1,181 @@
+﻿#include "WVT_Water7_Uplink.h"
+
+#define WVT_W7_UPLINK_MASK                  (WVT_W7_UPLINK_SLOTS - 1)
+
+/**
+ * Ячейка очереди. Номер хода хранится за вычетом индекса ячейки, 
+ * поэтому обнуленная при старте память - уже пустая очередь
+ */
+typedef struct
+{
+    uint32_t turn;
+    uint8_t length;
+    uint8_t frame[WVT_W7_UPLINK_FRAME_SIZE];
+} WVT_W7_Uplink_Slot_t;
+
+/**
+ * Ограниченная очередь Вьюкова: производители занимают ячейку сравнением с обменом
+ * позиции записи, потребитель - единственный, позицию чтения меняет без обмена
+ */
+typedef struct
+{
+    uint32_t tail;      /*!< Позиция записи, общая для производителей */
+    uint32_t head;      /*!< Позиция чтения */
+    WVT_W7_Uplink_Slot_t slots[WVT_W7_UPLINK_SLOTS];
+} WVT_W7_Uplink_Ring_t;
+
+static WVT_W7_Uplink_Ring_t uplink_rings[WVT_W7_UPLINK_CLASSES];
+
+/**
+ * @brief	Занимает позицию записи position, если ее не опередил другой производитель.
+ *          Иначе возвращает в position текущую позицию записи
+ *
+ * @returns	1 - позиция занята
+ */
+static uint8_t WVT_W7_Uplink_Claim(uint32_t * tail, uint32_t * position)
+{
+#if WVT_W7_UPLINK_LOCK_FREE
+    return __atomic_compare_exchange_n(tail, position, *position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ? 1 : 0;
+#else
+    uint32_t state;
+    uint8_t claimed = 0;
+
+    WVT_W7_UPLINK_LOCK(state);
+    if (*tail == *position)
+    {
+        *tail = *position + 1;
+        claimed = 1;
+    }
+    else
+    {
+        *position = *tail;
+    }
+    WVT_W7_UPLINK_UNLOCK(state);
+
+    return claimed;
+#endif
+}
+
+/**
+ * @brief	Ставит готовый кадр (WVT_W7_Event, WVT_W7_PairEvent, WVT_W7_Short_Regular...) 
+ *          в очередь на отправку. Без блокировок: можно вызывать из нескольких задач 
+ *          и из прерываний одновременно. Без атомарного обмена (см. WVT_W7_UPLINK_LOCK) 
+ *          блокировка держится только на время занятия позиции записи.
+ *
+ * @param 	   	priority	Класс кадра
+ * @param [in] 	frame   	Кадр
+ * @param 	   	length  	Длина кадра, не больше WVT_W7_UPLINK_FRAME_SIZE
+ *
+ * @returns	1 - кадр в очереди, 0 - очередь класса заполнена или неверные аргументы.
+ */
+uint8_t WVT_W7_Uplink_Push(WVT_W7_Uplink_Class_t priority, const uint8_t * frame, uint8_t length)
+{
+    if (    (priority >= WVT_W7_UPLINK_CLASSES)
+        ||  (frame == 0)
+        ||  (length == 0)
+        ||  (length > WVT_W7_UPLINK_FRAME_SIZE)  )
+    {
+        return 0;
+    }
+
+    WVT_W7_Uplink_Ring_t * ring = &uplink_rings[priority];
+    WVT_W7_Uplink_Slot_t * slot;
+    uint32_t position = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        slot = &ring->slots[position & WVT_W7_UPLINK_MASK];
+
+        const uint32_t turn = __atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) + (position & WVT_W7_UPLINK_MASK);
+        const int32_t difference = (int32_t) (turn - position);
+
+        if (difference == 0)
+        {
+            // Ячейка свободна: занимаем ее, если позицию не опередил другой производитель
+            if (WVT_W7_Uplink_Claim(&ring->tail, &position))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // Ячейку еще не прочитал потребитель: очередь заполнена
+            return 0;
+        }
+        else
+        {
+            position = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        slot->frame[i] = frame[i];
+    }
+    slot->length = length;
+    __atomic_store_n(&slot->turn, position + 1 - (position & WVT_W7_UPLINK_MASK), __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+/**
+ * @brief	Забирает кадр с наибольшим приоритетом. Вызывается только одним потребителем
+ *          (драйвером радио). Если производитель прерван во время записи кадра, 
+ *          кадры его класса за ним ждут завершения записи, а в этот вызов отправляются 
+ *          кадры следующих классов.
+ *
+ * @param [out]	frame   	Буфер для кадра, WVT_W7_UPLINK_FRAME_SIZE байт
+ * @param [out]	priority	Класс кадра, может быть 0
+ *
+ * @returns	Длина кадра, 0 - очередь пуста.
+ */
+uint8_t WVT_W7_Uplink_Pop(uint8_t * frame, WVT_W7_Uplink_Class_t * priority)
+{
+    for (uint8_t current = 0; current < WVT_W7_UPLINK_CLASSES; current++)
+    {
+        WVT_W7_Uplink_Ring_t * ring = &uplink_rings[current];
+        const uint32_t position = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        WVT_W7_Uplink_Slot_t * slot = &ring->slots[position & WVT_W7_UPLINK_MASK];
+        const uint32_t turn = __atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) + (position & WVT_W7_UPLINK_MASK);
+
+        if (turn != (position + 1))
+        {
+            continue;
+        }
+
+        const uint8_t length = slot->length;
+        for (uint8_t i = 0; i < length; i++)
+        {
+            frame[i] = slot->frame[i];
+        }
+
+        // Ячейка освобождается для записи на следующем круге
+        __atomic_store_n(&ring->head, position + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->turn, position + WVT_W7_UPLINK_SLOTS - (position & WVT_W7_UPLINK_MASK), __ATOMIC_RELEASE);
+
+        if (priority != 0)
+        {
+            *priority = (WVT_W7_Uplink_Class_t) current;
+        }
+        return length;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief	Возвращает число кадров в очереди, включая кадры, которые еще записываются.
+ *          Во всех классах их может быть до WVT_W7_UPLINK_CLASSES * WVT_W7_UPLINK_SLOTS
+ */
+uint16_t WVT_W7_Uplink_Pending(void)
+{
+    uint32_t count = 0;
+
+    // Позиция чтения не обгоняет позицию записи, поэтому она читается первой
+    for (uint8_t current = 0; current < WVT_W7_UPLINK_CLASSES; current++)
+    {
+        const uint32_t head = __atomic_load_n(&uplink_rings[current].head, __ATOMIC_RELAXED);
+        count += __atomic_load_n(&uplink_rings[current].tail, __ATOMIC_RELAXED) - head;
+    }
+    return (uint16_t) count;
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+#ifndef WVT_WATER7_UPLINK_H_
+#define WVT_WATER7_UPLINK_H_
+
+#include "WVT_Water7.h"
+
+#ifndef WVT_W7_UPLINK_SLOTS
+#define WVT_W7_UPLINK_SLOTS                 8   /*!< Число кадров в очереди каждого класса, степень двойки */
+#endif
+
+#ifndef WVT_W7_UPLINK_FRAME_SIZE
+#define WVT_W7_UPLINK_FRAME_SIZE            WVT_W7_BUFFER_SIZE  /*!< Наибольшая длина кадра */
+#endif
+
+#if (WVT_W7_UPLINK_SLOTS < 2) || (WVT_W7_UPLINK_SLOTS > 128) || (WVT_W7_UPLINK_SLOTS & (WVT_W7_UPLINK_SLOTS - 1))
+#error "WVT_W7_UPLINK_SLOTS must be a power of two in range 2..128"
+#endif
+
+#if (WVT_W7_UPLINK_FRAME_SIZE > 255)
+#error "WVT_W7_UPLINK_FRAME_SIZE must not exceed 255"
+#endif
+
+#if !defined(__GNUC__)
+#error "WVT_Water7_Uplink requires __atomic builtins (GCC or Clang)"
+#endif
+
+/*
+ * Позиция записи занимается сравнением с обменом, если оно без блокировок для 32-битных слов.
+ * На ядрах без него (ARMv6-M: Cortex-M0, M0+) - в критической секции: по умолчанию 
+ * прерывания запрещаются через PRIMASK, для других ядер задайте WVT_W7_UPLINK_LOCK(state) 
+ * и WVT_W7_UPLINK_UNLOCK(state), state - переменная uint32_t. Макросы должны быть барьером для компилятора
+ */
+#if defined(WVT_W7_UPLINK_LOCK) && defined(WVT_W7_UPLINK_UNLOCK)
+#define WVT_W7_UPLINK_LOCK_FREE             0
+#elif defined(__GCC_ATOMIC_INT_LOCK_FREE) && defined(__GCC_ATOMIC_LONG_LOCK_FREE) \
+    && (__GCC_ATOMIC_INT_LOCK_FREE == 2) && (__GCC_ATOMIC_LONG_LOCK_FREE == 2)
+#define WVT_W7_UPLINK_LOCK_FREE             1
+#elif defined(__ARM_ARCH_6M__)
+#define WVT_W7_UPLINK_LOCK_FREE             0
+#define WVT_W7_UPLINK_LOCK(state)           __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (state) : : "memory")
+#define WVT_W7_UPLINK_UNLOCK(state)         __asm volatile ("msr primask, %0" : : "r" (state) : "memory")
+#else
+#error "WVT_Water7_Uplink requires lock-free 32-bit atomics or WVT_W7_UPLINK_LOCK/WVT_W7_UPLINK_UNLOCK"
+#endif
+
+typedef enum
+{
+    WVT_W7_UPLINK_ALARM                 = 0x00,     /*!< Аварии и события, отправляются первыми */
+    WVT_W7_UPLINK_RESPONCE              = 0x01,     /*!< Ответы на запросы сервера */
+    WVT_W7_UPLINK_REGULAR               = 0x02,     /*!< Регулярные сообщения */
+    WVT_W7_UPLINK_CLASSES               = 0x03
+} WVT_W7_Uplink_Class_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    uint8_t WVT_W7_Uplink_Push(WVT_W7_Uplink_Class_t priority, const uint8_t * frame, uint8_t length);
+    uint8_t WVT_W7_Uplink_Pop(uint8_t * frame, WVT_W7_Uplink_Class_t * priority);
+    uint16_t WVT_W7_Uplink_Pending(void);
+#ifdef __cplusplus
+}
+#endif
+#endif
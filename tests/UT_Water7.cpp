@@ -1,5 +1,7 @@
 ﻿#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <vector>
 #include "../lib/WVT_Water7.h"
 #include "catch.hpp"
 
@@ -112,6 +114,55 @@ TEST_CASE("Event", "[event]")
 	CHECK(memcmp(event_packet, read_buffer, packet_length) == 0);
 }
 
+/**
+ * Пачка парных событий: одно абсолютное значение и до 60 часовых разностей
+ * 
+ * - тип 0x23, параметр, значение 4 байта, число разностей, разности по 2 байта
+ */
+TEST_CASE("Pair event batch", "[event]")
+{
+    const uint8_t par = 3;
+    const uint32_t value = 0x00012345;
+    uint16_t diffs[WVT_W7_PAIR_BATCH_MAX + 1];
+    const uint8_t batch_packet[] = {
+    //  тип | параметр | значение 4 байта      | число | разности
+        0x23, par,       0x00, 0x01, 0x23, 0x45, 3,      0x00, 0x00, 0x01, 0x01, 0x02, 0x02 };
+
+    for (uint16_t i = 0; i <= WVT_W7_PAIR_BATCH_MAX; i++)
+    {
+        diffs[i] = static_cast<uint16_t>((i << 8) + i);
+    }
+
+    CHECK(WVT_W7_PairEvent_Batch(par, value, diffs, 3, read_buffer) == sizeof(batch_packet));
+    CHECK(memcmp(batch_packet, read_buffer, sizeof(batch_packet)) == 0);
+
+    // Сутки часовых показаний - один пакет
+    CHECK(WVT_W7_PairEvent_Batch(par, value, diffs, 24, read_buffer) == (7 + (24 * 2)));
+    CHECK(WVT_W7_PairEvent_Batch(par, value, diffs, WVT_W7_PAIR_BATCH_MAX, read_buffer) <= WVT_W7_BUFFER_SIZE);
+    CHECK(WVT_W7_PairEvent_Batch(par, value, diffs, WVT_W7_PAIR_BATCH_MAX + 1, read_buffer) == 0);
+
+    uint8_t length = WVT_W7_PairEvent_Batch(par, value, diffs, 24, read_buffer);
+    uint8_t decoded_par = 0;
+    uint32_t decoded_value = 0;
+    uint16_t decoded_diffs[24];
+    uint8_t decoded_count = 24;
+
+    CHECK(WVT_W7_PairEvent_Batch_Decode(read_buffer, length, &decoded_par, &decoded_value, 
+        decoded_diffs, &decoded_count) == WVT_W7_OK);
+    CHECK(decoded_par == par);
+    CHECK(decoded_value == value);
+    CHECK(decoded_count == 24);
+    CHECK(memcmp(decoded_diffs, diffs, sizeof(decoded_diffs)) == 0);
+
+    // Неверная длина и недостаточный размер массива
+    decoded_count = 24;
+    CHECK(WVT_W7_PairEvent_Batch_Decode(read_buffer, static_cast<uint16_t>(length - 1), &decoded_par, &decoded_value, 
+        decoded_diffs, &decoded_count) == WVT_W7_ERROR);
+    decoded_count = 23;
+    CHECK(WVT_W7_PairEvent_Batch_Decode(read_buffer, length, &decoded_par, &decoded_value, 
+        decoded_diffs, &decoded_count) == WVT_W7_ERROR);
+}
+
 TEST_CASE("Short regular", "[short_regular]")
 {
 	const uint8_t packet_length_no_additional = 7;
@@ -143,6 +194,120 @@ TEST_CASE("Short regular", "[short_regular]")
     CHECK(WVT_W7_Short_Regular(read_buffer, payload, 0, schedule, five_additional_parameters) == packet_length_five_additional);
 }
 
+/**
+ * Длинное регулярное сообщение: список адресов произвольной длины, 
+ * адреса и значения кодируются как zigzag varint разностей
+ */
+TEST_CASE("Long regular", "[short_regular]")
+{
+    WVT_W7_Callbacks_t callbacks = {};
+    callbacks.rom_read = ext_rom_read;
+    callbacks.rom_write = ext_rom_write;
+    WVT_W7_Register_Callbacks(callbacks);
+
+    const uint16_t schedule = 0xBEEF;
+    const int32_t payload = 0x7ACEFEED;
+    uint16_t addresses[200];
+    int32_t values[200];
+    int32_t decoded_payload;
+    uint16_t decoded_schedule;
+    uint16_t count;
+    uint16_t packed;
+
+    SECTION("Encoding")
+    {
+        const uint16_t list[] = { 1, 2, 300 };
+        const uint8_t expected[] = {
+        //  тип | расписание | значение 4 байта      | флаги | число
+            0x24, 0xBE, 0xEF,  0x7A, 0xCE, 0xFE, 0xED, 0x00,   0x00, 0x03,
+        //  +1   =1    +1   =2    +298        =300
+            0x02, 0x02, 0x02, 0x04, 0xD4, 0x04, 0xD8, 0x04 };
+
+        const uint8_t length = WVT_W7_Long_Regular(read_buffer, payload, schedule, list, 3, 0, &packed);
+        CHECK(length == sizeof(expected));
+        CHECK(memcmp(read_buffer, expected, sizeof(expected)) == 0);
+        CHECK(packed == 3);
+    }
+
+    SECTION("More than five parameters")
+    {
+        for (uint16_t i = 0; i < 40; i++)
+        {
+            addresses[i] = static_cast<uint16_t>(1000 + i);
+        }
+
+        const uint8_t plain = WVT_W7_Long_Regular(read_buffer, payload, schedule, addresses, 40, 0, &packed);
+        CHECK(packed < 40);
+        count = 200;
+        REQUIRE(WVT_W7_Long_Regular_Decode(read_buffer, plain, &decoded_payload, &decoded_schedule, addresses + 100, values, &count) == WVT_W7_OK);
+        CHECK(count == packed);
+        CHECK(decoded_payload == payload);
+        CHECK(decoded_schedule == schedule);
+        for (uint16_t i = 0; i < count; i++)
+        {
+            CHECK(addresses[100 + i] == 1000 + i);
+            CHECK(values[i] == 1000 + i);
+        }
+
+        // Разностное кодирование близких значений укладывает весь список в один кадр
+        const uint8_t delta = WVT_W7_Long_Regular(read_buffer, payload, schedule, addresses, 40, 
+            WVT_W7_LONG_REGULAR_DELTA, &packed);
+        CHECK(packed == 40);
+        CHECK(delta == WVT_W7_LONG_REGULAR_DATA_OFFSET + 4 + 39 * 2);
+        count = 200;
+        REQUIRE(WVT_W7_Long_Regular_Decode(read_buffer, delta, &decoded_payload, &decoded_schedule, addresses + 100, values, &count) == WVT_W7_OK);
+        CHECK(count == 40);
+        CHECK(values[39] == 1039);
+        CHECK(addresses[139] == 1039);
+    }
+
+    SECTION("Long list is sent in parts")
+    {
+        for (uint16_t i = 0; i < 200; i++)
+        {
+            addresses[i] = static_cast<uint16_t>(i * 37);
+        }
+
+        uint16_t sent = 0;
+        uint16_t frames = 0;
+        while (sent < 200)
+        {
+            const uint8_t length = WVT_W7_Long_Regular(read_buffer, payload, schedule, addresses + sent, 
+                static_cast<uint16_t>(200 - sent), 0, &packed);
+            CHECK(length <= WVT_W7_BUFFER_SIZE);
+            REQUIRE(packed > 0);
+            sent = static_cast<uint16_t>(sent + packed);
+            frames++;
+        }
+        CHECK(frames > 1);
+    }
+
+    SECTION("Unreadable parameters are skipped")
+    {
+        const uint16_t list[] = { 227, 228, 229 };
+        const uint8_t length = WVT_W7_Long_Regular(read_buffer, payload, schedule, list, 3, 0, &packed);
+        count = 200;
+        REQUIRE(WVT_W7_Long_Regular_Decode(read_buffer, length, &decoded_payload, &decoded_schedule, addresses, values, &count) == WVT_W7_OK);
+        CHECK(packed == 3);
+        CHECK(count == 2);
+        CHECK(addresses[1] == 229);
+        CHECK(values[1] == 229);
+    }
+
+    SECTION("Malformed messages")
+    {
+        const uint16_t list[] = { 1, 2, 300 };
+        const uint8_t length = WVT_W7_Long_Regular(read_buffer, payload, schedule, list, 3, 0, &packed);
+
+        count = 2;
+        CHECK(WVT_W7_Long_Regular_Decode(read_buffer, length, &decoded_payload, &decoded_schedule, addresses, values, &count) == WVT_W7_ERROR);
+        count = 200;
+        CHECK(WVT_W7_Long_Regular_Decode(read_buffer, static_cast<uint16_t>(length - 1), &decoded_payload, &decoded_schedule, addresses, values, &count) == WVT_W7_ERROR);
+        read_buffer[0] = 0x80;
+        CHECK(WVT_W7_Long_Regular_Decode(read_buffer, length, &decoded_payload, &decoded_schedule, addresses, values, &count) == WVT_W7_ERROR);
+    }
+}
+
 TEST_CASE("Additional parameters", "[additional_parameters]")
 {
 	const int32_t no_additional_parameters = 0;
@@ -226,6 +391,437 @@ TEST_CASE("Normal work", "[parser]")
     }
 }
 
+/**
+ * Сжатое чтение последовательности: 
+ * 
+ * - тип 0x04, адрес начала, длинна - как у обычного чтения
+ * - в ответе длинна равна числу уместившихся параметров
+ * - параметры закодированы varint(zigzag(разность с предыдущим))
+ */
+TEST_CASE("Packed read multiple", "[parser]")
+{
+    uint8_t read_packed[5] = { 
+    //  тип | начало    |  длинна
+        0x04, 0x00, 100,  0x00, 20 };
+    uint16_t address = 0;
+    int32_t values[200];
+    uint16_t count = 200;
+
+    // Первое значение 100 занимает 2 байта, каждая следующая разность 1 - один байт
+    CHECK(WVT_W7_Parse(read_packed, sizeof(read_packed), read_buffer) == (5 + 2 + 19));
+	CHECK(memcmp(read_packed, read_buffer, sizeof(read_packed)) == 0);
+    CHECK(WVT_W7_Unpack_Multiple(read_buffer, (5 + 2 + 19), &address, values, &count) == WVT_W7_OK);
+    CHECK(address == 100);
+    REQUIRE(count == 20);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        CHECK(values[i] == (100 + i));
+    }
+
+    // Запрошено больше, чем помещается: ответ заполняет весь буфер
+    read_packed[3] = 0x10;
+    read_packed[2] = 0;
+    const uint8_t length = WVT_W7_Parse(read_packed, sizeof(read_packed), read_buffer);
+    count = 200;
+    CHECK(length == WVT_W7_BUFFER_SIZE);
+    CHECK(WVT_W7_Unpack_Multiple(read_buffer, length, &address, values, &count) == WVT_W7_OK);
+    CHECK(count == (WVT_W7_BUFFER_SIZE - 5));
+    CHECK(count > ((WVT_W7_BUFFER_SIZE - 5) / 4));
+
+    // Ошибка чтения после первого параметра: отправляются параметры перед ней
+    read_packed[2] = 220;
+    CHECK(WVT_W7_Parse(read_packed, sizeof(read_packed), read_buffer) == (5 + 2 + 7));
+    count = 200;
+    CHECK(WVT_W7_Unpack_Multiple(read_buffer, (5 + 2 + 7), &address, values, &count) == WVT_W7_OK);
+    CHECK(count == 8);
+    CHECK(values[7] == 227);
+
+    // Ошибка чтения первого параметра
+    read_packed[2] = 228;
+    CHECK(WVT_W7_Parse(read_packed, sizeof(read_packed), read_buffer) == 2);
+    CHECK(read_buffer[0] == (0x04 | 0x40));
+    CHECK(read_buffer[1] == 0x02);
+
+    // Неверная длинна
+    CHECK(WVT_W7_Parse(read_packed, 4, read_buffer) == 2);
+    CHECK(read_buffer[1] == 0x06);
+
+    // Обрезанный ответ не разбирается
+    count = 200;
+    CHECK(WVT_W7_Unpack_Multiple(read_buffer, 4, &address, values, &count) == WVT_W7_ERROR);
+}
+
+TEST_CASE("Varint", "[parser]")
+{
+    auto value = GENERATE(0, 1, -1, 63, -64, 64, 1000, -1000, INT32_MAX, INT32_MIN);
+    uint8_t encoded[WVT_W7_VARINT_MAX_LENGTH];
+    uint32_t decoded = 0;
+
+    const uint32_t zigzag = WVT_W7_Zigzag(static_cast<uint32_t>(value));
+    const uint8_t length = WVT_W7_Put_Varint(zigzag, encoded);
+
+    CHECK(length <= WVT_W7_VARINT_MAX_LENGTH);
+    CHECK(WVT_W7_Get_Varint(encoded, length, &decoded) == length);
+    CHECK(static_cast<int32_t>(WVT_W7_Unzigzag(decoded)) == value);
+    CHECK(WVT_W7_Get_Varint(encoded, static_cast<uint16_t>(length - 1), &decoded) == 0);
+
+    // Пятый байт с битами за пределами 32 бит
+    const uint8_t overlong[WVT_W7_VARINT_MAX_LENGTH] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x10 };
+    CHECK(WVT_W7_Get_Varint(overlong, sizeof(overlong), &decoded) == 0);
+
+    // Малые по модулю значения занимают один байт
+    if ((value >= -64) && (value <= 63))
+    {
+        CHECK(length == 1);
+    }
+}
+
+static int32_t modify_rom[4];
+static uint32_t modify_rom_writes = 0;
+
+static WVT_W7_Error_t modify_rom_read(uint16_t address, int32_t * value)
+{
+    if (address >= 4)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+
+    *value = modify_rom[address];
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t modify_rom_write(uint16_t address, int32_t value)
+{
+    if (address == 3)
+    {
+        return WVT_W7_ERROR_CODE_READ_ONLY;
+    }
+
+    modify_rom[address] = value;
+    modify_rom_writes++;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static int32_t Modify(uint8_t address, WVT_W7_Modify_Operation_t operation, uint32_t operand)
+{
+    uint8_t modify[8] = { 
+    //  тип | параметр      | операция                          | операнд
+        0x16, 0x00, address,  static_cast<uint8_t>(operation),  
+        static_cast<uint8_t>(operand >> 24), static_cast<uint8_t>(operand >> 16), 
+        static_cast<uint8_t>(operand >> 8), static_cast<uint8_t>(operand) };
+
+    REQUIRE(WVT_W7_Parse(modify, sizeof(modify), read_buffer) == 8);
+    REQUIRE(memcmp(modify, read_buffer, 4) == 0);
+
+    return static_cast<int32_t>(
+            (static_cast<uint32_t>(read_buffer[4]) << 24) + (static_cast<uint32_t>(read_buffer[5]) << 16)
+        +   (static_cast<uint32_t>(read_buffer[6]) << 8) + static_cast<uint32_t>(read_buffer[7]));
+}
+
+/**
+ * Атомарное изменение параметра: тип 0x16, адрес, операция, операнд.
+ * Ответ повторяет заголовок запроса и содержит значение после операции
+ */
+TEST_CASE("Modify", "[parser]")
+{
+    WVT_W7_Callbacks_t callbacks = {};
+
+    callbacks.rom_read = modify_rom_read;
+    callbacks.rom_write = modify_rom_write;
+    REQUIRE(WVT_W7_Register_Callbacks(callbacks) == WVT_W7_OK);
+    modify_rom[0] = 0x0F;
+    modify_rom[1] = INT32_MAX - 10;
+    modify_rom[2] = 5;
+    modify_rom_writes = 0;
+
+    SECTION("bits")
+    {
+        CHECK(Modify(0, WVT_W7_MODIFY_SET_BITS, 0x100) == 0x10F);
+        CHECK(Modify(0, WVT_W7_MODIFY_CLEAR_BITS, 0x3) == 0x10C);
+        CHECK(modify_rom[0] == 0x10C);
+        CHECK(modify_rom_writes == 2);
+
+        // Неизменившееся значение не перезаписывается
+        CHECK(Modify(0, WVT_W7_MODIFY_SET_BITS, 0x4) == 0x10C);
+        CHECK(modify_rom_writes == 2);
+    }
+
+    SECTION("add")
+    {
+        CHECK(Modify(1, WVT_W7_MODIFY_ADD_SATURATED, 5) == (INT32_MAX - 5));
+        CHECK(Modify(1, WVT_W7_MODIFY_ADD_SATURATED, 100) == INT32_MAX);
+        CHECK(Modify(1, WVT_W7_MODIFY_ADD_SATURATED, static_cast<uint32_t>(-10)) == (INT32_MAX - 10));
+        modify_rom[1] = INT32_MIN + 1;
+        CHECK(Modify(1, WVT_W7_MODIFY_ADD_SATURATED, static_cast<uint32_t>(-2)) == INT32_MIN);
+    }
+
+    SECTION("compare and swap")
+    {
+        uint8_t cas[12] = { 
+        //  тип | параметр | операция | ожидаемое              | новое
+            0x16, 0x00, 2,   0x03,      0x00, 0x00, 0x00, 0x05,  0x00, 0x00, 0x00, 0x07 };
+
+        CHECK(WVT_W7_Parse(cas, sizeof(cas), read_buffer) == 8);
+        CHECK(read_buffer[7] == 7);
+        CHECK(modify_rom[2] == 7);
+
+        // Текущее значение уже не равно ожидаемому
+        cas[11] = 9;
+        CHECK(WVT_W7_Parse(cas, sizeof(cas), read_buffer) == 8);
+        CHECK(read_buffer[7] == 7);
+        CHECK(modify_rom[2] == 7);
+
+        // Длина не соответствует операции
+        CHECK(WVT_W7_Parse(cas, 8, read_buffer) == 2);
+        CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        cas[3] = WVT_W7_MODIFY_SET_BITS;
+        CHECK(WVT_W7_Parse(cas, sizeof(cas), read_buffer) == 2);
+        CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+    }
+
+    SECTION("errors")
+    {
+        uint8_t modify[8] = { 0x16, 0x00, 3, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+        CHECK(WVT_W7_Parse(modify, sizeof(modify), read_buffer) == 2);
+        CHECK(read_buffer[0] == (0x16 | 0x40));
+        CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_READ_ONLY);
+
+        modify[2] = 4;
+        CHECK(WVT_W7_Parse(modify, sizeof(modify), read_buffer) == 2);
+        CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_ADDRESS);
+
+        modify[2] = 0;
+        modify[3] = 0x04;
+        CHECK(WVT_W7_Parse(modify, sizeof(modify), read_buffer) == 2);
+        CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        CHECK(WVT_W7_Parse(modify, 7, read_buffer) == 2);
+        CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+    }
+
+    callbacks.rom_read = ext_rom_read;
+    callbacks.rom_write = ext_rom_write;
+    WVT_W7_Register_Callbacks(callbacks);
+}
+
+/**
+ * Запись без подтверждения: тип 0x30, за которым следует обычный запрос записи.
+ * Успешная запись не формирует ответа, ошибка отправляется как обычно
+ */
+TEST_CASE("No acknowledgement", "[parser]")
+{
+    uint8_t write_single[] = { 
+    //  обертка | тип | параметр  | значение
+        0x30,     0x06, 0x00, 0x10, 0x00, 0x00, 0x00, 0x01 };
+    uint8_t write_multiple[] = { 
+    //  обертка | тип | параметр  | длинна   | значения
+        0x30,     0x10, 0x00, 0x10, 0x00, 2,   0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02 };
+
+    CHECK(WVT_W7_Parse(write_single, sizeof(write_single), read_buffer) == 0);
+    CHECK(WVT_W7_Parse(write_multiple, sizeof(write_multiple), read_buffer) == 0);
+
+    // Ошибка вложенного запроса
+    write_single[7] = 228;
+    CHECK(WVT_W7_Parse(write_single, sizeof(write_single), read_buffer) == 2);
+    CHECK(read_buffer[0] == (0x06 | 0x40));
+    CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+    CHECK(WVT_W7_Parse(write_single, (sizeof(write_single) - 1), read_buffer) == 2);
+    CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+
+    // Чтение без ответа не имеет смысла
+    uint8_t read_single[] = { 0x30, 0x07, 0x00, 0x10 };
+    CHECK(WVT_W7_Parse(read_single, sizeof(read_single), read_buffer) == 2);
+    CHECK(read_buffer[0] == (0x30 | 0x40));
+    CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_TYPE);
+    CHECK(WVT_W7_Parse(read_single, 1, read_buffer) == 2);
+    CHECK(read_buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+}
+
+/**
+ * Память с медленным доступом: первый вызов запускает операцию и возвращает BUSY,
+ * после завершения операции повторный вызов с теми же аргументами возвращает результат
+ */
+static int32_t async_rom[64];
+static bool async_enabled = false;
+static bool async_active = false;
+static bool async_done = false;
+static bool async_write = false;
+static uint16_t async_address = 0;
+static int32_t async_value = 0;
+static uint32_t async_operations = 0;
+
+static WVT_W7_Error_t async_rom_read(uint16_t address, int32_t * value)
+{
+    if (address >= 64)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+    if (async_enabled && ((async_done == false) || async_write || (async_address != address)))
+    {
+        REQUIRE(async_active == false);
+        async_active = true;
+        async_write = false;
+        async_address = address;
+        async_operations++;
+        return WVT_W7_ERROR_CODE_BUSY;
+    }
+
+    async_done = false;
+    *value = async_rom[address];
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t async_rom_write(uint16_t address, int32_t value)
+{
+    if (address >= 64)
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+    if (async_enabled && ((async_done == false) || (async_write == false) || (async_address != address)))
+    {
+        REQUIRE(async_active == false);
+        async_active = true;
+        async_write = true;
+        async_address = address;
+        async_value = value;
+        async_operations++;
+        return WVT_W7_ERROR_CODE_BUSY;
+    }
+
+    async_done = false;
+    REQUIRE(((async_enabled == false) || (async_value == value)));
+    async_rom[address] = value;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/** Завершает операции по одной, пока запрос не будет обработан */
+static uint8_t Async_Parse(uint8_t * request, uint16_t length, uint8_t * responce, uint32_t & resumes)
+{
+    uint8_t responce_length = WVT_W7_Parse(request, length, responce);
+
+    resumes = 0;
+    while (WVT_W7_Suspended())
+    {
+        REQUIRE(responce_length == 0);
+        REQUIRE(async_active);
+        async_active = false;
+        async_done = true;
+        resumes++;
+        responce_length = WVT_W7_Resume();
+    }
+    return responce_length;
+}
+
+/**
+ * Асинхронные функции доступа к памяти: запрос приостанавливается на каждой операции
+ * и продолжается WVT_W7_Resume, ответ совпадает с ответом при синхронном доступе
+ */
+TEST_CASE("Asynchronous storage", "[parser]")
+{
+    WVT_W7_Callbacks_t callbacks = {};
+    uint8_t sync_responce[WVT_W7_BUFFER_SIZE];
+    uint8_t async_responce[WVT_W7_BUFFER_SIZE];
+    uint32_t resumes = 0;
+
+    callbacks.rom_read = async_rom_read;
+    callbacks.rom_write = async_rom_write;
+    REQUIRE(WVT_W7_Register_Callbacks(callbacks) == WVT_W7_OK);
+    for (uint16_t i = 0; i < 64; i++)
+    {
+        async_rom[i] = (i * 1000) - 7000;
+    }
+    async_operations = 0;
+    async_active = false;
+    async_done = false;
+
+    SECTION("Reads")
+    {
+        uint8_t read_multiple[] = { 0x03, 0x00, 10, 0x00, 6 };
+        uint8_t read_packed[] = { 0x04, 0x00, 3, 0x00, 20 };
+        uint8_t tagged_read[] = { 0x31, 0x5A, 0x07, 0x00, 30 };
+        uint8_t * requests[] = { read_multiple, read_packed, tagged_read };
+        const uint16_t lengths[] = { sizeof(read_multiple), sizeof(read_packed), sizeof(tagged_read) };
+        const uint32_t operations[] = { 6, 20, 1 };
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            async_enabled = false;
+            const uint8_t expected = WVT_W7_Parse(requests[i], lengths[i], sync_responce);
+            REQUIRE(expected > 2);
+
+            async_enabled = true;
+            async_operations = 0;
+            CHECK(Async_Parse(requests[i], lengths[i], async_responce, resumes) == expected);
+            CHECK(memcmp(sync_responce, async_responce, expected) == 0);
+            CHECK(resumes == operations[i]);
+            CHECK(async_operations == operations[i]);
+        }
+    }
+
+    SECTION("Writes")
+    {
+        uint8_t write_multiple[] = { 0x10, 0x00, 40, 0x00, 3, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 3 };
+        uint8_t no_ack_write[] = { 0x30, 0x06, 0x00, 50, 0x00, 0x00, 0x01, 0x00 };
+        uint8_t modify[] = { 0x16, 0x00, 60, WVT_W7_MODIFY_ADD_SATURATED, 0x00, 0x00, 0x00, 100 };
+
+        async_enabled = true;
+        CHECK(Async_Parse(write_multiple, sizeof(write_multiple), async_responce, resumes) == 5);
+        CHECK(memcmp(write_multiple, async_responce, 5) == 0);
+        CHECK(resumes == 3);
+        CHECK(async_rom[40] == 1);
+        CHECK(async_rom[42] == 3);
+
+        CHECK(Async_Parse(no_ack_write, sizeof(no_ack_write), async_responce, resumes) == 0);
+        CHECK(resumes == 1);
+        CHECK(async_rom[50] == 256);
+
+        // Чтение и запись выполняются по одному разу
+        async_operations = 0;
+        CHECK(Async_Parse(modify, sizeof(modify), async_responce, resumes) == 8);
+        CHECK(async_operations == 2);
+        CHECK(async_rom[60] == 53100);
+        CHECK(async_responce[6] == (53100 >> 8));
+        CHECK(async_responce[7] == (53100 & 0xFF));
+    }
+
+    SECTION("Requests while suspended")
+    {
+        uint8_t read_multiple[] = { 0x03, 0x00, 10, 0x00, 2 };
+        uint8_t read_single[] = { 0x07, 0x00, 12 };
+
+        async_enabled = true;
+        CHECK(WVT_W7_Parse(read_multiple, sizeof(read_multiple), async_responce) == 0);
+        CHECK(WVT_W7_Suspended() == 1);
+
+        // Новый запрос отклоняется, даже в том же буфере ответа
+        CHECK(WVT_W7_Parse(read_single, sizeof(read_single), async_responce) == 2);
+        CHECK(async_responce[0] == (0x07 | 0x40));
+        CHECK(async_responce[1] == WVT_W7_ERROR_CODE_BUSY);
+
+        // Операция снова не завершилась
+        async_active = false;
+        CHECK(WVT_W7_Resume() == 0);
+        CHECK(WVT_W7_Suspended() == 1);
+
+        async_active = false;
+        async_done = true;
+        CHECK(WVT_W7_Resume() == 0);
+        async_active = false;
+        async_done = true;
+        CHECK(WVT_W7_Resume() == 13);
+        CHECK(memcmp(read_multiple, async_responce, 5) == 0);
+        CHECK(async_responce[12] == static_cast<uint8_t>(4000));
+        CHECK(WVT_W7_Suspended() == 0);
+        CHECK(WVT_W7_Resume() == 0);
+    }
+
+    async_enabled = false;
+    callbacks.rom_read = ext_rom_read;
+    callbacks.rom_write = ext_rom_write;
+    WVT_W7_Register_Callbacks(callbacks);
+}
+
 TEST_CASE("Error handling", "[parser]")
 {
     uint8_t read_single[] = { 
@@ -285,3 +881,251 @@ TEST_CASE("Scheduler", "[scheduler]")
 	
 	CHECK(trigger_count == schedule);
 }
+
+/**
+ * Следующее срабатывание должно приходиться на ту минуту, которую 
+ * дает поминутный опрос планировщика, в том числе при переходе через
+ * полночь и для расписаний, на которые не делится число минут в сутках.
+ * Внутри минуты все срабатывания устройства приходятся на одну секунду
+ */
+TEST_CASE("Next fire", "[scheduler]")
+{
+    auto schedule = GENERATE(1, 5, 7, 24, 100, 144, 700);
+    auto seed = GENERATE(0U, 1U, 0xDEADBEEFU);
+    const uint32_t seconds_per_day = 24 * 3600;
+    std::vector<uint32_t> slots;
+
+    // Сброс признака срабатывания, оставшегося от предыдущего прогона
+    WVT_W7_Scheduler(0, 1, 1);
+    WVT_W7_Set_Phase_Seed(seed);
+
+    for (uint8_t hour = 0; hour < 24; hour++)
+    {
+        for (uint8_t minute = 0; minute < 60; minute++)
+        {
+            if (WVT_W7_Scheduler(hour, minute, schedule))
+            {
+                slots.push_back(static_cast<uint32_t>((hour * 60) + minute) * 60);
+            }
+        }
+    }
+    REQUIRE(slots.size() > 0);
+
+    const uint32_t second = (WVT_W7_Next_Fire(schedule, 0) % 60);
+    if (seed == 0)
+    {
+        CHECK(second == 0);
+    }
+
+    for (uint32_t now = 0; now < seconds_per_day; now += 15)
+    {
+        uint32_t expected = slots.front() + second + seconds_per_day;
+        for (uint32_t slot : slots)
+        {
+            if ((slot + second) > now)
+            {
+                expected = slot + second;
+                break;
+            }
+        }
+        REQUIRE(WVT_W7_Next_Fire(schedule, now) == (expected - now));
+    }
+
+    CHECK(WVT_W7_Next_Fire(0, 0) == 0);
+    CHECK(WVT_W7_Next_Fire(-1, 0) == 0);
+
+    WVT_W7_Set_Phase_Seed(0);
+}
+
+TEST_CASE("Precision next fire", "[scheduler]")
+{
+    // 24 отправки в сутки: каждый час
+    CHECK(WVT_W7_Precision_Next_Fire(24, 0) == 3600);
+    CHECK(WVT_W7_Precision_Next_Fire(24, 3599) == 1);
+    CHECK(WVT_W7_Precision_Next_Fire(24, 23 * 3600 + 1800) == 1800);
+
+    // 86400 / 7 = 12342, последний слот 86394, следующий - полночь
+    CHECK(WVT_W7_Precision_Next_Fire(7, 12341) == 1);
+    CHECK(WVT_W7_Precision_Next_Fire(7, 86394) == 6);
+    CHECK(WVT_W7_Precision_Next_Fire(7, 86399) == 1);
+
+    // Время больше суток приводится к текущим суткам
+    CHECK(WVT_W7_Precision_Next_Fire(24, 86400 + 10) == 3590);
+
+    CHECK(WVT_W7_Precision_Next_Fire(100000, 5) == 1);
+    CHECK(WVT_W7_Precision_Next_Fire(0, 5) == 0);
+}
+
+/**
+ * Следующее срабатывание должно приходиться на ту секунду, в которую 
+ * срабатывает посекундно опрашиваемый WVT_W7_PrecisionScheduler, 
+ * в том числе при переходе через полночь и для расписаний, 
+ * на которые не делится число секунд в сутках
+ */
+TEST_CASE("Precision next fire sweep", "[scheduler]")
+{
+    auto schedule = GENERATE(1, 7, 24, 700, 1000, 9999);
+    auto seed = GENERATE(0U, 1U, 0xDEADBEEFU);
+    const uint32_t seconds_per_day = 24 * 3600;
+    std::vector<uint32_t> slots;
+
+    WVT_W7_Set_Phase_Seed(seed);
+
+    // Первые сутки сбрасывают состояние, оставшееся от предыдущего прогона
+    for (uint8_t day = 0; day < 2; day++)
+    {
+        for (uint32_t now = 0; now < seconds_per_day; now++)
+        {
+            const uint8_t hour = static_cast<uint8_t>(now / 3600);
+            const uint8_t minute = static_cast<uint8_t>((now / 60) % 60);
+            const uint8_t second = static_cast<uint8_t>(now % 60);
+            if (WVT_W7_PrecisionScheduler(hour, minute, second, schedule) && (day == 1))
+            {
+                slots.push_back(now);
+            }
+        }
+    }
+    // Слоты идут с периодом (24 * 3600) / schedule, последний слот суток может быть короче
+    const uint32_t period = seconds_per_day / static_cast<uint32_t>(schedule);
+    REQUIRE(slots.size() == static_cast<size_t>((seconds_per_day + period - 1) / period));
+
+    auto next = slots.begin();
+    for (uint32_t now = 0; now < seconds_per_day; now++)
+    {
+        while ((next != slots.end()) && (*next <= now))
+        {
+            ++next;
+        }
+        const uint32_t expected = (next != slots.end()) ? *next : (slots.front() + seconds_per_day);
+        const uint32_t actual = WVT_W7_Precision_Next_Fire(schedule, now);
+        if (actual != (expected - now))
+        {
+            FAIL("now " << now << ": " << actual << " instead of " << (expected - now));
+        }
+
+        // Время больше суток дает то же срабатывание
+        if ((now % 997) == 0)
+        {
+            REQUIRE(WVT_W7_Precision_Next_Fire(schedule, now + seconds_per_day) == actual);
+        }
+    }
+
+    WVT_W7_Set_Phase_Seed(0);
+}
+
+/**
+ * Смещение фазы не меняет числа отправок в сутки, 
+ * а разные устройства получают разные смещения
+ */
+TEST_CASE("Phase offset", "[scheduler]")
+{
+    auto schedule = GENERATE(1, 2, 3, 4, 6, 8, 12, 24, 48, 72, 96, 120, 144);
+    auto seed = GENERATE(1U, 2U, 3U, 0xCAFEU);
+    uint32_t trigger_count = 0;
+
+    WVT_W7_Set_Phase_Seed(seed);
+	for (uint8_t hour = 0; hour < 24; hour++)
+	{
+		for (uint8_t minute = 0; minute < 120; minute++)
+		{
+			if (WVT_W7_Scheduler(hour, (minute / 2), schedule))
+			{
+				trigger_count++;
+			}	
+		}
+	}
+	CHECK(trigger_count == static_cast<uint32_t>(schedule));
+    WVT_W7_Set_Phase_Seed(0);
+}
+
+TEST_CASE("Precision scheduler phase", "[scheduler]")
+{
+    const int32_t schedule = 24;
+    std::vector<uint32_t> fired;
+
+    WVT_W7_Set_Phase_Seed(12345);
+    const uint32_t first_slot = WVT_W7_Precision_Next_Fire(schedule, (24 * 3600) - 1) - 1;
+
+    // Первые сутки уходят на синхронизацию с сеткой слотов
+    for (uint32_t day = 0; day < 2; day++)
+    {
+        for (uint32_t second = 0; second < (24 * 3600); second++)
+        {
+            if (WVT_W7_PrecisionScheduler(static_cast<uint8_t>(second / 3600),
+                static_cast<uint8_t>((second / 60) % 60), static_cast<uint8_t>(second % 60), schedule)
+                && (day == 1))
+            {
+                fired.push_back(second);
+            }
+        }
+    }
+    WVT_W7_Set_Phase_Seed(0);
+
+    REQUIRE(fired.size() == static_cast<size_t>(schedule));
+    for (uint32_t second : fired)
+    {
+        CHECK((second % 3600) == (first_slot % 3600));
+    }
+}
+
+/**
+ * Моделирование нагрузки на базовую станцию: число сообщений в самую 
+ * загруженную секунду суток для парка устройств с одинаковым расписанием,
+ * без смещения фазы и со смещением от серийного номера.
+ * 
+ * Запуск: tests [benchmark]
+ */
+static uint32_t Peak_Load(uint32_t devices, int32_t schedule, bool precision, bool spread, uint32_t * total)
+{
+    const uint32_t seconds_per_day = 24 * 3600;
+    std::vector<uint32_t> load(seconds_per_day, 0);
+
+    *total = 0;
+    for (uint32_t device = 1; device <= devices; device++)
+    {
+        WVT_W7_Set_Phase_Seed(spread ? device : 0);
+
+        uint32_t now = seconds_per_day - 1;
+        while (true)
+        {
+            now += precision ? WVT_W7_Precision_Next_Fire(schedule, now) : WVT_W7_Next_Fire(schedule, now);
+            if (now >= (2 * seconds_per_day))
+            {
+                break;
+            }
+            load[now - seconds_per_day]++;
+            (*total)++;
+        }
+    }
+    WVT_W7_Set_Phase_Seed(0);
+
+    uint32_t peak = 0;
+    for (uint32_t sends : load)
+    {
+        peak = (sends > peak) ? sends : peak;
+    }
+    return peak;
+}
+
+TEST_CASE("Phase spreading load", "[.benchmark]")
+{
+    const uint32_t devices = 100000;
+    auto schedule = GENERATE(1, 24, 96);
+    auto precision = GENERATE(false, true);
+    uint32_t total_before;
+    uint32_t total_after;
+
+    const uint32_t peak_before = Peak_Load(devices, schedule, precision, false, &total_before);
+    const uint32_t peak_after = Peak_Load(devices, schedule, precision, true, &total_after);
+
+    // Пик при идеально равномерном распределении по секундам суток
+    const uint32_t even = (total_after + (24 * 3600) - 1) / (24 * 3600);
+
+    printf("%-10s schedule %3d/day, %u devices: peak %6u msg/s -> %4u msg/s (even %4u msg/s), %u msg/day\n",
+        precision ? "precision" : "minute", schedule, devices, peak_before, peak_after, even, total_after);
+
+    CHECK(total_before == total_after);
+    CHECK(peak_after < peak_before);
+    // Случайные фазы дают пик в пределах разброса вокруг равномерного, без всплесков на границах минут
+    CHECK(peak_after < (2 * even + 10));
+}
@@ -0,0 +1,94 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include "../lib/WVT_Water7_Aggregator.h"
+#include "catch.hpp"
+
+/**
+ * Пакет с несколькими событиями:
+ * 
+ * - тип 0x22
+ * - число записей
+ * - записи по 5 байт: идентификатор события, число повторов, последнее значение
+ */
+TEST_CASE("Event storm", "[aggregator]")
+{
+    // Вскрытие, протечка и обратный поток: 0x0101, 0x0102, 0x0103
+    const uint16_t tamper = 0x0101;
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint32_t uplinks = 0;
+
+    WVT_W7_Aggregator_Init(60, nullptr, 0);
+
+    // Шторм из 30 тревог за 30 секунд
+    for (uint16_t i = 0; i < 30; i++)
+    {
+        const uint16_t event = static_cast<uint16_t>(tamper + (i % 3));
+        uplinks += (WVT_W7_Aggregator_Add(event, i, i, buffer) != 0);
+        uplinks += (WVT_W7_Aggregator_Poll(i, buffer) != 0);
+    }
+    CHECK(uplinks == 0);
+    CHECK(WVT_W7_Aggregator_Poll(59, buffer) == 0);
+
+    const uint8_t storm_packet[] = {
+    //  тип | число | событие   | повторы | значение
+        0x22, 3,      0x01, 0x01, 10,       0x00, 27,
+                      0x01, 0x02, 10,       0x00, 28,
+                      0x01, 0x03, 10,       0x00, 29 };
+
+    CHECK(WVT_W7_Aggregator_Poll(60, buffer) == sizeof(storm_packet));
+    CHECK(memcmp(storm_packet, buffer, sizeof(storm_packet)) == 0);
+    CHECK(WVT_W7_Aggregator_Poll(1000, buffer) == 0);
+}
+
+TEST_CASE("Priority events", "[aggregator]")
+{
+    const uint16_t priority[] = { WVT_W7_EVENT_RESET, 0xBAAD };
+    const uint8_t event_packet[] = { 0x20, 0xBA, 0xAD, 0xBE, 0xEF };
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+    WVT_W7_Aggregator_Init(60, priority, 2);
+
+    CHECK(WVT_W7_Aggregator_Add(0x0001, 1, 0, buffer) == 0);
+    CHECK(WVT_W7_Aggregator_Add(0xBAAD, 0xBEEF, 1, buffer) == sizeof(event_packet));
+    CHECK(memcmp(event_packet, buffer, sizeof(event_packet)) == 0);
+
+    // Одиночное событие без повторов уходит обычным пакетом
+    const uint8_t single_packet[] = { 0x20, 0x00, 0x01, 0x00, 0x01 };
+    CHECK(WVT_W7_Aggregator_Flush(buffer) == sizeof(single_packet));
+    CHECK(memcmp(single_packet, buffer, sizeof(single_packet)) == 0);
+    CHECK(WVT_W7_Aggregator_Flush(buffer) == 0);
+}
+
+TEST_CASE("Aggregator overflow", "[aggregator]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+    WVT_W7_Aggregator_Init(60, nullptr, 0);
+
+    for (uint16_t event = 0; event < WVT_W7_AGGREGATOR_CAPACITY; event++)
+    {
+        CHECK(WVT_W7_Aggregator_Add(event, event, 0, buffer) == 0);
+    }
+
+    // Новое событие не помещается: окно закрывается досрочно
+    CHECK(WVT_W7_Aggregator_Add(0x1000, 0, 10, buffer) 
+        == (WVT_W7_MULTI_EVENT_DATA_OFFSET + (WVT_W7_AGGREGATOR_CAPACITY * WVT_W7_MULTI_EVENT_WIDTH)));
+    CHECK(buffer[0] == WVT_W7_PACKET_TYPE_MULTI_EVENT);
+    CHECK(buffer[1] == WVT_W7_AGGREGATOR_CAPACITY);
+
+    // Следующее окно открыто новым событием
+    CHECK(WVT_W7_Aggregator_Poll(69, buffer) == 0);
+    CHECK(WVT_W7_Aggregator_Poll(70, buffer) == 5);
+
+    // Счетчик повторов не переполняется
+    for (uint16_t i = 0; i < 300; i++)
+    {
+        WVT_W7_Aggregator_Add(0x0007, i, 100, buffer);
+    }
+    CHECK(WVT_W7_Aggregator_Flush(buffer) == (WVT_W7_MULTI_EVENT_DATA_OFFSET + WVT_W7_MULTI_EVENT_WIDTH));
+    CHECK(buffer[4] == UINT8_MAX);
+
+    // Без окна накопление отключено
+    WVT_W7_Aggregator_Init(0, nullptr, 0);
+    CHECK(WVT_W7_Aggregator_Add(0x0007, 1, 0, buffer) == 5);
+}
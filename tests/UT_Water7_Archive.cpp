@@ -0,0 +1,182 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../lib/WVT_Water7_Archive.h"
+#include "catch.hpp"
+
+static uint8_t archive_flash[WVT_W7_ARCHIVE_PAGES * WVT_W7_ARCHIVE_PAGE_SIZE];
+static uint32_t archive_erases = 0;
+
+static WVT_W7_Error_t flash_read(uint32_t offset, uint8_t * data, uint16_t length)
+{
+    if ((offset + length) > sizeof(archive_flash))
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+
+    memcpy(data, archive_flash + offset, length);
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/** Запись во флеш-память может только сбрасывать биты */
+static WVT_W7_Error_t flash_write(uint32_t offset, const uint8_t * data, uint16_t length)
+{
+    if ((offset + length) > sizeof(archive_flash))
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        REQUIRE(archive_flash[offset + i] == 0xFF);
+        archive_flash[offset + i] &= data[i];
+    }
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t flash_erase(uint32_t offset)
+{
+    REQUIRE((offset % WVT_W7_ARCHIVE_PAGE_SIZE) == 0);
+    memset(archive_flash + offset, 0xFF, WVT_W7_ARCHIVE_PAGE_SIZE);
+    archive_erases++;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static const WVT_W7_Archive_Storage_t archive_storage = { flash_read, flash_write, flash_erase };
+
+/**
+ * Сервер читает отсчеты с T1 до T2, продолжая чтение, пока устройство 
+ * выставляет признак продолжения
+ */
+static void Read_Archive(uint32_t first, uint32_t last, std::vector<uint32_t> & timestamps, 
+    std::vector<int32_t> & values, uint32_t * frames)
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint32_t frame_timestamps[WVT_W7_BUFFER_SIZE];
+    int32_t frame_values[WVT_W7_BUFFER_SIZE];
+    uint8_t more = 1;
+
+    *frames = 0;
+    while (more)
+    {
+        uint8_t request[] = { 
+        //  тип | T1                                      | T2
+            0x2E, static_cast<uint8_t>(first >> 24), static_cast<uint8_t>(first >> 16),
+                  static_cast<uint8_t>(first >> 8), static_cast<uint8_t>(first),
+                  static_cast<uint8_t>(last >> 24), static_cast<uint8_t>(last >> 16),
+                  static_cast<uint8_t>(last >> 8), static_cast<uint8_t>(last) };
+        uint16_t count = WVT_W7_BUFFER_SIZE;
+
+        const uint8_t length = WVT_W7_Parse(request, sizeof(request), buffer);
+        REQUIRE(WVT_W7_Archive_Decode(buffer, length, frame_timestamps, frame_values, &count, &more, &first) == WVT_W7_OK);
+        timestamps.insert(timestamps.end(), frame_timestamps, frame_timestamps + count);
+        values.insert(values.end(), frame_values, frame_values + count);
+        (*frames)++;
+        REQUIRE(*frames < 1000);
+    }
+}
+
+static uint32_t Sample_Time(uint32_t hour)
+{
+    return 1600000000U + (hour * 3600U) + (((hour % 7) == 0) ? 5U : 0U);
+}
+
+static int32_t Sample_Value(uint32_t hour)
+{
+    return static_cast<int32_t>(1000 + (hour * 3) + (hour % 5));
+}
+
+TEST_CASE("Archive", "[archive]")
+{
+    std::vector<uint32_t> timestamps;
+    std::vector<int32_t> values;
+    uint32_t frames;
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+    memset(archive_flash, 0, sizeof(archive_flash));
+    REQUIRE(WVT_W7_Archive_Init(&archive_storage) == WVT_W7_OK);
+    REQUIRE(WVT_W7_Archive_Format() == WVT_W7_OK);
+
+    SECTION("A day in one request")
+    {
+        for (uint32_t hour = 0; hour < 24 * 7; hour++)
+        {
+            REQUIRE(WVT_W7_Archive_Append(Sample_Time(hour), Sample_Value(hour)) == WVT_W7_ERROR_CODE_OK);
+        }
+
+        Read_Archive(Sample_Time(48), Sample_Time(71), timestamps, values, &frames);
+        CHECK(frames == 1);
+        REQUIRE(timestamps.size() == 24);
+        for (uint32_t hour = 0; hour < 24; hour++)
+        {
+            CHECK(timestamps[hour] == Sample_Time(48 + hour));
+            CHECK(values[hour] == Sample_Value(48 + hour));
+        }
+    }
+
+    SECTION("Resumable readout survives restart and ring wrap")
+    {
+        const uint32_t hours = 24 * 60;
+        for (uint32_t hour = 0; hour < hours; hour++)
+        {
+            REQUIRE(WVT_W7_Archive_Append(Sample_Time(hour), Sample_Value(hour)) == WVT_W7_ERROR_CODE_OK);
+            if (hour == hours / 2)
+            {
+                // Перезагрузка: место записи восстанавливается по флеш-памяти
+                REQUIRE(WVT_W7_Archive_Init(&archive_storage) == WVT_W7_OK);
+            }
+        }
+        CHECK(archive_erases > WVT_W7_ARCHIVE_PAGES);
+
+        Read_Archive(0, 0xFFFFFFFF, timestamps, values, &frames);
+        CHECK(frames > 1);
+        REQUIRE(timestamps.size() > 24 * 7);
+        REQUIRE(timestamps.size() < hours);
+
+        const uint32_t oldest = hours - static_cast<uint32_t>(timestamps.size());
+        for (size_t i = 0; i < timestamps.size(); i++)
+        {
+            CHECK(timestamps[i] == Sample_Time(oldest + static_cast<uint32_t>(i)));
+            CHECK(values[i] == Sample_Value(oldest + static_cast<uint32_t>(i)));
+        }
+    }
+
+    SECTION("Out of order and empty ranges")
+    {
+        uint8_t request[] = { 0x2E, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+        const uint8_t empty[] = { 0x2E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+        CHECK(WVT_W7_Parse(request, sizeof(request), buffer) == sizeof(empty));
+        CHECK(memcmp(buffer, empty, sizeof(empty)) == 0);
+
+        REQUIRE(WVT_W7_Archive_Append(1000, 1) == WVT_W7_ERROR_CODE_OK);
+        CHECK(WVT_W7_Archive_Append(1000, 2) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        CHECK(WVT_W7_Archive_Append(999, 2) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        Read_Archive(1001, 2000, timestamps, values, &frames);
+        CHECK(timestamps.empty());
+
+        // T1 больше T2
+        request[4] = 0x01;
+        request[8] = 0x00;
+        request[7] = 0x00;
+        request[6] = 0x00;
+        request[5] = 0x00;
+        CHECK(WVT_W7_Parse(request, sizeof(request), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        CHECK(WVT_W7_Parse(request, 8, buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+    }
+
+    SECTION("Missing storage")
+    {
+        const WVT_W7_Archive_Storage_t incomplete = { flash_read, flash_write, nullptr };
+        uint8_t request[] = { 0x2E, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+
+        CHECK(WVT_W7_Archive_Init(&incomplete) == WVT_W7_ERROR);
+        CHECK(WVT_W7_Archive_Append(1, 1) == WVT_W7_ERROR_CODE_INVALID_TYPE);
+        CHECK(WVT_W7_Parse(request, sizeof(request), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_TYPE);
+    }
+}
@@ -0,0 +1,378 @@
+﻿#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../lib/WVT_Water7_Firmware.h"
+#include "../host/WVT_Water7_Campaign.hpp"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+/**
+ * Модель устройства для больших парков: только битовая карта принятых частей.
+ * Отвечает на COMMIT состоянием в формате WVT_W7_Firmware, на части до BEGIN - ошибкой
+ */
+typedef struct
+{
+    bool begun;
+    uint32_t received;
+} Simulated_Device_t;
+
+static std::vector<uint8_t> Status_Frame(uint32_t image, uint16_t chunks, uint32_t received)
+{
+    uint16_t missing = 0;
+    for (uint16_t chunk = 0; chunk < chunks; chunk++)
+    {
+        missing = static_cast<uint16_t>(missing + (((received >> chunk) & 1) == 0));
+    }
+
+    std::vector<uint8_t> frame = { WVT_W7_PACKET_TYPE_FW_UPDATE, WVT_W7_FIRMWARE_STATUS,
+        static_cast<uint8_t>((missing == 0) ? WVT_W7_FIRMWARE_VERIFIED : WVT_W7_FIRMWARE_RECEIVING),
+        static_cast<uint8_t>(image >> 24), static_cast<uint8_t>(image >> 16),
+        static_cast<uint8_t>(image >> 8), static_cast<uint8_t>(image),
+        static_cast<uint8_t>(chunks >> 8), static_cast<uint8_t>(chunks),
+        static_cast<uint8_t>(missing >> 8), static_cast<uint8_t>(missing) };
+
+    uint16_t previous_end = 0;
+    for (uint16_t chunk = 0; chunk < chunks; chunk++)
+    {
+        if ((received >> chunk) & 1)
+        {
+            continue;
+        }
+
+        uint16_t end = chunk;
+        while ((end < chunks) && (((received >> end) & 1) == 0))
+        {
+            end++;
+        }
+        frame.push_back(static_cast<uint8_t>(chunk - previous_end));
+        frame.push_back(static_cast<uint8_t>(end - chunk - 1));
+        previous_end = end;
+        chunk = end;
+    }
+    return frame;
+}
+
+static std::vector<uint8_t> Simulate(Simulated_Device_t & device, uint32_t image, uint16_t chunks, const std::vector<uint8_t> & frame)
+{
+    switch (frame[1])
+    {
+    case WVT_W7_FIRMWARE_BEGIN:
+        // Ответ на BEGIN кампания не использует
+        device.begun = true;
+        return {};
+    case WVT_W7_FIRMWARE_CHUNK:
+        if (device.begun)
+        {
+            device.received |= 1U << ((frame[2] << 8) + frame[3]);
+            return {};
+        }
+        break;
+    case WVT_W7_FIRMWARE_COMMIT:
+        if (device.begun)
+        {
+            return Status_Frame(image, chunks, device.received);
+        }
+        break;
+    default:
+        break;
+    }
+    return { WVT_W7_PACKET_TYPE_FW_UPDATE | WVT_W7_ERROR_FLAG, WVT_W7_ERROR_CODE_INVALID_VALUE };
+}
+
+static std::vector<uint8_t> Make_Payload(size_t size)
+{
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        payload[i] = static_cast<uint8_t>((i * 131) >> 3);
+    }
+    return payload;
+}
+
+TEST_CASE("Firmware campaign", "[campaign]")
+{
+    const std::vector<uint8_t> payload = Make_Payload(600);
+    const uint32_t crc = WVT_W7_Crc32(0, payload.data(), static_cast<uint32_t>(payload.size()));
+    std::vector<water7::Campaign::Frame> frames;
+
+    SECTION("Real device over a lossy link")
+    {
+        uint8_t buffer[WVT_W7_BUFFER_SIZE];
+        std::mt19937 generator(3);
+        std::bernoulli_distribution lost(0.3);
+        water7::Campaign campaign(payload, 21, crc, 50);
+
+        Clear_Fake_Flash();
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        campaign.add_device(1, 100);
+
+        while ((campaign.finished() == 0) && (campaign.window() < 100))
+        {
+            campaign.schedule(frames);
+            for (water7::Campaign::Frame & frame : frames)
+            {
+                CHECK(frame.device == 1);
+                if (lost(generator))
+                {
+                    continue;
+                }
+
+                const uint8_t length = WVT_W7_Parse(frame.data.data(), static_cast<uint16_t>(frame.data.size()), buffer);
+                if ((length > 0) && (lost(generator) == false))
+                {
+                    CHECK(campaign.on_uplink(frame.device, buffer, length));
+                }
+            }
+        }
+
+        CHECK(campaign.finished() == 1);
+        CHECK(fake_committed_image == 21);
+        CHECK(fake_flash[WVT_W7_FIRMWARE_REGION_TARGET] == payload);
+        REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+    }
+
+    SECTION("Compressed flag and oversized chunks")
+    {
+        uint8_t buffer[WVT_W7_BUFFER_SIZE];
+        water7::Campaign campaign(payload, 22, crc, 200, WVT_W7_FIRMWARE_FLAG_COMPRESSED);
+
+        Clear_Fake_Flash();
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        campaign.add_device(1, 100);
+
+        while ((campaign.finished() == 0) && (campaign.window() < 100))
+        {
+            campaign.schedule(frames);
+            for (water7::Campaign::Frame & frame : frames)
+            {
+                REQUIRE(frame.data.size() <= WVT_W7_BUFFER_SIZE);
+                if (frame.data[1] == WVT_W7_FIRMWARE_CHUNK)
+                {
+                    CHECK(frame.data[WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET] == WVT_W7_FIRMWARE_FRAME_STORED);
+                }
+
+                const uint8_t length = WVT_W7_Parse(frame.data.data(), static_cast<uint16_t>(frame.data.size()), buffer);
+                if (length > 0)
+                {
+                    CHECK(campaign.on_uplink(frame.device, buffer, length));
+                }
+            }
+        }
+
+        CHECK(campaign.finished() == 1);
+        CHECK(fake_committed_image == 22);
+        CHECK(fake_flash[WVT_W7_FIRMWARE_REGION_TARGET] == payload);
+        REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+    }
+
+    SECTION("Malformed status keeps the plan")
+    {
+        water7::Campaign campaign(payload, 21, crc, 50);
+        campaign.add_device(7, 1);
+        campaign.set_device_frames(20);
+
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 14);
+
+        // Не хватает двух частей: они и COMMIT уходят в следующем окне
+        const std::vector<uint8_t> receiving = Status_Frame(21, 12, 0xFFC);
+        CHECK(campaign.on_uplink(7, receiving.data(), static_cast<uint16_t>(receiving.size())));
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 3);
+
+        // Обрезанный список пропусков не разбирается и не меняет план: 
+        // после срока ожидания повторяется только COMMIT
+        std::vector<uint8_t> truncated = Status_Frame(21, 12, 0x0F0);
+        truncated.pop_back();
+        CHECK_FALSE(campaign.on_uplink(7, truncated.data(), static_cast<uint16_t>(truncated.size())));
+        campaign.schedule(frames);
+        CHECK(frames.empty());
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].data[1] == WVT_W7_FIRMWARE_COMMIT);
+    }
+
+    SECTION("Capacity limits")
+    {
+        water7::Campaign campaign(payload, 21, crc, 50);
+        campaign.set_capacity(1, 10);
+        campaign.set_device_frames(3);
+        for (uint32_t device = 0; device < 20; device++)
+        {
+            campaign.add_device(device, 1 + (device % 2));
+        }
+
+        for (int window = 0; window < 5; window++)
+        {
+            size_t per_station[3] = { 0, 0, 0 };
+            size_t per_device[20] = { 0 };
+
+            campaign.schedule(frames);
+            for (const water7::Campaign::Frame & frame : frames)
+            {
+                per_station[1 + (frame.device % 2)]++;
+                per_device[frame.device]++;
+            }
+            CHECK(per_station[1] == 10);
+            CHECK(per_station[2] == 16);
+            for (size_t count : per_device)
+            {
+                CHECK(count <= 3);
+            }
+        }
+        CHECK(campaign.on_uplink(99, frames[0].data.data(), 2) == false);
+    }
+
+    SECTION("Fewest missing chunks first")
+    {
+        Simulated_Device_t devices[2] = { { false, 0 }, { false, 0 } };
+        water7::Campaign campaign(payload, 21, crc, 50);
+        campaign.add_device(0, 1);
+        campaign.add_device(1, 1);
+        campaign.set_device_frames(14);
+        campaign.set_capacity(1, 28);
+
+        // Все части и COMMIT за одно окно, часть пакетов потеряна
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 28);
+        for (const water7::Campaign::Frame & frame : frames)
+        {
+            const uint16_t chunk = static_cast<uint16_t>((frame.data[1] == WVT_W7_FIRMWARE_CHUNK) ? frame.data[3] : 0);
+            if ((frame.data[1] == WVT_W7_FIRMWARE_CHUNK) && (chunk < ((frame.device == 0) ? 8 : 2)))
+            {
+                continue;
+            }
+
+            const std::vector<uint8_t> reply = Simulate(devices[frame.device], 21, 12, frame.data);
+            if (reply.empty() == false)
+            {
+                CHECK(campaign.on_uplink(frame.device, reply.data(), static_cast<uint16_t>(reply.size())));
+            }
+        }
+
+        // Устройству 1 не хватает двух частей - оно обслуживается первым
+        campaign.set_capacity(1, 3);
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 3);
+        CHECK(frames[0].device == 1);
+        CHECK(frames[0].data[3] == 0);
+        CHECK(frames[1].data[3] == 1);
+        CHECK(frames[2].data[1] == WVT_W7_FIRMWARE_COMMIT);
+
+        campaign.schedule(frames);
+        CHECK(frames[0].device == 0);
+    }
+
+    SECTION("Repeated COMMIT and lost BEGIN")
+    {
+        water7::Campaign campaign(payload, 21, crc, 50);
+        campaign.add_device(7, 1);
+        campaign.set_device_frames(20);
+        campaign.set_status_timeout(3);
+
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 14);
+        CHECK(frames.back().data[1] == WVT_W7_FIRMWARE_COMMIT);
+
+        // Ответа нет - COMMIT повторяется через три окна
+        for (int window = 0; window < 2; window++)
+        {
+            campaign.schedule(frames);
+            CHECK(frames.empty());
+        }
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].data[1] == WVT_W7_FIRMWARE_COMMIT);
+
+        // Устройство не приняло BEGIN - образ передается заново
+        const uint8_t error[] = { WVT_W7_PACKET_TYPE_FW_UPDATE | WVT_W7_ERROR_FLAG, WVT_W7_ERROR_CODE_INVALID_VALUE };
+        CHECK(campaign.on_uplink(7, error, sizeof(error)));
+        campaign.schedule(frames);
+        REQUIRE(frames.size() == 14);
+        CHECK(frames[0].data[1] == WVT_W7_FIRMWARE_BEGIN);
+
+        const std::vector<uint8_t> verified = Status_Frame(21, 12, 0xFFF);
+        CHECK(campaign.on_uplink(7, verified.data(), static_cast<uint16_t>(verified.size())));
+        CHECK(campaign.finished() == 1);
+        campaign.schedule(frames);
+        CHECK(frames.empty());
+    }
+}
+
+TEST_CASE("Firmware campaign fleet", "[.benchmark]")
+{
+    const uint32_t device_count = 1000000;
+    const uint32_t station_count = 1000;
+    const uint8_t chunk_size = 100;
+    const std::vector<uint8_t> payload = Make_Payload(600);
+    const uint16_t chunks = static_cast<uint16_t>(payload.size() / chunk_size);
+    const water7::Campaign::Policy policies[] = { water7::Campaign::Policy::ROUND_ROBIN, water7::Campaign::Policy::FEWEST_MISSING };
+
+    printf("firmware campaign, %u devices, %u stations, %u chunks, 10%% loss\n", device_count, station_count, chunks);
+    for (water7::Campaign::Policy policy : policies)
+    {
+        std::mt19937 generator(11);
+        std::bernoulli_distribution lost(0.1);
+        std::vector<Simulated_Device_t> devices(device_count, { false, 0 });
+        std::vector<uint64_t> completed;
+        std::vector<water7::Campaign::Frame> frames;
+        water7::Campaign campaign(payload, 5, 0, chunk_size);
+        size_t sent = 0;
+        double scheduling = 0;
+
+        campaign.set_policy(policy);
+        for (uint32_t device = 0; device < device_count; device++)
+        {
+            campaign.add_device(device, device % station_count);
+        }
+        for (uint32_t station = 0; station < station_count; station++)
+        {
+            campaign.set_capacity(station, 64);
+        }
+
+        completed.reserve(device_count);
+        while (campaign.finished() < device_count)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            campaign.schedule(frames);
+            scheduling += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            REQUIRE(campaign.window() < 10000);
+            sent += frames.size();
+
+            for (const water7::Campaign::Frame & frame : frames)
+            {
+                if (lost(generator))
+                {
+                    continue;
+                }
+                const std::vector<uint8_t> reply = Simulate(devices[frame.device], 5, chunks, frame.data);
+                if ((reply.empty() == false) && (lost(generator) == false))
+                {
+                    const size_t finished = campaign.finished();
+                    campaign.on_uplink(frame.device, reply.data(), static_cast<uint16_t>(reply.size()));
+                    if (campaign.finished() > finished)
+                    {
+                        completed.push_back(campaign.window());
+                    }
+                }
+            }
+        }
+
+        double mean = 0;
+        for (uint64_t window : completed)
+        {
+            mean += static_cast<double>(window);
+        }
+        mean /= static_cast<double>(completed.size());
+        printf("%-14s: %llu windows, mean completion %.1f, 50%% done at %llu, 90%% at %llu; "
+            "%.2f frames/device, scheduling %.0f ns/frame\n",
+            (policy == water7::Campaign::Policy::ROUND_ROBIN) ? "round robin" : "fewest missing",
+            static_cast<unsigned long long>(campaign.window()), mean, 
+            static_cast<unsigned long long>(completed[completed.size() / 2]), 
+            static_cast<unsigned long long>(completed[completed.size() * 9 / 10]),
+            static_cast<double>(sent) / device_count, scheduling * 1e9 / static_cast<double>(sent));
+    }
+}
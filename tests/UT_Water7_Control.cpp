@@ -0,0 +1,152 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../lib/WVT_Water7.h"
+#include "../lib/WVT_Water7_Control.h"
+#include "../lib/WVT_Water7_Deferred.h"
+#include "catch.hpp"
+
+WVT_W7_Error_t ext_rom_read(uint16_t address, int32_t * value);
+WVT_W7_Error_t ext_rom_write(uint16_t address, int32_t value);
+
+/** Команды с первым байтом 0x01 выполняются сразу, 0x02 - долго (клапан, самотестирование) */
+static std::vector<uint8_t> slow_tickets;
+
+static WVT_W7_Error_t control_handler(uint8_t * data, uint16_t length, uint8_t * responce_buffer, uint16_t * bytes_written)
+{
+    (void)data;
+    (void)length;
+    (void)responce_buffer;
+    *bytes_written = 0;
+    return WVT_W7_ERROR_CODE_INVALID_TYPE;
+}
+
+static WVT_W7_Error_t control_command(uint8_t * data, uint16_t length, uint8_t * responce_buffer, uint16_t * bytes_written)
+{
+    (void)length;
+    switch (data[1])
+    {
+    case 0x01:
+        responce_buffer[1] = 0xAA;
+        *bytes_written = 2;
+        return WVT_W7_ERROR_CODE_OK;
+    case 0x02:
+        slow_tickets.push_back(WVT_W7_Control_Ticket());
+        return WVT_W7_ERROR_CODE_BUSY;
+    default:
+        return WVT_W7_ERROR_CODE_INVALID_VALUE;
+    }
+}
+
+/**
+ * Долгие команды: rfl_command возвращает WVT_W7_ERROR_CODE_BUSY, устройство сразу отвечает 
+ * кадром 0x28 "принято" с номером команды, результат приходит кадром 0x28 из очереди
+ */
+TEST_CASE("Deferred control commands", "[control]")
+{
+    WVT_W7_Callbacks_t callbacks = {};
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint8_t fast[] = { 0x27, 0x01, 0, 0, 0, 0, 0 };
+    uint8_t slow[] = { 0x27, 0x02, 1, 2, 3, 4, 5 };
+
+    callbacks.rom_read = ext_rom_read;
+    callbacks.rom_write = ext_rom_write;
+    callbacks.rfl_handler = control_handler;
+    callbacks.rfl_command = control_command;
+    REQUIRE(WVT_W7_Register_Callbacks(callbacks) == WVT_W7_OK);
+    WVT_W7_Control_Clear();
+    slow_tickets.clear();
+
+    SECTION("Accepted and completed")
+    {
+        CHECK(WVT_W7_Parse(fast, sizeof(fast), buffer) == 2);
+        CHECK(buffer[0] == 0x27);
+        CHECK(buffer[1] == 0xAA);
+
+        const uint8_t accepted_length = WVT_W7_Parse(slow, sizeof(slow), buffer);
+        REQUIRE(accepted_length == WVT_W7_CONTROL_ACCEPTED_LENGTH);
+        REQUIRE(slow_tickets.size() == 1);
+        CHECK(buffer[0] == WVT_W7_PACKET_TYPE_CONTROL_RESULT);
+        CHECK(buffer[1] == slow_tickets[0]);
+        CHECK(buffer[2] == WVT_W7_CONTROL_ACCEPTED);
+        CHECK(memcmp(buffer + 3, slow + 1, 6) == 0);
+
+        // Вторая команда получает следующий номер
+        REQUIRE(WVT_W7_Parse(slow, sizeof(slow), buffer) == WVT_W7_CONTROL_ACCEPTED_LENGTH);
+        REQUIRE(slow_tickets.size() == 2);
+        CHECK(slow_tickets[1] == static_cast<uint8_t>(slow_tickets[0] + 1));
+        CHECK(WVT_W7_Control_Pending() == 0);
+        CHECK(WVT_W7_Control_Next(buffer) == 0);
+
+        // Завершения отправляются в порядке поступления
+        const uint8_t result[] = { 0x10, 0x20 };
+        CHECK(WVT_W7_Control_Complete(slow_tickets[1], WVT_W7_ERROR_CODE_LL_ERROR, nullptr, 0));
+        CHECK(WVT_W7_Control_Complete(slow_tickets[0], WVT_W7_ERROR_CODE_OK, result, sizeof(result)));
+        CHECK(WVT_W7_Control_Pending() == 2);
+
+        REQUIRE(WVT_W7_Control_Next(buffer) == WVT_W7_CONTROL_RESULT_DATA_OFFSET);
+        const uint8_t failed[] = { 0x28, slow_tickets[1], WVT_W7_CONTROL_COMPLETED, WVT_W7_ERROR_CODE_LL_ERROR };
+        CHECK(memcmp(buffer, failed, sizeof(failed)) == 0);
+
+        REQUIRE(WVT_W7_Control_Next(buffer) == WVT_W7_CONTROL_RESULT_DATA_OFFSET + 2);
+        const uint8_t completed[] = { 0x28, slow_tickets[0], WVT_W7_CONTROL_COMPLETED, WVT_W7_ERROR_CODE_OK, 0x10, 0x20 };
+        CHECK(memcmp(buffer, completed, sizeof(completed)) == 0);
+        CHECK(WVT_W7_Control_Pending() == 0);
+        CHECK(WVT_W7_Control_Next(buffer) == 0);
+    }
+
+    SECTION("Wrapped and deferred")
+    {
+        // Тег последовательности сохраняется и для ответа "принято"
+        uint8_t tagged[] = { 0x31, 0x77, 0x27, 0x02, 9, 9, 9, 9, 9 };
+        REQUIRE(WVT_W7_Parse(tagged, sizeof(tagged), buffer) == WVT_W7_CONTROL_ACCEPTED_LENGTH + 2);
+        CHECK(buffer[0] == 0x31);
+        CHECK(buffer[1] == 0x77);
+        CHECK(buffer[2] == WVT_W7_PACKET_TYPE_CONTROL_RESULT);
+        CHECK(buffer[4] == WVT_W7_CONTROL_ACCEPTED);
+
+        // В режиме отложенных ответов "принято" уходит с регулярным сообщением
+        WVT_W7_Deferred_Clear();
+        WVT_W7_Deferred_Enable(1);
+        CHECK(WVT_W7_Parse(slow, sizeof(slow), buffer) == 0);
+        CHECK(WVT_W7_Deferred_Pending() == 1);
+        WVT_W7_Deferred_Enable(0);
+        WVT_W7_Deferred_Clear();
+    }
+
+    SECTION("Queue limits")
+    {
+        uint8_t result[WVT_W7_CONTROL_MAX_RESULT + 1] = {};
+
+        CHECK(WVT_W7_Control_Complete(0, WVT_W7_ERROR_CODE_OK, result, sizeof(result)) == 0);
+        CHECK(WVT_W7_Control_Complete(0, WVT_W7_ERROR_CODE_OK, nullptr, 1) == 0);
+        CHECK(WVT_W7_Control_Complete(0, WVT_W7_ERROR_CODE_OK, result, WVT_W7_CONTROL_MAX_RESULT) == 1);
+        CHECK(WVT_W7_Control_Complete(1, WVT_W7_ERROR_CODE_OK, nullptr, 0) == 0);
+        REQUIRE(WVT_W7_Control_Next(buffer) == WVT_W7_CONTROL_RESULT_DATA_OFFSET + WVT_W7_CONTROL_MAX_RESULT);
+        CHECK((WVT_W7_CONTROL_RESULT_DATA_OFFSET + WVT_W7_CONTROL_MAX_RESULT) <= WVT_W7_BUFFER_SIZE);
+
+        size_t queued = 0;
+        while (WVT_W7_Control_Complete(static_cast<uint8_t>(queued), WVT_W7_ERROR_CODE_OK, result, 3))
+        {
+            queued++;
+        }
+        CHECK(queued == WVT_W7_CONTROL_QUEUE_SIZE / (WVT_W7_CONTROL_RESULT_DATA_OFFSET + 3 + 1));
+        CHECK(WVT_W7_Control_Pending() == queued);
+        WVT_W7_Control_Clear();
+        CHECK(WVT_W7_Control_Pending() == 0);
+    }
+
+    SECTION("Other errors are unchanged")
+    {
+        slow[1] = 0x03;
+        REQUIRE(WVT_W7_Parse(slow, sizeof(slow), buffer) == 2);
+        CHECK(buffer[0] == (0x27 | 0x40));
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        CHECK(WVT_W7_Parse(slow, 6, buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+    }
+
+    callbacks.rfl_handler = nullptr;
+    callbacks.rfl_command = nullptr;
+    WVT_W7_Register_Callbacks(callbacks);
+}
@@ -0,0 +1,442 @@
+﻿#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../lib/WVT_Water7.h"
+#include "../lib/WVT_Water7_Archive.h"
+#include "../lib/WVT_Water7_Deferred.h"
+#include "../lib/WVT_Water7_Digest.h"
+#include "../lib/WVT_Water7_Subscriptions.h"
+#include "../lib/WVT_Water7_Sync.h"
+#include "../host/WVT_Water7_Coroutine.hpp"
+#include "catch.hpp"
+
+static const uint16_t rom_size = 64;
+
+/**
+ * Пул потоков, на котором завершаются операции с памятью: сопрограмма, 
+ * ожидающая schedule, продолжается на одном из рабочих потоков
+ */
+class Executor
+{
+public:
+    explicit Executor(unsigned threads)
+    {
+        for (unsigned i = 0; i < threads; i++)
+        {
+            workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (std::thread & worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    struct Awaiter
+    {
+        Executor & executor;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) const
+        {
+            {
+                std::lock_guard<std::mutex> lock(executor.mutex);
+                executor.queue.push_back(handle);
+            }
+            executor.ready.notify_one();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    Awaiter schedule() { return Awaiter{ *this }; }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return stopping || (queue.empty() == false); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                handle = queue.front();
+                queue.pop_front();
+            }
+            handle.resume();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::coroutine_handle<>> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};
+
+/** Память устройства, каждая операция завершается на рабочем потоке */
+class Device_Storage : public water7::Async_Storage
+{
+public:
+    Device_Storage(Executor & executor, const std::vector<int32_t> & rom) : executor(executor), rom(rom) {}
+
+    water7::task<water7::Storage_Result> read(uint16_t address) override
+    {
+        co_await executor.schedule();
+        if (address >= rom.size())
+        {
+            co_return water7::Storage_Result{ WVT_W7_ERROR_CODE_INVALID_ADDRESS, 0 };
+        }
+        co_return water7::Storage_Result{ WVT_W7_ERROR_CODE_OK, rom[address] };
+    }
+
+    water7::task<WVT_W7_Error_t> write(uint16_t address, int32_t value) override
+    {
+        co_await executor.schedule();
+        if (address >= rom.size())
+        {
+            co_return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+        }
+        if (address == 1)
+        {
+            co_return WVT_W7_ERROR_CODE_READ_ONLY;
+        }
+        rom[address] = value;
+        co_return WVT_W7_ERROR_CODE_OK;
+    }
+
+    Executor & executor;
+    std::vector<int32_t> rom;
+};
+
+/** Та же память для синхронного WVT_W7_Parse */
+static std::vector<int32_t> * sync_rom = nullptr;
+static uint32_t sync_calls = 0;
+
+static WVT_W7_Error_t sync_rom_read(uint16_t address, int32_t * value)
+{
+    sync_calls++;
+    if (address >= sync_rom->size())
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+    *value = (*sync_rom)[address];
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t sync_rom_write(uint16_t address, int32_t value)
+{
+    sync_calls++;
+    if (address >= sync_rom->size())
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+    if (address == 1)
+    {
+        return WVT_W7_ERROR_CODE_READ_ONLY;
+    }
+    (*sync_rom)[address] = value;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+/** Случайный запрос к параметрам, в том числе с ошибками в длине, адресе и типе */
+static std::vector<uint8_t> Make_Request(std::mt19937 & generator)
+{
+    auto next = [&generator](uint32_t limit) { return static_cast<uint32_t>(generator()) % limit; };
+    const uint8_t types[] = { 0x03, 0x04, 0x06, 0x07, 0x10, 0x16, 0x30, 0x31, 0x55 };
+    const uint8_t type = types[next(sizeof(types))];
+    const uint16_t address = static_cast<uint16_t>(next(rom_size + 4));
+    std::vector<uint8_t> request = { type, static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address) };
+    uint16_t count;
+
+    switch (type)
+    {
+    case 0x03:
+    case 0x04:
+        count = static_cast<uint16_t>(next((type == 0x03) ? 34 : 80));
+        request.push_back(static_cast<uint8_t>(count >> 8));
+        request.push_back(static_cast<uint8_t>(count));
+        break;
+    case 0x06:
+        for (int i = 0; i < 4; i++)
+        {
+            request.push_back(static_cast<uint8_t>(next(256)));
+        }
+        break;
+    case 0x10:
+        count = static_cast<uint16_t>(next(8));
+        request.push_back(0);
+        request.push_back(static_cast<uint8_t>(count));
+        for (uint16_t i = 0; i < (count * 4); i++)
+        {
+            request.push_back(static_cast<uint8_t>(next(256)));
+        }
+        break;
+    case 0x16:
+        request.push_back(static_cast<uint8_t>(next(5)));
+        for (uint32_t i = 0; i < ((next(2) == 0) ? 4U : 8U); i++)
+        {
+            request.push_back(static_cast<uint8_t>((next(3) == 0) ? 0 : next(256)));
+        }
+        break;
+    case 0x30:
+    case 0x31:
+        request = Make_Request(generator);
+        request.insert(request.begin(), static_cast<uint8_t>(next(256)));
+        if (type == 0x31)
+        {
+            request.insert(request.begin(), type);
+        }
+        else
+        {
+            request[0] = type;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // Изредка длина не соответствует запросу
+    if ((next(16) == 0) && (request.size() > 1))
+    {
+        request.pop_back();
+    }
+    return request;
+}
+
+static water7::task<size_t> Handle(Device_Storage & storage, const std::vector<uint8_t> & request, 
+    std::vector<uint8_t> & responce, std::atomic<size_t> & finished)
+{
+    const size_t length = co_await water7::parse(storage, request, responce);
+    responce.resize(length);
+    finished++;
+    co_return length;
+}
+
+static std::vector<int32_t> Make_Rom(std::mt19937 & generator)
+{
+    std::vector<int32_t> rom(rom_size);
+    for (int32_t & value : rom)
+    {
+        value = static_cast<int32_t>((generator() % 3) ? (generator() % 1000) : generator());
+    }
+    rom[5] = INT32_MAX - 1;
+    return rom;
+}
+
+TEST_CASE("Coroutine parse", "[coroutine]")
+{
+    WVT_W7_Callbacks_t callbacks = {};
+    callbacks.rom_read = sync_rom_read;
+    callbacks.rom_write = sync_rom_write;
+    REQUIRE(WVT_W7_Register_Callbacks(callbacks) == WVT_W7_OK);
+
+    SECTION("Same bytes as WVT_W7_Parse on many concurrent devices")
+    {
+        const size_t device_count = 20000;
+        std::mt19937 generator(5);
+        std::vector<std::vector<uint8_t>> requests(device_count);
+        std::vector<std::vector<int32_t>> roms(device_count);
+        std::vector<std::vector<uint8_t>> expected(device_count);
+        std::vector<std::vector<int32_t>> expected_roms(device_count);
+
+        for (size_t i = 0; i < device_count; i++)
+        {
+            uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+            requests[i] = Make_Request(generator);
+            roms[i] = Make_Rom(generator);
+            expected_roms[i] = roms[i];
+            sync_rom = &expected_roms[i];
+            const uint8_t length = WVT_W7_Parse(requests[i].data(), static_cast<uint16_t>(requests[i].size()), buffer);
+            expected[i].assign(buffer, buffer + length);
+        }
+
+        std::atomic<size_t> finished(0);
+        std::vector<std::unique_ptr<Device_Storage>> storages;
+        std::vector<std::vector<uint8_t>> responces(device_count, std::vector<uint8_t>(WVT_W7_BUFFER_SIZE));
+        std::vector<water7::task<size_t>> tasks;
+        {
+            Executor executor(4);
+
+            for (size_t i = 0; i < device_count; i++)
+            {
+                storages.push_back(std::make_unique<Device_Storage>(executor, roms[i]));
+                tasks.push_back(Handle(*storages[i], requests[i], responces[i], finished));
+            }
+            for (water7::task<size_t> & task : tasks)
+            {
+                task.start();
+            }
+            while (finished < device_count)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < device_count; i++)
+        {
+            CHECK(tasks[i].done());
+            mismatches += (responces[i] != expected[i]) || (storages[i]->rom != expected_roms[i]);
+        }
+        CHECK(mismatches == 0);
+    }
+
+    SECTION("Module requests are rejected")
+    {
+        Executor executor(1);
+        Device_Storage storage(executor, std::vector<int32_t>(rom_size, 0));
+        std::vector<int32_t> device_rom(rom_size, 0);
+        const uint8_t types[][2] = 
+        {
+            { WVT_W7_PACKET_TYPE_SUBSCRIBE, WVT_W7_SUBSCRIBE_LENGTH },
+            { WVT_W7_PACKET_TYPE_DIGEST, WVT_W7_DIGEST_LENGTH },
+            { WVT_W7_PACKET_TYPE_READ_CHANGED, WVT_W7_READ_CHANGED_LENGTH },
+            { WVT_W7_PACKET_TYPE_READ_ARCHIVE, WVT_W7_READ_ARCHIVE_LENGTH },
+            { WVT_W7_PACKET_TYPE_FW_UPDATE, 8 },
+            { WVT_W7_PACKET_TYPE_CONTROL, WVT_W7_CONTROL_LENGTH },
+        };
+        uint8_t out[WVT_W7_BUFFER_SIZE];
+
+        sync_rom = &device_rom;
+        sync_calls = 0;
+
+        for (const auto & type : types)
+        {
+            std::vector<uint8_t> request(type[1], 0);
+            request[0] = type[0];
+
+            // Запрос модуля отклоняется и внутри обертки с тегом
+            for (uint8_t tagged = 0; tagged < 2; tagged++)
+            {
+                const size_t offset = tagged * WVT_W7_TAGGED_DATA_OFFSET;
+                if (tagged)
+                {
+                    request.insert(request.begin(), { WVT_W7_PACKET_TYPE_TAGGED, 0x5A });
+                }
+
+                water7::task<size_t> task = water7::parse(storage, request, out);
+                task.start();
+                REQUIRE(task.done());
+                REQUIRE(task.result() == (offset + WVT_W7_ERROR_RESPONCE_LENGTH));
+                CHECK(out[offset] == (type[0] | WVT_W7_ERROR_FLAG));
+                CHECK(out[offset + 1] == WVT_W7_ERROR_CODE_INVALID_TYPE);
+            }
+        }
+        CHECK(sync_calls == 0);
+    }
+
+    SECTION("Writes skip device modules")
+    {
+        std::atomic<size_t> finished(0);
+        std::vector<uint8_t> responce(WVT_W7_BUFFER_SIZE);
+        std::vector<int32_t> rom;
+        const std::vector<uint8_t> request = { WVT_W7_PACKET_TYPE_WRITE_SINGLE, 0x00, 0x02, 0x00, 0x00, 0x01, 0x00 };
+        water7::task<size_t> task;
+
+        WVT_W7_Sync_Init(100);
+        WVT_W7_Deferred_Enable(1);
+        {
+            // Задача завершается на рабочем потоке: она удаляется после его остановки
+            Executor executor(1);
+            Device_Storage storage(executor, std::vector<int32_t>(rom_size, 0));
+
+            task = Handle(storage, request, responce, finished);
+            task.start();
+            while (finished == 0)
+            {
+                std::this_thread::yield();
+            }
+            rom = storage.rom;
+        }
+
+        // Версии параметров и очередь отложенных ответов - этого устройства, а не storage
+        CHECK(task.done());
+        CHECK(responce == request);
+        CHECK(rom[2] == 0x100);
+        CHECK(WVT_W7_Sync_Version() == 100);
+        CHECK(WVT_W7_Deferred_Pending() == 0);
+
+        WVT_W7_Deferred_Enable(0);
+    }
+
+    SECTION("Small output buffer")
+    {
+        Executor executor(1);
+        Device_Storage storage(executor, std::vector<int32_t>(rom_size, 0));
+        const uint8_t request[] = { 0x07, 0x00, 0x01 };
+        uint8_t out[WVT_W7_BUFFER_SIZE - 1];
+
+        water7::task<size_t> task = water7::parse(storage, request, out);
+        task.start();
+        CHECK(task.done());
+        CHECK(task.result() == 0);
+    }
+}
+
+TEST_CASE("Coroutine parse throughput", "[.benchmark]")
+{
+    const size_t device_count = 100000;
+    const unsigned thread_counts[] = { 1, 2, 4 };
+    std::mt19937 generator(9);
+    std::vector<std::vector<uint8_t>> requests(device_count);
+    std::vector<std::vector<int32_t>> roms(device_count);
+
+    for (size_t i = 0; i < device_count; i++)
+    {
+        requests[i] = Make_Request(generator);
+        roms[i] = Make_Rom(generator);
+    }
+
+    printf("coroutine parse, %u concurrent device requests\n", static_cast<unsigned>(device_count));
+    for (unsigned threads : thread_counts)
+    {
+        std::atomic<size_t> finished(0);
+        std::vector<std::unique_ptr<Device_Storage>> storages;
+        std::vector<std::vector<uint8_t>> responces(device_count, std::vector<uint8_t>(WVT_W7_BUFFER_SIZE));
+        std::vector<water7::task<size_t>> tasks;
+        double seconds;
+        {
+            Executor executor(threads);
+
+            for (size_t i = 0; i < device_count; i++)
+            {
+                storages.push_back(std::make_unique<Device_Storage>(executor, roms[i]));
+                tasks.push_back(Handle(*storages[i], requests[i], responces[i], finished));
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            for (water7::task<size_t> & task : tasks)
+            {
+                task.start();
+            }
+            while (finished < device_count)
+            {
+                std::this_thread::yield();
+            }
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        printf("%u threads: %.0f requests/s\n", threads, static_cast<double>(device_count) / seconds);
+    }
+}
@@ -0,0 +1,98 @@
+﻿#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include "../lib/WVT_Water7_Crc32.h"
+#include "catch.hpp"
+
+static uint32_t hardware_calls = 0;
+
+static uint32_t Crc32_Hardware(uint32_t crc, const uint8_t * data, uint32_t length)
+{
+    hardware_calls++;
+    return WVT_W7_Crc32_Bitwise(crc, data, length);
+}
+
+static std::vector<uint8_t> Make_Data(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    uint32_t state = 3;
+
+    for (uint8_t & byte : data)
+    {
+        state = state * 1103515245U + 12345U;
+        byte = static_cast<uint8_t>(state >> 16);
+    }
+    return data;
+}
+
+TEST_CASE("CRC-32", "[crc32]")
+{
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+    SECTION("Check value")
+    {
+        CHECK(WVT_W7_Crc32_Bitwise(0, check, sizeof(check)) == 0xCBF43926);
+        CHECK(WVT_W7_Crc32_Slice8(0, check, sizeof(check)) == 0xCBF43926);
+        CHECK(WVT_W7_Crc32(0, check, sizeof(check)) == 0xCBF43926);
+        CHECK(WVT_W7_Crc32(0, check, 0) == 0);
+    }
+
+    SECTION("Slice-by-8 matches bitwise at any length and alignment")
+    {
+        const std::vector<uint8_t> data = Make_Data(100);
+
+        for (uint32_t offset = 0; offset < 8; offset++)
+        {
+            for (uint32_t length = 0; (offset + length) <= data.size(); length++)
+            {
+                REQUIRE(WVT_W7_Crc32_Slice8(0, data.data() + offset, length) == WVT_W7_Crc32_Bitwise(0, data.data() + offset, length));
+            }
+        }
+
+        // Расчет по частям
+        const uint32_t crc = WVT_W7_Crc32_Slice8(0, data.data(), 37);
+        CHECK(WVT_W7_Crc32_Slice8(crc, data.data() + 37, 63) == WVT_W7_Crc32_Bitwise(0, data.data(), 100));
+    }
+
+    SECTION("Hardware CRC")
+    {
+        hardware_calls = 0;
+        WVT_W7_Crc32_Register(Crc32_Hardware);
+        CHECK(WVT_W7_Crc32(0, check, sizeof(check)) == 0xCBF43926);
+        CHECK(hardware_calls == 1);
+
+        WVT_W7_Crc32_Register(nullptr);
+        CHECK(WVT_W7_Crc32(0, check, sizeof(check)) == 0xCBF43926);
+        CHECK(hardware_calls == 1);
+    }
+}
+
+TEST_CASE("CRC-32 throughput", "[.benchmark]")
+{
+    const std::vector<uint8_t> data = Make_Data(1 << 20);
+    const struct
+    {
+        const char * name;
+        WVT_W7_Crc32_Function_t function;
+        uint32_t passes;
+    } implementations[] = {
+        { "bitwise", WVT_W7_Crc32_Bitwise, 4 },
+        { "slice-by-8", WVT_W7_Crc32_Slice8, 32 },
+    };
+
+    printf("CRC-32 throughput, %u byte buffer\n", static_cast<unsigned>(data.size()));
+    for (const auto & implementation : implementations)
+    {
+        uint32_t crc = 0;
+        const clock_t start = clock();
+        for (uint32_t pass = 0; pass < implementation.passes; pass++)
+        {
+            crc = implementation.function(crc, data.data(), static_cast<uint32_t>(data.size()));
+        }
+        const double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+        const double bytes = static_cast<double>(data.size()) * implementation.passes;
+
+        printf("%-12s %8.1f MB/s (crc %08X)\n", implementation.name, bytes / seconds / 1e6, crc);
+    }
+}
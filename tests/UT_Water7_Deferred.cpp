@@ -0,0 +1,129 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include "../lib/WVT_Water7_Deferred.h"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+/** Значение параметра - его адрес плюс 0x100 */
+static void Register_Deferred_Callbacks(void)
+{
+    Register_Fake_Rom(UINT16_MAX + 1);
+    for (size_t address = 0; address < fake_rom.size(); address++)
+    {
+        fake_rom[address] = static_cast<int32_t>(address) + 0x100;
+    }
+}
+
+TEST_CASE("Deferred responces", "[water7]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint8_t read_single[] = { 0x07, 0x00, 0x05 };
+    const uint8_t read_single_responce[] = { 0x07, 0x00, 0x05, 0x00, 0x00, 0x01, 0x05 };
+    const uint8_t regular_length = WVT_W7_ADDITIONAL_DATA_OFFSET + WVT_W7_ADDITIONAL_DATA_WIDTH;
+
+    Register_Deferred_Callbacks();
+    WVT_W7_Deferred_Clear();
+    WVT_W7_Deferred_Enable(1);
+
+    SECTION("Responce rides on the next regular message")
+    {
+        uint8_t bad_length[] = { 0x07, 0x00 };
+
+        REQUIRE(WVT_W7_Parse(read_single, sizeof(read_single), buffer) == 0);
+        REQUIRE(WVT_W7_Parse(bad_length, sizeof(bad_length), buffer) == 0);
+        REQUIRE(WVT_W7_Deferred_Pending() == 2);
+
+        // Регулярное сообщение с одним дополнительным параметром
+        const uint8_t length = WVT_W7_Short_Regular(buffer, 0x12345678, 0, 0x0101, 9);
+        REQUIRE(length == regular_length + 2 + sizeof(read_single_responce) + 2 + 2);
+        REQUIRE(WVT_W7_Deferred_Pending() == 0);
+
+        const uint8_t trailer = WVT_W7_Deferred_Trailer(buffer, length);
+        REQUIRE(trailer == regular_length);
+        REQUIRE(buffer[trailer] == WVT_W7_DEFERRED_MARKER);
+        REQUIRE(buffer[trailer + 1] == sizeof(read_single_responce));
+        REQUIRE(memcmp(buffer + trailer + 2, read_single_responce, sizeof(read_single_responce)) == 0);
+
+        const size_t second = trailer + 2 + sizeof(read_single_responce);
+        const uint8_t error_responce[] = { WVT_W7_DEFERRED_MARKER, 2, 0x47, 0x06 };
+        REQUIRE(memcmp(buffer + second, error_responce, sizeof(error_responce)) == 0);
+
+        // Очередь пуста, следующее сообщение без хвоста
+        REQUIRE(WVT_W7_Short_Regular(buffer, 0x12345678, 0, 0x0101, 9) == regular_length);
+        REQUIRE(WVT_W7_Deferred_Trailer(buffer, regular_length) == regular_length);
+    }
+
+    SECTION("Responce rides on the long regular message")
+    {
+        uint16_t addresses[60];
+        uint16_t decoded_addresses[60];
+        int32_t values[60];
+        uint16_t packed = 0;
+        uint16_t count = 60;
+        int32_t payload = 0;
+        uint16_t schedule = 0;
+
+        for (uint16_t i = 0; i < 60; i++)
+        {
+            addresses[i] = static_cast<uint16_t>(i * 1000);
+        }
+        REQUIRE(WVT_W7_Parse(read_single, sizeof(read_single), buffer) == 0);
+
+        // Список не помещается целиком, но место под ответ зарезервировано
+        const uint8_t length = WVT_W7_Long_Regular(buffer, 0x12345678, 0x0101, addresses, 60, 0, &packed);
+        REQUIRE(packed < 60);
+        REQUIRE(WVT_W7_Deferred_Pending() == 0);
+
+        const uint8_t trailer = WVT_W7_Deferred_Trailer(buffer, length);
+        REQUIRE(trailer + 2 + sizeof(read_single_responce) == length);
+        REQUIRE(buffer[trailer] == WVT_W7_DEFERRED_MARKER);
+        REQUIRE(memcmp(buffer + trailer + 2, read_single_responce, sizeof(read_single_responce)) == 0);
+
+        REQUIRE(WVT_W7_Long_Regular_Decode(buffer, length, &payload, &schedule, decoded_addresses, values, &count) == WVT_W7_OK);
+        REQUIRE(count == packed);
+        CHECK(decoded_addresses[packed - 1] == addresses[packed - 1]);
+        CHECK(values[packed - 1] == addresses[packed - 1] + 0x100);
+
+        // Без ответов в очереди хвоста нет
+        const uint8_t plain = WVT_W7_Long_Regular(buffer, 0x12345678, 0x0101, addresses, 3, 0, &packed);
+        REQUIRE(WVT_W7_Deferred_Trailer(buffer, plain) == plain);
+    }
+
+    SECTION("Oversized responce is sent at once")
+    {
+        uint8_t read_multiple[] = { 0x03, 0x00, 0x00, 0x00, 20 };
+        REQUIRE(WVT_W7_Parse(read_multiple, sizeof(read_multiple), buffer) == 5 + (20 * 4));
+        REQUIRE(WVT_W7_Deferred_Pending() == 0);
+    }
+
+    SECTION("Full queue falls back to immediate responces")
+    {
+        size_t queued = 0;
+        while (WVT_W7_Parse(read_single, sizeof(read_single), buffer) == 0)
+        {
+            queued++;
+        }
+        REQUIRE(queued == WVT_W7_DEFERRED_QUEUE_SIZE / (sizeof(read_single_responce) + 1));
+        REQUIRE(memcmp(buffer, read_single_responce, sizeof(read_single_responce)) == 0);
+
+        // В сообщение с пятью дополнительными параметрами помещается столько ответов, сколько есть места
+        const uint8_t five_length = WVT_W7_ADDITIONAL_DATA_OFFSET + (5 * WVT_W7_ADDITIONAL_DATA_WIDTH);
+        const size_t room = (WVT_W7_BUFFER_SIZE - five_length) / (sizeof(read_single_responce) + 2);
+        const size_t fit = (room < queued) ? room : queued;
+        REQUIRE(WVT_W7_Short_Regular(buffer, 0, 0, 0x0101, 0x10410410) == five_length + fit * (sizeof(read_single_responce) + 2));
+        REQUIRE(WVT_W7_Deferred_Pending() == queued - fit);
+
+        WVT_W7_Short_Regular(buffer, 0, 0, 0x0101, 0x10410410);
+        REQUIRE(WVT_W7_Deferred_Pending() == 0);
+    }
+
+    SECTION("Disabled mode answers immediately")
+    {
+        WVT_W7_Deferred_Enable(0);
+        REQUIRE(WVT_W7_Parse(read_single, sizeof(read_single), buffer) == sizeof(read_single_responce));
+        REQUIRE(WVT_W7_Deferred_Pending() == 0);
+    }
+
+    WVT_W7_Deferred_Enable(0);
+    WVT_W7_Deferred_Clear();
+}
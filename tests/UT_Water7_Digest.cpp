@@ -0,0 +1,128 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../lib/WVT_Water7_Digest.h"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+static void Register_Digest_Rom()
+{
+    Register_Fake_Rom(WVT_W7_DIGEST_PARAMETERS);
+    for (uint16_t i = 0; i < WVT_W7_DIGEST_PARAMETERS; i++)
+    {
+        fake_rom[i] = (i * 1000) - 7;
+    }
+}
+
+static uint32_t Hash_At(const uint8_t * record)
+{
+    return    (static_cast<uint32_t>(record[0]) << 24)
+            + (static_cast<uint32_t>(record[1]) << 16)
+            + (static_cast<uint32_t>(record[2]) << 8)
+            +  static_cast<uint32_t>(record[3]);
+}
+
+/**
+ * Запрос хешей: тип 0x2C, уровень, первый узел, число узлов.
+ * Ответ повторяет запрос и содержит хеши по 4 байта
+ */
+TEST_CASE("Digest", "[digest]")
+{
+    uint8_t digest[] = { 
+    //  тип | уровень | первый | число
+        0x2C, 0,        0,       1 };
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint32_t server_tree[WVT_W7_DIGEST_NODES];
+
+    Register_Digest_Rom();
+
+    // Занятая память не дает построить дерево из неизвестных значений
+    fake_rom_busy_address = 0;
+    CHECK(WVT_W7_Digest_Init() == WVT_W7_ERROR);
+    fake_rom_busy_address = UINT32_MAX;
+    CHECK(WVT_W7_Parse(digest, sizeof(digest), buffer) == 2);
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_TYPE);
+
+    REQUIRE(WVT_W7_Digest_Init() == WVT_W7_OK);
+    WVT_W7_Digest_Build(fake_rom.data(), server_tree);
+
+    CHECK(WVT_W7_Parse(digest, sizeof(digest), buffer) == (4 + 4));
+    CHECK(memcmp(digest, buffer, sizeof(digest)) == 0);
+    CHECK(Hash_At(buffer + 4) == server_tree[1]);
+
+    // Запись через протокол обновляет дерево
+    const uint8_t write_single[7] = { 0x06, 0x00, 10, 0x12, 0x34, 0x56, 0x78 };
+    CHECK(WVT_W7_Parse(const_cast<uint8_t *>(write_single), sizeof(write_single), buffer) == 7);
+    CHECK(WVT_W7_Parse(digest, sizeof(digest), buffer) == (4 + 4));
+    CHECK(Hash_At(buffer + 4) != server_tree[1]);
+
+    WVT_W7_Digest_Build(fake_rom.data(), server_tree);
+    CHECK(fake_rom[10] == 0x12345678);
+    CHECK(WVT_W7_Parse(digest, sizeof(digest), buffer) == (4 + 4));
+    CHECK(Hash_At(buffer + 4) == server_tree[1]);
+
+    // Запись в обход протокола
+    const int32_t old_value = fake_rom[200];
+    fake_rom[200] = 42;
+    WVT_W7_Digest_Update(200, old_value, 42);
+    WVT_W7_Digest_Build(fake_rom.data(), server_tree);
+    CHECK(WVT_W7_Parse(digest, sizeof(digest), buffer) == (4 + 4));
+    CHECK(Hash_At(buffer + 4) == server_tree[1]);
+
+    // Узлы вне дерева
+    digest[1] = 1;
+    digest[2] = 1;
+    digest[3] = 2;
+    CHECK(WVT_W7_Parse(digest, sizeof(digest), buffer) == 2);
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+    CHECK(WVT_W7_Parse(digest, 3, buffer) == 2);
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+}
+
+/**
+ * Сервер находит расхождение конфигурации, спускаясь только 
+ * по несовпавшим узлам дерева
+ */
+TEST_CASE("Digest drill down", "[digest]")
+{
+    auto drifted = GENERATE(0, 77, WVT_W7_DIGEST_PARAMETERS - 1);
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint32_t server_tree[WVT_W7_DIGEST_NODES];
+    uint32_t frames = 0;
+
+    Register_Digest_Rom();
+    WVT_W7_Digest_Build(fake_rom.data(), server_tree);
+    fake_rom[static_cast<size_t>(drifted)] += 1;
+    REQUIRE(WVT_W7_Digest_Init() == WVT_W7_OK);
+
+    std::vector<uint16_t> suspects = { 1 };
+    uint8_t level = 0;
+    while ((1U << level) < WVT_W7_DIGEST_LEAVES)
+    {
+        std::vector<uint16_t> next;
+
+        // Потомки всех подозрительных узлов запрашиваются одним пакетом на узел
+        level = static_cast<uint8_t>(level + 1);
+        for (uint16_t node : suspects)
+        {
+            const uint16_t first_child = static_cast<uint16_t>(2 * node);
+            uint8_t request[] = { 0x2C, level, static_cast<uint8_t>(first_child - (1U << level)), 2 };
+
+            REQUIRE(WVT_W7_Parse(request, sizeof(request), buffer) == (4 + 8));
+            frames++;
+            for (uint16_t i = 0; i < 2; i++)
+            {
+                if (Hash_At(buffer + 4 + (4 * i)) != server_tree[first_child + i])
+                {
+                    next.push_back(static_cast<uint16_t>(first_child + i));
+                }
+            }
+        }
+        suspects = next;
+    }
+
+    REQUIRE(suspects.size() == 1);
+    const uint32_t leaf = suspects[0] - WVT_W7_DIGEST_LEAVES;
+    CHECK(leaf == (static_cast<uint32_t>(drifted) / WVT_W7_DIGEST_BLOCK));
+    CHECK(frames < 10);
+}
@@ -0,0 +1,108 @@
+﻿#include <string.h>
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+std::vector<int32_t> fake_rom;
+uint32_t fake_rom_busy_address = UINT32_MAX;
+
+WVT_W7_Error_t Fake_Rom_Read(uint16_t address, int32_t * value)
+{
+    if (address >= fake_rom.size())
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+    if (address == fake_rom_busy_address)
+    {
+        return WVT_W7_ERROR_CODE_BUSY;
+    }
+
+    *value = fake_rom[address];
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+WVT_W7_Error_t Fake_Rom_Write(uint16_t address, int32_t value)
+{
+    if (address >= fake_rom.size())
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+
+    fake_rom[address] = value;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+void Register_Fake_Rom(size_t size)
+{
+    WVT_W7_Callbacks_t callbacks = {};
+
+    callbacks.rom_read = Fake_Rom_Read;
+    callbacks.rom_write = Fake_Rom_Write;
+    REQUIRE(WVT_W7_Register_Callbacks(callbacks) == WVT_W7_OK);
+
+    fake_rom.assign(size, 0);
+    fake_rom_busy_address = UINT32_MAX;
+}
+
+std::vector<uint8_t> fake_flash[5];
+uint32_t fake_flash_reads[5];
+uint32_t fake_flash_erases[5];
+uint32_t fake_committed_image = 0;
+
+static WVT_W7_Error_t Fake_Flash_Read(WVT_W7_Firmware_Region_t region, uint32_t offset, uint8_t * data, uint16_t length)
+{
+    const std::vector<uint8_t> & flash = fake_flash[region];
+
+    if ((offset + length) > flash.size())
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+
+    fake_flash_reads[region] += length;
+    memcpy(data, flash.data() + offset, length);
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t Fake_Flash_Write(WVT_W7_Firmware_Region_t region, uint32_t offset, const uint8_t * data, uint16_t length)
+{
+    std::vector<uint8_t> & flash = fake_flash[region];
+
+    if ((offset + length) > flash.size())
+    {
+        return WVT_W7_ERROR_CODE_INVALID_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        REQUIRE(flash[offset + i] == 0xFF);
+        flash[offset + i] = data[i];
+    }
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t Fake_Flash_Erase(WVT_W7_Firmware_Region_t region, uint32_t size)
+{
+    fake_flash[region].assign(size, 0xFF);
+    fake_flash_erases[region]++;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+static WVT_W7_Error_t Fake_Flash_Commit(uint32_t image, uint32_t size)
+{
+    (void)size;
+    fake_committed_image = image;
+    return WVT_W7_ERROR_CODE_OK;
+}
+
+const WVT_W7_Firmware_Storage_t fake_firmware_storage = { 
+    Fake_Flash_Read, Fake_Flash_Write, Fake_Flash_Erase, Fake_Flash_Commit };
+
+void Clear_Fake_Flash(void)
+{
+    for (size_t region = 0; region < 5; region++)
+    {
+        fake_flash[region].clear();
+        fake_flash_reads[region] = 0;
+        fake_flash_erases[region] = 0;
+    }
+    fake_committed_image = 0;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+#ifndef _UT_WATER7_FAKES_HPP
+#define _UT_WATER7_FAKES_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "../lib/WVT_Water7.h"
+#include "../lib/WVT_Water7_Firmware.h"
+
+/**
+ * Память параметров: по значению на адрес, адреса за концом fake_rom 
+ * отвечают WVT_W7_ERROR_CODE_INVALID_ADDRESS. Чтение fake_rom_busy_address 
+ * отвечает WVT_W7_ERROR_CODE_BUSY
+ */
+extern std::vector<int32_t> fake_rom;
+extern uint32_t fake_rom_busy_address;
+
+WVT_W7_Error_t Fake_Rom_Read(uint16_t address, int32_t * value);
+WVT_W7_Error_t Fake_Rom_Write(uint16_t address, int32_t value);
+
+/**
+ * @brief	Регистрирует память параметров из size нулевых значений
+ */
+void Register_Fake_Rom(size_t size);
+
+/**
+ * Флеш-память обновления прошивки: по массиву на область. Стирание заполняет 
+ * область байтами 0xFF, запись допускается только в стертые байты
+ */
+extern std::vector<uint8_t> fake_flash[5];
+extern uint32_t fake_flash_reads[5];     /*!< Число прочитанных байт области */
+extern uint32_t fake_flash_erases[5];
+extern uint32_t fake_committed_image;
+extern const WVT_W7_Firmware_Storage_t fake_firmware_storage;
+
+/**
+ * @brief	Стирает все области и сбрасывает счетчики: устройство без сохраненного приема
+ */
+void Clear_Fake_Flash(void);
+
+#endif //_UT_WATER7_FAKES_HPP
@@ -0,0 +1,867 @@
+﻿#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "../lib/WVT_Water7_Firmware.h"
+#include "../lib/WVT_Water7_Patch.h"
+#include "../host/WVT_Water7_Diff.hpp"
+#include "../host/WVT_Water7_Compressor.hpp"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+/** Области флеш-памяти и счетчики обращений к ним */
+static std::vector<uint8_t> & target_flash = fake_flash[WVT_W7_FIRMWARE_REGION_TARGET];
+static std::vector<uint8_t> & state_flash = fake_flash[WVT_W7_FIRMWARE_REGION_STATE];
+static std::vector<uint8_t> & state_b_flash = fake_flash[WVT_W7_FIRMWARE_REGION_STATE_B];
+static std::vector<uint8_t> & active_flash = fake_flash[WVT_W7_FIRMWARE_REGION_ACTIVE];
+static uint32_t & target_reads = fake_flash_reads[WVT_W7_FIRMWARE_REGION_TARGET];
+static uint32_t & active_reads = fake_flash_reads[WVT_W7_FIRMWARE_REGION_ACTIVE];
+static uint32_t & target_erases = fake_flash_erases[WVT_W7_FIRMWARE_REGION_TARGET];
+
+static std::vector<uint8_t> Make_Image(size_t size)
+{
+    std::vector<uint8_t> image(size);
+    uint32_t state = 1;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        state = state * 1103515245U + 12345U;
+        image[i] = static_cast<uint8_t>(state >> 16);
+    }
+    return image;
+}
+
+static std::vector<uint8_t> Begin_Request(uint32_t image_id, const std::vector<uint8_t> & image, uint8_t chunk_size, uint32_t crc,
+    uint8_t flags = 0)
+{
+    const uint32_t size = static_cast<uint32_t>(image.size());
+    std::vector<uint8_t> request = { 0x29, 0x01,
+        static_cast<uint8_t>(image_id >> 24), static_cast<uint8_t>(image_id >> 16), 
+        static_cast<uint8_t>(image_id >> 8), static_cast<uint8_t>(image_id),
+        static_cast<uint8_t>(size >> 24), static_cast<uint8_t>(size >> 16), 
+        static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size),
+        chunk_size,
+        static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16), 
+        static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) };
+
+    if (flags != 0)
+    {
+        request.push_back(flags);
+    }
+    return request;
+}
+
+static std::vector<uint8_t> Chunk_Request(const std::vector<uint8_t> & image, uint8_t chunk_size, uint16_t chunk)
+{
+    const size_t offset = static_cast<size_t>(chunk) * chunk_size;
+    const size_t length = ((image.size() - offset) < chunk_size) ? (image.size() - offset) : chunk_size;
+    std::vector<uint8_t> request = { 0x29, 0x02, static_cast<uint8_t>(chunk >> 8), static_cast<uint8_t>(chunk) };
+
+    request.insert(request.end(), image.begin() + static_cast<std::ptrdiff_t>(offset), 
+        image.begin() + static_cast<std::ptrdiff_t>(offset + length));
+    return request;
+}
+
+typedef struct
+{
+    uint32_t downlink_bytes;
+    uint32_t uplink_bytes;
+    uint32_t rounds;
+} Airtime_t;
+
+/**
+ * Передает образ или патч по каналу, теряющему пакеты в обе стороны с вероятностью loss.
+ * Сервер отправляет все части, затем запрашивает состояние и повторяет только пропуски.
+ * При сжатии пропуски каждый раз группируются в пакеты заново
+ */
+static Airtime_t Transfer(const std::vector<uint8_t> & image, uint8_t chunk_size, double loss, uint32_t seed,
+    const std::vector<uint8_t> * patch = nullptr, bool compressed = false)
+{
+    std::mt19937 generator(seed);
+    std::bernoulli_distribution lost(loss);
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint16_t missing[WVT_W7_FIRMWARE_MAX_CHUNKS];
+    Airtime_t airtime = { 0, 0, 0 };
+    const uint32_t crc = WVT_W7_Crc32(0, image.data(), static_cast<uint32_t>(image.size()));
+    const std::vector<uint8_t> & payload = (patch != nullptr) ? *patch : image;
+    const uint8_t flags = static_cast<uint8_t>(((patch != nullptr) ? WVT_W7_FIRMWARE_FLAG_PATCH : 0) 
+        | (compressed ? WVT_W7_FIRMWARE_FLAG_COMPRESSED : 0));
+    const uint16_t chunks = static_cast<uint16_t>((payload.size() + chunk_size - 1) / chunk_size);
+
+    std::vector<uint16_t> to_send;
+    for (uint16_t chunk = 0; chunk < chunks; chunk++)
+    {
+        to_send.push_back(chunk);
+    }
+
+    std::vector<uint8_t> request = Begin_Request(0x1234, payload, chunk_size, crc, flags);
+    REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+
+    while (true)
+    {
+        airtime.rounds++;
+        REQUIRE(airtime.rounds < 1000);
+
+        std::vector<std::vector<uint8_t>> frames;
+        if (compressed)
+        {
+            for (const water7::Compressed_Frame & frame : water7::compress_chunks(payload, chunk_size, to_send))
+            {
+                frames.push_back({ 0x29, 0x02, static_cast<uint8_t>(frame.chunk >> 8), static_cast<uint8_t>(frame.chunk) });
+                frames.back().insert(frames.back().end(), frame.data.begin(), frame.data.end());
+            }
+        }
+        else
+        {
+            for (uint16_t chunk : to_send)
+            {
+                frames.push_back(Chunk_Request(payload, chunk_size, chunk));
+            }
+        }
+
+        for (std::vector<uint8_t> & frame : frames)
+        {
+            airtime.downlink_bytes += static_cast<uint32_t>(frame.size());
+            if (lost(generator) == false)
+            {
+                REQUIRE(WVT_W7_Parse(frame.data(), static_cast<uint16_t>(frame.size()), buffer) == 0);
+            }
+        }
+
+        // Запрос состояния повторяется, пока ответ не дойдет
+        uint8_t commit[] = { 0x29, 0x04 };
+        uint8_t length = 0;
+        do
+        {
+            airtime.downlink_bytes += sizeof(commit);
+            if (lost(generator))
+            {
+                continue;
+            }
+            length = WVT_W7_Parse(commit, sizeof(commit), buffer);
+            airtime.uplink_bytes += length;
+            if (lost(generator))
+            {
+                length = 0;
+            }
+        } while (length == 0);
+
+        REQUIRE(buffer[0] == 0x29);
+        if (buffer[2] == WVT_W7_FIRMWARE_VERIFIED)
+        {
+            return airtime;
+        }
+
+        uint16_t count = WVT_W7_FIRMWARE_MAX_CHUNKS;
+        REQUIRE(buffer[2] == WVT_W7_FIRMWARE_RECEIVING);
+        REQUIRE(WVT_W7_Firmware_Missing(buffer, length, missing, &count) == WVT_W7_OK);
+        REQUIRE(count > 0);
+        to_send.assign(missing, missing + count);
+    }
+}
+
+/**
+ * Сборка прошивки для проверки патчей: функции из 16-битных инструкций,
+ * 32-битных вызовов с относительным смещением и пула литералов с абсолютными 
+ * адресами вызываемых функций и константами, как в коде Thumb-2
+ */
+typedef struct
+{
+    std::vector<uint16_t> code;
+    std::vector<uint32_t> calls;
+    std::vector<uint32_t> constants;
+} Function_t;
+
+static uint16_t Make_Instruction(std::mt19937 & generator)
+{
+    // Немногие коды операций и регистры встречаются чаще остальных
+    const uint32_t opcode = static_cast<uint32_t>((generator() % 4) ? (generator() % 24) : (generator() % 256));
+    const uint32_t operands = static_cast<uint32_t>((generator() % 4) ? (generator() % 16) : (generator() % 256));
+    return static_cast<uint16_t>((opcode << 8) | operands);
+}
+
+static std::vector<Function_t> Make_Program(uint32_t functions, uint32_t seed)
+{
+    // Компилятор повторяет одни и те же последовательности инструкций во всей программе
+    std::mt19937 idioms_generator(0xC0DE);
+    std::vector<std::vector<uint16_t>> idioms(48);
+    for (std::vector<uint16_t> & idiom : idioms)
+    {
+        for (uint32_t i = 1 + static_cast<uint32_t>(idioms_generator() % 6); i > 0; i--)
+        {
+            idiom.push_back(Make_Instruction(idioms_generator));
+        }
+    }
+
+    std::mt19937 generator(seed);
+    const auto next = [&generator]() { return static_cast<uint32_t>(generator()); };
+    std::vector<Function_t> program(functions);
+
+    for (Function_t & function : program)
+    {
+        const uint32_t length = 20 + next() % 180;
+        function.code.push_back(0xB5F0);
+        while (function.code.size() < length)
+        {
+            if (next() % 4)
+            {
+                const std::vector<uint16_t> & idiom = idioms[next() % idioms.size()];
+                function.code.insert(function.code.end(), idiom.begin(), idiom.end());
+            }
+            else
+            {
+                function.code.push_back(Make_Instruction(generator));
+            }
+        }
+        function.code.push_back(0xBDF0);
+        for (uint32_t i = next() % 6; i > 0; i--)
+        {
+            function.calls.push_back(next() % functions);
+        }
+        for (uint32_t i = 1 + next() % 3; i > 0; i--)
+        {
+            function.constants.push_back(next());
+        }
+    }
+    return program;
+}
+
+static std::vector<uint8_t> Link(const std::vector<Function_t> & program)
+{
+    const uint32_t base = 0x08000000;
+    std::vector<uint32_t> addresses;
+    std::vector<uint8_t> image;
+    uint32_t address = 0;
+
+    for (const Function_t & function : program)
+    {
+        addresses.push_back(address);
+        address += static_cast<uint32_t>((function.code.size() * 2) + (function.calls.size() * 8) + (function.constants.size() * 4));
+    }
+
+    const auto put = [&image](uint32_t value, uint8_t width)
+    {
+        for (uint8_t i = 0; i < width; i++)
+        {
+            image.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    };
+
+    for (const Function_t & function : program)
+    {
+        for (uint16_t instruction : function.code)
+        {
+            put(instruction, 2);
+        }
+        for (uint32_t callee : function.calls)
+        {
+            put(0xF000D000U | ((addresses[callee] - static_cast<uint32_t>(image.size())) >> 1 & 0x07FF), 4);
+        }
+        for (uint32_t callee : function.calls)
+        {
+            put(base + addresses[callee] + 1, 4);
+        }
+        for (uint32_t constant : function.constants)
+        {
+            put(constant, 4);
+        }
+    }
+    return image;
+}
+
+TEST_CASE("Firmware update", "[firmware]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    const std::vector<uint8_t> image = Make_Image(10000);
+    const uint32_t crc = WVT_W7_Crc32(0, image.data(), static_cast<uint32_t>(image.size()));
+
+    fake_committed_image = 0;
+    target_flash.clear();
+    state_flash.clear();
+    state_b_flash.clear();
+    REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    CHECK(WVT_W7_Firmware_Resume(buffer) == 0);
+
+    SECTION("Verification while receiving")
+    {
+        std::vector<uint8_t> request = Begin_Request(16, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+
+        // Каждая часть читается для проверки один раз, когда начало образа принято без пропусков,
+        // и еще раз перед записью, чтобы убедиться, что память стерта (WVT_W7_Firmware_Written)
+        target_reads = 0;
+        for (uint16_t chunk = 100; chunk > 0; chunk--)
+        {
+            request = Chunk_Request(image, 100, static_cast<uint16_t>(chunk - 1));
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+        CHECK(target_reads == image.size() * 2);
+
+        // Проверка после последней части не читает образ
+        target_reads = 0;
+        uint8_t commit[] = { 0x29, 0x04 };
+        REQUIRE(WVT_W7_Parse(commit, sizeof(commit), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_VERIFIED);
+        CHECK(target_reads == 0);
+    }
+
+    SECTION("Lossy link")
+    {
+        const Airtime_t airtime = Transfer(image, 100, 0.2, 1);
+        CHECK(target_flash == image);
+        CHECK(fake_committed_image == 0x1234);
+        CHECK(airtime.rounds > 1);
+        // Повторяются только пропуски: объем ненамного больше образа с учетом потерь
+        CHECK(airtime.downlink_bytes < image.size() * 2);
+    }
+
+    SECTION("Missing chunk ranges")
+    {
+        std::vector<uint8_t> request = Begin_Request(7, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET + 2);
+        // Весь образ пропущен: один диапазон с 0 длиной 100
+        const uint8_t all_missing[] = { 0x29, 0x03, 0x01, 0x00, 0x00, 0x00, 0x07, 0x00, 100, 0x00, 100, 0x00, 99 };
+        CHECK(memcmp(buffer, all_missing, sizeof(all_missing)) == 0);
+
+        for (uint16_t chunk = 0; chunk < 100; chunk++)
+        {
+            if ((chunk != 3) && ((chunk < 50) || (chunk > 59)))
+            {
+                request = Chunk_Request(image, 100, chunk);
+                REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+            }
+        }
+        // Повторная часть игнорируется
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+
+        uint8_t status[] = { 0x29, 0x03 };
+        const uint8_t length = WVT_W7_Parse(status, sizeof(status), buffer);
+        const uint8_t ranges[] = { 0x29, 0x03, 0x01, 0x00, 0x00, 0x00, 0x07, 0x00, 100, 0x00, 11, 
+        //  3, длина 1 | 50, длина 10
+            3, 0,        46, 9 };
+        REQUIRE(length == sizeof(ranges));
+        CHECK(memcmp(buffer, ranges, sizeof(ranges)) == 0);
+
+        uint16_t missing[16];
+        uint16_t count = 16;
+        REQUIRE(WVT_W7_Firmware_Missing(buffer, length, missing, &count) == WVT_W7_OK);
+        CHECK(count == 11);
+        CHECK(missing[0] == 3);
+        CHECK(missing[1] == 50);
+        CHECK(missing[10] == 59);
+        count = 10;
+        CHECK(WVT_W7_Firmware_Missing(buffer, length, missing, &count) == WVT_W7_ERROR);
+
+        // Повторное начало того же образа сохраняет принятые части
+        request = Begin_Request(7, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == sizeof(ranges));
+        CHECK(buffer[10] == 11);
+    }
+
+    SECTION("Resume after reset")
+    {
+        std::vector<uint8_t> request = Begin_Request(10, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+
+        fake_flash_erases[WVT_W7_FIRMWARE_REGION_STATE] = 0;
+        fake_flash_erases[WVT_W7_FIRMWARE_REGION_STATE_B] = 0;
+        for (uint16_t chunk = 0; chunk < 40; chunk++)
+        {
+            request = Chunk_Request(image, 100, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+        CHECK((fake_flash_erases[WVT_W7_FIRMWARE_REGION_STATE] + fake_flash_erases[WVT_W7_FIRMWARE_REGION_STATE_B]) 
+            == 40 / WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL);
+
+        // Перезагрузка: части после последнего сохранения считаются пропущенными
+        const uint16_t saved = (40 / WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL) * WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL;
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        const uint8_t length = WVT_W7_Firmware_Resume(buffer);
+        REQUIRE(length > 0);
+        CHECK(buffer[0] == 0x29);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_RECEIVING);
+        CHECK(buffer[6] == 10);
+        CHECK(buffer[10] == 100 - saved);
+
+        uint16_t missing[100];
+        uint16_t count = 100;
+        REQUIRE(WVT_W7_Firmware_Missing(buffer, length, missing, &count) == WVT_W7_OK);
+        REQUIRE(count == 100 - saved);
+        CHECK(missing[0] == saved);
+
+        // Уже записанные части принимаются повторно без записи во флеш-память
+        for (uint16_t i = 0; i < count; i++)
+        {
+            request = Chunk_Request(image, 100, missing[i]);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+
+        uint8_t commit[] = { 0x29, 0x04 };
+        REQUIRE(WVT_W7_Parse(commit, sizeof(commit), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_VERIFIED);
+        CHECK(fake_committed_image == 10);
+
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        REQUIRE(WVT_W7_Firmware_Resume(buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_VERIFIED);
+    }
+
+    SECTION("Damaged checkpoint is ignored")
+    {
+        std::vector<uint8_t> request = Begin_Request(11, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        REQUIRE(state_flash.size() == WVT_W7_FIRMWARE_CHECKPOINT_SIZE);
+
+        state_flash[WVT_W7_FIRMWARE_CHECKPOINT_HEADER + 3] ^= 0x10;
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        CHECK(WVT_W7_Firmware_Resume(buffer) == 0);
+    }
+
+    SECTION("Interrupted checkpoint")
+    {
+        std::vector<uint8_t> request = Begin_Request(12, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        for (uint16_t chunk = 0; chunk < 2 * WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL; chunk++)
+        {
+            request = Chunk_Request(image, 100, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+
+        // Записи чередуются: BEGIN в первой области, затем во второй и снова в первой.
+        // Питание пропало при стирании первой области - восстанавливается вторая
+        REQUIRE(state_b_flash.size() == WVT_W7_FIRMWARE_CHECKPOINT_SIZE);
+        state_flash.assign(WVT_W7_FIRMWARE_CHECKPOINT_SIZE, 0xFF);
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        uint8_t length = WVT_W7_Firmware_Resume(buffer);
+        REQUIRE(length > 0);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_RECEIVING);
+        CHECK(buffer[10] == 100 - WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL);
+
+        // Следующая запись не затирает единственную целую
+        const std::vector<uint8_t> previous = state_b_flash;
+        for (uint16_t chunk = WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL; chunk < 2 * WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL; chunk++)
+        {
+            request = Chunk_Request(image, 100, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+        CHECK(state_b_flash == previous);
+
+        // Поврежденная более новая запись тоже пропускается
+        state_flash[WVT_W7_FIRMWARE_CHECKPOINT_HEADER + 1] ^= 0x01;
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        length = WVT_W7_Firmware_Resume(buffer);
+        REQUIRE(length > 0);
+        CHECK(buffer[10] == 100 - WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL);
+    }
+
+    SECTION("Interrupted chunk write")
+    {
+        std::vector<uint8_t> request = Begin_Request(13, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        for (uint16_t chunk = 0; chunk < 40; chunk++)
+        {
+            request = Chunk_Request(image, 100, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+        const uint16_t saved = (40 / WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL) * WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL;
+
+        // Запись следующей части прервана на середине: она дописывается при повторе
+        std::fill(target_flash.begin() + (saved + 1) * 100 + 50, target_flash.begin() + (saved + 2) * 100, 0xFF);
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        for (uint16_t chunk = saved; chunk < 40; chunk++)
+        {
+            request = Chunk_Request(image, 100, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+        CHECK(std::equal(image.begin(), image.begin() + 4000, target_flash.begin()));
+
+        // Байт, записанный не полностью, дописать нельзя: прием сразу завершается ошибкой
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        target_flash[(saved + 2) * 100 + 10] ^= 0x01;
+        REQUIRE(target_flash[(saved + 2) * 100 + 10] != 0xFF);
+        request = Chunk_Request(image, 100, saved);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        request = Chunk_Request(image, 100, static_cast<uint16_t>(saved + 2));
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_FAILED);
+
+        Transfer(image, 100, 0.0, 1);
+        CHECK(target_flash == image);
+        CHECK(fake_committed_image == 0x1234);
+    }
+
+    SECTION("Corrupted image")
+    {
+        std::vector<uint8_t> request = Begin_Request(8, image, 100, crc ^ 1);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        for (uint16_t chunk = 0; chunk < 100; chunk++)
+        {
+            request = Chunk_Request(image, 100, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+
+        uint8_t commit[] = { 0x29, 0x04 };
+        REQUIRE(WVT_W7_Parse(commit, sizeof(commit), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_FAILED);
+        CHECK(fake_committed_image == 0);
+
+        // После ошибки образ передается заново
+        request = Chunk_Request(image, 100, 0);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        request = Begin_Request(8, image, 100, crc ^ 1);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_RECEIVING);
+        CHECK(buffer[10] == 100);
+    }
+
+    SECTION("Malformed requests")
+    {
+        const std::vector<uint8_t> huge(WVT_W7_FIRMWARE_MAX_CHUNKS * 10 + 1);
+        std::vector<uint8_t> request = Begin_Request(9, huge, 10, 0);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        request = Begin_Request(9, image, 100, crc);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        request = Chunk_Request(image, 100, 5);
+        request.pop_back();
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+
+        request = Chunk_Request(image, 100, 5);
+        request[3] = 100;
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        uint8_t unknown[] = { 0x29, 0x7F };
+        REQUIRE(WVT_W7_Parse(unknown, sizeof(unknown), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_TYPE);
+    }
+
+    // Обработка возвращается в rfl_handler
+    REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+    CHECK(WVT_W7_Firmware_Ready() == 0);
+}
+
+TEST_CASE("Firmware compression", "[firmware]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    const std::vector<uint8_t> image = Link(Make_Program(60, 4));
+    const uint32_t crc = WVT_W7_Crc32(0, image.data(), static_cast<uint32_t>(image.size()));
+    const uint8_t chunk_size = water7::compressed_chunk_size(image.size());
+
+    fake_committed_image = 0;
+    target_flash.clear();
+    state_flash.clear();
+    REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    REQUIRE(chunk_size == 20);
+
+    SECTION("Lossy link")
+    {
+        const Airtime_t airtime = Transfer(image, chunk_size, 0.2, 2, nullptr, true);
+        CHECK(target_flash == image);
+        CHECK(fake_committed_image == 0x1234);
+        CHECK(airtime.downlink_bytes < image.size() * 2);
+    }
+
+    SECTION("Damaged frames")
+    {
+        std::vector<uint8_t> request = Begin_Request(15, image, chunk_size, crc, WVT_W7_FIRMWARE_FLAG_COMPRESSED);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+
+        // Распакованные данные не кратны размеру части
+        std::vector<uint8_t> block = water7::lz_compress(image.data(), 25);
+        request = { 0x29, 0x02, 0x00, 0x00, 0x00 };
+        request.insert(request.end(), block.begin(), block.end());
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+
+        // Повтор ссылается за начало словаря
+        request = { 0x29, 0x02, 0x00, 0x00, 0x00, 0x10, 0xAA, 0x05 };
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        // Словарь длиннее принятого начала образа
+        request = { 0x29, 0x02, 0x00, 0x01, static_cast<uint8_t>(chunk_size + 1), 0x10, 0xAA };
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        // Части словаря еще не приняты: пакет пропускается без ответа
+        const std::vector<uint16_t> tail = { 2, 3 };
+        std::vector<water7::Compressed_Frame> frames = water7::compress_chunks(image, chunk_size, tail);
+        REQUIRE(frames.size() == 1);
+        REQUIRE(frames[0].data[0] > 0);
+        request = { 0x29, 0x02, 0x00, 0x02 };
+        request.insert(request.end(), frames[0].data.begin(), frames[0].data.end());
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+
+        // Несжатая часть, затем две части со словарем из нее
+        request = Chunk_Request(image, chunk_size, 1);
+        request.insert(request.begin() + WVT_W7_FIRMWARE_CHUNK_DATA_OFFSET, WVT_W7_FIRMWARE_FRAME_STORED);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        frames = water7::compress_chunks(image, chunk_size, tail, 4, chunk_size);
+        REQUIRE(frames.size() == 1);
+        request = { 0x29, 0x02, 0x00, 0x02 };
+        request.insert(request.end(), frames[0].data.begin(), frames[0].data.end());
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+
+        uint8_t status[] = { 0x29, 0x03 };
+        const uint8_t length = WVT_W7_Parse(status, sizeof(status), buffer);
+        std::vector<uint16_t> missing(WVT_W7_FIRMWARE_MAX_CHUNKS);
+        uint16_t count = WVT_W7_FIRMWARE_MAX_CHUNKS;
+        REQUIRE(WVT_W7_Firmware_Missing(buffer, length, missing.data(), &count) == WVT_W7_OK);
+        CHECK(count == (image.size() + chunk_size - 1) / chunk_size - 3);
+        CHECK(missing[0] == 0);
+        CHECK(missing[1] == 4);
+        CHECK(std::equal(image.begin() + chunk_size, image.begin() + 4 * chunk_size, target_flash.begin() + chunk_size));
+    }
+
+    REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+}
+
+TEST_CASE("Firmware patch", "[firmware]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    std::vector<Function_t> program = Make_Program(100, 3);
+    const std::vector<uint8_t> old_image = Link(program);
+    program[40].code.insert(program[40].code.begin() + 10, 7, 0x4770);
+    program[70].constants.push_back(0xDEADBEEF);
+    const std::vector<uint8_t> new_image = Link(program);
+    const std::vector<uint8_t> patch = water7::make_patch(old_image, new_image);
+    const uint32_t crc = WVT_W7_Crc32(0, new_image.data(), static_cast<uint32_t>(new_image.size()));
+
+    fake_committed_image = 0;
+    target_flash.clear();
+    state_flash.clear();
+    active_flash = old_image;
+    REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    CHECK(patch.size() < new_image.size() / 4);
+
+    SECTION("Lossy link")
+    {
+        // Части приходят не по порядку: патч применяется по мере заполнения пропусков
+        Transfer(new_image, 100, 0.2, 5, &patch);
+        CHECK(target_flash == new_image);
+        CHECK(fake_committed_image == 0x1234);
+    }
+
+    SECTION("Compressed patch")
+    {
+        Transfer(new_image, water7::compressed_chunk_size(patch.size()), 0.2, 6, &patch, true);
+        CHECK(target_flash == new_image);
+        CHECK(fake_committed_image == 0x1234);
+    }
+
+    SECTION("Identical image")
+    {
+        const std::vector<uint8_t> same = water7::make_patch(old_image, old_image);
+        CHECK(same.size() < WVT_W7_PATCH_HEADER_SIZE + 8);
+        Transfer(old_image, 100, 0.0, 5, &same);
+        CHECK(target_flash == old_image);
+    }
+
+    SECTION("Resume after reset")
+    {
+        const uint16_t chunks = static_cast<uint16_t>((patch.size() + 39) / 40);
+        std::vector<uint8_t> request = Begin_Request(12, patch, 40, crc, WVT_W7_FIRMWARE_FLAG_PATCH);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        REQUIRE(chunks > WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL + 4);
+        for (uint16_t chunk = 0; chunk < chunks; chunk++)
+        {
+            // Патч применяется и после последнего сохранения состояния
+            if (chunk <= WVT_W7_FIRMWARE_CHECKPOINT_INTERVAL + 2)
+            {
+                request = Chunk_Request(patch, 40, chunk);
+                REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+            }
+        }
+        const std::vector<uint8_t> written = target_flash;
+
+        // Патч применяется дальше с сохраненного положения: исходный образ не проверяется заново,
+        // новый не стирается, а записанное после сохранения не записывается второй раз
+        active_reads = 0;
+        target_erases = 0;
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+        REQUIRE(WVT_W7_Firmware_Resume(buffer) > 0);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_RECEIVING);
+        CHECK(target_flash == written);
+        CHECK(active_reads == 0);
+        for (uint16_t chunk = 0; chunk < chunks; chunk++)
+        {
+            request = Chunk_Request(patch, 40, chunk);
+            REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 0);
+        }
+
+        uint8_t commit[] = { 0x29, 0x04 };
+        REQUIRE(WVT_W7_Parse(commit, sizeof(commit), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_VERIFIED);
+        CHECK(target_flash == new_image);
+        CHECK(target_erases == 0);
+    }
+
+    SECTION("Patch for another image")
+    {
+        active_flash[100] ^= 1;
+        std::vector<uint8_t> request = Begin_Request(13, patch, 100, crc, WVT_W7_FIRMWARE_FLAG_PATCH);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        request = Chunk_Request(patch, 100, 0);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        uint8_t status[] = { 0x29, 0x03 };
+        REQUIRE(WVT_W7_Parse(status, sizeof(status), buffer) == WVT_W7_FIRMWARE_STATUS_DATA_OFFSET);
+        CHECK(buffer[2] == WVT_W7_FIRMWARE_FAILED);
+    }
+
+    SECTION("Damaged patch")
+    {
+        std::vector<uint8_t> damaged = patch;
+        damaged[WVT_W7_PATCH_HEADER_SIZE] = 0x7F;
+        std::vector<uint8_t> request = Begin_Request(14, damaged, 100, crc, WVT_W7_FIRMWARE_FLAG_PATCH);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) > 0);
+        request = Chunk_Request(damaged, 100, 0);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        // Неизвестный флаг
+        request = Begin_Request(14, damaged, 100, crc, 0x80);
+        REQUIRE(WVT_W7_Parse(request.data(), static_cast<uint16_t>(request.size()), buffer) == 2);
+        CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+    }
+
+    REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+}
+
+TEST_CASE("Firmware update airtime", "[.benchmark]")
+{
+    const std::vector<uint8_t> image = Make_Image(64 * 1024);
+    const uint8_t chunk_size = 100;
+    const double chunks = ceil(static_cast<double>(image.size()) / chunk_size);
+    const double losses[] = { 0.0, 0.05, 0.1, 0.2, 0.3 };
+
+    REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    printf("firmware update, %u byte image, %u byte chunks\n", static_cast<unsigned>(image.size()), chunk_size);
+    for (double loss : losses)
+    {
+        const Airtime_t airtime = Transfer(image, chunk_size, loss, 7);
+        REQUIRE(target_flash == image);
+
+        // Без списка пропусков образ повторяется целиком, пока каждая часть 
+        // не дойдет с вероятностью 99.9%
+        const double passes = (loss > 0) ? ceil(log(1.0 - pow(0.999, 1.0 / chunks)) / log(loss)) : 1.0;
+        printf("loss %4.0f%%: %7u bytes down (%.2f images), %5u bytes up, %2u rounds; blind repeat %.0f images\n",
+            loss * 100, airtime.downlink_bytes, 
+            static_cast<double>(airtime.downlink_bytes) / static_cast<double>(image.size()),
+            airtime.uplink_bytes, airtime.rounds, passes);
+
+        // Без сохраненного состояния тот же образ принимается заново
+        state_flash.clear();
+        state_b_flash.clear();
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    }
+    REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+}
+
+TEST_CASE("Firmware patch size", "[.benchmark]")
+{
+    const std::vector<Function_t> release = Make_Program(400, 11);
+    const std::vector<uint8_t> old_image = Link(release);
+
+    std::vector<Function_t> constant = release;
+    constant[200].constants[0] ^= 0x00010000;
+
+    std::vector<Function_t> fix = release;
+    fix[150].code.insert(fix[150].code.begin() + 5, 12, 0xBF00);
+
+    std::vector<Function_t> feature = release;
+    const std::vector<Function_t> added = Make_Program(12, 12);
+    feature.insert(feature.begin() + 300, added.begin(), added.end());
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        feature[i * 50].calls.push_back(300 + i);
+    }
+
+    std::vector<Function_t> rebuild = Make_Program(400, 11);
+    for (uint32_t i = 0; i < rebuild.size(); i += 7)
+    {
+        rebuild[i] = Make_Program(1, i)[0];
+    }
+
+    const struct
+    {
+        const char * name;
+        const std::vector<Function_t> * program;
+    } builds[] = {
+        { "constant changed", &constant },
+        { "bug fix in one function", &fix },
+        { "new module, 5 call sites", &feature },
+        { "every 7th function rewritten", &rebuild },
+    };
+
+    active_flash = old_image;
+    REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    printf("firmware patch, %u byte image\n", static_cast<unsigned>(old_image.size()));
+    for (const auto & build : builds)
+    {
+        const std::vector<uint8_t> new_image = Link(*build.program);
+        const std::vector<uint8_t> patch = water7::make_patch(old_image, new_image);
+
+        Transfer(new_image, 100, 0.0, 1, &patch);
+        REQUIRE(target_flash == new_image);
+        printf("%-30s %6u byte image, %6u byte patch (%5.2f%%)\n", build.name,
+            static_cast<unsigned>(new_image.size()), static_cast<unsigned>(patch.size()),
+            100.0 * static_cast<double>(patch.size()) / static_cast<double>(new_image.size()));
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    }
+    REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+}
+
+TEST_CASE("Firmware compression ratio", "[.benchmark]")
+{
+    const std::vector<Function_t> release = Make_Program(400, 11);
+    const std::vector<uint8_t> image = Link(release);
+    std::vector<Function_t> fix = release;
+    fix[150].code.insert(fix[150].code.begin() + 5, 12, 0xBF00);
+    const std::vector<uint8_t> fixed_image = Link(fix);
+    const std::vector<uint8_t> patch = water7::make_patch(image, fixed_image);
+    const std::vector<uint8_t> random = Make_Image(image.size());
+    // Образ до 32 КБ делится на части по 16 байт, которые плотнее заполняют пакет
+    const std::vector<uint8_t> small_image = Link(Make_Program(130, 11));
+
+    const struct
+    {
+        const char * name;
+        const std::vector<uint8_t> * payload;
+    } payloads[] = {
+        { "firmware image", &image },
+        { "small image", &small_image },
+        { "random data", &random },
+        { "patch (bug fix)", &patch },
+    };
+
+    active_flash = image;
+    REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+    printf("firmware compression, %u byte chunks without compression\n", WVT_W7_FIRMWARE_MAX_CHUNK_SIZE);
+    for (const auto & entry : payloads)
+    {
+        const bool is_patch = (entry.payload == &patch);
+        const std::vector<uint8_t> & result = is_patch ? fixed_image : *entry.payload;
+        const Airtime_t plain = Transfer(result, WVT_W7_FIRMWARE_MAX_CHUNK_SIZE, 0.0, 1, is_patch ? &patch : nullptr);
+        REQUIRE(target_flash == result);
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+
+        const uint8_t chunk_size = water7::compressed_chunk_size(entry.payload->size());
+        const Airtime_t packed = Transfer(result, chunk_size, 0.0, 1, is_patch ? &patch : nullptr, true);
+        REQUIRE(target_flash == result);
+        REQUIRE(WVT_W7_Firmware_Init(&fake_firmware_storage) == WVT_W7_OK);
+
+        printf("%-16s %6u bytes: %6u bytes down plain, %6u compressed (%2u byte chunks), ratio %.2f\n", 
+            entry.name, static_cast<unsigned>(entry.payload->size()), plain.downlink_bytes, packed.downlink_bytes,
+            chunk_size, static_cast<double>(plain.downlink_bytes) / static_cast<double>(packed.downlink_bytes));
+    }
+    REQUIRE(WVT_W7_Firmware_Init(nullptr) == WVT_W7_OK);
+}
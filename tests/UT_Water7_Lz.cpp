@@ -0,0 +1,172 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "../lib/WVT_Water7_Lz.h"
+#include "../lib/WVT_Water7_Firmware.h"
+#include "../host/WVT_Water7_Compressor.hpp"
+#include "catch.hpp"
+
+static std::vector<uint8_t> Round_Trip(const std::vector<uint8_t> & data)
+{
+    const std::vector<uint8_t> packed = water7::lz_compress(data.data(), data.size());
+    std::vector<uint8_t> unpacked(data.size() + 1);
+    uint16_t length = 0;
+
+    REQUIRE(WVT_W7_Lz_Decompress(packed.data(), static_cast<uint16_t>(packed.size()), 
+        unpacked.data(), 0, static_cast<uint16_t>(unpacked.size()), &length) == WVT_W7_ERROR_CODE_OK);
+    unpacked.resize(length);
+    CHECK(unpacked == data);
+    return packed;
+}
+
+TEST_CASE("LZ block compression", "[lz]")
+{
+    uint8_t output[32];
+    uint16_t length = 0;
+
+    SECTION("Round trip")
+    {
+        CHECK(Round_Trip({}).size() == 1);
+        CHECK(Round_Trip({ 1, 2 }).size() == 3);
+        // Длинная серия - один повтор, перекрывающийся с собой
+        CHECK(Round_Trip(std::vector<uint8_t>(255, 0x5A)).size() == 4);
+
+        std::vector<uint8_t> text(200);
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            text[i] = static_cast<uint8_t>("abcabcabd"[i % 9] + ((i % 50) == 0));
+        }
+        CHECK(Round_Trip(text).size() < 40);
+
+        // Несжимаемые данные: литералы с байтами продолжения длины
+        std::vector<uint8_t> noise(255);
+        uint32_t state = 7;
+        for (uint8_t & byte : noise)
+        {
+            state = state * 1103515245U + 12345U;
+            byte = static_cast<uint8_t>(state >> 16);
+        }
+        CHECK(Round_Trip(noise).size() <= noise.size() + 2);
+    }
+
+    SECTION("Dictionary")
+    {
+        std::vector<uint8_t> data(200);
+        uint32_t state = 3;
+        for (uint8_t & byte : data)
+        {
+            state = state * 1103515245U + 12345U;
+            byte = static_cast<uint8_t>(state >> 16);
+        }
+        // Вторая половина повторяет первую: без словаря она не сжимается
+        std::copy(data.begin(), data.begin() + 100, data.begin() + 100);
+
+        const std::vector<uint8_t> alone = water7::lz_compress(data.data() + 100, 100);
+        const std::vector<uint8_t> packed = water7::lz_compress(data.data(), data.size(), 100);
+        CHECK(alone.size() > 100);
+        CHECK(packed.size() < 5);
+
+        std::vector<uint8_t> unpacked(data.begin(), data.begin() + 100);
+        unpacked.resize(200);
+        REQUIRE(WVT_W7_Lz_Decompress(packed.data(), static_cast<uint16_t>(packed.size()), 
+            unpacked.data(), 100, static_cast<uint16_t>(unpacked.size()), &length) == WVT_W7_ERROR_CODE_OK);
+        CHECK(length == 100);
+        CHECK(unpacked == data);
+
+        // Без словаря повтор ссылается за начало блока
+        CHECK(WVT_W7_Lz_Decompress(packed.data(), static_cast<uint16_t>(packed.size()), 
+            unpacked.data() + 100, 0, 100, &length) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+    }
+
+    SECTION("Malformed blocks")
+    {
+        // Литералов меньше, чем указано
+        const uint8_t short_literals[] = { 0x30, 1, 2 };
+        CHECK(WVT_W7_Lz_Decompress(short_literals, sizeof(short_literals), output, 0, sizeof(output), &length) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        // Обрыв в байтах продолжения
+        const uint8_t cut_length[] = { 0xF0, 0xFF };
+        CHECK(WVT_W7_Lz_Decompress(cut_length, sizeof(cut_length), output, 0, sizeof(output), &length) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        // Нулевое смещение
+        const uint8_t zero_offset[] = { 0x10, 1, 0 };
+        CHECK(WVT_W7_Lz_Decompress(zero_offset, sizeof(zero_offset), output, 0, sizeof(output), &length) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+        // Распакованные данные не помещаются в буфер
+        const uint8_t overflow[] = { 0x1F, 1, 1, 40 };
+        CHECK(WVT_W7_Lz_Decompress(overflow, sizeof(overflow), output, 0, sizeof(output), &length) == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+        const uint8_t fits[] = { 0x1F, 1, 1, 13 };
+        REQUIRE(WVT_W7_Lz_Decompress(fits, sizeof(fits), output, 0, sizeof(output), &length) == WVT_W7_ERROR_CODE_OK);
+        CHECK(length == 32);
+        CHECK(output[31] == 1);
+    }
+
+    SECTION("Frames fit the buffer")
+    {
+        std::vector<uint8_t> image(3000);
+        for (size_t i = 0; i < image.size(); i++)
+        {
+            image[i] = static_cast<uint8_t>(((i % 700) < 350) ? ((i * i) >> 5) : (i / 40));
+        }
+
+        const uint8_t chunk_size = water7::compressed_chunk_size(image.size());
+        std::vector<uint16_t> chunks;
+        for (uint16_t chunk = 0; (chunk * chunk_size) < image.size(); chunk++)
+        {
+            if ((chunk % 10) != 3)
+            {
+                chunks.push_back(chunk);
+            }
+        }
+
+        const std::vector<water7::Compressed_Frame> frames = water7::compress_chunks(image, chunk_size, chunks);
+        std::vector<uint8_t> block(WVT_W7_FIRMWARE_DICTIONARY_SIZE + WVT_W7_FIRMWARE_MAX_BLOCK_SIZE);
+        size_t covered = 0;
+        for (const water7::Compressed_Frame & frame : frames)
+        {
+            const size_t offset = static_cast<size_t>(frame.chunk) * chunk_size;
+            const size_t dictionary = frame.data[0];
+
+            CHECK(frame.data.size() <= WVT_W7_BUFFER_SIZE - 4);
+            if (dictionary == WVT_W7_FIRMWARE_FRAME_STORED)
+            {
+                length = static_cast<uint16_t>(frame.data.size() - 1);
+                CHECK(memcmp(frame.data.data() + 1, image.data() + offset, length) == 0);
+            }
+            else
+            {
+                REQUIRE(dictionary <= offset);
+                memcpy(block.data(), image.data() + offset - dictionary, dictionary);
+                REQUIRE(WVT_W7_Lz_Decompress(frame.data.data() + 1, static_cast<uint16_t>(frame.data.size() - 1), 
+                    block.data(), static_cast<uint16_t>(dictionary), static_cast<uint16_t>(block.size()), &length) == WVT_W7_ERROR_CODE_OK);
+                CHECK(memcmp(block.data() + dictionary, image.data() + offset, length) == 0);
+            }
+            covered += static_cast<size_t>((length + chunk_size - 1) / chunk_size);
+        }
+        // Пакеты не переходят через пропущенные части
+        CHECK(covered == chunks.size());
+        CHECK(frames.size() < chunks.size() / 2);
+    }
+
+    SECTION("Incompressible frames are stored")
+    {
+        std::vector<uint8_t> noise(1000);
+        uint32_t state = 11;
+        for (uint8_t & byte : noise)
+        {
+            state = state * 1103515245U + 12345U;
+            byte = static_cast<uint8_t>(state >> 16);
+        }
+
+        const uint8_t chunk_size = water7::compressed_chunk_size(noise.size());
+        std::vector<uint16_t> chunks;
+        for (uint16_t chunk = 0; (chunk * chunk_size) < noise.size(); chunk++)
+        {
+            chunks.push_back(chunk);
+        }
+        for (const water7::Compressed_Frame & frame : water7::compress_chunks(noise, chunk_size, chunks))
+        {
+            CHECK(frame.data[0] == WVT_W7_FIRMWARE_FRAME_STORED);
+            CHECK(frame.data.size() <= WVT_W7_FIRMWARE_MAX_CHUNK_SIZE);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+﻿#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "../lib/WVT_Water7_Series.h"
+#include "catch.hpp"
+
+typedef struct
+{
+    uint32_t timestamp;
+    int32_t value;
+} Sample_t;
+
+/**
+ * Передает отсчеты накопителю и разбирает все выданные сообщения.
+ * Возвращает суммарную длину сообщений
+ */
+static size_t Send_Series(const std::vector<Sample_t> & samples, std::vector<Sample_t> & received, uint32_t * frames)
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint32_t timestamps[1024];
+    int32_t values[1024];
+    size_t bytes = 0;
+
+    *frames = 0;
+    for (size_t i = 0; i <= samples.size(); i++)
+    {
+        const uint8_t length = (i < samples.size()) 
+            ? WVT_W7_Series_Add(samples[i].timestamp, samples[i].value, buffer)
+            : WVT_W7_Series_Flush(buffer);
+
+        if (length == 0)
+        {
+            continue;
+        }
+
+        uint16_t count = 1024;
+        REQUIRE(length <= WVT_W7_BUFFER_SIZE);
+        REQUIRE(WVT_W7_Series_Decode(buffer, length, timestamps, values, &count) == WVT_W7_OK);
+        for (uint16_t sample = 0; sample < count; sample++)
+        {
+            received.push_back({ timestamps[sample], values[sample] });
+        }
+        bytes += length;
+        (*frames)++;
+    }
+
+    return bytes;
+}
+
+/**
+ * Почасовые показания счетчика: значение растет на малую величину,
+ * время отсчета иногда сдвигается на несколько секунд
+ */
+static std::vector<Sample_t> Meter_Series(size_t count)
+{
+    std::vector<Sample_t> samples;
+    uint32_t state = 12345;
+    uint32_t timestamp = 1600000000;
+    int32_t value = 1234567;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        state = state * 1103515245U + 12345U;
+        if ((state >> 28) == 0)
+        {
+            timestamp += (state >> 20) & 0x0F;
+        }
+        timestamp += 3600;
+        value += static_cast<int32_t>((state >> 16) & 0x1F);
+        samples.push_back({ timestamp, value });
+    }
+
+    return samples;
+}
+
+TEST_CASE("Series", "[series]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    std::vector<Sample_t> received;
+    uint32_t frames;
+
+    SECTION("Round trip")
+    {
+        std::vector<Sample_t> samples = Meter_Series(500);
+        // Редкие скачки времени и значения используют длинные коды
+        samples[100].timestamp += 100000;
+        samples[200].value = -5;
+        samples[201].value = 0x7FFFFFFF;
+        samples[300].timestamp = samples[299].timestamp;
+
+        WVT_W7_Series_Init(0, 0);
+        Send_Series(samples, received, &frames);
+
+        REQUIRE(received.size() == samples.size());
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            CHECK(received[i].timestamp == samples[i].timestamp);
+            CHECK(received[i].value == samples[i].value);
+        }
+    }
+
+    SECTION("Sample limit")
+    {
+        WVT_W7_Series_Init(3, 0);
+        CHECK(WVT_W7_Series_Add(100, 1, buffer) == 0);
+        CHECK(WVT_W7_Series_Add(200, 1, buffer) == 0);
+        // Первый интервал - '110' + 9 бит и '0', повтор интервала и значения - 2 бита
+        CHECK(WVT_W7_Series_Add(300, 1, buffer) == WVT_W7_SERIES_DATA_OFFSET + 2);
+        CHECK(buffer[0] == 0x25);
+        CHECK(buffer[2] == 3);
+        CHECK(WVT_W7_Series_Flush(buffer) == 0);
+    }
+
+    SECTION("Deadline")
+    {
+        WVT_W7_Series_Init(0, 3600);
+        CHECK(WVT_W7_Series_Poll(0, buffer) == 0);
+        CHECK(WVT_W7_Series_Add(1000, 7, buffer) == 0);
+        CHECK(WVT_W7_Series_Add(1900, 8, buffer) == 0);
+        CHECK(WVT_W7_Series_Poll(4599, buffer) == 0);
+        CHECK(WVT_W7_Series_Poll(4600, buffer) > 0);
+        CHECK(WVT_W7_Series_Poll(9000, buffer) == 0);
+
+        uint32_t timestamps[2];
+        int32_t values[2];
+        uint16_t count = 2;
+        WVT_W7_Series_Add(1000, 7, buffer);
+        WVT_W7_Series_Add(1900, 8, buffer);
+        const uint8_t length = WVT_W7_Series_Flush(buffer);
+        REQUIRE(WVT_W7_Series_Decode(buffer, length, timestamps, values, &count) == WVT_W7_OK);
+        CHECK(count == 2);
+        CHECK(timestamps[1] == 1900);
+        CHECK(values[1] == 8);
+
+        count = 1;
+        CHECK(WVT_W7_Series_Decode(buffer, length, timestamps, values, &count) == WVT_W7_ERROR);
+        count = 2;
+        CHECK(WVT_W7_Series_Decode(buffer, static_cast<uint16_t>(length - 1), timestamps, values, &count) == WVT_W7_ERROR);
+        CHECK(WVT_W7_Series_Decode(buffer, static_cast<uint16_t>(length + 1), timestamps, values, &count) == WVT_W7_ERROR);
+    }
+
+    SECTION("Readings per uplink byte")
+    {
+        const std::vector<Sample_t> samples = Meter_Series(2000);
+
+        WVT_W7_Series_Init(0, 0);
+        const size_t bytes = Send_Series(samples, received, &frames);
+
+        // Короткое регулярное сообщение - 7 байт на показание
+        CHECK(samples.size() * 7 >= bytes * 4);
+        CHECK(received.size() == samples.size());
+    }
+
+    WVT_W7_Series_Init(0, 0);
+}
+
+TEST_CASE("Series compression", "[.benchmark]")
+{
+    const std::vector<Sample_t> samples = Meter_Series(100000);
+    std::vector<Sample_t> received;
+    uint32_t frames;
+
+    WVT_W7_Series_Init(0, 0);
+    const size_t bytes = Send_Series(samples, received, &frames);
+
+    printf("series: %u readings, %u frames, %.2f bytes per reading, %.1fx fewer bytes than short regular\n",
+        static_cast<unsigned>(samples.size()), frames,
+        static_cast<double>(bytes) / static_cast<double>(samples.size()),
+        static_cast<double>(samples.size() * 7) / static_cast<double>(bytes));
+    WVT_W7_Series_Init(0, 0);
+}
@@ -0,0 +1,122 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include "../lib/WVT_Water7_Subscriptions.h"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+static void Register_Subscription_Rom()
+{
+    Register_Fake_Rom(16);
+    WVT_W7_Subscriptions_Clear();
+}
+
+/**
+ * Подписка: тип 0x2A, адрес, режим, порог, минимальный и максимальный интервалы.
+ * Ответ повторяет запрос
+ */
+TEST_CASE("Subscribe", "[subscriptions]")
+{
+    uint8_t subscribe[] = {
+    //  тип | адрес   | режим | порог                 | мин. интервал | макс. интервал
+        0x2A, 0x00, 5,  0x01,   0x00, 0x00, 0x00, 10,   0x00, 60,       0x0E, 0x10 };
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+    Register_Subscription_Rom();
+    fake_rom[5] = 1000;
+
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == sizeof(subscribe));
+    CHECK(memcmp(subscribe, buffer, sizeof(subscribe)) == 0);
+
+    // Первое уведомление сообщает текущее значение
+    const uint8_t notify[] = {
+    //  тип | число | адрес   | значение
+        0x2B, 1,      0x00, 5,  0x00, 0x00, 0x03, 0xE8 };
+    CHECK(WVT_W7_Subscriptions_Poll(0, buffer) == sizeof(notify));
+    CHECK(memcmp(notify, buffer, sizeof(notify)) == 0);
+
+    // Изменение меньше порога не отправляется
+    fake_rom[5] = 1009;
+    CHECK(WVT_W7_Subscriptions_Poll(100, buffer) == 0);
+
+    // Пересечение порога отправляется не раньше минимального интервала
+    fake_rom[5] = 990;
+    CHECK(WVT_W7_Subscriptions_Poll(30, buffer) == 0);
+    CHECK(WVT_W7_Subscriptions_Poll(120, buffer) == sizeof(notify));
+    CHECK(buffer[7] == (990 & 0xFF));
+
+    // Без изменений - уведомление по максимальному интервалу
+    CHECK(WVT_W7_Subscriptions_Poll(120 + 3599, buffer) == 0);
+    CHECK(WVT_W7_Subscriptions_Poll(120 + 3600, buffer) == sizeof(notify));
+
+    // Отмена подписки
+    subscribe[3] = WVT_W7_SUBSCRIPTION_NONE;
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == sizeof(subscribe));
+    fake_rom[5] = 0;
+    CHECK(WVT_W7_Subscriptions_Poll(100000, buffer) == 0);
+}
+
+TEST_CASE("Relative threshold", "[subscriptions]")
+{
+    uint8_t subscribe[] = {
+    //  тип | адрес   | режим | порог 5%               | без интервалов
+        0x2A, 0x00, 1,  0x02,   0x00, 0x00, 0x00, 50,   0x00, 0x00,      0x00, 0x00 };
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+    Register_Subscription_Rom();
+    fake_rom[1] = -2000;
+    fake_rom[2] = 7;
+
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == sizeof(subscribe));
+    subscribe[2] = 2;
+    subscribe[3] = WVT_W7_SUBSCRIPTION_ABSOLUTE;
+    subscribe[7] = 1;
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == sizeof(subscribe));
+
+    // Оба параметра в одном уведомлении
+    CHECK(WVT_W7_Subscriptions_Poll(0, buffer) == (2 + (2 * 6)));
+    CHECK(WVT_W7_Subscriptions_Poll(1, buffer) == 0);
+
+    fake_rom[1] = -2099;
+    CHECK(WVT_W7_Subscriptions_Poll(2, buffer) == 0);
+    fake_rom[1] = -2100;
+    CHECK(WVT_W7_Subscriptions_Poll(3, buffer) == (2 + 6));
+    CHECK(buffer[3] == 1);
+}
+
+TEST_CASE("Subscription errors", "[subscriptions]")
+{
+    uint8_t subscribe[] = {
+        0x2A, 0x00, 0,  0x01,   0x00, 0x00, 0x00, 1,   0x00, 0x00,      0x00, 0x00 };
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+
+    Register_Subscription_Rom();
+
+    // Неверная длинна
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe) - 1, buffer) == 2);
+    CHECK(buffer[0] == (0x2A | 0x40));
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_LENGTH);
+
+    // Несуществующий параметр
+    subscribe[2] = 100;
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == 2);
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_ADDRESS);
+
+    // Неверный режим
+    subscribe[2] = 0;
+    subscribe[3] = 7;
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == 2);
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+    // Таблица заполнена
+    subscribe[3] = WVT_W7_SUBSCRIPTION_ABSOLUTE;
+    for (uint8_t address = 0; address < WVT_W7_SUBSCRIPTIONS_MAX; address++)
+    {
+        subscribe[2] = address;
+        CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == sizeof(subscribe));
+    }
+    subscribe[2] = WVT_W7_SUBSCRIPTIONS_MAX;
+    CHECK(WVT_W7_Parse(subscribe, sizeof(subscribe), buffer) == 2);
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_INVALID_VALUE);
+
+    WVT_W7_Subscriptions_Clear();
+}
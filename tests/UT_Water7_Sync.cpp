@@ -0,0 +1,136 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include <map>
+#include "../lib/WVT_Water7_Sync.h"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+/**
+ * Сервер читает изменения после версии since, пока устройство не 
+ * сообщит об окончании просмотра. Возвращает версию первого ответа
+ */
+static uint32_t Read_Changed(uint32_t since, std::map<uint16_t, int32_t> & twin, uint32_t * frames)
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint8_t request[] = { 
+    //  тип | версия                                        | адрес продолжения
+        0x2D, static_cast<uint8_t>(since >> 24), static_cast<uint8_t>(since >> 16), 
+              static_cast<uint8_t>(since >> 8), static_cast<uint8_t>(since), 0x00, 0x00 };
+    uint32_t version = 0;
+
+    *frames = 0;
+    while (true)
+    {
+        const uint8_t length = WVT_W7_Parse(request, sizeof(request), buffer);
+        REQUIRE(length >= WVT_W7_READ_CHANGED_DATA_OFFSET);
+        REQUIRE(buffer[0] == 0x2D);
+        REQUIRE(((length - WVT_W7_READ_CHANGED_DATA_OFFSET) % WVT_W7_READ_CHANGED_WIDTH) == 0);
+
+        if (*frames == 0)
+        {
+            version =     (static_cast<uint32_t>(buffer[1]) << 24) + (static_cast<uint32_t>(buffer[2]) << 16)
+                        + (static_cast<uint32_t>(buffer[3]) << 8) + static_cast<uint32_t>(buffer[4]);
+        }
+        (*frames)++;
+
+        for (uint8_t position = WVT_W7_READ_CHANGED_DATA_OFFSET; position < length; position = static_cast<uint8_t>(position + 6))
+        {
+            const uint16_t address = static_cast<uint16_t>((buffer[position] << 8) + buffer[position + 1]);
+            twin[address] = static_cast<int32_t>(
+                    (static_cast<uint32_t>(buffer[position + 2]) << 24) + (static_cast<uint32_t>(buffer[position + 3]) << 16)
+                +   (static_cast<uint32_t>(buffer[position + 4]) << 8) + static_cast<uint32_t>(buffer[position + 5]));
+        }
+
+        if (buffer[5] == 0)
+        {
+            return version;
+        }
+        request[5] = buffer[6];
+        request[6] = buffer[7];
+    }
+}
+
+/**
+ * Запрос изменений: тип 0x2D, версия V, адрес продолжения.
+ * Ответ: тип, текущая версия, признак продолжения, адрес продолжения,
+ * записи адрес-значение
+ */
+TEST_CASE("Read changed", "[sync]")
+{
+    std::map<uint16_t, int32_t> twin;
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    uint32_t frames;
+
+    Register_Fake_Rom(WVT_W7_SYNC_PARAMETERS);
+    for (uint16_t i = 0; i < WVT_W7_SYNC_PARAMETERS; i++)
+    {
+        fake_rom[i] = i;
+    }
+    WVT_W7_Sync_Init(1);
+
+    // Первая синхронизация - полная выгрузка за несколько пакетов
+    uint32_t version = Read_Changed(0, twin, &frames);
+    CHECK(version == 1);
+    CHECK(twin.size() == WVT_W7_SYNC_PARAMETERS);
+    CHECK(frames > 1);
+
+    // Без изменений - один короткий ответ
+    twin.clear();
+    CHECK(Read_Changed(version, twin, &frames) == version);
+    CHECK(twin.empty());
+    CHECK(frames == 1);
+
+    // Записи через протокол попадают в следующую синхронизацию
+    uint8_t write_single[7] = { 0x06, 0x00, 10, 0x00, 0x00, 0x01, 0x00 };
+    CHECK(WVT_W7_Parse(write_single, sizeof(write_single), buffer) == 7);
+    uint8_t write_multiple[5 + 8] = { 0x10, 0x00, 201, 0x00, 2, 0, 0, 0, 1, 0, 0, 0, 2 };
+    CHECK(WVT_W7_Parse(write_multiple, sizeof(write_multiple), buffer) == 5);
+    CHECK(WVT_W7_Sync_Version() == (version + 3));
+
+    version = Read_Changed(version, twin, &frames);
+    CHECK(version == WVT_W7_Sync_Version());
+    CHECK(frames == 1);
+    CHECK(twin.size() == (2 * WVT_W7_SYNC_BLOCK));
+    CHECK(twin[10] == 0x100);
+    CHECK(twin[201] == 1);
+    CHECK(twin[202] == 2);
+
+    // Изменение в обход протокола
+    twin.clear();
+    fake_rom[100] = -1;
+    WVT_W7_Sync_Touch(100);
+    Read_Changed(version, twin, &frames);
+    CHECK(twin.size() == WVT_W7_SYNC_BLOCK);
+    CHECK(twin[100] == -1);
+
+    // Непрочитанный параметр не пропускается: его блок переносится в следующий ответ,
+    // а первый блок ответа завершает запрос ошибкой
+    const uint16_t busy_block = 100 - (100 % WVT_W7_SYNC_BLOCK);
+    WVT_W7_Sync_Touch(2);
+    WVT_W7_Sync_Touch(100);
+    fake_rom_busy_address = 100;
+
+    uint8_t read_changed[] = { 0x2D, static_cast<uint8_t>(version >> 24), static_cast<uint8_t>(version >> 16), 
+        static_cast<uint8_t>(version >> 8), static_cast<uint8_t>(version), 0x00, 0x00 };
+    CHECK(WVT_W7_Parse(read_changed, sizeof(read_changed), buffer) == 
+        (WVT_W7_READ_CHANGED_DATA_OFFSET + (WVT_W7_SYNC_BLOCK * WVT_W7_READ_CHANGED_WIDTH)));
+    CHECK(buffer[5] == 1);
+    CHECK(((buffer[6] << 8) + buffer[7]) == busy_block);
+
+    read_changed[5] = buffer[6];
+    read_changed[6] = buffer[7];
+    CHECK(WVT_W7_Parse(read_changed, sizeof(read_changed), buffer) == 2);
+    CHECK(buffer[0] == (0x2D | 0x40));
+    CHECK(buffer[1] == WVT_W7_ERROR_CODE_BUSY);
+
+    fake_rom_busy_address = UINT32_MAX;
+    CHECK(WVT_W7_Parse(read_changed, sizeof(read_changed), buffer) == 
+        (WVT_W7_READ_CHANGED_DATA_OFFSET + (WVT_W7_SYNC_BLOCK * WVT_W7_READ_CHANGED_WIDTH)));
+    CHECK(buffer[5] == 0);
+
+    // Неверная длинна
+    CHECK(WVT_W7_Parse(write_single, 6, buffer) == 2);
+    write_single[0] = 0x2D;
+    CHECK(WVT_W7_Parse(write_single, 6, buffer) == 2);
+    CHECK(buffer[0] == (0x2D | 0x40));
+}
@@ -0,0 +1,205 @@
+﻿#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../lib/WVT_Water7.h"
+#include "../host/WVT_Water7_Correlator.hpp"
+#include "UT_Water7_Fakes.hpp"
+#include "catch.hpp"
+
+/** Значение параметра - его адрес, умноженный на 10 */
+static void Register_Tagged_Callbacks(void)
+{
+    Register_Fake_Rom(UINT16_MAX + 1);
+    for (size_t address = 0; address < fake_rom.size(); address++)
+    {
+        fake_rom[address] = static_cast<int32_t>(address) * 10;
+    }
+}
+
+TEST_CASE("Tagged request", "[water7]")
+{
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    Register_Tagged_Callbacks();
+
+    SECTION("Inner responce carries the tag")
+    {
+        uint8_t request[] = { 0x31, 0x5A, 0x07, 0x00, 0x07 };
+        const uint8_t expected[] = { 0x31, 0x5A, 0x07, 0x00, 0x07, 0x00, 0x00, 0x00, 0x46 };
+
+        const uint8_t length = WVT_W7_Parse(request, sizeof(request), buffer);
+        REQUIRE(length == sizeof(expected));
+        REQUIRE(memcmp(buffer, expected, sizeof(expected)) == 0);
+    }
+
+    SECTION("Inner error carries the tag")
+    {
+        uint8_t request[] = { 0x31, 0x01, 0x07, 0x00 };
+        const uint8_t expected[] = { 0x31, 0x01, 0x47, 0x06 };
+
+        const uint8_t length = WVT_W7_Parse(request, sizeof(request), buffer);
+        REQUIRE(length == sizeof(expected));
+        REQUIRE(memcmp(buffer, expected, sizeof(expected)) == 0);
+    }
+
+    SECTION("Silent inner request stays silent")
+    {
+        uint8_t request[] = { 0x31, 0x02, 0x30, 0x06, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01 };
+        REQUIRE(WVT_W7_Parse(request, sizeof(request), buffer) == 0);
+    }
+
+    SECTION("Missing inner request")
+    {
+        uint8_t request[] = { 0x31, 0x02 };
+        const uint8_t expected[] = { 0x71, 0x06 };
+
+        const uint8_t length = WVT_W7_Parse(request, sizeof(request), buffer);
+        REQUIRE(length == sizeof(expected));
+        REQUIRE(memcmp(buffer, expected, sizeof(expected)) == 0);
+    }
+
+    SECTION("Inner multiple read shrinks to fit the envelope")
+    {
+        const uint8_t fit = (WVT_W7_BUFFER_SIZE - WVT_W7_TAGGED_DATA_OFFSET - WVT_W7_MULTI_DATA_OFFSET) / WVT_W7_PARAMETER_WIDTH;
+        uint8_t request[] = { 0x31, 0x03, 0x03, 0x00, 0x00, 0x00, fit };
+
+        REQUIRE(WVT_W7_Parse(request, sizeof(request), buffer) 
+            == WVT_W7_TAGGED_DATA_OFFSET + WVT_W7_MULTI_DATA_OFFSET + fit * WVT_W7_PARAMETER_WIDTH);
+
+        request[6] = static_cast<uint8_t>(fit + 1);
+        REQUIRE(WVT_W7_Parse(request, sizeof(request), buffer) == 4);
+        REQUIRE(buffer[2] == 0x43);
+    }
+}
+
+TEST_CASE("Correlator", "[water7]")
+{
+    water7::Correlator correlator(16);
+    std::vector<uint8_t> frame;
+    uint8_t buffer[WVT_W7_BUFFER_SIZE];
+    Register_Tagged_Callbacks();
+
+    SECTION("Pipelined responces are matched out of order")
+    {
+        const uint8_t first[] = { 0x07, 0x00, 0x01 };
+        const uint8_t second[] = { 0x07, 0x00, 0x02 };
+        std::vector<uint8_t> frames[2];
+        int32_t values[2] = { -1, -1 };
+
+        for (uint8_t index = 0; index < 2; index++)
+        {
+            const uint8_t * request = (index == 0) ? first : second;
+            REQUIRE(correlator.submit(7, request, 3, 4, [&values, index](const uint8_t * responce, uint16_t length)
+            {
+                REQUIRE(responce != nullptr);
+                REQUIRE(length == 7);
+                values[index] = responce[6];
+            }, frames[index]));
+        }
+        REQUIRE(frames[0][1] != frames[1][1]);
+        REQUIRE(correlator.pending() == 2);
+
+        // Ответы приходят в обратном порядке
+        for (int8_t index = 1; index >= 0; index--)
+        {
+            const uint8_t length = WVT_W7_Parse(frames[index].data(), static_cast<uint16_t>(frames[index].size()), buffer);
+            REQUIRE(correlator.on_uplink(7, buffer, length));
+        }
+
+        REQUIRE(values[0] == 10);
+        REQUIRE(values[1] == 20);
+        REQUIRE(correlator.pending() == 0);
+
+        // Повторный ответ уже ничему не соответствует
+        const uint8_t length = WVT_W7_Parse(frames[0].data(), static_cast<uint16_t>(frames[0].size()), buffer);
+        REQUIRE_FALSE(correlator.on_uplink(7, buffer, length));
+    }
+
+    SECTION("Tags are per device")
+    {
+        const uint8_t request[] = { 0x07, 0x00, 0x01 };
+        bool answered = false;
+
+        REQUIRE(correlator.submit(1, request, sizeof(request), 4, nullptr, frame));
+        const uint8_t length = WVT_W7_Parse(frame.data(), static_cast<uint16_t>(frame.size()), buffer);
+        REQUIRE(correlator.submit(2, request, sizeof(request), 4, 
+            [&answered](const uint8_t *, uint16_t) { answered = true; }, frame));
+
+        REQUIRE_FALSE(correlator.on_uplink(3, buffer, length));
+        REQUIRE(correlator.on_uplink(2, buffer, length));
+        REQUIRE(answered);
+        REQUIRE(correlator.pending() == 1);
+    }
+
+    SECTION("Timeouts expire through the wheel")
+    {
+        const uint8_t request[] = { 0x07, 0x00, 0x01 };
+        uint32_t expired_short = 0;
+        uint32_t expired_long = 0;
+
+        REQUIRE(correlator.submit(1, request, sizeof(request), 3, 
+            [&expired_short](const uint8_t * responce, uint16_t length) 
+            { 
+                REQUIRE(responce == nullptr);
+                REQUIRE(length == 0);
+                expired_short++; 
+            }, frame));
+        // Срок больше оборота колеса
+        REQUIRE(correlator.submit(1, request, sizeof(request), 40, 
+            [&expired_long](const uint8_t *, uint16_t) { expired_long++; }, frame));
+
+        correlator.advance(2);
+        REQUIRE(expired_short == 0);
+        correlator.advance(1);
+        REQUIRE(expired_short == 1);
+
+        correlator.advance(36);
+        REQUIRE(expired_long == 0);
+        correlator.advance(1);
+        REQUIRE(expired_long == 1);
+        REQUIRE(correlator.pending() == 0);
+        REQUIRE(expired_short == 1);
+    }
+
+    SECTION("Late responce does not reach the next request")
+    {
+        const uint8_t request[] = { 0x07, 0x00, 0x01 };
+        std::vector<uint8_t> late;
+        uint32_t expired = 0;
+        bool answered = false;
+
+        REQUIRE(correlator.submit(5, request, sizeof(request), 2, 
+            [&expired](const uint8_t * responce, uint16_t) { REQUIRE(responce == nullptr); expired++; }, late));
+        correlator.advance(2);
+        REQUIRE(expired == 1);
+        REQUIRE(correlator.pending() == 0);
+
+        // Устройство без ожидающих запросов продолжает выдавать теги по кругу
+        REQUIRE(correlator.submit(5, request, sizeof(request), 2, 
+            [&answered](const uint8_t *, uint16_t) { answered = true; }, frame));
+        REQUIRE(frame[1] != late[1]);
+
+        uint8_t length = WVT_W7_Parse(late.data(), static_cast<uint16_t>(late.size()), buffer);
+        REQUIRE_FALSE(correlator.on_uplink(5, buffer, length));
+        REQUIRE_FALSE(answered);
+        REQUIRE(correlator.pending() == 1);
+
+        length = WVT_W7_Parse(frame.data(), static_cast<uint16_t>(frame.size()), buffer);
+        REQUIRE(correlator.on_uplink(5, buffer, length));
+        REQUIRE(answered);
+    }
+
+    SECTION("Tags run out")
+    {
+        const uint8_t request[] = { 0x07, 0x00, 0x01 };
+
+        for (uint16_t index = 0; index < 256; index++)
+        {
+            REQUIRE(correlator.submit(9, request, sizeof(request), 8, nullptr, frame));
+        }
+        REQUIRE_FALSE(correlator.submit(9, request, sizeof(request), 8, nullptr, frame));
+
+        correlator.advance(8);
+        REQUIRE(correlator.pending() == 0);
+        REQUIRE(correlator.submit(9, request, sizeof(request), 8, nullptr, frame));
+    }
+}
@@ -0,0 +1,279 @@
+﻿#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../lib/WVT_Water7_Uplink.h"
+#include "catch.hpp"
+
+static void Drain()
+{
+    uint8_t frame[WVT_W7_UPLINK_FRAME_SIZE];
+    while (WVT_W7_Uplink_Pop(frame, nullptr) > 0)
+    {
+    }
+}
+
+/** Кадр производителя: номер производителя, номер кадра и заполнение, зависящее от них */
+static uint8_t Make_Frame(uint8_t producer, uint16_t sequence, uint8_t * frame)
+{
+    const uint8_t length = static_cast<uint8_t>(4 + ((sequence * 7 + producer) % 60));
+
+    frame[0] = producer;
+    frame[1] = static_cast<uint8_t>(sequence >> 8);
+    frame[2] = static_cast<uint8_t>(sequence);
+    frame[3] = length;
+    for (uint8_t i = 4; i < length; i++)
+    {
+        frame[i] = static_cast<uint8_t>(producer * 31 + sequence + i);
+    }
+    return length;
+}
+
+TEST_CASE("Uplink queue", "[uplink]")
+{
+    uint8_t frame[WVT_W7_UPLINK_FRAME_SIZE];
+    WVT_W7_Uplink_Class_t priority = WVT_W7_UPLINK_CLASSES;
+
+    Drain();
+
+    SECTION("Priority order")
+    {
+        const uint8_t regular[] = { 0x80, 1 };
+        const uint8_t responce[] = { 0x07, 0, 1, 0, 0, 0, 5 };
+        const uint8_t alarm[] = { 0x20, 0, 7, 0, 1 };
+
+        CHECK(WVT_W7_Uplink_Pop(frame, &priority) == 0);
+        CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_REGULAR, regular, sizeof(regular)));
+        CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_RESPONCE, responce, sizeof(responce)));
+        CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_ALARM, alarm, sizeof(alarm)));
+        CHECK(WVT_W7_Uplink_Pending() == 3);
+
+        REQUIRE(WVT_W7_Uplink_Pop(frame, &priority) == sizeof(alarm));
+        CHECK(priority == WVT_W7_UPLINK_ALARM);
+        CHECK(memcmp(frame, alarm, sizeof(alarm)) == 0);
+        REQUIRE(WVT_W7_Uplink_Pop(frame, &priority) == sizeof(responce));
+        CHECK(priority == WVT_W7_UPLINK_RESPONCE);
+        CHECK(memcmp(frame, responce, sizeof(responce)) == 0);
+        REQUIRE(WVT_W7_Uplink_Pop(frame, &priority) == sizeof(regular));
+        CHECK(priority == WVT_W7_UPLINK_REGULAR);
+        CHECK(WVT_W7_Uplink_Pop(frame, &priority) == 0);
+        CHECK(WVT_W7_Uplink_Pending() == 0);
+    }
+
+    SECTION("Full queue and invalid frames")
+    {
+        for (uint16_t lap = 0; lap < 3; lap++)
+        {
+            for (uint16_t i = 0; i < WVT_W7_UPLINK_SLOTS; i++)
+            {
+                Make_Frame(1, i, frame);
+                CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_REGULAR, frame, 4));
+            }
+            CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_REGULAR, frame, 4) == 0);
+
+            // Другой класс не зависит от заполненного
+            CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_ALARM, frame, 4));
+            CHECK(WVT_W7_Uplink_Pending() == WVT_W7_UPLINK_SLOTS + 1);
+            CHECK(WVT_W7_Uplink_Pop(frame, &priority) == 4);
+            CHECK(priority == WVT_W7_UPLINK_ALARM);
+
+            for (uint16_t i = 0; i < WVT_W7_UPLINK_SLOTS; i++)
+            {
+                REQUIRE(WVT_W7_Uplink_Pop(frame, &priority) == 4);
+                CHECK(frame[2] == i);
+            }
+        }
+
+        CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_CLASSES, frame, 4) == 0);
+        CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_ALARM, nullptr, 4) == 0);
+        CHECK(WVT_W7_Uplink_Push(WVT_W7_UPLINK_ALARM, frame, 0) == 0);
+        CHECK(WVT_W7_Uplink_Pending() == 0);
+    }
+
+    SECTION("Concurrent producers")
+    {
+        const uint8_t producer_count = 4;
+        const uint16_t frames_per_producer = 20000;
+        std::atomic<bool> producers_done(false);
+        std::vector<std::thread> producers;
+        uint16_t expected[producer_count][WVT_W7_UPLINK_CLASSES] = {};
+        size_t received = 0;
+        size_t damaged = 0;
+        size_t reordered = 0;
+
+        for (uint8_t producer = 0; producer < producer_count; producer++)
+        {
+            producers.emplace_back([producer, frames_per_producer]
+            {
+                uint8_t data[WVT_W7_UPLINK_FRAME_SIZE];
+                uint16_t sequence[WVT_W7_UPLINK_CLASSES] = {};
+
+                for (uint16_t i = 0; i < frames_per_producer; i++)
+                {
+                    const WVT_W7_Uplink_Class_t priority = static_cast<WVT_W7_Uplink_Class_t>((i * 5 + producer) % WVT_W7_UPLINK_CLASSES);
+                    const uint8_t length = Make_Frame(producer, sequence[priority]++, data);
+
+                    while (WVT_W7_Uplink_Push(priority, data, length) == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        std::thread consumer([&]
+        {
+            uint8_t data[WVT_W7_UPLINK_FRAME_SIZE];
+            WVT_W7_Uplink_Class_t current;
+
+            for (;;)
+            {
+                const bool finished = producers_done;
+                const uint8_t length = WVT_W7_Uplink_Pop(data, &current);
+
+                if (length == 0)
+                {
+                    if (finished)
+                    {
+                        break;
+                    }
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                uint8_t check[WVT_W7_UPLINK_FRAME_SIZE];
+                const uint8_t producer = data[0];
+                const uint16_t sequence = static_cast<uint16_t>((data[1] << 8) + data[2]);
+
+                received++;
+                if (    (producer >= producer_count)
+                    ||  (Make_Frame(producer, sequence, check) != length)
+                    ||  (memcmp(check, data, length) != 0)  )
+                {
+                    damaged++;
+                    continue;
+                }
+
+                // Кадры одного производителя в одном классе приходят по порядку
+                reordered += (sequence != expected[producer][current]);
+                expected[producer][current] = static_cast<uint16_t>(sequence + 1);
+            }
+        });
+
+        for (std::thread & producer : producers)
+        {
+            producer.join();
+        }
+        producers_done = true;
+        consumer.join();
+
+        CHECK(received == static_cast<size_t>(producer_count) * frames_per_producer);
+        CHECK(damaged == 0);
+        CHECK(reordered == 0);
+        CHECK(WVT_W7_Uplink_Pending() == 0);
+    }
+}
+
+TEST_CASE("Uplink queue throughput", "[.benchmark]")
+{
+    const size_t frames_per_producer = 200000;
+    const unsigned producer_counts[] = { 1, 2, 4 };
+    std::mutex mutex;
+    std::deque<std::vector<uint8_t>> locked_queue[WVT_W7_UPLINK_CLASSES];
+
+    Drain();
+    printf("uplink queue, %u frames per producer, one consumer\n", static_cast<unsigned>(frames_per_producer));
+    for (unsigned producer_count : producer_counts)
+    {
+        for (int locked = 0; locked < 2; locked++)
+        {
+            std::atomic<size_t> received(0);
+            std::vector<std::thread> producers;
+            const size_t total = producer_count * frames_per_producer;
+            const auto start = std::chrono::steady_clock::now();
+
+            for (unsigned producer = 0; producer < producer_count; producer++)
+            {
+                producers.emplace_back([&, producer]
+                {
+                    uint8_t data[WVT_W7_UPLINK_FRAME_SIZE];
+                    for (size_t i = 0; i < frames_per_producer; i++)
+                    {
+                        const WVT_W7_Uplink_Class_t priority = static_cast<WVT_W7_Uplink_Class_t>(i % WVT_W7_UPLINK_CLASSES);
+                        const uint8_t length = Make_Frame(static_cast<uint8_t>(producer), static_cast<uint16_t>(i), data);
+
+                        if (locked)
+                        {
+                            // Та же очередь под мьютексом, с тем же ограничением размера
+                            for (;;)
+                            {
+                                {
+                                    std::lock_guard<std::mutex> lock(mutex);
+                                    if (locked_queue[priority].size() < WVT_W7_UPLINK_SLOTS)
+                                    {
+                                        locked_queue[priority].emplace_back(data, data + length);
+                                        break;
+                                    }
+                                }
+                                std::this_thread::yield();
+                            }
+                        }
+                        else
+                        {
+                            while (WVT_W7_Uplink_Push(priority, data, length) == 0)
+                            {
+                                std::this_thread::yield();
+                            }
+                        }
+                    }
+                });
+            }
+
+            uint8_t data[WVT_W7_UPLINK_FRAME_SIZE];
+            while (received < total)
+            {
+                size_t length = 0;
+                if (locked)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (std::deque<std::vector<uint8_t>> & queue : locked_queue)
+                    {
+                        if (queue.empty() == false)
+                        {
+                            length = queue.front().size();
+                            memcpy(data, queue.front().data(), length);
+                            queue.pop_front();
+                            break;
+                        }
+                    }
+                }
+                else
+                {
+                    length = WVT_W7_Uplink_Pop(data, nullptr);
+                }
+
+                if (length > 0)
+                {
+                    received++;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+            for (std::thread & producer : producers)
+            {
+                producer.join();
+            }
+
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("%u producers, %-9s: %.2f M frames/s\n", producer_count, locked ? "mutex" : "lock-free", 
+                static_cast<double>(total) / seconds / 1e6);
+        }
+    }
+}
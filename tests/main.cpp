@@ -1,3 +1,4 @@
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 #define CATCH_CONFIG_CONSOLE_WIDTH 300
 #include "catch.hpp"